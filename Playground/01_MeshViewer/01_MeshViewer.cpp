@@ -11,29 +11,60 @@
 #include "../../../Common_3/OS/Interfaces/IFont.h"
 #include "../../../Common_3/OS/Interfaces/IUI.h"
 
+#include "../../../Common_3/OS/Core/ThreadSystem.h"
+
 //Renderer
 #include "../../../Common_3/Renderer/IRenderer.h"
 #include "../../../Common_3/Renderer/IResourceLoader.h"
 
 #include "../../../Common_3/ThirdParty/OpenSource/cgltf/GLTFLoader.h"
 
+#include "SceneGraph.h"
+#include "FrustumCulling.h"
+#include "Benchmark.h"
+#include "MeshAsset.h"
+#include "Meshlets.h"
+#include "MeshLod.h"
+#include "ModelStreaming.h"
+#include "TextureStreaming.h"
+#include "BasisTexture.h"
+#include "DeferredRemoval.h"
+#include "ClusteredLights.h"
+#include "DrawSort.h"
+#include "Materials.h"
+#include "UploadArena.h"
+#include "ShadowCascades.h"
+
 //***********************************************************************************//
 //*                                 Device Resources                                *//
 //***********************************************************************************//
-const uint32_t	gImageCount = 3;
+// Frames the CPU records ahead of the GPU, --frames-in-flight <n> or the GUI, and swapchain images, --swapchain-images
+// <n>. Per frame resources are allocated for the maximum, so the frame count can change while running.
+const uint32_t	gMaxFramesInFlight = 3;
+uint32_t		gFramesInFlight = gMaxFramesInFlight;
+uint32_t		gSwapchainImageCount = 3;
 ProfileToken	gGpuProfileToken;
 
 uint32_t		gFrameIndex = 0;
 Renderer*		pRenderer = NULL;
 
 Queue*			pGraphicsQueue = NULL;
-CmdPool*		pCmdPools[gImageCount];
-Cmd*			pCmds[gImageCount];
+CmdPool*		pCmdPools[gMaxFramesInFlight];
+Cmd*			pCmds[gMaxFramesInFlight];
+Cmd*			pPostCmds[gMaxFramesInFlight];
+
+// Scene draws can be recorded by worker threads, each into its own per-frame pool
+const uint32_t	gMaxRecordThreads = 8;
+ThreadSystem*	pThreadSystem = NULL;
+CmdPool*		pRecordCmdPools[gMaxFramesInFlight][gMaxRecordThreads];
+Cmd*			pRecordCmds[gMaxFramesInFlight][gMaxRecordThreads];
 
 SwapChain*		pSwapChain = NULL;
-Fence*			pRenderCompleteFences[gImageCount] = { NULL };
+// Headless runs render into this target instead of the swapchain
+RenderTarget*	pOffscreenTarget = NULL;
+Fence*			pRenderCompleteFences[gMaxFramesInFlight] = { NULL };
 Semaphore*		pImageAcquiredSemaphore = NULL;
-Semaphore*		pRenderCompleteSemaphores[gImageCount] = { NULL };
+Semaphore*		pRenderCompleteSemaphores[gMaxFramesInFlight] = { NULL };
 
 RenderTarget*	pDepthBuffer = NULL;
 //***********************************************************************************//
@@ -55,22 +86,69 @@ Sampler*			pBaseColorSampler = NULL;
 
 // Shaders
 Shader*				pBasicShader = NULL;
+Shader*				pCullShader = NULL;
+Shader*				pClusterCullShader = NULL;
+Shader*				pLightBinShader = NULL;
+Shader*				pDepthPrepassShader = NULL;
+Shader*				pShadowShader = NULL;
+Shader*				pCullLateShader = NULL;
+Shader*				pHiZDepthShader = NULL;
+Shader*				pHiZReduceShader = NULL;
 
 // Root Signatures
 RootSignature*		pBasicRootSignature = NULL;
+RootSignature*		pCullRootSignature = NULL;
+RootSignature*		pClusterCullRootSignature = NULL;
+RootSignature*		pLightBinRootSignature = NULL;
+RootSignature*		pHiZRootSignature = NULL;
 
 // Textures
 Texture*			pBaseColorMap = NULL;
 
 // Geometry
 VertexLayout		gVertexLayout = {};
-Geometry*			pGeometry = NULL;
+
+// Vertex and index buffers the scene is drawn from, uploaded from the blobs of gMeshAsset
+struct SceneGeometry
+{
+	Buffer*		pVertexBuffer;
+	Buffer*		pIndexBuffer;
+	uint32_t	mVertexStride;
+	IndexType	mIndexType;
+	// Covers the geometry and every buffer createConstants fills from the CPU, the scene is resident once it completes
+	SyncToken	mUploadToken;
+	// Packed copy of the vertex blob, freed with the asset blobs once uploaded
+	void*		pPackedVertices;
+	uint64_t	mVertexBufferSize;
+	// Packed vertices only: position = unorm position * scale + offset
+	vec4		mPositionDequantScale;
+	vec4		mPositionDequantOffset;
+};
+SceneGeometry		gSceneGeometry = {};
 
 // DescriptorSets
 DescriptorSet*		pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_COUNT];
+DescriptorSet*		pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_COUNT];
+DescriptorSet*		pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_COUNT];
+DescriptorSet*		pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_COUNT];
+DescriptorSet*		pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_COUNT];
 
 // Pipelines
 Pipeline*			pBasicPipeline;
+// Scene pass after the depth prepass: CMP_EQUAL without depth writes, so only the visible surface is shaded
+Pipeline*			pBasicEqualPipeline = NULL;
+Pipeline*			pDepthPrepassPipeline = NULL;
+Pipeline*			pShadowPipeline = NULL;
+Pipeline*			pCullPipeline = NULL;
+Pipeline*			pClusterCullPipeline = NULL;
+Pipeline*			pLightBinPipeline = NULL;
+Pipeline*			pCullLatePipeline = NULL;
+Pipeline*			pHiZDepthPipeline = NULL;
+Pipeline*			pHiZReducePipeline = NULL;
+
+// Command Signatures
+CommandSignature*	pIndirectDrawCommandSignature = NULL;
+CommandSignature*	pIndirectDispatchCommandSignature = NULL;
 //***********************************************************************************//
 
 //***********************************************************************************//
@@ -81,82 +159,1883 @@ ICameraController*	pCameraController = NULL;
 const uint32_t		gLightCount = 3;
 const uint32_t		gTotalLightCount = gLightCount + 1;
 
-struct GlobalConstants
+struct GlobalConstants
+{
+	CameraMatrix mViewProjectionMatrix;
+	vec4 mCameraPosition;
+	vec4 mLightColor[gTotalLightCount];
+	vec4 mLightDirection[gLightCount];
+	mat4 mViewMatrix;
+	vec4 mClusterScale;
+	mat4 mShadowMatrices[SHADOW_CASCADE_COUNT];
+	vec4 mShadowSplits;
+	vec4 mShadowTexelSizes;
+	vec4 mShadowParams;
+};
+// Composed on the CPU during the frame and written to its block of the upload arena right before submit
+GlobalConstants		gGlobalConstantsData;
+
+static float4		gLightColor[gTotalLightCount] = { float4(1.f), float4(1.f), float4(1.f), float4(1.f, 1.f, 1.f, 0.25f) };
+static float		gLightColorIntensity[gTotalLightCount] = { 0.1f, 0.2f, 0.2f, 0.25f };
+static float2		gLightDirection = { -122.0f, 222.0f };
+
+// Clustered lights: the light bin compute pass sorts the point and spot lights of this frame's pLightsBuffers into the
+// froxel grid of ClusteredLights.h, the scene fragment shader only loops over the lights of its own cluster.
+// --lights <n> or the GUI picks how many lights of gLightField are lit.
+const uint32_t		gMaxClusteredLightCount = 16384;
+static uint32_t		gClusteredLightCount = 1024;
+static float		gClusteredLightRadius = 0.75f;
+static float		gClusteredLightIntensity = 0.25f;
+static bool			gAnimateLights = true;
+float				gLightTime = 0.0f;
+const uint32_t		gLightBinThreadGroupSize = 64;
+COMPILE_ASSERT(CLUSTER_COUNT % gLightBinThreadGroupSize == 0);
+// The grid ends well before the far plane of the camera, anything further shades with the lights of the last slice
+const float			gClusterNear = 0.1f;
+const float			gClusterFar = 500.0f;
+// x = tan of the half horizontal fov, y = tan of the half vertical fov, z, w = near and far plane of the grid
+vec4				gClusterProjection = vec4(0.0f);
+LightField			gLightField = {};
+
+struct LightBinConstants
+{
+	mat4     mViewMatrix;
+	vec4     mClusterProjection;
+	uint32_t mLightCount;
+	uint32_t mPadding[3];
+};
+Buffer*				pLightBinConstantsBuffers[gMaxFramesInFlight] = { NULL };
+Buffer*				pLightsBuffers[gMaxFramesInFlight] = { NULL };
+Buffer*				pClusterLightCountsBuffer = NULL;
+Buffer*				pClusterLightIndicesBuffer = NULL;
+// Copies of the cluster light counts for the stats, read once the fence of the frame that wrote them is waited on
+Buffer*				pClusterLightCountsReadbackBuffers[gMaxFramesInFlight] = { NULL };
+bool				gClusterLightCountsWritten[gMaxFramesInFlight] = {};
+ClusterLightStats	gClusterLightStats = {};
+
+// Sun shadows, --shadows or the GUI: cascaded shadow maps in the slices of pShadowMap. The first cascade renders every
+// frame, the second every other frame and the far ones only when ShadowCascades.h finds their cache out of date.
+// --no-shadow-cache renders every cascade every frame, compare the Shadow Cascade timestamps of both.
+static bool			gShadows = false;
+static bool			gShadowCaching = true;
+const uint32_t		gShadowMapSize = 2048;
+// Normal offset in texels of the cascade and depth bias in shadow map depth, which spans the whole scene
+static float		gShadowNormalOffset = 1.5f;
+static float		gShadowDepthBias = 0.0005f;
+RenderTarget*		pShadowMap = NULL;
+// One region of gMaxInstanceCount entries per cascade, the instances whose copy of the scene reaches it
+Buffer*				pShadowInstancesBuffers[gMaxFramesInFlight] = { NULL };
+ShadowCascades		gShadowCascades = {};
+// Decided in Update for the shadow pass of Draw
+bool				gShadowPassActive = false;
+uint32_t			gShadowInstanceCount = 1;
+uint32_t			gShadowDrawCount = 0;
+static const char*	gShadowCascadeNames[SHADOW_CASCADE_COUNT] = { "Shadow Cascade 0", "Shadow Cascade 1", "Shadow Cascade 2", "Shadow Cascade 3" };
+static const char*	gShadowRefreshNames[SHADOW_REFRESH_COUNT] = { "cached", "invalid", "light", "casters", "coverage", "interval", "uncached" };
+
+// Command line: --model <name> loads <name>.gltf from RD_MESHES (default Duck), --bake imports it and writes <name>.fpbm
+// next to it. A baked file is preferred over the GLTF whenever it exists.
+const char*			gModelName = "Duck";
+bool				gBakeModel = false;
+// --packed-vertices: draw from the 16 byte packed layout decoded in packed.vert instead of the 32 byte float layout
+bool				gPackedVertices = false;
+// --optimize-meshes: reorder imported meshes for the vertex cache, overdraw and vertex fetch before they are baked or drawn
+bool				gOptimizeMeshes = false;
+// --lods: build a simplified LOD chain for every mesh at load, see LOD selection below
+bool				gBuildLods = false;
+MeshAsset			gMeshAsset = {};
+SceneGraph*			pSceneGraph = NULL;
+
+// Nodes that own meshes, the unit of work for draw recording
+struct DrawNode
+{
+	uint32_t mSceneNode;
+	uint32_t mMeshIndex;
+	uint32_t mMeshCount;
+	// First entry of this node's meshes in gMeshWorldBounds and gMeshVisibility
+	uint32_t mFirstBounds;
+	// Largest error of the node's meshes at every LOD level, in mesh units
+	float    mLodErrors[MESH_LOD_MAX_LEVELS];
+};
+DrawNode*			gDrawNodes = NULL;
+uint32_t			gDrawNodeCount = 0;
+
+// One world space AABB per mesh of every draw node, refreshed when the node's world matrix changes
+BoundsArray			gMeshWorldBounds = {};
+uint8_t*			gMeshVisibility = NULL;
+static bool			gFrustumCulling = true;
+HiresTimer			gCullTimer;
+
+static bool			gAnimateScene = false;
+const float			gAnimationSpeed = 0.5f;
+HiresTimer			gSceneUpdateTimer;
+
+const uint32_t		gMaxDrawsPerFrame = 32768;
+
+struct DrawConstants
+{
+	mat4     mModelMatrix;
+	uint32_t mVisibleInstanceOffset;
+	uint32_t mUseVisibleInstances;
+	uint32_t mMaterialIndex;
+	uint32_t mShadowCascade;
+	// Every draw carries the dequantization of its vertex buffer, streamed models and placeholders have their own
+	vec4     mPositionDequantScale;
+	vec4     mPositionDequantOffset;
+};
+
+// Per-frame upload arena holding the global constants and the per-draw constants of the frame. The global constants
+// always take the first block so the PER_FRAME descriptor set can point at it, every draw writes its constants into
+// the next aligned element and binds it as a root CBV by offset, so no descriptor set is written between draws.
+UploadArena			gUploadArena = {};
+UploadAllocation<GlobalConstants> gGlobalConstantsUpload = {};
+
+enum DrawMode
+{
+	DRAW_MODE_PER_NODE = 0,
+	DRAW_MODE_INSTANCED,
+	DRAW_MODE_INDIRECT,
+	DRAW_MODE_COUNT
+};
+static const char*	gDrawModeNames[DRAW_MODE_COUNT] = { "Per Node", "Instanced", "Indirect" };
+static uint32_t		gDrawModeValues[DRAW_MODE_COUNT] = { DRAW_MODE_PER_NODE, DRAW_MODE_INSTANCED, DRAW_MODE_INDIRECT };
+static uint32_t		gDrawMode = DRAW_MODE_PER_NODE;
+
+// --depth-prepass: every scene draw is first drawn depth only with depth.vert and no pixel shader, the scene pass then
+// tests with CMP_EQUAL and depth writes off so each pixel runs the lighting once. Compare the Draw Mesh timestamp of
+// both settings from camera positions looking through many layers of the scene.
+static bool			gDepthPrepass = false;
+// --sort-draws: the CPU recorded paths draw the visible draw nodes ordered by their DrawSort.h key instead of in node
+// order, front to back within a pipeline and material
+static bool			gSortDraws = false;
+DrawSortList		gDrawOrder = {};
+HiresTimer			gDrawSortTimer;
+
+// Instances are laid out on a square spiral around the origin so any instance count forms a compact field
+const uint32_t		gMaxInstanceCount = 100000;
+const float			gInstanceSpacing = 1.5f;
+static uint32_t		gInstanceCount = 1;
+mat4*				gInstanceTransforms = NULL;
+Buffer*				pInstanceTransformsBuffer = NULL;
+Buffer*				pIndirectDrawArgsBuffers[gMaxFramesInFlight] = { NULL };
+
+// GPU culling: the cull compute pass tests every (instance, mesh) pair and appends the visible instances to
+// the mesh's segment of pVisibleInstancesBuffer. The append counter is the instance count of the mesh's
+// indirect arguments, so the CPU only issues one indirect draw per mesh whatever the instance count.
+static bool			gGpuCulling = false;
+const uint32_t		gCullThreadGroupSize = 64;
+
+struct CullConstants
+{
+	vec4     mFrustumPlanes[6];
+	uint32_t mInstanceCount;
+	uint32_t mMeshCount;
+	uint32_t mVisibleListCapacity;
+	uint32_t mDrawCountOffset;
+	mat4     mViewProjection;
+	mat4     mOcclusionViewProjection;
+	vec4     mHiZParams;
+	uint32_t mOcclusionEnabled;
+	uint32_t mRetestCapacity;
+	uint32_t mLateDrawArgsOffset;
+	uint32_t mLateVisibleOffset;
+};
+Buffer*				pCullConstantsBuffers[gMaxFramesInFlight] = { NULL };
+Buffer*				pMeshBoundsBuffers[gMaxFramesInFlight] = { NULL };
+// Indirect arguments of every mesh followed by one draw count per mesh, reset from pGpuDrawArgsResetBuffer each frame
+Buffer*				pGpuDrawArgsBuffer = NULL;
+Buffer*				pGpuDrawArgsResetBuffer = NULL;
+Buffer*				pVisibleInstancesBuffer = NULL;
+// Entries of every mesh's segment, gInstanceCount rounded up to a power of two so dragging the instance count only
+// recreates pVisibleInstancesBuffer at every doubling
+uint32_t			gVisibleInstanceCapacity = 0;
+
+// Hi-Z occlusion culling on top of GPU culling, --occlusion-culling or the GUI. The cull pass also tests every pair
+// against the Hi-Z pyramid of last frame's depth, seen with last frame's camera, and queues the occluded ones for a
+// retest instead of drawing them. Once the visible pairs are drawn the pyramid is rebuilt from this frame's depth and
+// the late cull pass retests the queue against it, so whatever came into view is drawn this frame and does not pop in
+// a frame late. Its draws use a second block of pGpuDrawArgsBuffer and the second half of pVisibleInstancesBuffer.
+static bool			gOcclusionCulling = false;
+// Pairs occluded beyond the capacity of the retest list are drawn right away
+const uint32_t		gMaxOcclusionRetestCount = 1 << 20;
+// Largest pVisibleInstancesBuffer with the late segments, beyond it the scene falls back to frustum culling only
+const uint64_t		gMaxOcclusionVisibleInstancesSize = 256ull << 20;
+// The second halves and the full retest list only exist once occlusion culling is used, from --occlusion-culling or
+// the first time the GUI enables it. Until then, or while the segments would pass gMaxOcclusionVisibleInstancesSize,
+// the retest list holds a single pair.
+static bool			gOcclusionBuffers = false;
+uint32_t			gOcclusionRetestCapacity = 0;
+const uint32_t		gHiZMaxMipCount = 16;
+const uint32_t		gHiZThreadGroupSize = 8;
+
+struct HiZConstants
+{
+	uint32_t mDestinationWidth;
+	uint32_t mDestinationHeight;
+	uint32_t mSourceWidth;
+	uint32_t mSourceHeight;
+};
+// Min and max depth pyramid, recreated with the depth buffer. Mip 0 is the power of two at or below the depth buffer
+// size in each direction.
+Texture*			pHiZTexture = NULL;
+uint32_t			gHiZWidth = 0;
+uint32_t			gHiZHeight = 0;
+uint32_t			gHiZMipCount = 0;
+// Whether the pyramid holds last frame's depth, and the camera it was built with
+bool				gHiZValid = false;
+mat4				gHiZViewProjection = mat4::identity();
+Buffer*				pOcclusionRetestBuffer = NULL;
+// Pairs queued for the retest and pairs the retest found visible, reset from pOcclusionResetBuffer every frame
+Buffer*				pOcclusionCountersBuffer = NULL;
+Buffer*				pOcclusionDispatchArgsBuffer = NULL;
+Buffer*				pOcclusionResetBuffer = NULL;
+Buffer*				pOcclusionCountersReadbackBuffers[gMaxFramesInFlight] = { NULL };
+bool				gOcclusionCountersWritten[gMaxFramesInFlight] = {};
+
+struct OcclusionStats
+{
+	uint32_t mRetestCount;
+	uint32_t mLateVisibleCount;
+	uint32_t mOverflowCount;
+};
+OcclusionStats		gOcclusionStats = {};
+
+// Meshlet culling: the cluster cull compute pass tests every meshlet of every draw mesh against the frustum and its
+// normal cone and appends the indices of the survivors to the draw mesh's segment of pClusterIndexBuffer. Draws
+// are not instanced in this mode, each draw mesh issues one indirect draw of whatever survived.
+// --meshlet-culling builds the meshlets at load and starts in this mode, without it the mode is not offered.
+static bool			gBuildMeshlets = false;
+static bool			gMeshletCulling = false;
+// Off by default: the scene is drawn without backface culling, so even single-sided clusters facing away stay visible
+static bool			gMeshletConeCulling = false;
+MeshletSet			gMeshlets = {};
+// Number of (meshlet, draw mesh) pairs the cull pass runs over
+uint32_t			gClusterCount = 0;
+uint32_t			gClusterIndexCount = 0;
+
+struct ClusterCullConstants
+{
+	vec4     mFrustumPlanes[6];
+	vec4     mCameraPosition;
+	uint32_t mClusterCount;
+	uint32_t mConeCulling;
+	uint32_t mPadding[2];
+};
+Buffer*				pClusterCullConstantsBuffers[gMaxFramesInFlight] = { NULL };
+Buffer*				pDrawTransformsBuffers[gMaxFramesInFlight] = { NULL };
+Buffer*				pClustersBuffer = NULL;
+Buffer*				pMeshletsBuffer = NULL;
+Buffer*				pMeshletBoundsBuffer = NULL;
+Buffer*				pMeshletIndicesBuffer = NULL;
+// Indirect arguments of every draw mesh, reset from pClusterDrawArgsResetBuffer each frame
+Buffer*				pClusterDrawArgsBuffer = NULL;
+Buffer*				pClusterDrawArgsResetBuffer = NULL;
+Buffer*				pClusterIndexBuffer = NULL;
+
+// LOD selection: every draw node, and in instanced mode every instance, draws the coarsest level whose error projects
+// to less than gLodPixelThreshold pixels from the distance between the camera and its world AABB. Instances are
+// bucketed per level into this frame's pLodInstancesBuffers, one region of gInstanceCount entries per draw node, and
+// each level is drawn as its own instanced draw. The lists are reallocated with the instance count, nodes whose region
+// would pass gMaxLodInstances draw level 0. Indirect draws share their arguments per mesh and stay at level 0.
+MeshLodSet			gMeshLods = {};
+static bool			gLodSelection = true;
+static float		gLodPixelThreshold = 1.0f;
+// Closer than this the distance is clamped, the camera can be inside a box
+const float			gLodMinDistance = 0.1f;
+// Set in Update for the draws of the frame: pixels covered by one world unit at distance 1, and the camera position
+float				gLodProjectionScale = 0.0f;
+vec3				gLodCameraPosition = vec3(0.0f);
+// Current level of every draw node and of every entry of the instance regions, the state the hysteresis starts from
+uint8_t*			gDrawNodeLods = NULL;
+// Levels the last selection picked for every draw node. The scene pass after a depth prepass replays them instead of
+// selecting again, both passes have to draw the same triangles for the CMP_EQUAL test.
+struct DrawNodeLodState
+{
+	uint32_t mLevelCounts[MESH_LOD_MAX_LEVELS];
+	uint32_t mLevelOffsets[MESH_LOD_MAX_LEVELS];
+	uint32_t mUseVisibleInstances;
+};
+DrawNodeLodState*	gDrawNodeLodStates = NULL;
+const uint32_t		gMaxLodInstances = 1u << 22;
+// Entries of gInstanceLods and of every pLodInstancesBuffers list
+uint32_t			gLodInstanceCapacity = 0;
+bool				gLodInstanceCapacityWarned = false;
+uint8_t*			gInstanceLods = NULL;
+Buffer*				pLodInstancesBuffers[gMaxFramesInFlight] = { NULL };
+
+// Streaming, --stream: Init only waits for the placeholders, not for the scene and its texture. The model is imported
+// on pLoadThreadSystem while the first frames render an empty scene. Once Update picks the import up and until
+// gSceneGeometry.mUploadToken completes every draw node is drawn as a cube of its world bounds, and each frame's
+// descriptor set samples the 1x1 placeholder until the base color texture is resident.
+bool				gStreamAssets = false;
+bool				gSceneImported = false;
+bool				gSceneResident = false;
+
+// CPU side of the main scene: the asset and everything built from it. Only touched by the import until mDone is set,
+// then moved into gMeshAsset, gMeshlets, gMeshLods and gSceneGeometry.
+struct SceneImport
+{
+	MeshAsset		mAsset;
+	MeshletSet		mMeshlets;
+	MeshLodSet		mLods;
+	float*			pUvDensities;
+	void*			pPackedVertices;
+	uint32_t		mVertexStride;
+	vec4			mPositionDequantScale;
+	vec4			mPositionDequantOffset;
+	tfrg_atomic32_t	mDone;
+};
+SceneImport			gSceneImport = {};
+SyncToken			gBaseColorMapToken = {};
+// Material textures each frame's descriptor set samples, rebound after the frame's fence when one of them changes
+Texture*			gBoundMaterialTextures[gMaxFramesInFlight][MATERIAL_MAX_TEXTURES] = {};
+Texture*			pPlaceholderTexture = NULL;
+// Unit cube around the origin in the scene vertex layout
+SceneGeometry		gPlaceholderCube = {};
+const uint32_t		gPlaceholderCubeIndexCount = 36;
+// CPU sources of scene uploads, freed once the scene is resident. Streaming adds those of the empty startup scene.
+void*				gSceneStagingAllocations[8] = {};
+uint32_t			gSceneStagingAllocationCount = 0;
+HiresTimer			gStartupTimer;
+bool				gFirstFrameReported = false;
+
+// Input to present latency. Update stamps each frame with the time it sampled the input system, which is after the wait
+// for the frame's slot, so that stall never ages the input. A frame's GPU side ends at the first fence poll that sees it
+// done, polls happen at every slot wait and after every present.
+typedef struct FrameLatency
+{
+	int64_t		mInputUSec;
+	bool		mInFlight;
+} FrameLatency;
+FrameLatency		gFrameLatencies[gMaxFramesInFlight] = {};
+// Moving averages of input to queuePresent and input to GPU done
+float				gInputToPresentMs = 0.0f;
+float				gInputToGpuDoneMs = 0.0f;
+
+// Driver pipeline cache, loaded from and saved to RD_PIPELINE_CACHE, so warm starts and every Load after the first one
+// get the pipelines the driver has compiled before
+PipelineCache*		pPipelineCache = NULL;
+const char*			gPipelineCacheName = "MeshViewer";
+// Last Load, the swapchain recreation of a resize or fullscreen toggle, and its addPipelines share
+float				gLoadMs = 0.0f;
+float				gPipelinesMs = 0.0f;
+uint32_t			gLoadCount = 0;
+
+// Render targets and pipelines replaced while frames are in flight, removed once their last frame's fence is waited on
+DeferredRemovalQueue	gDeferredRemovals = {};
+// Output format the pipelines were built for. They only depend on it, so a resize or fullscreen toggle keeps them.
+TinyImageFormat		gPipelineColorFormat = TinyImageFormat_UNDEFINED;
+
+// Runtime models, picked in the GUI from the meshes shipped in Resources/Meshes and loaded on pLoadThreadSystem
+const uint32_t		gMaxStreamedModels = 16;
+const float			gStreamedModelSpacing = 1.5f;
+ThreadSystem*		pLoadThreadSystem = NULL;
+StreamedModel		gStreamedModels[gMaxStreamedModels] = {};
+uint32_t			gStreamedModelCount = 0;
+static const char*	gStreamableModelNames[] = { "Duck", "matBall", "cube", "sphere", "capsule", "plane" };
+static uint32_t		gStreamableModelValues[] = { 0, 1, 2, 3, 4, 5 };
+static uint32_t		gStreamableModel = 0;
+
+// Texture mip streaming, --mip-streaming [--texture-budget <MB>]: the base color map starts with its mip tail and
+// gets finer mips as the screen space UV density of the draws asks for them, within gTextureBudgetMB
+bool				gMipStreaming = false;
+static float		gTextureBudgetMB = 256.0f;
+const uint32_t		gMaxStreamedTextures = 256;
+const uint64_t		gMaxTextureUploadBytesPerFrame = 4ull << 20;
+TextureStreaming*	pTextureStreaming = NULL;
+uint32_t			gBaseColorStreamedTexture = UINT32_MAX;
+// UV units per mesh unit of every asset mesh, what the draws' density feedback is computed from
+float*				gMeshUvDensities = NULL;
+
+// Basis Universal base color map, loaded instead of DuckCM.dds when Resources/Textures has DuckCM.ktx2 or DuckCM.basis.
+// Its images transcode on a pool of their own, so the record threads never wait behind them.
+ThreadSystem*		pTranscodeThreadSystem = NULL;
+BasisTexture		gBaseColorBasisTexture = {};
+bool				gBaseColorIsBasis = false;
+
+// Bindless materials, see Materials.h. The GLTF materials of the scene live in pMaterialsBuffer and every texture they
+// use in the materialTextures array, so draws only differ in the material index of their draw constants.
+MaterialTable		gMaterialTable = {};
+Buffer*				pMaterialsBuffer = NULL;
+// Asset textures by table entry, NULL for the ones without a file, which sample white
+Texture*			pMaterialTextures[MATERIAL_MAX_TEXTURES] = { NULL };
+SyncToken			gMaterialTexturesToken = {};
+Texture*			pWhiteTexture = NULL;
+
+struct FrameStats
+{
+	uint32_t mDrawCount;
+	uint64_t mTriangleCount;
+	uint32_t mInstanceCount;
+	uint32_t mRecordThreadCount;
+	uint32_t mUpdatedNodeCount;
+	uint32_t mVisibleMeshCount;
+	uint32_t mCulledMeshCount;
+	// Nodes or instances drawn at each LOD level
+	uint32_t mLodCounts[MESH_LOD_MAX_LEVELS];
+	uint32_t mPlaceholderCount;
+	float    mDrawSortMs;
+	float    mCpuSubmitMs;
+	float    mSceneUpdateMs;
+	float    mCullMs;
+};
+FrameStats			gFrameStats = {};
+HiresTimer			gSubmitTimer;
+char				gStatsText[256] = {};
+
+struct RecordTask
+{
+	Cmd*			pCmd;
+	RenderTarget*	pRenderTarget;
+	Pipeline*		pPipeline;
+	bool			mReplayLods;
+	uint32_t		mFirstDrawNode;
+	uint32_t		mDrawNodeCount;
+	UploadAllocation<DrawConstants> mDrawConstants;
+	uint32_t		mDrawCount;
+	uint64_t		mTriangleCount;
+	uint32_t		mLodCounts[MESH_LOD_MAX_LEVELS];
+	float			mRecordMs;
+};
+static uint32_t		gRecordThreadCount = 1;
+RecordTask			gRecordTasks[gMaxRecordThreads] = {};
+
+BenchmarkDesc		gBenchmarkDesc = {};
+Benchmark*			pBenchmark = NULL;
+HiresTimer			gFrameTimer;
+//***********************************************************************************//
+
+class MeshViewer : public IApp
+{
+public:
+	bool Init() override;
+	void Exit() override;
+
+	bool Load() override;
+	void Unload() override;
+
+	void Update(float deltaTime) override;
+	void Draw() override;
+
+	const char* GetName() override { return "01_MeshViewer"; }
+
+private:
+	void createSamplers();
+	void createShaders();
+	void createRootSignatures();
+	void createPlaceholders();
+	void createResources();
+	void createConstants();
+	void createDescriptorSets();
+	void createScene();
+	void createGUI();
+
+	// Scene sized parts of the above, rebuilt when a streamed import replaces the empty startup scene
+	void addSceneGeometry();
+	void addMaterials();
+	void addSceneNodes();
+	void removeSceneNodes();
+	void addSceneBuffers();
+	void removeSceneBuffers(bool deferred);
+	void addSceneDescriptorSets();
+	void removeSceneDescriptorSets(bool deferred);
+	void addImportedScene();
+	void resizeGpuCullBuffers();
+	void resizeLodInstanceBuffers();
+
+	bool addSwapChain();
+	bool addRenderTargets();
+	bool addDepthBuffer();
+	bool addHiZPyramid();
+	void addPipelines();
+	void removePipelines();
+
+	void updateUniformBuffers();
+};
+
+// Position of the n-th cell (1-based) on a square spiral starting at the origin
+static void getSpiralCell(int32_t n, int32_t* pX, int32_t* pY)
+{
+	int32_t k = (int32_t)ceilf((sqrtf((float)n) - 1.0f) * 0.5f);
+	int32_t t = 2 * k + 1;
+	int32_t m = t * t;
+	t -= 1;
+
+	if (n >= m - t) { *pX = k - (m - n); *pY = -k; return; }
+	m -= t;
+	if (n >= m - t) { *pX = -k; *pY = -k + (m - n); return; }
+	m -= t;
+	if (n >= m - t) { *pX = -k + (m - n); *pY = k; return; }
+	*pX = k; *pY = k - (m - n - t);
+}
+
+static void updateIndirectDrawArgs()
+{
+	IndirectDrawIndexArguments* pArgs = (IndirectDrawIndexArguments*)pIndirectDrawArgsBuffers[gFrameIndex]->pCpuMappedAddress;
+	for (uint32_t i = 0; i < gMeshAsset.mMeshCount; ++i)
+	{
+		pArgs[i].mIndexCount = gMeshAsset.pMeshes[i].mIndexCount;
+		pArgs[i].mInstanceCount = gInstanceCount;
+		pArgs[i].mStartIndex = gMeshAsset.pMeshes[i].mStartIndex;
+		pArgs[i].mVertexOffset = 0;
+		pArgs[i].mStartInstance = 0;
+	}
+}
+
+// Recomputes the world AABBs of the draw nodes whose world matrix changed in the last scene graph update
+static void updateMeshWorldBounds(bool updateAll)
+{
+	for (uint32_t d = 0; d < gDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		if (!updateAll && !(pSceneGraph->pFlags[node.mSceneNode] & SCENE_NODE_FLAG_WORLD_CHANGED))
+			continue;
+
+		const mat4& worldMatrix = pSceneGraph->pWorldMatrices[node.mSceneNode];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const MeshAssetMesh& mesh = gMeshAsset.pMeshes[node.mMeshIndex + i];
+			setTransformedBounds(&gMeshWorldBounds, node.mFirstBounds + i, vec3(mesh.mMin[0], mesh.mMin[1], mesh.mMin[2]),
+				vec3(mesh.mMax[0], mesh.mMax[1], mesh.mMax[2]), worldMatrix);
+		}
+	}
+}
+
+// Half extent of the spiral instance field, every instance is offset by at most this much from the node
+static vec3 getInstanceFieldExtent(uint32_t instanceCount)
+{
+	const float rings = ceilf((sqrtf((float)instanceCount) - 1.0f) * 0.5f);
+	return vec3(rings * gInstanceSpacing, 0.0f, rings * gInstanceSpacing);
+}
+
+static void cullScene(const mat4& viewProjection)
+{
+	resetHiresTimer(&gCullTimer);
+
+	uint32_t visibleCount = gMeshWorldBounds.mCount;
+	if (gFrustumCulling && !gGpuCulling)
+	{
+		Frustum frustum;
+		extractFrustumPlanes(viewProjection, &frustum);
+		// Instanced modes draw every mesh over the whole instance field, test the box swept over it
+		if (gDrawMode != DRAW_MODE_PER_NODE && gInstanceCount > 1)
+			inflateFrustum(&frustum, getInstanceFieldExtent(gInstanceCount));
+
+		visibleCount = cullBounds(&frustum, &gMeshWorldBounds, gMeshVisibility);
+	}
+	else
+	{
+		memset(gMeshVisibility, 1, gMeshWorldBounds.mPaddedCount);
+	}
+
+	gFrameStats.mVisibleMeshCount = visibleCount;
+	gFrameStats.mCulledMeshCount = gMeshWorldBounds.mCount - visibleCount;
+	gFrameStats.mCullMs = (float)getHiresTimerUSec(&gCullTimer, false) / 1000.0f;
+}
+
+static bool isLodSelectionActive()
+{
+	return gMeshLods.pLevels && gLodSelection && gDrawMode != DRAW_MODE_INDIRECT;
+}
+
+// A region per draw node for the instance count rounded up to a power of two, so dragging the instance count only
+// reallocates at every doubling
+static uint32_t getLodInstanceCapacity()
+{
+	if (!gMeshLods.pLevels)
+		return 1;
+	uint32_t instanceCapacity = 64;
+	while (instanceCapacity < gInstanceCount)
+		instanceCapacity <<= 1;
+	return (uint32_t)min((uint64_t)max(gDrawNodeCount, 1u) * instanceCapacity, (uint64_t)gMaxLodInstances);
+}
+
+// Every scene mesh owns a constants slot, it carries the mesh's material. Instanced LOD draws own one per level, each
+// level reads its own part of the instance list.
+static uint32_t getDrawSlotsPerMesh()
+{
+	return isLodSelectionActive() && gDrawMode == DRAW_MODE_INSTANCED ? MESH_LOD_MAX_LEVELS : 1;
+}
+
+static void getDrawNodeWorldBounds(const DrawNode& node, vec3* pMin, vec3* pMax)
+{
+	const BoundsArray& bounds = gMeshWorldBounds;
+	*pMin = vec3(FLT_MAX);
+	*pMax = vec3(-FLT_MAX);
+	for (uint32_t i = node.mFirstBounds; i < node.mFirstBounds + node.mMeshCount; ++i)
+	{
+		*pMin = minPerElem(*pMin, vec3(bounds.pMinX[i], bounds.pMinY[i], bounds.pMinZ[i]));
+		*pMax = maxPerElem(*pMax, vec3(bounds.pMaxX[i], bounds.pMaxY[i], bounds.pMaxZ[i]));
+	}
+}
+
+// Largest axis scale of a world matrix, converts mesh units to world units
+static float getMaxAxisScale(const mat4& worldMatrix)
+{
+	return sqrtf(max(lengthSqr(worldMatrix.getCol0().getXYZ()), max(lengthSqr(worldMatrix.getCol1().getXYZ()), lengthSqr(worldMatrix.getCol2().getXYZ()))));
+}
+
+// Pixels one unit of mesh error covers for a box, errorScale converts mesh units to world units
+static float getLodPixelsPerUnit(const vec3& boundsMin, const vec3& boundsMax, float errorScale)
+{
+	const vec3 delta = maxPerElem(maxPerElem(boundsMin - gLodCameraPosition, gLodCameraPosition - boundsMax), vec3(0.0f));
+	return gLodProjectionScale * errorScale / max(length(delta), gLodMinDistance);
+}
+
+// Picks a level for every instance of a draw node and writes the instance indices grouped by level into the node's
+// region of this frame's LOD instance list. Returns false when the region does not fit, the node then draws level 0.
+static bool bucketInstancesByLod(uint32_t drawNodeIndex, const vec3& boundsMin, const vec3& boundsMax, const float* pErrors,
+	uint32_t* pLevelCounts, uint32_t* pLevelOffsets)
+{
+	const uint32_t regionStart = drawNodeIndex * gInstanceCount;
+	if ((uint64_t)regionStart + gInstanceCount > gLodInstanceCapacity)
+		return false;
+
+	uint8_t* pLevels = gInstanceLods + regionStart;
+	for (uint32_t l = 0; l < MESH_LOD_MAX_LEVELS; ++l)
+		pLevelCounts[l] = 0;
+	for (uint32_t i = 0; i < gInstanceCount; ++i)
+	{
+		const vec3 offset = gInstanceTransforms[i].getTranslation();
+		pLevels[i] = (uint8_t)selectMeshLod(pErrors, pLevels[i], getLodPixelsPerUnit(boundsMin + offset, boundsMax + offset, 1.0f), gLodPixelThreshold);
+		++pLevelCounts[pLevels[i]];
+	}
+
+	uint32_t cursors[MESH_LOD_MAX_LEVELS];
+	uint32_t offset = regionStart;
+	for (uint32_t l = 0; l < MESH_LOD_MAX_LEVELS; ++l)
+	{
+		pLevelOffsets[l] = offset;
+		cursors[l] = offset;
+		offset += pLevelCounts[l];
+	}
+
+	uint32_t* pList = (uint32_t*)pLodInstancesBuffers[gFrameIndex]->pCpuMappedAddress;
+	for (uint32_t i = 0; i < gInstanceCount; ++i)
+		pList[cursors[pLevels[i]]++] = i;
+	return true;
+}
+
+// Writes slot of drawConstants and binds it. Blocks are allocated on the main thread, so recording threads fill the
+// slots of theirs without synchronization.
+static void bindDrawConstants(Cmd* cmd, const UploadAllocation<DrawConstants>& drawConstants, uint32_t slot, const mat4& modelMatrix, uint32_t visibleInstanceOffset, uint32_t useVisibleInstances,
+	uint32_t materialIndex, const vec4& positionDequantScale = gSceneGeometry.mPositionDequantScale,
+	const vec4& positionDequantOffset = gSceneGeometry.mPositionDequantOffset)
+{
+	DrawConstants* pDrawConstants = drawConstants.get(slot);
+	pDrawConstants->mModelMatrix = modelMatrix;
+	pDrawConstants->mVisibleInstanceOffset = visibleInstanceOffset;
+	pDrawConstants->mUseVisibleInstances = useVisibleInstances;
+	pDrawConstants->mMaterialIndex = materialIndex;
+	pDrawConstants->mShadowCascade = 0;
+	pDrawConstants->mPositionDequantScale = positionDequantScale;
+	pDrawConstants->mPositionDequantOffset = positionDequantOffset;
+
+	DescriptorDataRange drawConstantsRange = { (uint32_t)drawConstants.getOffset(slot), sizeof(DrawConstants) };
+	Buffer* pBuffer = drawConstants.getBuffer();
+	DescriptorData drawConstantsParam = {};
+	drawConstantsParam.pName = "drawConstants_rootcbv";
+	drawConstantsParam.pRanges = &drawConstantsRange;
+	drawConstantsParam.ppBuffers = &pBuffer;
+	cmdBindDescriptorSetWithRootCbvs(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 1, &drawConstantsParam);
+}
+
+// Records the draws of the draw nodes gDrawOrder lists at [firstDraw, firstDraw + drawNodeCount) with pPipeline into a
+// command buffer that already has the scene render targets bound. Safe to call from several threads on disjoint ranges.
+// Every mesh owns getDrawSlotsPerMesh() slots of drawConstants from its bounds index * getDrawSlotsPerMesh() on, nodes
+// with meshes beyond the block are skipped. pLodCounts gets the nodes or instances per LOD level.
+// With replayLods the levels of the last call are drawn again instead of being selected.
+static void drawSceneRange(Cmd* cmd, Pipeline* pPipeline, bool replayLods, uint32_t firstDraw, uint32_t drawNodeCount,
+	const UploadAllocation<DrawConstants>& drawConstants, uint32_t* pDrawCount, uint64_t* pTriangleCount, uint32_t* pLodCounts)
+{
+	const uint32_t instanceCount = gDrawMode == DRAW_MODE_PER_NODE ? 1 : gInstanceCount;
+	const bool useLods = isLodSelectionActive();
+	const uint32_t slotsPerMesh = getDrawSlotsPerMesh();
+
+	cmdBindPipeline(cmd, pPipeline);
+	cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+	cmdBindVertexBuffer(cmd, 1, &gSceneGeometry.pVertexBuffer, &gSceneGeometry.mVertexStride, (uint64_t*)NULL);
+	cmdBindIndexBuffer(cmd, gSceneGeometry.pIndexBuffer, gSceneGeometry.mIndexType, (uint64_t)NULL);
+
+	uint32_t drawCount = 0;
+	uint64_t triangleCount = 0;
+	for (uint32_t d = 0; d < drawNodeCount; ++d)
+	{
+		const uint32_t drawNodeIndex = gDrawOrder.pValues[firstDraw + d];
+		const DrawNode& node = gDrawNodes[drawNodeIndex];
+		const uint32_t slot = node.mFirstBounds * slotsPerMesh;
+		const uint8_t* pVisibility = gMeshVisibility + node.mFirstBounds;
+		if ((node.mFirstBounds + node.mMeshCount) * slotsPerMesh > drawConstants.getCount())
+			continue;
+
+		bool anyVisible = false;
+		for (uint32_t i = 0; i < node.mMeshCount && !anyVisible; ++i)
+			anyVisible = pVisibility[i] != 0;
+		if (!anyVisible)
+			continue;
+
+		const mat4& worldMatrix = pSceneGraph->pWorldMatrices[node.mSceneNode];
+
+		// The argument blocks are shared by every node using the mesh, so indirect draws are culled per node. One
+		// multi-draw per run of meshes sharing a material.
+		if (gDrawMode == DRAW_MODE_INDIRECT)
+		{
+			for (uint32_t first = 0; first < node.mMeshCount;)
+			{
+				const uint32_t material = getMeshMaterial(&gMaterialTable, gMeshAsset.pMeshes[node.mMeshIndex + first]);
+				uint32_t last = first + 1;
+				while (last < node.mMeshCount && getMeshMaterial(&gMaterialTable, gMeshAsset.pMeshes[node.mMeshIndex + last]) == material)
+					++last;
+
+				bindDrawConstants(cmd, drawConstants, slot + first * slotsPerMesh, worldMatrix, 0, 0, material);
+				cmdExecuteIndirect(cmd, pIndirectDrawCommandSignature, last - first, pIndirectDrawArgsBuffers[gFrameIndex],
+					(node.mMeshIndex + first) * sizeof(IndirectDrawIndexArguments), NULL, 0);
+				++drawCount;
+				first = last;
+			}
+			for (uint32_t i = 0; i < node.mMeshCount; ++i)
+				triangleCount += (uint64_t)gMeshAsset.pMeshes[node.mMeshIndex + i].mIndexCount / 3 * instanceCount;
+			pLodCounts[0] += instanceCount;
+			continue;
+		}
+
+		// Without LODs everything is drawn at level 0 with the plain instance index
+		uint32_t levelCounts[MESH_LOD_MAX_LEVELS] = { instanceCount };
+		uint32_t levelOffsets[MESH_LOD_MAX_LEVELS] = {};
+		uint32_t useVisibleInstances = 0;
+		DrawNodeLodState& lodState = gDrawNodeLodStates[drawNodeIndex];
+		if (useLods && replayLods)
+		{
+			memcpy(levelCounts, lodState.mLevelCounts, sizeof(levelCounts));
+			memcpy(levelOffsets, lodState.mLevelOffsets, sizeof(levelOffsets));
+			useVisibleInstances = lodState.mUseVisibleInstances;
+		}
+		else if (useLods)
+		{
+			vec3 boundsMin, boundsMax;
+			getDrawNodeWorldBounds(node, &boundsMin, &boundsMax);
+
+			const float errorScale = getMaxAxisScale(worldMatrix);
+			float errors[MESH_LOD_MAX_LEVELS];
+			for (uint32_t l = 0; l < MESH_LOD_MAX_LEVELS; ++l)
+				errors[l] = node.mLodErrors[l] * errorScale;
+
+			if (instanceCount > 1)
+			{
+				if (bucketInstancesByLod(drawNodeIndex, boundsMin, boundsMax, errors, levelCounts, levelOffsets))
+					useVisibleInstances = 2;
+			}
+			else
+			{
+				const uint32_t level = selectMeshLod(errors, gDrawNodeLods[drawNodeIndex], getLodPixelsPerUnit(boundsMin, boundsMax, 1.0f),
+					gLodPixelThreshold);
+				gDrawNodeLods[drawNodeIndex] = (uint8_t)level;
+				levelCounts[0] = 0;
+				levelCounts[level] = instanceCount;
+			}
+
+			memcpy(lodState.mLevelCounts, levelCounts, sizeof(levelCounts));
+			memcpy(lodState.mLevelOffsets, levelOffsets, sizeof(levelOffsets));
+			lodState.mUseVisibleInstances = useVisibleInstances;
+		}
+
+		for (uint32_t level = 0; level < MESH_LOD_MAX_LEVELS; ++level)
+		{
+			const uint32_t levelInstanceCount = levelCounts[level];
+			if (!levelInstanceCount)
+				continue;
+
+			pLodCounts[level] += levelInstanceCount;
+
+			// Meshes sharing the material of the one before draw with its constants
+			uint32_t boundMaterial = UINT32_MAX;
+			for (uint32_t i = 0; i < node.mMeshCount; ++i)
+			{
+				if (!pVisibility[i])
+					continue;
+
+				const MeshAssetMesh& mesh = gMeshAsset.pMeshes[node.mMeshIndex + i];
+				const uint32_t material = getMeshMaterial(&gMaterialTable, mesh);
+				if (material != boundMaterial)
+				{
+					bindDrawConstants(cmd, drawConstants, slot + i * slotsPerMesh + min(level, slotsPerMesh - 1), worldMatrix, levelOffsets[level],
+						useVisibleInstances, material);
+					boundMaterial = material;
+				}
+				MeshLodLevel lod = { mesh.mStartIndex, mesh.mIndexCount, 0.0f };
+				if (useLods)
+					lod = getMeshLodLevel(&gMeshLods, node.mMeshIndex + i, level);
+				if (gDrawMode == DRAW_MODE_INSTANCED)
+					cmdDrawIndexedInstanced(cmd, lod.mIndexCount, lod.mStartIndex, levelInstanceCount, 0, 0);
+				else
+					cmdDrawIndexed(cmd, lod.mIndexCount, lod.mStartIndex, 0);
+				triangleCount += (uint64_t)lod.mIndexCount / 3 * levelInstanceCount;
+				++drawCount;
+			}
+		}
+	}
+
+	*pDrawCount += drawCount;
+	*pTriangleCount += triangleCount;
+}
+
+static uint32_t getGpuDrawArgsSize()
+{
+	// 5 uints of IndirectDrawIndexArguments and one draw count per mesh
+	return (uint32_t)(sizeof(IndirectDrawIndexArguments) + sizeof(uint32_t)) * max(gMeshWorldBounds.mCount, 1u);
+}
+
+// Both sets of segments of pVisibleInstancesBuffer for the current instance capacity. The late segments start at
+// mLateVisibleOffset and end below twice that, every index into them is a uint in the shaders.
+static bool occlusionBuffersFit(uint32_t meshCount)
+{
+	const uint64_t entryCount = (uint64_t)max(meshCount, 1u) * gVisibleInstanceCapacity * 2;
+	return entryCount <= UINT32_MAX && sizeof(uint32_t) * entryCount <= gMaxOcclusionVisibleInstancesSize;
+}
+
+static uint32_t getVisibleInstanceCapacity(uint32_t instanceCount)
+{
+	uint32_t capacity = 64;
+	while (capacity < instanceCount)
+		capacity <<= 1;
+	return capacity;
+}
+
+static uint32_t getLateVisibleOffset()
+{
+	return (uint32_t)((uint64_t)gMeshWorldBounds.mCount * gVisibleInstanceCapacity);
+}
+
+static void addOcclusionRetestBuffer()
+{
+	gOcclusionRetestCapacity = gOcclusionBuffers ? gMaxOcclusionRetestCount : 1;
+
+	BufferLoadDesc occlusionRetestDesc = {};
+	occlusionRetestDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER;
+	occlusionRetestDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	occlusionRetestDesc.mDesc.mStartState = RESOURCE_STATE_UNORDERED_ACCESS;
+	occlusionRetestDesc.mDesc.mFirstElement = 0;
+	occlusionRetestDesc.mDesc.mElementCount = gOcclusionRetestCapacity;
+	occlusionRetestDesc.mDesc.mStructStride = sizeof(uint32_t) * 2;
+	occlusionRetestDesc.mDesc.mSize = sizeof(uint32_t) * 2 * (uint64_t)gOcclusionRetestCapacity;
+	occlusionRetestDesc.pData = NULL;
+	occlusionRetestDesc.ppBuffer = &pOcclusionRetestBuffer;
+	addResource(&occlusionRetestDesc, NULL);
+}
+
+static void addGpuCullBuffers()
+{
+	const uint32_t meshBoundsCount = max(gMeshWorldBounds.mCount, 1u);
+	gVisibleInstanceCapacity = getVisibleInstanceCapacity(gInstanceCount);
+	if (gOcclusionBuffers && !occlusionBuffersFit(meshBoundsCount))
+	{
+		LOGF(LogLevel::eWARNING, "Occlusion culling: %u meshes of %u instances need %llu MB of visible instances, more than %llu MB, "
+			"falling back to frustum culling", meshBoundsCount, gVisibleInstanceCapacity,
+			(unsigned long long)((sizeof(uint32_t) * 2 * (uint64_t)meshBoundsCount * gVisibleInstanceCapacity) >> 20),
+			(unsigned long long)(gMaxOcclusionVisibleInstancesSize >> 20));
+		gOcclusionBuffers = gOcclusionCulling = false;
+	}
+	// A second block and a second set of segments for the late draws of occlusion culling
+	const uint32_t phaseCount = gOcclusionBuffers ? 2 : 1;
+
+	BufferLoadDesc gpuDrawArgsDesc = {};
+	gpuDrawArgsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_INDIRECT_BUFFER;
+	gpuDrawArgsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	gpuDrawArgsDesc.mDesc.mStartState = RESOURCE_STATE_INDIRECT_ARGUMENT;
+	gpuDrawArgsDesc.mDesc.mFirstElement = 0;
+	gpuDrawArgsDesc.mDesc.mElementCount = getGpuDrawArgsSize() * phaseCount / sizeof(uint32_t);
+	gpuDrawArgsDesc.mDesc.mStructStride = sizeof(uint32_t);
+	gpuDrawArgsDesc.mDesc.mSize = (uint64_t)getGpuDrawArgsSize() * phaseCount;
+	gpuDrawArgsDesc.pData = NULL;
+	gpuDrawArgsDesc.ppBuffer = &pGpuDrawArgsBuffer;
+	addResource(&gpuDrawArgsDesc, NULL);
+
+	// Every mesh owns a segment large enough for all current instances, so appends never need a prefix sum. The late
+	// draws of occlusion culling append to the second set of segments, an instance is drawn by one phase or the other.
+	BufferLoadDesc visibleInstancesDesc = {};
+	visibleInstancesDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER | DESCRIPTOR_TYPE_RW_BUFFER;
+	visibleInstancesDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	visibleInstancesDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	visibleInstancesDesc.mDesc.mFirstElement = 0;
+	visibleInstancesDesc.mDesc.mElementCount = (uint64_t)meshBoundsCount * gVisibleInstanceCapacity * phaseCount;
+	visibleInstancesDesc.mDesc.mStructStride = sizeof(uint32_t);
+	visibleInstancesDesc.mDesc.mSize = sizeof(uint32_t) * (uint64_t)meshBoundsCount * gVisibleInstanceCapacity * phaseCount;
+	visibleInstancesDesc.pData = NULL;
+	visibleInstancesDesc.ppBuffer = &pVisibleInstancesBuffer;
+	addResource(&visibleInstancesDesc, NULL);
+}
+
+// Resets the indirect arguments and runs the cull compute pass. Has to be recorded outside of a render pass.
+// With occlusion culling this is the first phase, cullSceneGpuLate runs the second.
+static void cullSceneGpu(Cmd* cmd, const mat4& viewProjection, uint32_t instanceCount, bool occlusionCulling)
+{
+	const uint32_t meshCount = gMeshWorldBounds.mCount;
+
+	CullConstants* pCullConstants = (CullConstants*)pCullConstantsBuffers[gFrameIndex]->pCpuMappedAddress;
+	Frustum frustum;
+	extractFrustumPlanes(viewProjection, &frustum);
+	for (uint32_t i = 0; i < 6; ++i)
+		pCullConstants->mFrustumPlanes[i] = frustum.mPlanes[i];
+	pCullConstants->mInstanceCount = instanceCount;
+	pCullConstants->mMeshCount = meshCount;
+	pCullConstants->mVisibleListCapacity = gVisibleInstanceCapacity;
+	pCullConstants->mDrawCountOffset = meshCount * (uint32_t)(sizeof(IndirectDrawIndexArguments) / sizeof(uint32_t));
+	pCullConstants->mViewProjection = viewProjection;
+	pCullConstants->mOcclusionViewProjection = gHiZViewProjection;
+	pCullConstants->mHiZParams = vec4((float)gHiZWidth, (float)gHiZHeight, (float)gHiZMipCount, 0.0f);
+	pCullConstants->mOcclusionEnabled = occlusionCulling && gHiZValid ? 1 : 0;
+	pCullConstants->mRetestCapacity = gOcclusionRetestCapacity;
+	pCullConstants->mLateDrawArgsOffset = getGpuDrawArgsSize() / sizeof(uint32_t);
+	pCullConstants->mLateVisibleOffset = getLateVisibleOffset();
+	// The pyramid built later this frame is seen with this camera
+	gHiZViewProjection = viewProjection;
+
+	vec4* pMeshBounds = (vec4*)pMeshBoundsBuffers[gFrameIndex]->pCpuMappedAddress;
+	for (uint32_t i = 0; i < meshCount; ++i)
+	{
+		pMeshBounds[i * 2] = vec4(gMeshWorldBounds.pMinX[i], gMeshWorldBounds.pMinY[i], gMeshWorldBounds.pMinZ[i], 0.0f);
+		pMeshBounds[i * 2 + 1] = vec4(gMeshWorldBounds.pMaxX[i], gMeshWorldBounds.pMaxY[i], gMeshWorldBounds.pMaxZ[i], 0.0f);
+	}
+
+	cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "GPU Cull");
+
+	// The occlusion buffers are only touched with occlusion culling on, they stay in their resting states otherwise
+	const uint32_t occlusionBarrierCount = occlusionCulling ? 2 : 0;
+	BufferBarrier resetBarriers[] = {
+		{ pGpuDrawArgsBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_COPY_DEST },
+		{ pOcclusionCountersBuffer, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_COPY_DEST },
+		{ pOcclusionDispatchArgsBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_COPY_DEST },
+	};
+	cmdResourceBarrier(cmd, 1 + occlusionBarrierCount, resetBarriers, 0, NULL, 0, NULL);
+	cmdUpdateBuffer(cmd, pGpuDrawArgsBuffer, 0, pGpuDrawArgsResetBuffer, 0, getGpuDrawArgsSize());
+	if (occlusionCulling)
+	{
+		cmdUpdateBuffer(cmd, pGpuDrawArgsBuffer, getGpuDrawArgsSize(), pGpuDrawArgsResetBuffer, 0, getGpuDrawArgsSize());
+		cmdUpdateBuffer(cmd, pOcclusionCountersBuffer, 0, pOcclusionResetBuffer, 0, sizeof(uint32_t) * 4);
+		cmdUpdateBuffer(cmd, pOcclusionDispatchArgsBuffer, 0, pOcclusionResetBuffer, 0, sizeof(uint32_t) * 4);
+	}
+
+	BufferBarrier cullBarriers[] = {
+		{ pGpuDrawArgsBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS },
+		{ pVisibleInstancesBuffer, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS },
+		{ pOcclusionCountersBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS },
+		{ pOcclusionDispatchArgsBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS },
+	};
+	cmdResourceBarrier(cmd, 2 + occlusionBarrierCount, cullBarriers, 0, NULL, 0, NULL);
+
+	cmdBindPipeline(cmd, pCullPipeline);
+	cmdBindDescriptorSet(cmd, 0, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdDispatch(cmd, (instanceCount + gCullThreadGroupSize - 1) / gCullThreadGroupSize, meshCount, 1);
+
+	// The counters stay in the unordered access state for the second phase
+	BufferBarrier drawBarriers[] = {
+		{ pGpuDrawArgsBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDIRECT_ARGUMENT },
+		{ pVisibleInstancesBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE },
+		{ pOcclusionDispatchArgsBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDIRECT_ARGUMENT },
+		{ pOcclusionRetestBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_UNORDERED_ACCESS },
+	};
+	cmdResourceBarrier(cmd, 2 + occlusionBarrierCount, drawBarriers, 0, NULL, 0, NULL);
+
+	cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+}
+
+// Builds the Hi-Z pyramid from the depth buffer, mip 0 from the depth texels under each of its texels and every
+// further mip from 2x2 texels of the one above. Has to be recorded outside of a render pass, leaves the depth buffer
+// ready for depth writes again.
+static void buildHiZPyramid(Cmd* cmd)
+{
+	cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Hi-Z Build");
+
+	TextureBarrier buildBarrier = { pHiZTexture, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
+	RenderTargetBarrier depthBarrier = { pDepthBuffer, RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_SHADER_RESOURCE };
+	cmdResourceBarrier(cmd, 0, NULL, 1, &buildBarrier, 1, &depthBarrier);
+
+	const UploadAllocation<HiZConstants> hiZConstants = allocateUpload<HiZConstants>(&gUploadArena, gHiZMipCount);
+	DescriptorDataRange hiZConstantsRange = { 0, sizeof(HiZConstants) };
+	Buffer* pHiZConstantsBuffer = hiZConstants.getBuffer();
+	DescriptorData hiZConstantsParam = {};
+	hiZConstantsParam.pName = "hiZConstants_rootcbv";
+	hiZConstantsParam.pRanges = &hiZConstantsRange;
+	hiZConstantsParam.ppBuffers = &pHiZConstantsBuffer;
+
+	cmdBindDescriptorSet(cmd, 0, pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	for (uint32_t mip = 0; mip < hiZConstants.getCount(); ++mip)
+	{
+		HiZConstants* pConstants = hiZConstants.get(mip);
+		pConstants->mDestinationWidth = max(gHiZWidth >> mip, 1u);
+		pConstants->mDestinationHeight = max(gHiZHeight >> mip, 1u);
+		pConstants->mSourceWidth = mip ? max(gHiZWidth >> (mip - 1), 1u) : pDepthBuffer->mWidth;
+		pConstants->mSourceHeight = mip ? max(gHiZHeight >> (mip - 1), 1u) : pDepthBuffer->mHeight;
+
+		// Every mip reads what the previous dispatch wrote
+		if (mip)
+		{
+			TextureBarrier mipBarrier = { pHiZTexture, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_UNORDERED_ACCESS };
+			cmdResourceBarrier(cmd, 0, NULL, 1, &mipBarrier, 0, NULL);
+		}
+
+		cmdBindPipeline(cmd, mip ? pHiZReducePipeline : pHiZDepthPipeline);
+		hiZConstantsRange.mOffset = (uint32_t)hiZConstants.getOffset(mip);
+		cmdBindDescriptorSetWithRootCbvs(cmd, gFrameIndex * gHiZMaxMipCount + mip, pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 1,
+			&hiZConstantsParam);
+		cmdDispatch(cmd, (pConstants->mDestinationWidth + gHiZThreadGroupSize - 1) / gHiZThreadGroupSize,
+			(pConstants->mDestinationHeight + gHiZThreadGroupSize - 1) / gHiZThreadGroupSize, 1);
+	}
+
+	TextureBarrier cullBarrier = { pHiZTexture, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE };
+	depthBarrier = { pDepthBuffer, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_WRITE };
+	cmdResourceBarrier(cmd, 0, NULL, 1, &cullBarrier, 1, &depthBarrier);
+
+	cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+}
+
+// Second phase of occlusion culling: retests the pairs the first phase found occluded against the pyramid of this
+// frame's first phase draws, in a dispatch sized by the first phase. Has to be recorded outside of a render pass.
+static void cullSceneGpuLate(Cmd* cmd)
+{
+	cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "GPU Cull Late");
+
+	BufferBarrier cullBarriers[] = {
+		{ pGpuDrawArgsBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_UNORDERED_ACCESS },
+		{ pVisibleInstancesBuffer, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS },
+	};
+	cmdResourceBarrier(cmd, 2, cullBarriers, 0, NULL, 0, NULL);
+
+	cmdBindPipeline(cmd, pCullLatePipeline);
+	cmdBindDescriptorSet(cmd, 0, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdExecuteIndirect(cmd, pIndirectDispatchCommandSignature, 1, pOcclusionDispatchArgsBuffer, 0, NULL, 0);
+
+	BufferBarrier drawBarriers[] = {
+		{ pGpuDrawArgsBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDIRECT_ARGUMENT },
+		{ pVisibleInstancesBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE },
+		{ pOcclusionCountersBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_COPY_SOURCE },
+	};
+	cmdResourceBarrier(cmd, 3, drawBarriers, 0, NULL, 0, NULL);
+	cmdUpdateBuffer(cmd, pOcclusionCountersReadbackBuffers[gFrameIndex], 0, pOcclusionCountersBuffer, 0, sizeof(uint32_t) * 4);
+	gOcclusionCountersWritten[gFrameIndex] = true;
+
+	cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+}
+
+// Issues one indirect draw per mesh, instance counts and whether the draw happens at all come from cullSceneGpu, or
+// from cullSceneGpuLate for the late draws of occlusion culling. The triangle count is the upper bound before culling,
+// the CPU never sees the culled instance counts, and already covers the late draws.
+static void drawSceneGpuCulled(Cmd* cmd, Pipeline* pPipeline, const UploadAllocation<DrawConstants>& drawConstants, bool late, uint32_t instanceCount,
+	uint32_t* pDrawCount, uint64_t* pTriangleCount)
+{
+	cmdBindPipeline(cmd, pPipeline);
+	cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+	cmdBindVertexBuffer(cmd, 1, &gSceneGeometry.pVertexBuffer, &gSceneGeometry.mVertexStride, (uint64_t*)NULL);
+	cmdBindIndexBuffer(cmd, gSceneGeometry.pIndexBuffer, gSceneGeometry.mIndexType, (uint64_t)NULL);
+
+	DescriptorDataRange drawConstantsRange = { 0, sizeof(DrawConstants) };
+	Buffer* pDrawConstantsBuffer = drawConstants.getBuffer();
+	DescriptorData drawConstantsParam = {};
+	drawConstantsParam.pName = "drawConstants_rootcbv";
+	drawConstantsParam.pRanges = &drawConstantsRange;
+	drawConstantsParam.ppBuffers = &pDrawConstantsBuffer;
+
+	const uint64_t argsOffset = late ? getGpuDrawArgsSize() : 0;
+	const uint64_t drawCountOffset = argsOffset + (uint64_t)gMeshWorldBounds.mCount * sizeof(IndirectDrawIndexArguments);
+	const uint32_t visibleOffset = late ? getLateVisibleOffset() : 0;
+
+	uint32_t drawCount = 0;
+	uint64_t triangleCount = 0;
+	for (uint32_t d = 0; d < gDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const uint32_t mesh = node.mFirstBounds + i;
+			if (mesh >= drawConstants.getCount())
+				break;
+
+			DrawConstants* pDrawConstants = drawConstants.get(mesh);
+			pDrawConstants->mModelMatrix = pSceneGraph->pWorldMatrices[node.mSceneNode];
+			pDrawConstants->mVisibleInstanceOffset = visibleOffset + mesh * gVisibleInstanceCapacity;
+			pDrawConstants->mUseVisibleInstances = 1;
+			pDrawConstants->mMaterialIndex = getMeshMaterial(&gMaterialTable, gMeshAsset.pMeshes[node.mMeshIndex + i]);
+			pDrawConstants->mShadowCascade = 0;
+			pDrawConstants->mPositionDequantScale = gSceneGeometry.mPositionDequantScale;
+			pDrawConstants->mPositionDequantOffset = gSceneGeometry.mPositionDequantOffset;
+			drawConstantsRange.mOffset = (uint32_t)drawConstants.getOffset(mesh);
+			cmdBindDescriptorSetWithRootCbvs(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 1, &drawConstantsParam);
+
+			cmdExecuteIndirect(cmd, pIndirectDrawCommandSignature, 1, pGpuDrawArgsBuffer, argsOffset + mesh * sizeof(IndirectDrawIndexArguments),
+				pGpuDrawArgsBuffer, drawCountOffset + mesh * sizeof(uint32_t));
+			if (!late)
+				triangleCount += (uint64_t)gMeshAsset.pMeshes[node.mMeshIndex + i].mIndexCount / 3 * instanceCount;
+			++drawCount;
+		}
+	}
+
+	*pDrawCount += drawCount;
+	*pTriangleCount += triangleCount;
+}
+
+// Writes the draw mesh transforms, resets the indirect arguments and runs the cluster cull pass.
+// Has to be recorded outside of a render pass.
+static void cullClustersGpu(Cmd* cmd, const mat4& viewProjection, const vec3& cameraPosition)
+{
+	ClusterCullConstants* pConstants = (ClusterCullConstants*)pClusterCullConstantsBuffers[gFrameIndex]->pCpuMappedAddress;
+	Frustum frustum;
+	extractFrustumPlanes(viewProjection, &frustum);
+	for (uint32_t i = 0; i < 6; ++i)
+		pConstants->mFrustumPlanes[i] = frustum.mPlanes[i];
+	pConstants->mCameraPosition = vec4(cameraPosition, 1.0f);
+	pConstants->mClusterCount = gClusterCount;
+	pConstants->mConeCulling = gMeshletConeCulling ? 1 : 0;
+
+	mat4* pDrawTransforms = (mat4*)pDrawTransformsBuffers[gFrameIndex]->pCpuMappedAddress;
+	for (uint32_t d = 0; d < gDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+			pDrawTransforms[node.mFirstBounds + i] = pSceneGraph->pWorldMatrices[node.mSceneNode];
+	}
+
+	cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Cluster Cull");
+
+	BufferBarrier resetBarrier = { pClusterDrawArgsBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_COPY_DEST };
+	cmdResourceBarrier(cmd, 1, &resetBarrier, 0, NULL, 0, NULL);
+	cmdUpdateBuffer(cmd, pClusterDrawArgsBuffer, 0, pClusterDrawArgsResetBuffer, 0,
+		sizeof(IndirectDrawIndexArguments) * max(gMeshWorldBounds.mCount, 1u));
+
+	BufferBarrier cullBarriers[] = {
+		{ pClusterDrawArgsBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS },
+		{ pClusterIndexBuffer, RESOURCE_STATE_INDEX_BUFFER, RESOURCE_STATE_UNORDERED_ACCESS },
+	};
+	cmdResourceBarrier(cmd, 2, cullBarriers, 0, NULL, 0, NULL);
+
+	cmdBindPipeline(cmd, pClusterCullPipeline);
+	cmdBindDescriptorSet(cmd, 0, pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdDispatch(cmd, (gClusterCount + gCullThreadGroupSize - 1) / gCullThreadGroupSize, 1, 1);
+
+	BufferBarrier drawBarriers[] = {
+		{ pClusterDrawArgsBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDIRECT_ARGUMENT },
+		{ pClusterIndexBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDEX_BUFFER },
+	};
+	cmdResourceBarrier(cmd, 2, drawBarriers, 0, NULL, 0, NULL);
+
+	cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+}
+
+// Issues one indirect draw per draw mesh from the compacted cluster index stream of cullClustersGpu.
+// The triangle count is the upper bound before culling.
+static void drawSceneClusterCulled(Cmd* cmd, Pipeline* pPipeline, const UploadAllocation<DrawConstants>& drawConstants, uint32_t* pDrawCount,
+	uint64_t* pTriangleCount)
+{
+	cmdBindPipeline(cmd, pPipeline);
+	cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+	cmdBindVertexBuffer(cmd, 1, &gSceneGeometry.pVertexBuffer, &gSceneGeometry.mVertexStride, (uint64_t*)NULL);
+	cmdBindIndexBuffer(cmd, pClusterIndexBuffer, INDEX_TYPE_UINT32, (uint64_t)NULL);
+
+	DescriptorDataRange drawConstantsRange = { 0, sizeof(DrawConstants) };
+	Buffer* pDrawConstantsBuffer = drawConstants.getBuffer();
+	DescriptorData drawConstantsParam = {};
+	drawConstantsParam.pName = "drawConstants_rootcbv";
+	drawConstantsParam.pRanges = &drawConstantsRange;
+	drawConstantsParam.ppBuffers = &pDrawConstantsBuffer;
+
+	uint32_t drawCount = 0;
+	uint64_t triangleCount = 0;
+	for (uint32_t d = 0; d < gDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const uint32_t mesh = node.mFirstBounds + i;
+			if (mesh >= drawConstants.getCount())
+				break;
+
+			DrawConstants* pDrawConstants = drawConstants.get(mesh);
+			pDrawConstants->mModelMatrix = pSceneGraph->pWorldMatrices[node.mSceneNode];
+			pDrawConstants->mVisibleInstanceOffset = 0;
+			pDrawConstants->mUseVisibleInstances = 0;
+			pDrawConstants->mMaterialIndex = getMeshMaterial(&gMaterialTable, gMeshAsset.pMeshes[node.mMeshIndex + i]);
+			pDrawConstants->mShadowCascade = 0;
+			pDrawConstants->mPositionDequantScale = gSceneGeometry.mPositionDequantScale;
+			pDrawConstants->mPositionDequantOffset = gSceneGeometry.mPositionDequantOffset;
+			drawConstantsRange.mOffset = (uint32_t)drawConstants.getOffset(mesh);
+			cmdBindDescriptorSetWithRootCbvs(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 1, &drawConstantsParam);
+
+			cmdExecuteIndirect(cmd, pIndirectDrawCommandSignature, 1, pClusterDrawArgsBuffer, mesh * sizeof(IndirectDrawIndexArguments), NULL, 0);
+			triangleCount += (uint64_t)gMeshAsset.pMeshes[node.mMeshIndex + i].mIndexCount / 3;
+			++drawCount;
+		}
+	}
+
+	*pDrawCount += drawCount;
+	*pTriangleCount += triangleCount;
+}
+
+// Box every caster of the scene lies in, the instance field included
+static void getSceneWorldBounds(uint32_t instanceCount, vec3* pMin, vec3* pMax)
+{
+	const BoundsArray& bounds = gMeshWorldBounds;
+	*pMin = vec3(FLT_MAX);
+	*pMax = vec3(-FLT_MAX);
+	for (uint32_t i = 0; i < bounds.mCount; ++i)
+	{
+		*pMin = minPerElem(*pMin, vec3(bounds.pMinX[i], bounds.pMinY[i], bounds.pMinZ[i]));
+		*pMax = maxPerElem(*pMax, vec3(bounds.pMaxX[i], bounds.pMaxY[i], bounds.pMaxZ[i]));
+	}
+	const vec3 fieldExtent = getInstanceFieldExtent(instanceCount);
+	*pMin = *pMin - fieldExtent;
+	*pMax = *pMax + fieldExtent;
+}
+
+// Renders the cascades updateShadowCascades picked this frame into their slices of pShadowMap, the others keep what
+// they hold. Every draw node reaching a cascade draws all of its meshes at full detail over the instances of the field
+// whose copy of the scene reaches the cascade. Has to be recorded outside of a render pass.
+static void drawShadowCascades(Cmd* cmd)
+{
+	gShadowDrawCount = 0;
+	bool anyRefresh = false;
+	for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+		anyRefresh |= gShadowCascades.mCascades[c].mRefresh != SHADOW_REFRESH_NONE;
+	if (!anyRefresh)
+		return;
+
+	RenderTargetBarrier writeBarrier = { pShadowMap, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_WRITE };
+	cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &writeBarrier);
+
+	const vec3 fieldExtent = getInstanceFieldExtent(gShadowInstanceCount);
+	// Every instance carries a copy of the scene at its offset
+	vec3 sceneMin, sceneMax;
+	getSceneWorldBounds(1, &sceneMin, &sceneMax);
+	uint32_t* pShadowInstances = (uint32_t*)pShadowInstancesBuffers[gFrameIndex]->pCpuMappedAddress;
+	for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+	{
+		ShadowCascade& cascade = gShadowCascades.mCascades[c];
+		if (cascade.mRefresh == SHADOW_REFRESH_NONE)
+			continue;
+
+		HiresTimer recordTimer;
+		initHiresTimer(&recordTimer);
+		cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, gShadowCascadeNames[c]);
+
+		const uint32_t regionStart = c * gMaxInstanceCount;
+		uint32_t instanceCount = gShadowInstanceCount;
+		if (gShadowInstanceCount > 1)
+		{
+			instanceCount = 0;
+			for (uint32_t i = 0; i < gShadowInstanceCount; ++i)
+			{
+				const vec3 offset = gInstanceTransforms[i].getTranslation();
+				if (shadowCascadeOverlaps(&gShadowCascades, c, sceneMin + offset, sceneMax + offset))
+					pShadowInstances[regionStart + instanceCount++] = i;
+			}
+		}
+		cascade.mInstanceCount = instanceCount;
+
+		LoadActionsDesc loadActions = {};
+		loadActions.mLoadActionDepth = LOAD_ACTION_CLEAR;
+		loadActions.mClearDepth.depth = 1.0f;
+		loadActions.mClearDepth.stencil = 0;
+		cmdBindRenderTargets(cmd, 0, NULL, pShadowMap, &loadActions, NULL, NULL, c, -1);
+		cmdSetViewport(cmd, 0.0f, 0.0f, (float)gShadowMapSize, (float)gShadowMapSize, 0.0f, 1.0f);
+		cmdSetScissor(cmd, 0, 0, gShadowMapSize, gShadowMapSize);
+
+		cmdBindPipeline(cmd, pShadowPipeline);
+		cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+		cmdBindVertexBuffer(cmd, 1, &gSceneGeometry.pVertexBuffer, &gSceneGeometry.mVertexStride, (uint64_t*)NULL);
+		cmdBindIndexBuffer(cmd, gSceneGeometry.pIndexBuffer, gSceneGeometry.mIndexType, (uint64_t)NULL);
+
+		const UploadAllocation<DrawConstants> drawConstants = allocateUpload<DrawConstants>(&gUploadArena, gDrawNodeCount);
+		DescriptorDataRange drawConstantsRange = { 0, sizeof(DrawConstants) };
+		Buffer* pDrawConstantsBuffer = drawConstants.getBuffer();
+		DescriptorData drawConstantsParam = {};
+		drawConstantsParam.pName = "drawConstants_rootcbv";
+		drawConstantsParam.pRanges = &drawConstantsRange;
+		drawConstantsParam.ppBuffers = &pDrawConstantsBuffer;
+
+		// The slice is still cleared when no instance reaches it
+		for (uint32_t d = 0; d < drawConstants.getCount() && instanceCount; ++d)
+		{
+			const DrawNode& node = gDrawNodes[d];
+			vec3 boundsMin, boundsMax;
+			getDrawNodeWorldBounds(node, &boundsMin, &boundsMax);
+			if (!shadowCascadeOverlaps(&gShadowCascades, c, boundsMin - fieldExtent, boundsMax + fieldExtent))
+				continue;
+
+			DrawConstants* pDrawConstants = drawConstants.get(d);
+			pDrawConstants->mModelMatrix = pSceneGraph->pWorldMatrices[node.mSceneNode];
+			pDrawConstants->mVisibleInstanceOffset = regionStart;
+			pDrawConstants->mUseVisibleInstances = gShadowInstanceCount > 1 ? 3 : 0;
+			pDrawConstants->mMaterialIndex = MATERIAL_DEFAULT;
+			pDrawConstants->mShadowCascade = c;
+			pDrawConstants->mPositionDequantScale = gSceneGeometry.mPositionDequantScale;
+			pDrawConstants->mPositionDequantOffset = gSceneGeometry.mPositionDequantOffset;
+			drawConstantsRange.mOffset = (uint32_t)drawConstants.getOffset(d);
+			cmdBindDescriptorSetWithRootCbvs(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 1, &drawConstantsParam);
+
+			for (uint32_t i = 0; i < node.mMeshCount; ++i)
+			{
+				const MeshAssetMesh& mesh = gMeshAsset.pMeshes[node.mMeshIndex + i];
+				cmdDrawIndexedInstanced(cmd, mesh.mIndexCount, mesh.mStartIndex, instanceCount, 0, 0);
+				++gShadowDrawCount;
+			}
+		}
+
+		cmdBindRenderTargets(cmd, 0, NULL, NULL, NULL, NULL, NULL, -1, -1);
+		cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+		cascade.mRecordMs = (float)getHiresTimerUSec(&recordTimer, false) / 1000.0f;
+	}
+
+	RenderTargetBarrier readBarrier = { pShadowMap, RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_SHADER_RESOURCE };
+	cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &readBarrier);
+}
+
+// Writes this frame's lights, bins them into the cluster grid and copies the cluster light counts out for the stats.
+// Has to be recorded outside of a render pass.
+static void binLightsGpu(Cmd* cmd, const mat4& viewMatrix, uint32_t instanceCount)
+{
+	const uint32_t lightCount = min(gClusteredLightCount, gMaxClusteredLightCount);
+
+	// The lights fill the instance field and the room around it, the scene is fit into a unit box at the origin
+	const vec3 fieldExtent = getInstanceFieldExtent(instanceCount);
+	writeLightField(&gLightField, lightCount, gLightTime, gClusteredLightRadius, gClusteredLightIntensity, vec3(-1.0f, 0.0f, -1.0f) - fieldExtent,
+		vec3(1.0f, 1.5f, 1.0f) + fieldExtent, (ClusterLight*)pLightsBuffers[gFrameIndex]->pCpuMappedAddress);
+
+	LightBinConstants* pConstants = (LightBinConstants*)pLightBinConstantsBuffers[gFrameIndex]->pCpuMappedAddress;
+	pConstants->mViewMatrix = viewMatrix;
+	pConstants->mClusterProjection = gClusterProjection;
+	pConstants->mLightCount = lightCount;
+
+	cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Light Binning");
+
+	BufferBarrier binBarriers[] = {
+		{ pClusterLightCountsBuffer, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS },
+		{ pClusterLightIndicesBuffer, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS },
+	};
+	cmdResourceBarrier(cmd, 2, binBarriers, 0, NULL, 0, NULL);
+
+	cmdBindPipeline(cmd, pLightBinPipeline);
+	cmdBindDescriptorSet(cmd, 0, pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdDispatch(cmd, CLUSTER_COUNT / gLightBinThreadGroupSize, 1, 1);
+
+	BufferBarrier readbackBarriers[] = {
+		{ pClusterLightCountsBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_COPY_SOURCE },
+		{ pClusterLightIndicesBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE },
+	};
+	cmdResourceBarrier(cmd, 2, readbackBarriers, 0, NULL, 0, NULL);
+	cmdUpdateBuffer(cmd, pClusterLightCountsReadbackBuffers[gFrameIndex], 0, pClusterLightCountsBuffer, 0, sizeof(uint32_t) * CLUSTER_COUNT);
+	gClusterLightCountsWritten[gFrameIndex] = true;
+
+	BufferBarrier shadeBarrier = { pClusterLightCountsBuffer, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_SHADER_RESOURCE };
+	cmdResourceBarrier(cmd, 1, &shadeBarrier, 0, NULL, 0, NULL);
+
+	cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+}
+
+static void addLatencySample(float* pAverageMs, float ms)
+{
+	*pAverageMs = *pAverageMs > 0.0f ? *pAverageMs + (ms - *pAverageMs) * 0.05f : ms;
+}
+
+static void pollFrameLatencies()
+{
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		FrameLatency& latency = gFrameLatencies[i];
+		if (!latency.mInFlight)
+			continue;
+
+		FenceStatus fenceStatus;
+		getFenceStatus(pRenderer, pRenderCompleteFences[i], &fenceStatus);
+		if (fenceStatus == FENCE_STATUS_INCOMPLETE)
+			continue;
+
+		addLatencySample(&gInputToGpuDoneMs, (float)(getUSec(false) - latency.mInputUSec) / 1000.0f);
+		latency.mInFlight = false;
+	}
+}
+
+// Stall if the CPU is gFramesInFlight frames ahead of the GPU
+static void waitForFrameSlot()
+{
+	Fence*      pNextFence = pRenderCompleteFences[gFrameIndex];
+	FenceStatus fenceStatus;
+	getFenceStatus(pRenderer, pNextFence, &fenceStatus);
+	if (fenceStatus == FENCE_STATUS_INCOMPLETE)
+		waitForFences(pRenderer, 1, &pNextFence);
+
+	pollFrameLatencies();
+}
+
+// Vulkan bakes the present mode into the swapchain and toggleVSync recreates it under the frames in flight, the other
+// APIs only change the sync interval of the next present
+static bool isVSyncToggleRecreatingSwapChain()
+{
+#if defined(USE_MULTIPLE_RENDER_APIS)
+	return gSelectedRendererApi == RENDERER_API_VULKAN;
+#elif defined(VULKAN)
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Target the frame ends up in, the swapchain image or the offscreen target of headless runs
+static RenderTarget* getOutputRenderTarget(uint32_t swapchainImageIndex)
+{
+	return pOffscreenTarget ? pOffscreenTarget : pSwapChain->ppRenderTargets[swapchainImageIndex];
+}
+
+// Fills gDrawOrder with the draw nodes the CPU recorded paths draw this frame. Unsorted it lists every node in node
+// order. Sorted it only lists the nodes with a visible mesh, by pipeline, by the material of their first mesh and front
+// to back by the distance of the camera to their bounds.
+static void buildDrawOrder(bool sort, const vec3& cameraPosition)
+{
+	gDrawOrder.mCount = 0;
+	gDrawOrder.mPassCount = 0;
+	if (!sort)
+	{
+		for (uint32_t i = 0; i < gDrawNodeCount; ++i)
+			addDrawSortEntry(&gDrawOrder, 0, i);
+		return;
+	}
+
+	for (uint32_t i = 0; i < gDrawNodeCount; ++i)
+	{
+		const DrawNode& node = gDrawNodes[i];
+		const uint8_t* pVisibility = gMeshVisibility + node.mFirstBounds;
+		bool anyVisible = false;
+		for (uint32_t m = 0; m < node.mMeshCount && !anyVisible; ++m)
+			anyVisible = pVisibility[m] != 0;
+		if (!anyVisible)
+			continue;
+
+		vec3 boundsMin, boundsMax;
+		getDrawNodeWorldBounds(node, &boundsMin, &boundsMax);
+		const vec3 closest = minPerElem(maxPerElem(cameraPosition, boundsMin), boundsMax);
+		// Every scene draw uses the basic pipeline, it only gets a key of its own once there is a second one
+		const uint32_t material = getMeshMaterial(&gMaterialTable, gMeshAsset.pMeshes[node.mMeshIndex]);
+		addDrawSortEntry(&gDrawOrder, makeDrawSortKey(0, material, length(closest - cameraPosition)), i);
+	}
+	sortDrawList(&gDrawOrder);
+}
+
+static void recordSceneTask(void* pUserData, uintptr_t index)
+{
+	UNREF_PARAM(pUserData);
+	RecordTask* pTask = &gRecordTasks[index];
+
+	HiresTimer recordTimer;
+	initHiresTimer(&recordTimer);
+
+	Cmd* cmd = pTask->pCmd;
+	beginCmd(cmd);
+
+	LoadActionsDesc loadActions = {};
+	loadActions.mLoadActionsColor[0] = LOAD_ACTION_LOAD;
+	loadActions.mLoadActionDepth = LOAD_ACTION_LOAD;
+	cmdBindRenderTargets(cmd, 1, &pTask->pRenderTarget, pDepthBuffer, &loadActions, NULL, NULL, -1, -1);
+	cmdSetViewport(cmd, 0.0f, 0.0f, (float)pTask->pRenderTarget->mWidth, (float)pTask->pRenderTarget->mHeight, 0.0f, 1.0f);
+	cmdSetScissor(cmd, 0, 0, pTask->pRenderTarget->mWidth, pTask->pRenderTarget->mHeight);
+
+	drawSceneRange(cmd, pTask->pPipeline, pTask->mReplayLods, pTask->mFirstDrawNode, pTask->mDrawNodeCount, pTask->mDrawConstants, &pTask->mDrawCount,
+		 &pTask->mTriangleCount, pTask->mLodCounts);
+
+	cmdBindRenderTargets(cmd, 0, NULL, 0, NULL, NULL, NULL, -1, -1);
+	endCmd(cmd);
+
+	pTask->mRecordMs = (float)getHiresTimerUSec(&recordTimer, false) / 1000.0f;
+}
+
+static void drawPlaceholderCube(Cmd* cmd, const UploadAllocation<DrawConstants>& drawConstants, uint32_t slot, const vec3& boundsMin,
+	const vec3& boundsMax)
+{
+	// Flat boxes still get some volume so they stay visible
+	const vec3 extent = maxPerElem(boundsMax - boundsMin, vec3(0.01f));
+	const mat4 modelMatrix = mat4::translation((boundsMin + boundsMax) * 0.5f) * mat4::scale(extent);
+	bindDrawConstants(cmd, drawConstants, slot, modelMatrix, 0, 0, MATERIAL_DEFAULT, gPlaceholderCube.mPositionDequantScale,
+		gPlaceholderCube.mPositionDequantOffset);
+	cmdDrawIndexed(cmd, gPlaceholderCubeIndexCount, 0, 0);
+}
+
+// Draws every visible draw node as a cube of its world bounds while the scene uploads are in flight.
+// Every node owns one slot of drawConstants.
+static void drawScenePlaceholders(Cmd* cmd, uint32_t drawNodeCount, const UploadAllocation<DrawConstants>& drawConstants, uint32_t* pDrawCount,
+	uint64_t* pTriangleCount)
+{
+	cmdBindPipeline(cmd, pBasicPipeline);
+	cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+	cmdBindVertexBuffer(cmd, 1, &gPlaceholderCube.pVertexBuffer, &gPlaceholderCube.mVertexStride, (uint64_t*)NULL);
+	cmdBindIndexBuffer(cmd, gPlaceholderCube.pIndexBuffer, gPlaceholderCube.mIndexType, (uint64_t)NULL);
+
+	for (uint32_t d = 0; d < drawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		const uint8_t* pVisibility = gMeshVisibility + node.mFirstBounds;
+
+		bool anyVisible = false;
+		for (uint32_t i = 0; i < node.mMeshCount && !anyVisible; ++i)
+			anyVisible = pVisibility[i] != 0;
+		if (!anyVisible)
+			continue;
+
+		vec3 boundsMin, boundsMax;
+		getDrawNodeWorldBounds(node, &boundsMin, &boundsMax);
+		drawPlaceholderCube(cmd, drawConstants, d, boundsMin, boundsMax);
+		*pTriangleCount += gPlaceholderCubeIndexCount / 3;
+		++*pDrawCount;
+	}
+}
+
+// Draws the runtime models in their own pass after the scene. A model that is not resident yet is a cube of its
+// bounds once the load task has placed it, and a unit cube at its position before that.
+static void drawStreamedModels(Cmd* cmd, RenderTarget* pRenderTarget, uint32_t* pDrawCount, uint64_t* pTriangleCount, uint32_t* pPlaceholderCount)
+{
+	LoadActionsDesc loadActions = {};
+	loadActions.mLoadActionsColor[0] = LOAD_ACTION_LOAD;
+	loadActions.mLoadActionDepth = LOAD_ACTION_LOAD;
+	cmdBindRenderTargets(cmd, 1, &pRenderTarget, pDepthBuffer, &loadActions, NULL, NULL, -1, -1);
+	cmdSetViewport(cmd, 0.0f, 0.0f, (float)pRenderTarget->mWidth, (float)pRenderTarget->mHeight, 0.0f, 1.0f);
+	cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
+
+	cmdBindPipeline(cmd, pBasicPipeline);
+	cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+
+	for (uint32_t m = 0; m < gStreamedModelCount; ++m)
+	{
+		StreamedModel* pModel = &gStreamedModels[m];
+		const StreamedModelState state = getStreamedModelState(pModel);
+		if (state == STREAMED_MODEL_STATE_FAILED || state == STREAMED_MODEL_STATE_EMPTY)
+			continue;
+
+		if (state != STREAMED_MODEL_STATE_READY)
+		{
+			const UploadAllocation<DrawConstants> drawConstants = allocateUpload<DrawConstants>(&gUploadArena);
+			if (!drawConstants.getCount())
+				return;
+
+			vec3 boundsMin = pModel->mPosition - vec3(0.5f, 0.0f, 0.5f);
+			vec3 boundsMax = pModel->mPosition + vec3(0.5f, 1.0f, 0.5f);
+			if (state == STREAMED_MODEL_STATE_UPLOADING)
+			{
+				boundsMin = pModel->mBoundsMin;
+				boundsMax = pModel->mBoundsMax;
+			}
+
+			cmdBindVertexBuffer(cmd, 1, &gPlaceholderCube.pVertexBuffer, &gPlaceholderCube.mVertexStride, (uint64_t*)NULL);
+			cmdBindIndexBuffer(cmd, gPlaceholderCube.pIndexBuffer, gPlaceholderCube.mIndexType, (uint64_t)NULL);
+			drawPlaceholderCube(cmd, drawConstants, 0, boundsMin, boundsMax);
+			*pTriangleCount += gPlaceholderCubeIndexCount / 3;
+			++*pDrawCount;
+			++*pPlaceholderCount;
+			continue;
+		}
+
+		cmdBindVertexBuffer(cmd, 1, &pModel->pVertexBuffer, &pModel->mVertexStride, (uint64_t*)NULL);
+		cmdBindIndexBuffer(cmd, pModel->pIndexBuffer, pModel->mIndexType, (uint64_t)NULL);
+
+		const MeshAsset& asset = pModel->mAsset;
+		const SceneGraph* pModelSceneGraph = pModel->pSceneGraph;
+		for (uint32_t n = 0; n < asset.mNodeCount; ++n)
+		{
+			const MeshAssetNode& node = asset.pNodes[n];
+			if (node.mMeshIndex == MESH_ASSET_INVALID_NODE)
+				continue;
+
+			const UploadAllocation<DrawConstants> drawConstants = allocateUpload<DrawConstants>(&gUploadArena);
+			if (!drawConstants.getCount())
+				return;
+
+			bindDrawConstants(cmd, drawConstants, 0, pModelSceneGraph->pWorldMatrices[pModelSceneGraph->pSortedIndices[n]], 0, 0, MATERIAL_DEFAULT,
+				pModel->mPositionDequantScale, pModel->mPositionDequantOffset);
+			for (uint32_t i = 0; i < node.mMeshCount; ++i)
+			{
+				const MeshAssetMesh& mesh = asset.pMeshes[node.mMeshIndex + i];
+				cmdDrawIndexed(cmd, mesh.mIndexCount, mesh.mStartIndex, 0);
+				*pTriangleCount += mesh.mIndexCount / 3;
+				++*pDrawCount;
+			}
+		}
+	}
+}
+
+static void updateDrawDescriptorSet(uint32_t index, Texture** ppMaterialTextures)
+{
+	// The root CBV range is only the size of one slot, the offset is supplied per draw
+	DescriptorDataRange drawConstantsRange = { 0, sizeof(DrawConstants) };
+	DescriptorData params[3] = {};
+	params[0].pName = "drawConstants_rootcbv";
+	params[0].ppBuffers = &gUploadArena.ppBuffers[index];
+	params[0].pRanges = &drawConstantsRange;
+	params[1].pName = "materialTextures";
+	params[1].ppTextures = ppMaterialTextures;
+	params[1].mCount = MATERIAL_MAX_TEXTURES;
+	params[2].pName = "baseColorSampler";
+	params[2].ppSamplers = &pBaseColorSampler;
+	updateDescriptorSet(pRenderer, index, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 3, params);
+	memcpy(gBoundMaterialTextures[index], ppMaterialTextures, sizeof(gBoundMaterialTextures[index]));
+}
+
+static Texture* getBaseColorTexture()
+{
+	if (gBaseColorIsBasis)
+		return gBaseColorBasisTexture.mState == BASIS_TEXTURE_STATE_READY ? gBaseColorBasisTexture.pTexture : pPlaceholderTexture;
+	if (gBaseColorStreamedTexture != UINT32_MAX)
+	{
+		Texture* pStreamedTexture = getStreamedTexture(pTextureStreaming, gBaseColorStreamedTexture);
+		return pStreamedTexture ? pStreamedTexture : pPlaceholderTexture;
+	}
+	return isTokenCompleted(&gBaseColorMapToken) ? pBaseColorMap : pPlaceholderTexture;
+}
+
+// Rewrites the texture array of descriptor set index when a texture got resident or was replaced since it was written.
+// Unused entries hold the placeholder, every entry of the array has to be a valid texture.
+static void updateMaterialTextures(uint32_t index)
+{
+	const bool assetTexturesLoaded = isTokenCompleted(&gMaterialTexturesToken);
+	Texture* pTextures[MATERIAL_MAX_TEXTURES];
+	for (uint32_t i = 0; i < MATERIAL_MAX_TEXTURES; ++i)
+		pTextures[i] = pPlaceholderTexture;
+	pTextures[MATERIAL_TEXTURE_SCENE] = getBaseColorTexture();
+	pTextures[MATERIAL_TEXTURE_WHITE] = pWhiteTexture;
+	for (uint32_t i = 0; i < gMaterialTable.mTextureCount; ++i)
+	{
+		Texture* pTexture = pMaterialTextures[i] ? (assetTexturesLoaded ? pMaterialTextures[i] : pPlaceholderTexture) : pWhiteTexture;
+		pTextures[MATERIAL_TEXTURE_FIRST_ASSET + i] = pTexture;
+	}
+
+	if (memcmp(gBoundMaterialTextures[index], pTextures, sizeof(pTextures)) != 0)
+		updateDrawDescriptorSet(index, pTextures);
+}
+
+// Screen space UV density feedback: every visible draw node reports the pixels one UV unit of its meshes covers at the
+// point of its bounds closest to the camera, and the base color map streams towards the mip the densest one needs
+static void requestBaseColorMips()
+{
+	if (!gMeshUvDensities)
+		return;
+
+	// The instance field repeats every node around its position, the nearest copy decides
+	const bool instanced = gDrawMode != DRAW_MODE_PER_NODE && gInstanceCount > 1;
+	const vec3 fieldExtent = instanced ? getInstanceFieldExtent(gInstanceCount) : vec3(0.0f);
+
+	float pixelsPerUv = 0.0f;
+	for (uint32_t d = 0; d < gDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		const uint8_t* pVisibility = gMeshVisibility + node.mFirstBounds;
+
+		vec3 boundsMin, boundsMax;
+		getDrawNodeWorldBounds(node, &boundsMin, &boundsMax);
+		const float pixelsPerMeshUnit =
+			getLodPixelsPerUnit(boundsMin - fieldExtent, boundsMax + fieldExtent, getMaxAxisScale(pSceneGraph->pWorldMatrices[node.mSceneNode]));
+
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const float uvDensity = gMeshUvDensities[node.mMeshIndex + i];
+			if (pVisibility[i] && uvDensity > 0.0f)
+				pixelsPerUv = max(pixelsPerUv, pixelsPerMeshUnit / uvDensity);
+		}
+	}
+
+	if (pixelsPerUv > 0.0f)
+		requestStreamedTexture(pTextureStreaming, gBaseColorStreamedTexture, pixelsPerUv);
+}
+
+// Loads or imports --model and builds what the options ask for from its blobs, everything up to the GPU upload
+static void importScene(SceneImport* pImport)
 {
-	CameraMatrix mViewProjectionMatrix;
-	vec4 mCameraPosition;
-	vec4 mLightColor[gTotalLightCount];
-	vec4 mLightDirection[gLightCount];
-};
-GlobalConstants		gGlobalConstantsData;
-Buffer*				pGlobalConstantsBuffer[gImageCount] = { NULL };
+	char gltfFileName[256] = {};
+	char bakedFileName[256] = {};
+	snprintf(gltfFileName, sizeof(gltfFileName), "%s.gltf", gModelName);
+	snprintf(bakedFileName, sizeof(bakedFileName), "%s.%s", gModelName, MESH_ASSET_EXTENSION);
+
+	HiresTimer loadTimer;
+	initHiresTimer(&loadTimer);
+
+	// A baked file is mapped, otherwise the GLTF is read and parsed once for both the scene tables and the vertex data
+	MeshAsset* pAsset = &pImport->mAsset;
+	const bool baked = !gBakeModel && loadMeshAsset(RD_MESHES, bakedFileName, pAsset);
+	if (!baked && importMeshAsset(gltfFileName, pAsset))
+	{
+		// Optimizing before the bake stores the optimized order, later runs map it without paying for it again
+		if (gOptimizeMeshes)
+			optimizeMeshAsset(pAsset);
+		if (gBakeModel)
+			saveMeshAsset(pAsset, RD_MESHES, bakedFileName);
+	}
+	else if (baked && gOptimizeMeshes)
+	{
+		optimizeMeshAsset(pAsset);
+	}
 
-static float4		gLightColor[gTotalLightCount] = { float4(1.f), float4(1.f), float4(1.f), float4(1.f, 1.f, 1.f, 0.25f) };
-static float		gLightColorIntensity[gTotalLightCount] = { 0.1f, 0.2f, 0.2f, 0.25f };
-static float2		gLightDirection = { -122.0f, 222.0f };
+	if (gBuildMeshlets && pAsset->pVertices)
+		buildMeshlets(pAsset, &pImport->mMeshlets);
+	if (gBuildLods && pAsset->pVertices)
+		buildMeshLods(pAsset, &pImport->mLods);
+	if (gBaseColorStreamedTexture != UINT32_MAX && pAsset->pVertices)
+	{
+		pImport->pUvDensities = (float*)calloc(max(pAsset->mMeshCount, 1u), sizeof(float));
+		computeMeshUvDensities(pAsset, pImport->pUvDensities);
+	}
 
-struct MeshConstants
-{
-	mat4 mModelMatrix;
-};
-MeshConstants		gMeshConstants;
-Buffer*				pMeshConstantsBuffer = NULL;
-GLTFContainer*		pGLTFContainer = NULL;
-mat4*				gNodeTransforms = NULL;
+	pImport->mVertexStride = pAsset->mVertexStride;
+	pImport->mPositionDequantScale = vec4(1.0f);
+	pImport->mPositionDequantOffset = vec4(0.0f);
+	if (gPackedVertices && pAsset->pVertices)
+	{
+		vec3 dequantScale;
+		vec3 dequantOffset;
+		pImport->pPackedVertices = packMeshAssetVertices(pAsset, &dequantScale, &dequantOffset);
+		pImport->mVertexStride = MESH_ASSET_PACKED_VERTEX_STRIDE;
+		pImport->mPositionDequantScale = vec4(dequantScale, 0.0f);
+		pImport->mPositionDequantOffset = vec4(dequantOffset, 0.0f);
+	}
 
-struct MaterialConstants
-{
-	vec4 mBaseColorFactor;
-};
-MaterialConstants	gMaterialConstants;
-Buffer*				pMaterialConstantsBuffer = NULL;
-//***********************************************************************************//
+	LOGF(LogLevel::eINFO, "Loaded '%s' from %s in %.2f ms", gModelName, baked ? bakedFileName : gltfFileName,
+		getHiresTimerUSec(&loadTimer, false) / 1000.0f);
+}
 
-class MeshViewer : public IApp
+static void importSceneTask(void* pUserData, uintptr_t index)
 {
-public:
-	bool Init() override;
-	void Exit() override;
-
-	bool Load() override;
-	void Unload() override;
+	UNREF_PARAM(index);
+	SceneImport* pImport = (SceneImport*)pUserData;
+	importScene(pImport);
+	tfrg_atomic32_store_release(&pImport->mDone, 1);
+}
 
-	void Update(float deltaTime) override;
-	void Draw() override;
+// Hands a finished import over to the scene globals, which hold the empty startup scene or nothing at this point
+static void useSceneImport(SceneImport* pImport)
+{
+	gMeshAsset = pImport->mAsset;
+	gMeshlets = pImport->mMeshlets;
+	gMeshLods = pImport->mLods;
+	gMeshUvDensities = pImport->pUvDensities;
+	gSceneGeometry.pPackedVertices = pImport->pPackedVertices;
+	gSceneGeometry.mVertexStride = pImport->mVertexStride;
+	gSceneGeometry.mPositionDequantScale = pImport->mPositionDequantScale;
+	gSceneGeometry.mPositionDequantOffset = pImport->mPositionDequantOffset;
+	*pImport = {};
+	gSceneImported = true;
+}
 
-	const char* GetName() override { return "01_MeshViewer"; }
+// An import Exit finds done but never picked up
+static void exitSceneImport(SceneImport* pImport)
+{
+	exitMeshAsset(&pImport->mAsset);
+	exitMeshlets(&pImport->mMeshlets);
+	exitMeshLods(&pImport->mLods);
+	free(pImport->pUvDensities);
+	free(pImport->pPackedVertices);
+	*pImport = {};
+}
 
-private:
-	void createSamplers();
-	void createShaders();
-	void createRootSignatures();
-	void createResources();
-	void createConstants();
-	void createDescriptorSets();
-	void createScene();
-	void createGUI();
+// The blobs are on the GPU now, only the flat node and mesh tables are still needed
+static void onSceneResident()
+{
+	releaseMeshAssetBlobs(&gMeshAsset);
+	releaseMeshLodIndices(&gMeshLods);
+	free(gSceneGeometry.pPackedVertices);
+	gSceneGeometry.pPackedVertices = NULL;
+	for (uint32_t i = 0; i < gSceneStagingAllocationCount; ++i)
+		free(gSceneStagingAllocations[i]);
+	gSceneStagingAllocationCount = 0;
+	gSceneResident = true;
+
+	LOGF(LogLevel::eINFO, "Scene resident %.2f ms after startup", getHiresTimerUSec(&gStartupTimer, false) / 1000.0f);
+}
 
-	bool addSwapChain();
-	bool addRenderTargets();
-	bool addDepthBuffer();
-	void addPipelines();
+static void addStreamedModel(void* pUserData)
+{
+	UNREF_PARAM(pUserData);
+	if (gStreamedModelCount == gMaxStreamedModels)
+	{
+		LOGF(LogLevel::eWARNING, "Streaming: at most %u runtime models", gMaxStreamedModels);
+		return;
+	}
 
-	void updateUniformBuffers();
-};
+	// Models line up along -x, away from the instance field's first cells
+	StreamedModelDesc desc = {};
+	desc.pName = gStreamableModelNames[gStreamableModel];
+	desc.mPosition = vec3(-gStreamedModelSpacing * (float)(gStreamedModelCount + 1), 0.0f, 0.0f);
+	desc.mSize = 1.0f;
+	desc.mOptimize = gOptimizeMeshes;
+	desc.mPackVertices = gPackedVertices;
+	requestStreamedModel(pLoadThreadSystem, &desc, &gStreamedModels[gStreamedModelCount++]);
+}
 
 DEFINE_APPLICATION_MAIN(MeshViewer)
 
 bool MeshViewer::Init()
 {
+	initHiresTimer(&gStartupTimer);
+
 	// File paths
 	fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_SHADER_SOURCES, "Shaders");
 	fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_SHADER_BINARIES, "CompiledShaders");
+	// The pipeline cache sits next to the shader binaries it was built from
+	fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_PIPELINE_CACHE, "CompiledShaders");
 	fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_GPU_CONFIG, "GPUCfg");
 	fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_TEXTURES, "Textures");
 	fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_MESHES, "Meshes");
 	fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_FONTS, "Fonts");
 	fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_SCREENSHOTS, "Screenshots");
 	fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_SCRIPTS, "Scripts");
+	fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_OTHER_FILES, "");
+
+	if (parseBenchmarkArgs(IApp::argc, IApp::argv, &gBenchmarkDesc))
+		initBenchmark(&gBenchmarkDesc, &pBenchmark);
+
+	for (int i = 1; i < IApp::argc; ++i)
+	{
+		if (strcmp(IApp::argv[i], "--bake") == 0)
+			gBakeModel = true;
+		else if (strcmp(IApp::argv[i], "--packed-vertices") == 0)
+			gPackedVertices = true;
+		else if (strcmp(IApp::argv[i], "--lods") == 0)
+			gBuildLods = true;
+		else if (strcmp(IApp::argv[i], "--meshlet-culling") == 0)
+			gBuildMeshlets = gMeshletCulling = true;
+		else if (strcmp(IApp::argv[i], "--optimize-meshes") == 0)
+			gOptimizeMeshes = true;
+		else if (strcmp(IApp::argv[i], "--stream") == 0)
+			gStreamAssets = true;
+		else if (strcmp(IApp::argv[i], "--frames-in-flight") == 0 && i + 1 < IApp::argc)
+			gFramesInFlight = clamp((uint32_t)atoi(IApp::argv[++i]), 1u, gMaxFramesInFlight);
+		else if (strcmp(IApp::argv[i], "--swapchain-images") == 0 && i + 1 < IApp::argc)
+			gSwapchainImageCount = max((uint32_t)atoi(IApp::argv[++i]), 2u);
+		else if (strcmp(IApp::argv[i], "--mip-streaming") == 0)
+			gMipStreaming = true;
+		else if (strcmp(IApp::argv[i], "--texture-budget") == 0 && i + 1 < IApp::argc)
+			gTextureBudgetMB = max((float)atof(IApp::argv[++i]), 0.0f);
+		else if (strcmp(IApp::argv[i], "--lights") == 0 && i + 1 < IApp::argc)
+			gClusteredLightCount = min((uint32_t)atoi(IApp::argv[++i]), gMaxClusteredLightCount);
+		else if (strcmp(IApp::argv[i], "--depth-prepass") == 0)
+			gDepthPrepass = true;
+		else if (strcmp(IApp::argv[i], "--occlusion-culling") == 0)
+			gGpuCulling = gOcclusionCulling = true;
+		else if (strcmp(IApp::argv[i], "--sort-draws") == 0)
+			gSortDraws = true;
+		else if (strcmp(IApp::argv[i], "--shadows") == 0)
+			gShadows = true;
+		else if (strcmp(IApp::argv[i], "--no-shadow-cache") == 0)
+			gShadowCaching = false;
+		else if (strcmp(IApp::argv[i], "--model") == 0 && i + 1 < IApp::argc)
+			gModelName = IApp::argv[++i];
+	}
 
 	// Window and renderer setup
 	RendererDesc settings;
@@ -168,7 +2047,7 @@ bool MeshViewer::Init()
 	queueDesc.mFlag = QUEUE_FLAG_INIT_MICROPROFILE;
 
 	addQueue(pRenderer, &queueDesc, &pGraphicsQueue);
-	for (uint32_t i = 0; i < gImageCount; ++i)
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
 	{
 		CmdPoolDesc cmdPoolDesc = {};
 		cmdPoolDesc.pQueue = pGraphicsQueue;
@@ -176,9 +2055,22 @@ bool MeshViewer::Init()
 		CmdDesc cmdDesc = {};
 		cmdDesc.pPool = pCmdPools[i];
 		addCmd(pRenderer, &cmdDesc, &pCmds[i]);
+		addCmd(pRenderer, &cmdDesc, &pPostCmds[i]);
+
+		for (uint32_t t = 0; t < gMaxRecordThreads; ++t)
+		{
+			addCmdPool(pRenderer, &cmdPoolDesc, &pRecordCmdPools[i][t]);
+			cmdDesc.pPool = pRecordCmdPools[i][t];
+			addCmd(pRenderer, &cmdDesc, &pRecordCmds[i][t]);
+		}
 	}
 
-	for (uint32_t i = 0; i < gImageCount; ++i)
+	initThreadSystem(&pThreadSystem);
+	// A single thread keeps runtime model loads off the record threads and in request order
+	initThreadSystem(&pLoadThreadSystem, 1);
+	initThreadSystem(&pTranscodeThreadSystem);
+
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
 	{
 		addFence(pRenderer, &pRenderCompleteFences[i]);
 		addSemaphore(pRenderer, &pRenderCompleteSemaphores[i]);
@@ -187,24 +2079,12 @@ bool MeshViewer::Init()
 
 	initResourceLoaderInterface(pRenderer);
 
-	//*****************************************************************************//
-	//*                              USER TODO                                    *//
-	//*****************************************************************************//
-
-	createSamplers();
-	createShaders();
-	createRootSignatures();
-	createResources();
-	createConstants();
-
-	waitForAllResourceLoads();
-
-	createDescriptorSets();
-	createScene();
-	createGUI();
-
-	//*****************************************************************************//
+	PipelineCacheLoadDesc pipelineCacheDesc = {};
+	pipelineCacheDesc.pFileName = gPipelineCacheName;
+	loadPipelineCache(pRenderer, &pipelineCacheDesc, &pPipelineCache);
+	initDeferredRemovalQueue(pRenderer, gMaxFramesInFlight, &gDeferredRemovals);
 
+	// Fonts, UI and profiler come up before the scene, so their uploads are ahead of it in the copy queue
 	// Load fonts
 	FontDesc font = {};
 	font.pFontPath = "TitilliumText/TitilliumText-Bold.otf";
@@ -230,8 +2110,56 @@ bool MeshViewer::Init()
 	// Gpu profiler can only be added after initProfile.
 	gGpuProfileToken = addGpuProfiler(pRenderer, pGraphicsQueue, "Graphics");
 
+	//*****************************************************************************//
+	//*                              USER TODO                                    *//
+	//*****************************************************************************//
+
+	createSamplers();
+	HiresTimer shaderTimer;
+	initHiresTimer(&shaderTimer);
+	createShaders();
+	LOGF(LogLevel::eINFO, "Shader binaries loaded in %.2f ms", getHiresTimerUSec(&shaderTimer, false) / 1000.0f);
+	createRootSignatures();
+	// Everything the first frame needs is small and does not depend on the scene size, the only uploads startup waits for
+	createPlaceholders();
 	waitForAllResourceLoads();
 
+	createResources();
+	// The draw nodes and mesh bounds size the GPU culling buffers
+	createScene();
+	createConstants();
+
+	// With --stream the first frames draw an empty scene, then placeholders, Update picks the scene up once its import is
+	// done and again once its token completes
+	if (!gStreamAssets)
+	{
+		// Queues the upload of every transcoded image, the second update sees them land
+		if (gBaseColorIsBasis)
+		{
+			waitThreadSystemIdle(pTranscodeThreadSystem);
+			updateBasisTexture(&gBaseColorBasisTexture);
+		}
+		waitForAllResourceLoads();
+		if (gBaseColorIsBasis)
+			updateBasisTexture(&gBaseColorBasisTexture);
+		onSceneResident();
+	}
+
+	createDescriptorSets();
+	createGUI();
+
+	initHiresTimer(&gSubmitTimer);
+	initHiresTimer(&gDrawSortTimer);
+	initHiresTimer(&gSceneUpdateTimer);
+	initHiresTimer(&gCullTimer);
+	initHiresTimer(&gFrameTimer);
+
+	//*****************************************************************************//
+
+	// Headless runs are driven by the benchmark camera path only
+	if (gBenchmarkDesc.mHeadless)
+		return true;
+
 	InputSystemDesc inputDesc = {};
 	inputDesc.pRenderer = pRenderer;
 	inputDesc.pWindow = pWindow;
@@ -276,7 +2204,16 @@ bool MeshViewer::Init()
 
 void MeshViewer::Exit()
 {
-	exitInputSystem();
+	// Unload leaves the pipelines to the next Load, and headless runs have no swapchain Unload would wait for
+	waitQueueIdle(pGraphicsQueue);
+	removePipelines();
+	exitDeferredRemovalQueue(&gDeferredRemovals);
+
+	if (!gBenchmarkDesc.mHeadless)
+		exitInputSystem();
+
+	exitBenchmark(pBenchmark);
+	pBenchmark = NULL;
 
 	exitCameraController(pCameraController);
 
@@ -289,46 +2226,145 @@ void MeshViewer::Exit()
 	//*****************************************************************************//
 	//*                              USER TODO                                    *//
 	//*****************************************************************************//
+	// Streamed resources can still be in flight
+	waitThreadSystemIdle(pLoadThreadSystem);
+	waitThreadSystemIdle(pTranscodeThreadSystem);
+	waitForAllResourceLoads();
+	for (uint32_t i = 0; i < gStreamedModelCount; ++i)
+		exitStreamedModel(&gStreamedModels[i]);
+	gStreamedModelCount = 0;
+	for (uint32_t i = 0; i < gSceneStagingAllocationCount; ++i)
+		free(gSceneStagingAllocations[i]);
+	gSceneStagingAllocationCount = 0;
+	exitSceneImport(&gSceneImport);
+
 	// Remove Descriptor Sets
+	removeSceneDescriptorSets(false);
 	removeDescriptorSet(pRenderer, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
-	removeDescriptorSet(pRenderer, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	removeDescriptorSet(pRenderer, pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	removeDescriptorSet(pRenderer, pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	removeDescriptorSet(pRenderer, pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	removeDescriptorSet(pRenderer, pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
 
 	// Remove Resources
-	removeResource(pMeshConstantsBuffer);
-	removeResource(pMaterialConstantsBuffer);
-	for (uint32_t i = 0; i < gImageCount; ++i)
+	exitUploadArena(&gUploadArena);
+	removeSceneBuffers(false);
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		removeResource(pCullConstantsBuffers[i]);
+		removeResource(pClusterCullConstantsBuffers[i]);
+		removeResource(pLightBinConstantsBuffers[i]);
+		removeResource(pLightsBuffers[i]);
+		removeResource(pShadowInstancesBuffers[i]);
+		removeResource(pClusterLightCountsReadbackBuffers[i]);
+		gClusterLightCountsWritten[i] = false;
+		removeResource(pOcclusionCountersReadbackBuffers[i]);
+		gOcclusionCountersWritten[i] = false;
+	}
+	removeResource(pClusterLightCountsBuffer);
+	removeResource(pClusterLightIndicesBuffer);
+	exitLightField(&gLightField);
+	removeRenderTarget(pRenderer, pShadowMap);
+	pShadowMap = NULL;
+	removeResource(pOcclusionRetestBuffer);
+	removeResource(pOcclusionCountersBuffer);
+	removeResource(pOcclusionDispatchArgsBuffer);
+	removeResource(pOcclusionResetBuffer);
+	exitMeshlets(&gMeshlets);
+	exitMeshLods(&gMeshLods);
+	removeResource(pInstanceTransformsBuffer);
+	free(gInstanceTransforms);
+	gInstanceTransforms = NULL;
+	if (pBaseColorMap)
+		removeResource(pBaseColorMap);
+	for (uint32_t i = 0; i < gMaterialTable.mTextureCount; ++i)
 	{
-		removeResource(pGlobalConstantsBuffer[i]);
+		if (pMaterialTextures[i])
+			removeResource(pMaterialTextures[i]);
+		pMaterialTextures[i] = NULL;
 	}
-	removeResource(pBaseColorMap);
-	removeResource(pGeometry);
-	gltfUnloadContainer(pGLTFContainer);
-	pGLTFContainer = NULL;
-	gNodeTransforms = NULL;
+	removeResource(pMaterialsBuffer);
+	exitMaterialTable(&gMaterialTable);
+	exitTextureStreaming(pTextureStreaming);
+	pTextureStreaming = NULL;
+	exitBasisTexture(&gBaseColorBasisTexture);
+	gBaseColorIsBasis = false;
+	gBaseColorStreamedTexture = UINT32_MAX;
+	free(gMeshUvDensities);
+	gMeshUvDensities = NULL;
+	removeResource(pPlaceholderTexture);
+	removeResource(pWhiteTexture);
+	removeResource(gPlaceholderCube.pVertexBuffer);
+	removeResource(gPlaceholderCube.pIndexBuffer);
+	free(gPlaceholderCube.pPackedVertices);
+	gPlaceholderCube = {};
+	if (gSceneGeometry.pVertexBuffer)
+		removeResource(gSceneGeometry.pVertexBuffer);
+	if (gSceneGeometry.pIndexBuffer)
+		removeResource(gSceneGeometry.pIndexBuffer);
+	gSceneGeometry = {};
+	exitMeshAsset(&gMeshAsset);
+	removeSceneNodes();
+	gSceneImported = false;
+
+	// Remove Command Signatures
+	removeIndirectCommandSignature(pRenderer, pIndirectDrawCommandSignature);
+	removeIndirectCommandSignature(pRenderer, pIndirectDispatchCommandSignature);
 
 	// Remove Root Signatures
 	removeRootSignature(pRenderer, pBasicRootSignature);
+	removeRootSignature(pRenderer, pCullRootSignature);
+	removeRootSignature(pRenderer, pClusterCullRootSignature);
+	removeRootSignature(pRenderer, pLightBinRootSignature);
+	removeRootSignature(pRenderer, pHiZRootSignature);
 
 	// Remove Shaders
 	removeShader(pRenderer, pBasicShader);
+	removeShader(pRenderer, pCullShader);
+	removeShader(pRenderer, pClusterCullShader);
+	removeShader(pRenderer, pLightBinShader);
+	removeShader(pRenderer, pDepthPrepassShader);
+	removeShader(pRenderer, pShadowShader);
+	removeShader(pRenderer, pCullLateShader);
+	removeShader(pRenderer, pHiZDepthShader);
+	removeShader(pRenderer, pHiZReduceShader);
 
 	// Remove Samplers
 	removeSampler(pRenderer, pBaseColorSampler);
 	//*****************************************************************************//
 
-	for (uint32_t i = 0; i < gImageCount; ++i)
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
 	{
 		removeFence(pRenderer, pRenderCompleteFences[i]);
 		removeSemaphore(pRenderer, pRenderCompleteSemaphores[i]);
 	}
 	removeSemaphore(pRenderer, pImageAcquiredSemaphore);
 
-	for (uint32_t i = 0; i < gImageCount; ++i)
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
 	{
+		for (uint32_t t = 0; t < gMaxRecordThreads; ++t)
+		{
+			removeCmd(pRenderer, pRecordCmds[i][t]);
+			removeCmdPool(pRenderer, pRecordCmdPools[i][t]);
+		}
+		removeCmd(pRenderer, pPostCmds[i]);
 		removeCmd(pRenderer, pCmds[i]);
 		removeCmdPool(pRenderer, pCmdPools[i]);
 	}
 
+	shutdownThreadSystem(pThreadSystem);
+	shutdownThreadSystem(pLoadThreadSystem);
+	shutdownThreadSystem(pTranscodeThreadSystem);
+
+	if (pPipelineCache)
+	{
+		PipelineCacheSaveDesc pipelineCacheSaveDesc = {};
+		pipelineCacheSaveDesc.pFileName = gPipelineCacheName;
+		savePipelineCache(pRenderer, pPipelineCache, &pipelineCacheSaveDesc);
+		removePipelineCache(pRenderer, pPipelineCache);
+		pPipelineCache = NULL;
+	}
+
 	exitResourceLoaderInterface(pRenderer);
 	removeQueue(pRenderer, pGraphicsQueue);
 	exitRenderer(pRenderer);
@@ -337,6 +2373,9 @@ void MeshViewer::Exit()
 
 bool MeshViewer::Load()
 {
+	HiresTimer loadTimer;
+	initHiresTimer(&loadTimer);
+
 	if (!addSwapChain())
 		return false;
 
@@ -346,54 +2385,100 @@ bool MeshViewer::Load()
 	if (!addDepthBuffer())
 		return false;
 
+	if (!addHiZPyramid())
+		return false;
+
 	// LOAD USER INTERFACE
 	RenderTarget* ppPipelineRenderTargets[] = {
-		pSwapChain->ppRenderTargets[0],
+		getOutputRenderTarget(0),
 		pDepthBuffer,
 	};
 
-	if (!addFontSystemPipelines(ppPipelineRenderTargets, 2, NULL))
-		return false;
+	HiresTimer pipelineTimer;
+	initHiresTimer(&pipelineTimer);
+	gPipelinesMs = 0.0f;
+	if (gPipelineColorFormat != ppPipelineRenderTargets[0]->mFormat)
+	{
+		removePipelines();
 
-	if (!addUserInterfacePipelines(ppPipelineRenderTargets[0]))
-		return false;
+		if (!addFontSystemPipelines(ppPipelineRenderTargets, 2, pPipelineCache))
+			return false;
+
+		if (!addUserInterfacePipelines(ppPipelineRenderTargets[0]))
+			return false;
+
+		addPipelines();
+		gPipelineColorFormat = ppPipelineRenderTargets[0]->mFormat;
+		gPipelinesMs = getHiresTimerUSec(&pipelineTimer, false) / 1000.0f;
+	}
 
-	addPipelines();
+	// The first Load is part of startup, later ones are the hitch of a resize or fullscreen toggle
+	gLoadMs = getHiresTimerUSec(&loadTimer, false) / 1000.0f;
+	LOGF(LogLevel::eINFO, "%s took %.2f ms, %.2f ms of it in addPipelines", gLoadCount ? "Swapchain recreation" : "First load", gLoadMs, gPipelinesMs);
+	++gLoadCount;
 
 	return true;
 }
 
 void MeshViewer::Unload()
 {
-	waitQueueIdle(pGraphicsQueue);
-
-	removeUserInterfacePipelines();
-
-	removeFontSystemPipelines();
-
-	//*****************************************************************************//
-	//*                     USER TODO :  Remove Pipelines                         *//
-	//*****************************************************************************//
-
-	removePipeline(pRenderer, pBasicPipeline);
-
-	//*****************************************************************************//
-
-	removeSwapChain(pRenderer, pSwapChain);
+	// Pipelines stay for the next Load, see gPipelineColorFormat. The swapchain is the one thing that cannot be retired
+	// later: the window takes no second swapchain, so the frames presenting from this one have to finish first. Every
+	// resize pays this drain, addSwapChain cannot hand the old swapchain to the new one (Vulkan oldSwapchain) and
+	// D3D12 only resizes back buffers no frame uses.
+	const bool queueIdle = pSwapChain != NULL;
+	if (pSwapChain)
+	{
+		waitQueueIdle(pGraphicsQueue);
+		removeSwapChain(pRenderer, pSwapChain);
+	}
+	pSwapChain = NULL;
 
 
 	//*****************************************************************************//
 	//*                    USER TODO :  Remove Render Targets                     *//
 	//*****************************************************************************//
 
-	removeRenderTarget(pRenderer, pDepthBuffer);
+	// Nothing can use them after the drain above. Headless runs have no swapchain and never drain, their frames in flight
+	// keep the targets until the deferred removal queue lets them go.
+	if (queueIdle)
+	{
+		removeRenderTarget(pRenderer, pDepthBuffer);
+		removeResource(pHiZTexture);
+	}
+	else
+	{
+		deferRemoveRenderTarget(&gDeferredRemovals, pDepthBuffer);
+		deferRemoveTexture(&gDeferredRemovals, pHiZTexture);
+		deferRemoveRenderTarget(&gDeferredRemovals, pOffscreenTarget);
+	}
+	pDepthBuffer = NULL;
+	pHiZTexture = NULL;
+	pOffscreenTarget = NULL;
 
 	//*****************************************************************************//
 }
 
 void MeshViewer::Update(float deltaTime)
 {
-	updateInputSystem(mSettings.mWidth, mSettings.mHeight);
+	resetHiresTimer(&gFrameTimer);
+
+	// The slot is waited for before the input is sampled, not after, so the wait does not add to the input's age
+	waitForFrameSlot();
+
+	if (!gBenchmarkDesc.mHeadless)
+		updateInputSystem(mSettings.mWidth, mSettings.mHeight);
+	gFrameLatencies[gFrameIndex].mInputUSec = getUSec(false);
+
+	if (pBenchmark)
+	{
+		// Fixed time step and camera path so every run renders the same frames
+		deltaTime = 1.0f / 60.0f;
+		vec3 cameraPosition, cameraLookAt;
+		getBenchmarkCameraPose(pBenchmark, &cameraPosition, &cameraLookAt);
+		pCameraController->moveTo(cameraPosition);
+		pCameraController->lookAt(cameraLookAt);
+	}
 
 	pCameraController->update(deltaTime);
 
@@ -408,6 +2493,10 @@ void MeshViewer::Update(float deltaTime)
 	CameraMatrix projMat = CameraMatrix::perspective(horizontal_fov, aspectInverse, 0.1f, 1000.0f);
 	CameraMatrix projViewMat = projMat * viewMat;
 
+	// Horizontal pixels one world unit covers at distance 1, LOD selection divides it by the distance of each box
+	gLodProjectionScale = (float)mSettings.mWidth * 0.5f / tanf(horizontal_fov * 0.5f);
+	gLodCameraPosition = pCameraController->getViewPosition();
+
 	gGlobalConstantsData.mViewProjectionMatrix = projViewMat;
 	gGlobalConstantsData.mCameraPosition = vec4(pCameraController->getViewPosition(), 1.0f);
 
@@ -428,36 +2517,146 @@ void MeshViewer::Update(float deltaTime)
 	gGlobalConstantsData.mLightDirection[1] = vec4(-sunDirection.getX(), sunDirection.getY(), -sunDirection.getZ(), 0.0f);
 	gGlobalConstantsData.mLightDirection[2] = vec4(-sunDirection.getX(), -sunDirection.getY(), -sunDirection.getZ(), 0.0f);
 
+	// Clustered lights, binned with this view in Draw
+	if (gAnimateLights)
+		gLightTime += deltaTime;
+	const float tanHalfFovX = tanf(horizontal_fov * 0.5f);
+	gClusterProjection = vec4(tanHalfFovX, tanHalfFovX * aspectInverse, gClusterNear, gClusterFar);
+	gGlobalConstantsData.mViewMatrix = viewMat;
+	gGlobalConstantsData.mClusterScale = getClusterScale(mSettings.mWidth, mSettings.mHeight, gClusterNear, gClusterFar);
+
+	// The fence of this slot has been waited on, so its copy of the cluster light counts is complete
+	if (gClusterLightCountsWritten[gFrameIndex])
+		computeClusterLightStats((const uint32_t*)pClusterLightCountsReadbackBuffers[gFrameIndex]->pCpuMappedAddress, &gClusterLightStats);
+
+	// Same for the occlusion counters of the last frame recorded into this slot
+	if (gOcclusionCountersWritten[gFrameIndex])
+	{
+		const uint32_t* pCounters = (const uint32_t*)pOcclusionCountersReadbackBuffers[gFrameIndex]->pCpuMappedAddress;
+		gOcclusionStats.mRetestCount = min(pCounters[0], gOcclusionRetestCapacity);
+		gOcclusionStats.mOverflowCount = pCounters[0] - gOcclusionStats.mRetestCount;
+		gOcclusionStats.mLateVisibleCount = pCounters[1];
+	}
+
+	// The streamed import is picked up before the scene update, so its nodes are updated and culled this frame
+	if (!gSceneImported && tfrg_atomic32_load_acquire(&gSceneImport.mDone))
+		addImportedScene();
+	// Occlusion culling enabled from the GUI for the first time or an instance count outside the segments, the new
+	// buffers are ready before this frame's cull pass
+	if ((gOcclusionCulling && !gOcclusionBuffers) || getVisibleInstanceCapacity(gInstanceCount) != gVisibleInstanceCapacity)
+		resizeGpuCullBuffers();
+	if (getLodInstanceCapacity() != gLodInstanceCapacity)
+		resizeLodInstanceBuffers();
+	// Warned once whenever the regions stop fitting
+	const bool lodInstancesOverflow =
+		isLodSelectionActive() && gDrawMode == DRAW_MODE_INSTANCED && (uint64_t)gDrawNodeCount * gInstanceCount > gLodInstanceCapacity;
+	if (lodInstancesOverflow && !gLodInstanceCapacityWarned)
+		LOGF(LogLevel::eWARNING, "LOD: %u draw nodes of %u instances pass %u LOD instances, only the first %u nodes select levels", gDrawNodeCount,
+			gInstanceCount, gMaxLodInstances, gLodInstanceCapacity / gInstanceCount);
+	gLodInstanceCapacityWarned = lodInstancesOverflow;
+
 	// Animation
+	if (gAnimateScene && pSceneGraph->mLevelCount)
+	{
+		// Spin every root around its own origin, the scene graph only recomputes the subtrees below them
+		const Quat spin = Quat::rotationY(deltaTime * gAnimationSpeed);
+		for (uint32_t i = pSceneGraph->pLevelOffsets[0]; i < pSceneGraph->pLevelOffsets[1]; ++i)
+		{
+			sceneGraphSetLocalTRS(pSceneGraph, i, pSceneGraph->pTranslations[i], normalize(spin * pSceneGraph->pRotations[i]), pSceneGraph->pScales[i]);
+		}
+	}
+
+	resetHiresTimer(&gSceneUpdateTimer);
+	gFrameStats.mUpdatedNodeCount = updateSceneGraph(pSceneGraph);
+	gFrameStats.mSceneUpdateMs = (float)getHiresTimerUSec(&gSceneUpdateTimer, false) / 1000.0f;
+
+	updateMeshWorldBounds(false);
+	cullScene(projViewMat.getPrimaryMatrix());
+
+	// Streaming
+	if (gPlaceholderCube.pPackedVertices && isTokenCompleted(&gPlaceholderCube.mUploadToken))
+	{
+		free(gPlaceholderCube.pPackedVertices);
+		gPlaceholderCube.pPackedVertices = NULL;
+	}
+	if (gSceneImported && !gSceneResident && isTokenCompleted(&gSceneGeometry.mUploadToken))
+		onSceneResident();
+	for (uint32_t i = 0; i < gStreamedModelCount; ++i)
+		updateStreamedModel(&gStreamedModels[i]);
+	if (gBaseColorIsBasis)
+		updateBasisTexture(&gBaseColorBasisTexture);
+	if (gBaseColorStreamedTexture != UINT32_MAX)
+		requestBaseColorMips();
+
+	// Shadows, once the scene is resident. The cascades are placed for this view, the ones that keep their cache keep
+	// the matrix they were rendered with.
+	gShadowPassActive = gShadows && gSceneResident;
+	gGlobalConstantsData.mShadowParams = vec4(gShadowPassActive ? 1.0f : 0.0f, (float)gShadowMapSize, gShadowNormalOffset, gShadowDepthBias);
+	if (gShadowPassActive)
+	{
+		const uint32_t shadowInstanceCount = gDrawMode == DRAW_MODE_PER_NODE || gMeshletCulling ? 1 : gInstanceCount;
+		if (gFrameStats.mUpdatedNodeCount || shadowInstanceCount != gShadowInstanceCount)
+			invalidateShadowCascades(&gShadowCascades, SHADOW_REFRESH_CASTERS);
+		gShadowInstanceCount = shadowInstanceCount;
+
+		vec3 sceneMin, sceneMax;
+		getSceneWorldBounds(gShadowInstanceCount, &sceneMin, &sceneMax);
+		updateShadowCascades(&gShadowCascades, viewMat, tanHalfFovX, tanHalfFovX * aspectInverse, sunDirection, sceneMin, sceneMax, gShadowCaching);
+
+		float splits[SHADOW_CASCADE_COUNT];
+		float texelSizes[SHADOW_CASCADE_COUNT];
+		for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+		{
+			const ShadowCascade& cascade = gShadowCascades.mCascades[i];
+			gGlobalConstantsData.mShadowMatrices[i] = cascade.mShadowMatrix;
+			splits[i] = cascade.mSplitFar;
+			texelSizes[i] = 2.0f * cascade.mRadius / (float)gShadowMapSize;
+		}
+		gGlobalConstantsData.mShadowSplits = vec4(splits[0], splits[1], splits[2], splits[3]);
+		gGlobalConstantsData.mShadowTexelSizes = vec4(texelSizes[0], texelSizes[1], texelSizes[2], texelSizes[3]);
+	}
+	else
+	{
+		// Whatever the slices hold is stale by the time shadows come back
+		invalidateShadowCascades(&gShadowCascades, SHADOW_REFRESH_INVALID);
+	}
 
 	//*****************************************************************************//
 }
 
 void MeshViewer::Draw()
 {
-	if (pSwapChain->mEnableVsync != mSettings.mVSyncEnabled)
-	{
-		waitQueueIdle(pGraphicsQueue);
-		::toggleVSync(pRenderer, &pSwapChain);
-	}
+	const bool headless = gBenchmarkDesc.mHeadless;
 
-	uint32_t swapchainImageIndex;
-	acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL, &swapchainImageIndex);
+	uint32_t swapchainImageIndex = 0;
+	if (!headless)
+	{
+		if (pSwapChain->mEnableVsync != mSettings.mVSyncEnabled)
+		{
+			if (isVSyncToggleRecreatingSwapChain())
+				waitQueueIdle(pGraphicsQueue);
+			::toggleVSync(pRenderer, &pSwapChain);
+		}
 
-	// Stall if CPU is running "Swap Chain Buffer Count" frames ahead of GPU
-	Fence*      pNextFence = pRenderCompleteFences[gFrameIndex];
-	FenceStatus fenceStatus;
-	getFenceStatus(pRenderer, pNextFence, &fenceStatus);
-	if (fenceStatus == FENCE_STATUS_INCOMPLETE)
-		waitForFences(pRenderer, 1, &pNextFence);
+		acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL, &swapchainImageIndex);
+	}
 
 	resetCmdPool(pRenderer, pCmdPools[gFrameIndex]);
 
-	//*****************************************************************************//
-	//*                     USER TODO : Update Uniform Buffers                    *//
-	//*****************************************************************************//
-	updateUniformBuffers();
-	//*****************************************************************************//
+	// The slot wait in Update guarantees the GPU is done with this frame's upload arena
+	resetUploadArena(&gUploadArena, gFrameIndex);
+	gGlobalConstantsUpload = allocateUpload<GlobalConstants>(&gUploadArena);
+	ASSERT(gGlobalConstantsUpload.getOffset(0) == 0);
+	// and with everything retired gMaxFramesInFlight frames ago
+	updateDeferredRemovalQueue(&gDeferredRemovals);
+
+	// and with this frame's descriptor sets, so a streamed texture can replace the one they sample
+	if (pTextureStreaming)
+	{
+		pTextureStreaming->mDesc.mBudgetBytes = (uint64_t)(gTextureBudgetMB * 1024.0f * 1024.0f);
+		updateTextureStreaming(pTextureStreaming);
+	}
+	updateMaterialTextures(gFrameIndex);
 
 	Semaphore* pRenderCompleteSemaphore = pRenderCompleteSemaphores[gFrameIndex];
 	Fence*     pRenderCompleteFence = pRenderCompleteFences[gFrameIndex];
@@ -470,15 +2669,109 @@ void MeshViewer::Draw()
 	//*                              USER TODO                                    *//
 	//*****************************************************************************//
 
-	RenderTarget* pRenderTarget = pSwapChain->ppRenderTargets[swapchainImageIndex];
+	RenderTarget* pRenderTarget = getOutputRenderTarget(swapchainImageIndex);
+	// The offscreen target rests in the state a readback or blit would expect
+	const ResourceState outputState = headless ? RESOURCE_STATE_SHADER_RESOURCE : RESOURCE_STATE_PRESENT;
 
 	RenderTargetBarrier barriers[] =    // wait for resource transition
 	{
-		{ pRenderTarget, RESOURCE_STATE_PRESENT, RESOURCE_STATE_RENDER_TARGET },
+		{ pRenderTarget, outputState, RESOURCE_STATE_RENDER_TARGET },
 	};
 	cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
 
+	// Placeholders stand in for every draw node until the scene is resident, the GPU paths need its buffers
+	const bool meshletCulling = gMeshletCulling && gSceneResident && gMeshlets.mMeshletCount;
+	const bool gpuCulling = gGpuCulling && gSceneResident;
+	const uint32_t instanceCount = gDrawMode == DRAW_MODE_PER_NODE || meshletCulling || !gSceneResident ? 1 : gInstanceCount;
+	// Both GPU culling paths issue one indirect draw per draw mesh, meshlet culling takes precedence
+	const bool gpuDriven = meshletCulling || gpuCulling;
+	const bool occlusionCulling = gpuCulling && !meshletCulling && gOcclusionCulling;
+	if (meshletCulling)
+		cullClustersGpu(cmd, gGlobalConstantsData.mViewProjectionMatrix.getPrimaryMatrix(), gGlobalConstantsData.mCameraPosition.getXYZ());
+	else if (gpuCulling)
+		cullSceneGpu(cmd, gGlobalConstantsData.mViewProjectionMatrix.getPrimaryMatrix(), instanceCount, occlusionCulling);
+	// The pyramid built this frame is what the next one tests against
+	gHiZValid = occlusionCulling;
+	binLightsGpu(cmd, gGlobalConstantsData.mViewMatrix, instanceCount);
+	if (gShadowPassActive)
+		drawShadowCascades(cmd);
+
+	Cmd*     ppSubmitCmds[gMaxRecordThreads + 2] = {};
+	uint32_t submitCmdCount = 0;
+
 	{
+		resetHiresTimer(&gSubmitTimer);
+
+		// The CPU recorded paths draw the nodes in gDrawOrder, placeholders stand in for every node
+		const bool cpuRecorded = gSceneResident && !gpuDriven;
+		gFrameStats.mDrawSortMs = 0.0f;
+		if (cpuRecorded)
+		{
+			resetHiresTimer(&gDrawSortTimer);
+			buildDrawOrder(gSortDraws, gGlobalConstantsData.mCameraPosition.getXYZ());
+			gFrameStats.mDrawSortMs = (float)getHiresTimerUSec(&gDrawSortTimer, false) / 1000.0f;
+		}
+
+		// Placeholders take one slot per draw node, GPU culled draws one per mesh and the CPU recorded paths
+		// getDrawSlotsPerMesh() per mesh
+		const uint32_t slotsPerMesh = gpuDriven ? 1 : getDrawSlotsPerMesh();
+		const UploadAllocation<DrawConstants> drawConstants =
+			allocateUpload<DrawConstants>(&gUploadArena, gSceneResident ? gMeshWorldBounds.mCount * slotsPerMesh : gDrawNodeCount);
+		const uint32_t drawNodeCount = cpuRecorded ? gDrawOrder.mCount : drawConstants.getCount();
+		// The late draws of occlusion culling read their own half of the visible instances
+		UploadAllocation<DrawConstants> lateDrawConstants = {};
+		if (occlusionCulling)
+			lateDrawConstants = allocateUpload<DrawConstants>(&gUploadArena, gMeshWorldBounds.mCount);
+		if (gDrawMode == DRAW_MODE_INDIRECT && !gpuDriven)
+			updateIndirectDrawArgs();
+
+		// Depth only pass over the same draws, the scene pass below then only shades the surface that ends up visible.
+		// It selects the LOD levels the scene pass replays.
+		const bool depthPrepass = gDepthPrepass && gSceneResident;
+		Pipeline* pScenePipeline = depthPrepass ? pBasicEqualPipeline : pBasicPipeline;
+		if (depthPrepass)
+		{
+			cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Depth Prepass");
+
+			LoadActionsDesc prepassLoadActions = {};
+			prepassLoadActions.mLoadActionDepth = LOAD_ACTION_CLEAR;
+			prepassLoadActions.mClearDepth.depth = 1.0f;
+			prepassLoadActions.mClearDepth.stencil = 0;
+			cmdBindRenderTargets(cmd, 0, NULL, pDepthBuffer, &prepassLoadActions, NULL, NULL, -1, -1);
+			cmdSetViewport(cmd, 0.0f, 0.0f, (float)pRenderTarget->mWidth, (float)pRenderTarget->mHeight, 0.0f, 1.0f);
+			cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
+
+			// Counted by the scene pass
+			uint32_t prepassDrawCount = 0;
+			uint64_t prepassTriangleCount = 0;
+			uint32_t prepassLodCounts[MESH_LOD_MAX_LEVELS] = {};
+			if (meshletCulling)
+				drawSceneClusterCulled(cmd, pDepthPrepassPipeline, drawConstants, &prepassDrawCount, &prepassTriangleCount);
+			else if (gpuCulling)
+				drawSceneGpuCulled(cmd, pDepthPrepassPipeline, drawConstants, false, instanceCount, &prepassDrawCount, &prepassTriangleCount);
+			else
+				drawSceneRange(cmd, pDepthPrepassPipeline, false, 0, drawNodeCount, drawConstants, &prepassDrawCount, &prepassTriangleCount,
+					prepassLodCounts);
+
+			cmdBindRenderTargets(cmd, 0, NULL, 0, NULL, NULL, NULL, -1, -1);
+
+			// The prepass is where occlusion culling gets its pyramid, the scene pass then draws both phases
+			if (occlusionCulling)
+			{
+				buildHiZPyramid(cmd);
+				cullSceneGpuLate(cmd);
+
+				prepassLoadActions.mLoadActionDepth = LOAD_ACTION_LOAD;
+				cmdBindRenderTargets(cmd, 0, NULL, pDepthBuffer, &prepassLoadActions, NULL, NULL, -1, -1);
+				cmdSetViewport(cmd, 0.0f, 0.0f, (float)pRenderTarget->mWidth, (float)pRenderTarget->mHeight, 0.0f, 1.0f);
+				cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
+				drawSceneGpuCulled(cmd, pDepthPrepassPipeline, lateDrawConstants, true, instanceCount, &prepassDrawCount, &prepassTriangleCount);
+				cmdBindRenderTargets(cmd, 0, NULL, 0, NULL, NULL, NULL, -1, -1);
+			}
+
+			cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+		}
+
 		cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Draw Mesh");
 
 		LoadActionsDesc loadActions = {};
@@ -487,35 +2780,112 @@ void MeshViewer::Draw()
 		loadActions.mClearColorValues[0].g = 0.0F;
 		loadActions.mClearColorValues[0].b = 0.0F;
 		loadActions.mClearColorValues[0].a = 0.0F;
-		loadActions.mLoadActionDepth = LOAD_ACTION_CLEAR;
+		loadActions.mLoadActionDepth = depthPrepass ? LOAD_ACTION_LOAD : LOAD_ACTION_CLEAR;
 		loadActions.mClearDepth.depth = 1.0f;
 		loadActions.mClearDepth.stencil = 0;
 		cmdBindRenderTargets(cmd, 1, &pRenderTarget, pDepthBuffer, &loadActions, NULL, NULL, -1, -1);
 		cmdSetViewport(cmd, 0.0f, 0.0f, (float)pRenderTarget->mWidth, (float)pRenderTarget->mHeight, 0.0f, 1.0f);
 		cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
 
-		cmdBindPipeline(cmd, pBasicPipeline);
-		cmdBindDescriptorSet(cmd, gFrameIndex, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
-		cmdBindVertexBuffer(cmd, 1, &pGeometry->pVertexBuffers[0], pGeometry->mVertexStrides, (uint64_t*)NULL);
-		cmdBindIndexBuffer(cmd, pGeometry->pIndexBuffer, pGeometry->mIndexType, (uint64_t)NULL);
+		// The GPU culled paths only issue one indirect draw per mesh, not worth spreading over the record threads
+		const uint32_t threadCount = gpuDriven || !gSceneResident ? 1 : max(min(gRecordThreadCount, drawNodeCount), 1u);
+		gFrameStats.mDrawCount = 0;
+		gFrameStats.mTriangleCount = 0;
+		gFrameStats.mInstanceCount = instanceCount;
+		gFrameStats.mRecordThreadCount = threadCount;
+		memset(gFrameStats.mLodCounts, 0, sizeof(gFrameStats.mLodCounts));
+		gFrameStats.mPlaceholderCount = 0;
 
-		for (uint32_t n = 0; n < pGLTFContainer->mNodeCount; ++n)
+		if (!gSceneResident)
+		{
+			drawScenePlaceholders(cmd, drawNodeCount, drawConstants, &gFrameStats.mDrawCount, &gFrameStats.mTriangleCount);
+			gFrameStats.mPlaceholderCount = gFrameStats.mDrawCount;
+			gRecordTasks[0].mRecordMs = (float)getHiresTimerUSec(&gSubmitTimer, false) / 1000.0f;
+		}
+		else if (meshletCulling)
+		{
+			drawSceneClusterCulled(cmd, pScenePipeline, drawConstants, &gFrameStats.mDrawCount, &gFrameStats.mTriangleCount);
+			gRecordTasks[0].mRecordMs = (float)getHiresTimerUSec(&gSubmitTimer, false) / 1000.0f;
+		}
+		else if (gpuCulling)
+		{
+			drawSceneGpuCulled(cmd, pScenePipeline, drawConstants, false, instanceCount, &gFrameStats.mDrawCount, &gFrameStats.mTriangleCount);
+			if (occlusionCulling && !depthPrepass)
+			{
+				// Without a prepass the pass breaks between the phases for the pyramid and the retest
+				cmdBindRenderTargets(cmd, 0, NULL, 0, NULL, NULL, NULL, -1, -1);
+				buildHiZPyramid(cmd);
+				cullSceneGpuLate(cmd);
+
+				LoadActionsDesc lateLoadActions = {};
+				lateLoadActions.mLoadActionsColor[0] = LOAD_ACTION_LOAD;
+				lateLoadActions.mLoadActionDepth = LOAD_ACTION_LOAD;
+				cmdBindRenderTargets(cmd, 1, &pRenderTarget, pDepthBuffer, &lateLoadActions, NULL, NULL, -1, -1);
+				cmdSetViewport(cmd, 0.0f, 0.0f, (float)pRenderTarget->mWidth, (float)pRenderTarget->mHeight, 0.0f, 1.0f);
+				cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
+			}
+			if (occlusionCulling)
+				drawSceneGpuCulled(cmd, pScenePipeline, lateDrawConstants, true, instanceCount, &gFrameStats.mDrawCount, &gFrameStats.mTriangleCount);
+			gRecordTasks[0].mRecordMs = (float)getHiresTimerUSec(&gSubmitTimer, false) / 1000.0f;
+		}
+		else if (threadCount == 1)
+		{
+			drawSceneRange(cmd, pScenePipeline, depthPrepass, 0, drawNodeCount, drawConstants, &gFrameStats.mDrawCount,
+				&gFrameStats.mTriangleCount, gFrameStats.mLodCounts);
+			gRecordTasks[0].mRecordMs = (float)getHiresTimerUSec(&gSubmitTimer, false) / 1000.0f;
+		}
+		else
 		{
-			GLTFNode& node = pGLTFContainer->pNodes[n];
-			if (node.mMeshIndex != UINT_MAX)
+			// The clearing pass ends here, each worker continues the render pass with load actions in its own
+			// command buffer. Command buffers are submitted in chunk order, so the result matches one thread.
+			// A timestamp query has to begin and end in the same command buffer, so Draw Mesh only times the clear here
+			// and Draw Mesh Post what follows the workers.
+			cmdBindRenderTargets(cmd, 0, NULL, 0, NULL, NULL, NULL, -1, -1);
+			cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+			endCmd(cmd);
+			ppSubmitCmds[submitCmdCount++] = cmd;
+
+			for (uint32_t t = 0; t < threadCount; ++t)
 			{
-				gMeshConstants.mModelMatrix = gNodeTransforms[n];
-				gMaterialConstants.mBaseColorFactor = vec4(1.0f);
-				cmdBindDescriptorSet(cmd, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+				const uint32_t firstDrawNode = (uint32_t)((uint64_t)drawNodeCount * t / threadCount);
+				const uint32_t lastDrawNode = (uint32_t)((uint64_t)drawNodeCount * (t + 1) / threadCount);
+
+				RecordTask& task = gRecordTasks[t];
+				task.pCmd = pRecordCmds[gFrameIndex][t];
+				task.pRenderTarget = pRenderTarget;
+				task.pPipeline = pScenePipeline;
+				task.mReplayLods = depthPrepass;
+				task.mFirstDrawNode = firstDrawNode;
+				task.mDrawNodeCount = lastDrawNode - firstDrawNode;
+				task.mDrawConstants = drawConstants;
+				task.mDrawCount = 0;
+				task.mTriangleCount = 0;
+				memset(task.mLodCounts, 0, sizeof(task.mLodCounts));
+				resetCmdPool(pRenderer, pRecordCmdPools[gFrameIndex][t]);
+			}
 
-				for (uint32_t i = 0; i < node.mMeshCount; ++i)
-				{
-					GLTFMesh& mesh = pGLTFContainer->pMeshes[node.mMeshIndex + i];
-					cmdDrawIndexed(cmd, mesh.mIndexCount, mesh.mStartIndex, 0);
-				}
+			addThreadSystemRangeTask(pThreadSystem, recordSceneTask, NULL, threadCount);
+			waitThreadSystemIdle(pThreadSystem);
+
+			for (uint32_t t = 0; t < threadCount; ++t)
+			{
+				ppSubmitCmds[submitCmdCount++] = gRecordTasks[t].pCmd;
+				gFrameStats.mDrawCount += gRecordTasks[t].mDrawCount;
+				gFrameStats.mTriangleCount += gRecordTasks[t].mTriangleCount;
+				for (uint32_t l = 0; l < MESH_LOD_MAX_LEVELS; ++l)
+					gFrameStats.mLodCounts[l] += gRecordTasks[t].mLodCounts[l];
 			}
+
+			cmd = pPostCmds[gFrameIndex];
+			beginCmd(cmd);
+			cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Draw Mesh Post");
 		}
 
+		if (gStreamedModelCount)
+			drawStreamedModels(cmd, pRenderTarget, &gFrameStats.mDrawCount, &gFrameStats.mTriangleCount, &gFrameStats.mPlaceholderCount);
+
+		gFrameStats.mCpuSubmitMs = (float)getHiresTimerUSec(&gSubmitTimer, false) / 1000.0f;
+
 		cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
 	}
 
@@ -535,7 +2905,147 @@ void MeshViewer::Draw()
 		gFrameTimeDraw.mFontSize = 18.0f;
 		gFrameTimeDraw.mFontID = 0;
 		float2 txtSize = cmdDrawCpuProfile(cmd, float2(8.0f, 15.0f), &gFrameTimeDraw);
-		cmdDrawGpuProfile(cmd, float2(8.f, txtSize.y + 75.f), gGpuProfileToken, &gFrameTimeDraw);
+		float2 gpuTxtSize = cmdDrawGpuProfile(cmd, float2(8.f, txtSize.y + 75.f), gGpuProfileToken, &gFrameTimeDraw);
+
+		float statsY = txtSize.y + gpuTxtSize.y + 100.f;
+		snprintf(gStatsText, sizeof(gStatsText), "Draw calls: %u  Triangles: %llu  Instances: %u  CPU submit: %.3f ms  GPU frame: %.3f ms",
+			gFrameStats.mDrawCount, (unsigned long long)gFrameStats.mTriangleCount, gFrameStats.mInstanceCount, gFrameStats.mCpuSubmitMs,
+			getGpuProfileTime(gGpuProfileToken));
+		gFrameTimeDraw.pText = gStatsText;
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		int written = snprintf(gStatsText, sizeof(gStatsText), "Record threads: %u  ms:", gFrameStats.mRecordThreadCount);
+		for (uint32_t t = 0; t < gFrameStats.mRecordThreadCount && written > 0 && written < (int)sizeof(gStatsText); ++t)
+			written += snprintf(gStatsText + written, sizeof(gStatsText) - written, " %.3f", gRecordTasks[t].mRecordMs);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		snprintf(gStatsText, sizeof(gStatsText), "Scene graph: %u nodes  updated: %u  update: %.3f ms",
+			pSceneGraph->mNodeCount, gFrameStats.mUpdatedNodeCount, gFrameStats.mSceneUpdateMs);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		if (meshletCulling)
+			snprintf(gStatsText, sizeof(gStatsText), "Frustum culling: meshlets, %u clusters of %u meshlets (see Cluster Cull timestamp)",
+				gClusterCount, gMeshlets.mMeshletCount);
+		else if (gpuCulling)
+			snprintf(gStatsText, sizeof(gStatsText), "Frustum culling: GPU, %u meshes x %u instances (see GPU Cull timestamp)",
+				gMeshWorldBounds.mCount, instanceCount);
+		else
+			snprintf(gStatsText, sizeof(gStatsText), "Frustum culling: visible %u  culled %u  cull: %.3f ms",
+				gFrameStats.mVisibleMeshCount, gFrameStats.mCulledMeshCount, gFrameStats.mCullMs);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		if (occlusionCulling)
+		{
+			// Read back a few frames late, the cost is in the Hi-Z Build and GPU Cull Late timestamps
+			snprintf(gStatsText, sizeof(gStatsText), "Occlusion culling: Hi-Z %ux%u, %u mips  occluded: %u  visible after retest: %u  over retest list: %u",
+				gHiZWidth, gHiZHeight, gHiZMipCount, gOcclusionStats.mRetestCount - gOcclusionStats.mLateVisibleCount,
+				gOcclusionStats.mLateVisibleCount, gOcclusionStats.mOverflowCount);
+			cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+			statsY += 20.f;
+		}
+
+		// Compare the Draw Mesh timestamp of runs with and without --packed-vertices for the vertex fetch cost
+		snprintf(gStatsText, sizeof(gStatsText), "Vertex format: %s, %u bytes per vertex, %.1f KB",
+			gPackedVertices ? "packed" : "float", gSceneGeometry.mVertexStride, gSceneGeometry.mVertexBufferSize / 1024.0f);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		if (gMeshLods.pLevels)
+			snprintf(gStatsText, sizeof(gStatsText), "LOD: %s  drawn per level: %u / %u / %u / %u", isLodSelectionActive() ? "on" : "off",
+				gFrameStats.mLodCounts[0], gFrameStats.mLodCounts[1], gFrameStats.mLodCounts[2], gFrameStats.mLodCounts[3]);
+		else
+			snprintf(gStatsText, sizeof(gStatsText), "LOD: not built (--lods)");
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		uint32_t readyModelCount = 0;
+		for (uint32_t i = 0; i < gStreamedModelCount; ++i)
+		{
+			const StreamedModelState state = getStreamedModelState(&gStreamedModels[i]);
+			readyModelCount += state == STREAMED_MODEL_STATE_READY || state == STREAMED_MODEL_STATE_EMPTY ? 1 : 0;
+		}
+		snprintf(gStatsText, sizeof(gStatsText), "Streaming: scene %s  base color map %s  models resident %u / %u  placeholders drawn %u",
+			gSceneResident ? "resident" : "loading", gBoundMaterialTextures[gFrameIndex][MATERIAL_TEXTURE_SCENE] != pPlaceholderTexture ? "resident" : "loading",
+			readyModelCount, gStreamedModelCount, gFrameStats.mPlaceholderCount);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		snprintf(gStatsText, sizeof(gStatsText), "Latency: frames in flight %u  swapchain images %u  input to present %.2f ms  input to GPU done %.2f ms",
+			gFramesInFlight, gSwapchainImageCount, gInputToPresentMs, gInputToGpuDoneMs);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		snprintf(gStatsText, sizeof(gStatsText), "Lights: %u clustered  per cluster avg %.2f  avg occupied %.2f  max %u  occupied clusters %u / %u  over %u: %u",
+			min(gClusteredLightCount, gMaxClusteredLightCount), gClusterLightStats.mAverageLights, gClusterLightStats.mAverageOccupiedLights,
+			gClusterLightStats.mMaxLights, gClusterLightStats.mOccupiedCount, CLUSTER_COUNT, CLUSTER_MAX_LIGHTS, gClusterLightStats.mOverflowCount);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		snprintf(gStatsText, sizeof(gStatsText), "Materials: %u  textures %u + base color map  %s", gMaterialTable.mMaterialCount - 1,
+			gMaterialTable.mTextureCount, isTokenCompleted(&gMaterialTexturesToken) ? "resident" : "loading");
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		// The shading the prepass saves shows as the difference of Draw Mesh with it off and Draw Mesh plus Depth Prepass with it on
+		snprintf(gStatsText, sizeof(gStatsText), "Draw order: %s  %u draws  sort %.3f ms in %u radix passes  depth prepass %s",
+			gSortDraws ? "sorted" : "node order", gDrawOrder.mCount, gFrameStats.mDrawSortMs, gDrawOrder.mPassCount, gDepthPrepass ? "on" : "off");
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		if (gShadowPassActive)
+		{
+			// GPU time of every render is in the Shadow Cascade timestamps, the hit rate is over the last SHADOW_STATS_WINDOW frames
+			written = snprintf(gStatsText, sizeof(gStatsText), "Shadows: %u draws ", gShadowDrawCount);
+			for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT && written > 0 && written < (int)sizeof(gStatsText); ++c)
+			{
+				const ShadowCascade& cascade = gShadowCascades.mCascades[c];
+				written += snprintf(gStatsText + written, sizeof(gStatsText) - written, " | %u: %s hit %.0f%% %u instances record %.3f ms", c,
+					gShadowRefreshNames[cascade.mRefresh], cascade.mHitRate * 100.0f, cascade.mInstanceCount, cascade.mRecordMs);
+			}
+		}
+		else
+		{
+			snprintf(gStatsText, sizeof(gStatsText), "Shadows: off");
+		}
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		snprintf(gStatsText, sizeof(gStatsText), "Upload arena: %.2f / %.2f MB per frame  peak %.2f MB  %u allocations",
+			(float)gUploadArena.mUsed / (1024.0f * 1024.0f), (float)gUploadArena.mSize / (1024.0f * 1024.0f),
+			(float)max(gUploadArena.mPeakUsed, gUploadArena.mUsed) / (1024.0f * 1024.0f), gUploadArena.mAllocationCount);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		snprintf(gStatsText, sizeof(gStatsText), "Pipelines: cache %s  last load %.2f ms  addPipelines %.2f ms  loads %u  deferred removals %u pending, %u done",
+			pPipelineCache ? "on" : "off", gLoadMs, gPipelinesMs, gLoadCount, gDeferredRemovals.mCount, gDeferredRemovals.mRemovedCount);
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		statsY += 20.f;
+
+		if (pTextureStreaming)
+		{
+			const TextureStreamingStats& textureStats = pTextureStreaming->mStats;
+			snprintf(gStatsText, sizeof(gStatsText),
+				"Texture streaming: resident %.2f MB  budget %.2f MB  wanted %.2f MB  at wanted mip %u / %u  evictions %u  held back %u  uploaded %.2f MB",
+				textureStats.mResidentBytes / (1024.0f * 1024.0f), gTextureBudgetMB, textureStats.mWantedBytes / (1024.0f * 1024.0f),
+				textureStats.mSatisfiedCount, textureStats.mTextureCount, textureStats.mEvictionCount, textureStats.mDeniedCount,
+				textureStats.mUploadedBytes / (1024.0f * 1024.0f));
+		}
+		else if (gBaseColorIsBasis)
+		{
+			snprintf(gStatsText, sizeof(gStatsText), "Basis: '%s'  %u / %u images uploaded  %s", gBaseColorBasisTexture.mFileName,
+				gBaseColorBasisTexture.mUploadedCount, max(gBaseColorBasisTexture.mImageCount, 1u),
+				gBaseColorBasisTexture.mState == BASIS_TEXTURE_STATE_READY ? "resident" : "transcoding");
+		}
+		else
+		{
+			snprintf(gStatsText, sizeof(gStatsText), "Texture streaming: off (--mip-streaming)");
+		}
+		cmdDrawTextWithFont(cmd, float2(8.f, statsY), &gFrameTimeDraw);
+		gFrameTimeDraw.pText = NULL;
 
 		cmdDrawUserInterface(cmd);
 
@@ -544,31 +3054,71 @@ void MeshViewer::Draw()
 
 	cmdBindRenderTargets(cmd, 0, NULL, 0, NULL, NULL, NULL, -1, -1);
 
-	RenderTargetBarrier finalBarriers = { pRenderTarget, RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_PRESENT };
+	RenderTargetBarrier finalBarriers = { pRenderTarget, RESOURCE_STATE_RENDER_TARGET, outputState };
 	cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &finalBarriers);
 	cmdEndGpuFrameProfile(cmd, gGpuProfileToken);
 	endCmd(cmd);
 
+	ppSubmitCmds[submitCmdCount++] = cmd;
+
+	// Late latch: the GPU reads the camera only once the submit executes, so it goes into the persistently mapped
+	// constants after recording, as the last write before the submit
+	updateUniformBuffers();
+
+	// Headless frames neither wait for an acquired image nor hand one to the presentation engine
 	QueueSubmitDesc submitDesc = {};
-	submitDesc.mCmdCount = 1;
-	submitDesc.mSignalSemaphoreCount = 1;
-	submitDesc.mWaitSemaphoreCount = 1;
-	submitDesc.ppCmds = &cmd;
+	submitDesc.mCmdCount = submitCmdCount;
+	submitDesc.mSignalSemaphoreCount = headless ? 0 : 1;
+	submitDesc.mWaitSemaphoreCount = headless ? 0 : 1;
+	submitDesc.ppCmds = ppSubmitCmds;
 	submitDesc.ppSignalSemaphores = &pRenderCompleteSemaphore;
 	submitDesc.ppWaitSemaphores = &pImageAcquiredSemaphore;
 	submitDesc.pSignalFence = pRenderCompleteFence;
 	queueSubmit(pGraphicsQueue, &submitDesc);
-	QueuePresentDesc presentDesc = {};
-	presentDesc.mIndex = swapchainImageIndex;
-	presentDesc.mWaitSemaphoreCount = 1;
-	presentDesc.ppWaitSemaphores = &pRenderCompleteSemaphore;
-	presentDesc.pSwapChain = pSwapChain;
-	presentDesc.mSubmitDone = true;
-	queuePresent(pGraphicsQueue, &presentDesc);
+	if (!headless)
+	{
+		QueuePresentDesc presentDesc = {};
+		presentDesc.mIndex = swapchainImageIndex;
+		presentDesc.mWaitSemaphoreCount = 1;
+		presentDesc.ppWaitSemaphores = &pRenderCompleteSemaphore;
+		presentDesc.pSwapChain = pSwapChain;
+		presentDesc.mSubmitDone = true;
+		queuePresent(pGraphicsQueue, &presentDesc);
+	}
+
+	addLatencySample(&gInputToPresentMs, (float)(getUSec(false) - gFrameLatencies[gFrameIndex].mInputUSec) / 1000.0f);
+	gFrameLatencies[gFrameIndex].mInFlight = true;
+	pollFrameLatencies();
+
+	if (!gFirstFrameReported)
+	{
+		LOGF(LogLevel::eINFO, "First frame submitted %.2f ms after startup, scene %s", getHiresTimerUSec(&gStartupTimer, false) / 1000.0f,
+			gSceneResident ? "resident" : "still streaming");
+		gFirstFrameReported = true;
+	}
 
 	flipProfiler();
 
-	gFrameIndex = (gFrameIndex + 1) % gImageCount;
+	if (pBenchmark)
+	{
+		// GPU times come from the profiler, which resolves them a few frames late
+		BenchmarkFrame frame = {};
+		frame.mCpuMs = (float)getHiresTimerUSec(&gFrameTimer, false) / 1000.0f;
+		frame.mGpuMs = getGpuProfileTime(gGpuProfileToken);
+		frame.mDrawCount = gFrameStats.mDrawCount;
+		frame.mTriangleCount = gFrameStats.mTriangleCount;
+		benchmarkRecordFrame(pBenchmark, &frame);
+
+		if (benchmarkIsDone(pBenchmark))
+		{
+			writeBenchmarkReport(pBenchmark, GetName());
+			exitBenchmark(pBenchmark);
+			pBenchmark = NULL;
+			requestShutdown();
+		}
+	}
+
+	gFrameIndex = (gFrameIndex + 1) % gFramesInFlight;
 }
 
 void MeshViewer::createSamplers()
@@ -586,30 +3136,281 @@ void MeshViewer::createSamplers()
 void MeshViewer::createShaders()
 {
 	ShaderLoadDesc basicShader = {};
-	basicShader.mStages[0] = { "basic.vert", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	basicShader.mStages[0] = { gPackedVertices ? "packed.vert" : "basic.vert", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
 	basicShader.mStages[1] = { "basic.frag", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
 	addShader(pRenderer, &basicShader, &pBasicShader);
+
+	// Position only, the prepass has no pixel shader
+	ShaderLoadDesc depthPrepassShader = {};
+	depthPrepassShader.mStages[0] = { gPackedVertices ? "depth_packed.vert" : "depth.vert", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &depthPrepassShader, &pDepthPrepassShader);
+
+	// Depth only as well, with the cascade's shadow matrix
+	ShaderLoadDesc shadowShader = {};
+	shadowShader.mStages[0] = { gPackedVertices ? "shadow_packed.vert" : "shadow.vert", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &shadowShader, &pShadowShader);
+
+	ShaderLoadDesc cullShader = {};
+	cullShader.mStages[0] = { "cull.comp", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &cullShader, &pCullShader);
+
+	ShaderLoadDesc cullLateShader = {};
+	cullLateShader.mStages[0] = { "cull_late.comp", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &cullLateShader, &pCullLateShader);
+
+	ShaderLoadDesc hiZDepthShader = {};
+	hiZDepthShader.mStages[0] = { "hiz_depth.comp", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &hiZDepthShader, &pHiZDepthShader);
+
+	ShaderLoadDesc hiZReduceShader = {};
+	hiZReduceShader.mStages[0] = { "hiz_reduce.comp", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &hiZReduceShader, &pHiZReduceShader);
+
+	ShaderLoadDesc clusterCullShader = {};
+	clusterCullShader.mStages[0] = { "cluster_cull.comp", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &clusterCullShader, &pClusterCullShader);
+
+	ShaderLoadDesc lightBinShader = {};
+	lightBinShader.mStages[0] = { "light_bin.comp", NULL, 0, NULL, SHADER_STAGE_LOAD_FLAG_NONE };
+	addShader(pRenderer, &lightBinShader, &pLightBinShader);
 }
 
 void MeshViewer::createRootSignatures()
 {
 	RootSignatureDesc rootDesc = {};
 	rootDesc.mStaticSamplerCount = 0;
-	rootDesc.mShaderCount = 1;
-	rootDesc.ppShaders = &pBasicShader;
+	// The depth prepass and the shadow pass bind the same descriptor sets as the scene pass
+	Shader* pSceneShaders[] = { pBasicShader, pDepthPrepassShader, pShadowShader };
+	rootDesc.mShaderCount = 3;
+	rootDesc.ppShaders = pSceneShaders;
 	addRootSignature(pRenderer, &rootDesc, &pBasicRootSignature);
+
+	// Both phases of the GPU cull bind the same descriptor sets
+	Shader* pCullShaders[] = { pCullShader, pCullLateShader };
+	rootDesc.mShaderCount = 2;
+	rootDesc.ppShaders = pCullShaders;
+	addRootSignature(pRenderer, &rootDesc, &pCullRootSignature);
+
+	Shader* pHiZShaders[] = { pHiZDepthShader, pHiZReduceShader };
+	rootDesc.ppShaders = pHiZShaders;
+	addRootSignature(pRenderer, &rootDesc, &pHiZRootSignature);
+
+	rootDesc.mShaderCount = 1;
+	rootDesc.ppShaders = &pClusterCullShader;
+	addRootSignature(pRenderer, &rootDesc, &pClusterCullRootSignature);
+
+	rootDesc.ppShaders = &pLightBinShader;
+	addRootSignature(pRenderer, &rootDesc, &pLightBinRootSignature);
+
+	IndirectArgumentDescriptor indirectArg = {};
+	indirectArg.mType = INDIRECT_DRAW_INDEX;
+
+	CommandSignatureDesc cmdSignatureDesc = {};
+	cmdSignatureDesc.pRootSignature = pBasicRootSignature;
+	cmdSignatureDesc.mIndirectArgCount = 1;
+	cmdSignatureDesc.pArgDescs = &indirectArg;
+	addIndirectCommandSignature(pRenderer, &cmdSignatureDesc, &pIndirectDrawCommandSignature);
+
+	// The late cull pass is sized by the pairs the first phase queued
+	indirectArg.mType = INDIRECT_DISPATCH;
+	cmdSignatureDesc.pRootSignature = pCullRootSignature;
+	addIndirectCommandSignature(pRenderer, &cmdSignatureDesc, &pIndirectDispatchCommandSignature);
+}
+
+// Unit cube around the origin, four vertices per face so every face gets its own normal
+static void buildPlaceholderCube(float* pVertices, uint16_t* pIndices)
+{
+	const float corners[4][2] = { { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+	for (uint32_t face = 0; face < 6; ++face)
+	{
+		const uint32_t axis = face / 2;
+		const float sign = (face & 1) ? -1.0f : 1.0f;
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			float* pVertex = pVertices + (face * 4 + c) * 8;
+			pVertex[axis] = 0.5f * sign;
+			pVertex[(axis + 1) % 3] = corners[c][0] * sign;
+			pVertex[(axis + 2) % 3] = corners[c][1];
+			pVertex[3 + axis] = sign;
+			pVertex[3 + (axis + 1) % 3] = 0.0f;
+			pVertex[3 + (axis + 2) % 3] = 0.0f;
+			pVertex[6] = corners[c][0] + 0.5f;
+			pVertex[7] = corners[c][1] + 0.5f;
+		}
+
+		const uint16_t first = (uint16_t)(face * 4);
+		const uint16_t faceIndices[6] = { first, (uint16_t)(first + 1), (uint16_t)(first + 2), first, (uint16_t)(first + 2), (uint16_t)(first + 3) };
+		memcpy(pIndices + face * 6, faceIndices, sizeof(faceIndices));
+	}
+}
+
+static void addSolidTexture(const char* pName, const uint8_t* pTexel, Texture** ppTexture)
+{
+	TextureDesc textureDesc = {};
+	textureDesc.mWidth = 1;
+	textureDesc.mHeight = 1;
+	textureDesc.mDepth = 1;
+	textureDesc.mArraySize = 1;
+	textureDesc.mMipLevels = 1;
+	textureDesc.mSampleCount = SAMPLE_COUNT_1;
+	textureDesc.mFormat = TinyImageFormat_R8G8B8A8_SRGB;
+	textureDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+	textureDesc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+	textureDesc.pName = pName;
+
+	TextureLoadDesc textureLoadDesc = {};
+	textureLoadDesc.pDesc = &textureDesc;
+	textureLoadDesc.ppTexture = ppTexture;
+	addResource(&textureLoadDesc, NULL);
+
+	TextureUpdateDesc textureUpdate = {};
+	textureUpdate.pTexture = *ppTexture;
+	beginUpdateResource(&textureUpdate);
+	memcpy(textureUpdate.pMappedData, pTexel, 4);
+	endUpdateResource(&textureUpdate, NULL);
+}
+
+// Texture files of RD_TEXTURES are loaded by name, the loader picks the extension of the platform
+static bool hasTextureFile(const char* pName)
+{
+	const char* extensions[] = { "dds", "ktx" };
+	char fileName[MESH_ASSET_TEXTURE_NAME_LENGTH + 8] = {};
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		snprintf(fileName, sizeof(fileName), "%s.%s", pName, extensions[i]);
+		if (fsFileExist(RD_TEXTURES, fileName))
+			return true;
+	}
+	return false;
+}
+
+void MeshViewer::createPlaceholders()
+{
+	// 1x1 mid grey stand-in for the base color map and every other material texture still loading, and the white
+	// texture of untextured materials
+	{
+		const uint8_t grey[4] = { 128, 128, 128, 255 };
+		addSolidTexture("Placeholder Texture", grey, &pPlaceholderTexture);
+		const uint8_t white[4] = { 255, 255, 255, 255 };
+		addSolidTexture("White Texture", white, &pWhiteTexture);
+	}
+
+	// Placeholder geometry, drawn with the scene pipeline so it uses the scene vertex layout
+	{
+		// Static, the uploads read them after this returns
+		static float vertices[24 * 8];
+		static uint16_t indices[gPlaceholderCubeIndexCount];
+		buildPlaceholderCube(vertices, indices);
+
+		gPlaceholderCube.mVertexStride = 8 * sizeof(float);
+		gPlaceholderCube.mIndexType = INDEX_TYPE_UINT16;
+		gPlaceholderCube.mPositionDequantScale = vec4(1.0f);
+		gPlaceholderCube.mPositionDequantOffset = vec4(0.0f);
+		const void* pVertexData = vertices;
+		if (gPackedVertices)
+		{
+			MeshAsset cubeAsset = {};
+			cubeAsset.mVertexCount = 24;
+			cubeAsset.mVertexStride = gPlaceholderCube.mVertexStride;
+			cubeAsset.pVertices = vertices;
+
+			vec3 dequantScale;
+			vec3 dequantOffset;
+			gPlaceholderCube.pPackedVertices = packMeshAssetVertices(&cubeAsset, &dequantScale, &dequantOffset);
+			gPlaceholderCube.mVertexStride = MESH_ASSET_PACKED_VERTEX_STRIDE;
+			gPlaceholderCube.mPositionDequantScale = vec4(dequantScale, 0.0f);
+			gPlaceholderCube.mPositionDequantOffset = vec4(dequantOffset, 0.0f);
+			pVertexData = gPlaceholderCube.pPackedVertices;
+		}
+		gPlaceholderCube.mVertexBufferSize = 24 * gPlaceholderCube.mVertexStride;
+
+		BufferLoadDesc vertexBufferDesc = {};
+		vertexBufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER;
+		vertexBufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		vertexBufferDesc.mDesc.mSize = gPlaceholderCube.mVertexBufferSize;
+		vertexBufferDesc.pData = pVertexData;
+		vertexBufferDesc.ppBuffer = &gPlaceholderCube.pVertexBuffer;
+		addResource(&vertexBufferDesc, &gPlaceholderCube.mUploadToken);
+
+		BufferLoadDesc indexBufferDesc = {};
+		indexBufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_INDEX_BUFFER;
+		indexBufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		indexBufferDesc.mDesc.mSize = sizeof(indices);
+		indexBufferDesc.pData = indices;
+		indexBufferDesc.ppBuffer = &gPlaceholderCube.pIndexBuffer;
+		addResource(&indexBufferDesc, &gPlaceholderCube.mUploadToken);
+		// Update frees the packed copy once the token completes
+	}
+
+	// Every draw reads instanceTransforms, placeholders only instance 0, the identity of non-instanced draws.
+	// That entry goes up now, the rest of the field with the scene in createConstants.
+	gInstanceTransforms = (mat4*)malloc(sizeof(mat4) * gMaxInstanceCount); //-V630
+	for (uint32_t i = 0; i < gMaxInstanceCount; ++i)
+	{
+		int32_t x, z;
+		getSpiralCell((int32_t)i + 1, &x, &z);
+		gInstanceTransforms[i] = mat4::translation(vec3((float)x * gInstanceSpacing, 0.0f, (float)z * gInstanceSpacing));
+	}
+
+	BufferLoadDesc instanceTransformsDesc = {};
+	instanceTransformsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	instanceTransformsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	instanceTransformsDesc.mDesc.mFirstElement = 0;
+	instanceTransformsDesc.mDesc.mElementCount = gMaxInstanceCount;
+	instanceTransformsDesc.mDesc.mStructStride = sizeof(mat4);
+	instanceTransformsDesc.mDesc.mSize = sizeof(mat4) * gMaxInstanceCount;
+	instanceTransformsDesc.pData = NULL;
+	instanceTransformsDesc.ppBuffer = &pInstanceTransformsBuffer;
+	addResource(&instanceTransformsDesc, NULL);
+
+	BufferUpdateDesc identityUpdate = {};
+	identityUpdate.pBuffer = pInstanceTransformsBuffer;
+	identityUpdate.mDstOffset = 0;
+	identityUpdate.mSize = sizeof(mat4);
+	beginUpdateResource(&identityUpdate);
+	memcpy(identityUpdate.pMappedData, gInstanceTransforms, sizeof(mat4));
+	endUpdateResource(&identityUpdate, NULL);
 }
 
 void MeshViewer::createResources()
 {
 	// Load Textures
 	{
-		TextureLoadDesc baseColorMapDesc = {};
-		baseColorMapDesc.pFileName = "DuckCM";
-		baseColorMapDesc.ppTexture = &pBaseColorMap;
-		// Textures representing color should be stored in SRGB or HDR format
-		baseColorMapDesc.mCreationFlag = TEXTURE_CREATION_FLAG_SRGB;
-		addResource(&baseColorMapDesc, NULL);
+		// Basis packages are several times smaller than the DDS, they win when both are shipped
+		const char* basisFileNames[] = { "DuckCM.ktx2", "DuckCM.basis" };
+		for (uint32_t i = 0; i < 2 && !gBaseColorIsBasis; ++i)
+		{
+			if (!fsFileExist(RD_TEXTURES, basisFileNames[i]))
+				continue;
+			BasisTextureDesc basisDesc = {};
+			basisDesc.pFileName = basisFileNames[i];
+			basisDesc.mSrgb = true;
+			gBaseColorIsBasis = addBasisTexture(pRenderer, pTranscodeThreadSystem, &basisDesc, &gBaseColorBasisTexture);
+		}
+
+		if (!gBaseColorIsBasis && gMipStreaming)
+		{
+			TextureStreamingDesc textureStreamingDesc = {};
+			textureStreamingDesc.mBudgetBytes = (uint64_t)(gTextureBudgetMB * 1024.0f * 1024.0f);
+			textureStreamingDesc.mMaxUploadBytesPerFrame = gMaxTextureUploadBytesPerFrame;
+			textureStreamingDesc.mMaxTextures = gMaxStreamedTextures;
+			textureStreamingDesc.mFramesInFlight = gMaxFramesInFlight;
+			textureStreamingDesc.pThreadSystem = pLoadThreadSystem;
+			initTextureStreaming(&textureStreamingDesc, &pTextureStreaming);
+			// The file is stored as SRGB already, the streamer takes the format from the DDS header
+			gBaseColorStreamedTexture = addStreamedTexture(pTextureStreaming, "DuckCM.dds");
+		}
+
+		// Files the streamer cannot handle load with every mip
+		if (!gBaseColorIsBasis && gBaseColorStreamedTexture == UINT32_MAX)
+		{
+			TextureLoadDesc baseColorMapDesc = {};
+			baseColorMapDesc.pFileName = "DuckCM";
+			baseColorMapDesc.ppTexture = &pBaseColorMap;
+			// Textures representing color should be stored in SRGB or HDR format
+			baseColorMapDesc.mCreationFlag = TEXTURE_CREATION_FLAG_SRGB;
+			addResource(&baseColorMapDesc, &gBaseColorMapToken);
+		}
 	}
 
 	// Load Models
@@ -631,75 +3432,745 @@ void MeshViewer::createResources()
 		gVertexLayout.mAttribs[2].mLocation = 2;
 		gVertexLayout.mAttribs[2].mOffset = 6 * sizeof(float);
 
-		GeometryLoadDesc loadDesc = {};
-		loadDesc.pFileName = "Duck.gltf";
-		loadDesc.pVertexLayout = &gVertexLayout;
-		loadDesc.ppGeometry = &pGeometry;
-		addResource(&loadDesc, NULL);
+		if (gPackedVertices)
+		{
+			gVertexLayout.mAttribs[0].mFormat = TinyImageFormat_R16G16B16A16_UNORM;
+			gVertexLayout.mAttribs[1].mFormat = TinyImageFormat_R16G16_SNORM;
+			gVertexLayout.mAttribs[1].mOffset = 4 * sizeof(uint16_t);
+			gVertexLayout.mAttribs[2].mFormat = TinyImageFormat_R16G16_SFLOAT;
+			gVertexLayout.mAttribs[2].mOffset = 6 * sizeof(uint16_t);
+		}
+
+		// With --stream the import runs on the load thread and Update adds the scene once it is done, until then the
+		// scene is empty
+		if (gStreamAssets)
+		{
+			addThreadSystemTask(pLoadThreadSystem, importSceneTask, &gSceneImport);
+		}
+		else
+		{
+			importScene(&gSceneImport);
+			useSceneImport(&gSceneImport);
+		}
+		addSceneGeometry();
+	}
+
+	// Load Materials
+	addMaterials();
+
+	// Shadow Map
+	{
+		// Does not depend on the swapchain, so it lives from Init to Exit. Slices hold their cascade across frames.
+		RenderTargetDesc shadowMapRT = {};
+		shadowMapRT.mArraySize = SHADOW_CASCADE_COUNT;
+		shadowMapRT.mClearValue.depth = 1.0f;
+		shadowMapRT.mClearValue.stencil = 0;
+		shadowMapRT.mDepth = 1;
+		shadowMapRT.mDescriptors = DESCRIPTOR_TYPE_TEXTURE | DESCRIPTOR_TYPE_RENDER_TARGET_ARRAY_SLICES;
+		shadowMapRT.mFormat = TinyImageFormat_D32_SFLOAT;
+		shadowMapRT.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+		shadowMapRT.mWidth = gShadowMapSize;
+		shadowMapRT.mHeight = gShadowMapSize;
+		shadowMapRT.mSampleCount = SAMPLE_COUNT_1;
+		shadowMapRT.mSampleQuality = 0;
+		shadowMapRT.mFlags = TEXTURE_CREATION_FLAG_NONE;
+		shadowMapRT.pName = "Shadow Map";
+		addRenderTarget(pRenderer, &shadowMapRT, &pShadowMap);
+
+		// Sized for the largest field, 1.6 MB per frame, so the instance count never reallocates it
+		BufferLoadDesc shadowInstancesDesc = {};
+		shadowInstancesDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		shadowInstancesDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		shadowInstancesDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+		shadowInstancesDesc.mDesc.mFirstElement = 0;
+		shadowInstancesDesc.mDesc.mElementCount = SHADOW_CASCADE_COUNT * gMaxInstanceCount;
+		shadowInstancesDesc.mDesc.mStructStride = sizeof(uint32_t);
+		shadowInstancesDesc.mDesc.mSize = sizeof(uint32_t) * SHADOW_CASCADE_COUNT * gMaxInstanceCount;
+		shadowInstancesDesc.pData = NULL;
+		for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+		{
+			shadowInstancesDesc.ppBuffer = &pShadowInstancesBuffers[i];
+			addResource(&shadowInstancesDesc, NULL);
+		}
+
+		ShadowCascadesDesc cascadesDesc = {};
+		cascadesDesc.mNear = 0.1f;
+		cascadesDesc.mFar = 40.0f;
+		cascadesDesc.mSplitLambda = 0.75f;
+		cascadesDesc.mCacheMargin = 0.25f;
+		cascadesDesc.mResolution = gShadowMapSize;
+		cascadesDesc.mRefreshIntervals[0] = 1;
+		cascadesDesc.mRefreshIntervals[1] = 2;
+		initShadowCascades(&cascadesDesc, &gShadowCascades);
+	}
+}
+
+void MeshViewer::addSceneGeometry()
+{
+	const void* pVertexData = gSceneGeometry.pPackedVertices ? gSceneGeometry.pPackedVertices : gMeshAsset.pVertices;
+	gSceneGeometry.mVertexBufferSize = (uint64_t)gMeshAsset.mVertexCount * gSceneGeometry.mVertexStride;
+	gSceneGeometry.mIndexType = gMeshAsset.mIndexSize == sizeof(uint16_t) ? INDEX_TYPE_UINT16 : INDEX_TYPE_UINT32;
+	// The empty startup scene of --stream, or a model that failed to load, has nothing to upload
+	if (!pVertexData || !gMeshAsset.mIndexCount)
+		return;
+
+	// The blobs are already in the vertex layout of createResources. The resource loader copies them to the GPU on its
+	// own thread, the image is released once gSceneGeometry.mUploadToken completes.
+	BufferLoadDesc vertexBufferDesc = {};
+	vertexBufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER;
+	vertexBufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	vertexBufferDesc.mDesc.mSize = gSceneGeometry.mVertexBufferSize;
+	vertexBufferDesc.pData = pVertexData;
+	vertexBufferDesc.ppBuffer = &gSceneGeometry.pVertexBuffer;
+	addResource(&vertexBufferDesc, &gSceneGeometry.mUploadToken);
+
+	// With LODs the index buffer holds the asset indices followed by every simplified level
+	BufferLoadDesc indexBufferDesc = {};
+	indexBufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_INDEX_BUFFER;
+	indexBufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	indexBufferDesc.mDesc.mSize = (uint64_t)gMeshAsset.mIndexCount * gMeshAsset.mIndexSize;
+	indexBufferDesc.pData = gMeshAsset.pIndices;
+	if (gMeshLods.pIndices)
+	{
+		indexBufferDesc.mDesc.mSize = (uint64_t)gMeshLods.mIndexCount * gMeshLods.mIndexSize;
+		indexBufferDesc.pData = gMeshLods.pIndices;
+	}
+	indexBufferDesc.ppBuffer = &gSceneGeometry.pIndexBuffer;
+	addResource(&indexBufferDesc, &gSceneGeometry.mUploadToken);
+
+	LOGF(LogLevel::eINFO, "Vertex buffer: %u vertices x %u bytes = %.1f KB, %.1f KB saved against the float layout", gMeshAsset.mVertexCount,
+		gSceneGeometry.mVertexStride, gSceneGeometry.mVertexBufferSize / 1024.0f,
+		((uint64_t)gMeshAsset.mVertexCount * gMeshAsset.mVertexStride - gSceneGeometry.mVertexBufferSize) / 1024.0f);
+}
+
+void MeshViewer::addMaterials()
+{
+	// Materials using DuckCM sample the base color map loaded above, streamed or transcoded as it may be
+	initMaterialTable(&gMeshAsset, "DuckCM", &gMaterialTable);
+
+	// Placeholders read the default material from the first frame on, so the table is written right away
+	BufferLoadDesc materialsDesc = {};
+	materialsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	materialsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	materialsDesc.mDesc.mFirstElement = 0;
+	materialsDesc.mDesc.mElementCount = gMaterialTable.mMaterialCount * MATERIAL_STRIDE;
+	materialsDesc.mDesc.mStructStride = sizeof(vec4);
+	materialsDesc.mDesc.mSize = sizeof(GpuMaterial) * gMaterialTable.mMaterialCount;
+	materialsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	materialsDesc.pData = NULL;
+	materialsDesc.ppBuffer = &pMaterialsBuffer;
+	addResource(&materialsDesc, NULL);
+	memcpy(pMaterialsBuffer->pCpuMappedAddress, gMaterialTable.pMaterials, sizeof(GpuMaterial) * gMaterialTable.mMaterialCount);
+
+	uint32_t missingCount = 0;
+	for (uint32_t i = 0; i < gMaterialTable.mTextureCount; ++i)
+	{
+		const char* pName = gMeshAsset.pTextures[gMaterialTable.pAssetTextures[i]].mName;
+		if (!hasTextureFile(pName))
+		{
+			LOGF(LogLevel::eWARNING, "Materials: no texture file for '%s', its materials sample white", pName);
+			++missingCount;
+			continue;
+		}
 
-		uint32_t res = gltfLoadContainer("Duck.gltf", NULL, GLTF_FLAG_CALCULATE_BOUNDS, &pGLTFContainer);
+		TextureLoadDesc materialTextureDesc = {};
+		materialTextureDesc.pFileName = pName;
+		materialTextureDesc.ppTexture = &pMaterialTextures[i];
+		materialTextureDesc.mCreationFlag = TEXTURE_CREATION_FLAG_SRGB;
+		addResource(&materialTextureDesc, &gMaterialTexturesToken);
 	}
+
+	LOGF(LogLevel::eINFO, "Materials: %u materials, %u textures besides the base color map, %u of them missing", gMaterialTable.mMaterialCount - 1,
+		gMaterialTable.mTextureCount, missingCount);
 }
 
 void MeshViewer::createConstants()
 {
-	BufferLoadDesc globalConstantsDesc = {};
-	globalConstantsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	globalConstantsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-	globalConstantsDesc.mDesc.mSize = sizeof(GlobalConstants);
-	globalConstantsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
-	globalConstantsDesc.pData = &gGlobalConstantsData;
-	for (uint32_t i = 0; i < gImageCount; ++i)
-	{
-		globalConstantsDesc.ppBuffer = &pGlobalConstantsBuffer[i];
-		addResource(&globalConstantsDesc, NULL);
-	}
-
-	BufferLoadDesc meshConstantsDesc = {};
-	meshConstantsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	meshConstantsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-	meshConstantsDesc.mDesc.mSize = sizeof(MeshConstants);
-	meshConstantsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
-	meshConstantsDesc.pData = &gMeshConstants;
-	meshConstantsDesc.ppBuffer = &pMeshConstantsBuffer;
-	addResource(&meshConstantsDesc, NULL);
-
-	BufferLoadDesc materialConstantsDesc = {};
-	materialConstantsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	materialConstantsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-	materialConstantsDesc.mDesc.mSize = sizeof(MaterialConstants);
-	materialConstantsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
-	materialConstantsDesc.pData = &gMaterialConstants;
-	materialConstantsDesc.ppBuffer = &pMaterialConstantsBuffer;
-	addResource(&materialConstantsDesc, NULL);
+	// Root CBV offsets have to respect the uniform buffer alignment of the device. Room for the global constants and
+	// gMaxDrawsPerFrame draws.
+	const uint32_t alignment = pRenderer->pActiveGpuSettings->mUniformBufferAlignment;
+	UploadArenaDesc uploadArenaDesc = {};
+	uploadArenaDesc.mSize = round_up_64(sizeof(GlobalConstants), alignment) + round_up_64(sizeof(DrawConstants), alignment) * gMaxDrawsPerFrame;
+	uploadArenaDesc.mFrameCount = gMaxFramesInFlight;
+	uploadArenaDesc.mAlignment = alignment;
+	uploadArenaDesc.pName = "Upload Arena";
+	initUploadArena(&uploadArenaDesc, &gUploadArena);
+
+	// Instance 0 went up with the placeholders, the rest of the field is only needed by the resident scene
+	BufferUpdateDesc instanceFieldUpdate = {};
+	instanceFieldUpdate.pBuffer = pInstanceTransformsBuffer;
+	instanceFieldUpdate.mDstOffset = sizeof(mat4);
+	instanceFieldUpdate.mSize = sizeof(mat4) * (gMaxInstanceCount - 1);
+	beginUpdateResource(&instanceFieldUpdate);
+	memcpy(instanceFieldUpdate.pMappedData, gInstanceTransforms + 1, instanceFieldUpdate.mSize);
+	endUpdateResource(&instanceFieldUpdate, &gSceneGeometry.mUploadToken);
+
+	// GPU culling
+	BufferLoadDesc cullConstantsDesc = {};
+	cullConstantsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	cullConstantsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	cullConstantsDesc.mDesc.mSize = sizeof(CullConstants);
+	cullConstantsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	cullConstantsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		cullConstantsDesc.ppBuffer = &pCullConstantsBuffers[i];
+		addResource(&cullConstantsDesc, NULL);
+	}
+
+	// Occlusion culling, the retest list follows the scene buffers since they can turn it off
+	gOcclusionBuffers = gOcclusionCulling;
+
+	BufferLoadDesc occlusionCountersDesc = {};
+	occlusionCountersDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER;
+	occlusionCountersDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	occlusionCountersDesc.mDesc.mStartState = RESOURCE_STATE_COPY_SOURCE;
+	occlusionCountersDesc.mDesc.mFirstElement = 0;
+	occlusionCountersDesc.mDesc.mElementCount = 4;
+	occlusionCountersDesc.mDesc.mStructStride = sizeof(uint32_t);
+	occlusionCountersDesc.mDesc.mSize = sizeof(uint32_t) * 4;
+	occlusionCountersDesc.pData = NULL;
+	occlusionCountersDesc.ppBuffer = &pOcclusionCountersBuffer;
+	addResource(&occlusionCountersDesc, NULL);
+
+	BufferLoadDesc occlusionDispatchArgsDesc = occlusionCountersDesc;
+	occlusionDispatchArgsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_INDIRECT_BUFFER;
+	occlusionDispatchArgsDesc.mDesc.mStartState = RESOURCE_STATE_INDIRECT_ARGUMENT;
+	occlusionDispatchArgsDesc.ppBuffer = &pOcclusionDispatchArgsBuffer;
+	addResource(&occlusionDispatchArgsDesc, NULL);
+
+	// Zero counters and group counts, copied over both before every first phase
+	static const uint32_t occlusionReset[4] = {};
+	BufferLoadDesc occlusionResetDesc = {};
+	occlusionResetDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+	occlusionResetDesc.mDesc.mStartState = RESOURCE_STATE_COPY_SOURCE;
+	occlusionResetDesc.mDesc.mSize = sizeof(occlusionReset);
+	occlusionResetDesc.pData = occlusionReset;
+	occlusionResetDesc.ppBuffer = &pOcclusionResetBuffer;
+	addResource(&occlusionResetDesc, NULL);
+
+	BufferLoadDesc occlusionCountersReadbackDesc = {};
+	occlusionCountersReadbackDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_TO_CPU;
+	occlusionCountersReadbackDesc.mDesc.mStartState = RESOURCE_STATE_COPY_DEST;
+	occlusionCountersReadbackDesc.mDesc.mSize = sizeof(uint32_t) * 4;
+	occlusionCountersReadbackDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	occlusionCountersReadbackDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		occlusionCountersReadbackDesc.ppBuffer = &pOcclusionCountersReadbackBuffers[i];
+		addResource(&occlusionCountersReadbackDesc, NULL);
+	}
+
+	// Meshlet culling
+	BufferLoadDesc clusterCullConstantsDesc = {};
+	clusterCullConstantsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	clusterCullConstantsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	clusterCullConstantsDesc.mDesc.mSize = sizeof(ClusterCullConstants);
+	clusterCullConstantsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	clusterCullConstantsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		clusterCullConstantsDesc.ppBuffer = &pClusterCullConstantsBuffers[i];
+		addResource(&clusterCullConstantsDesc, NULL);
+	}
+
+	// Clustered lights
+	initLightField(gMaxClusteredLightCount, 0x5eed1u, &gLightField);
+
+	BufferLoadDesc lightBinConstantsDesc = {};
+	lightBinConstantsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lightBinConstantsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	lightBinConstantsDesc.mDesc.mSize = sizeof(LightBinConstants);
+	lightBinConstantsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	lightBinConstantsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		lightBinConstantsDesc.ppBuffer = &pLightBinConstantsBuffers[i];
+		addResource(&lightBinConstantsDesc, NULL);
+	}
+
+	BufferLoadDesc lightsDesc = {};
+	lightsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	lightsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	lightsDesc.mDesc.mFirstElement = 0;
+	lightsDesc.mDesc.mElementCount = gMaxClusteredLightCount * (sizeof(ClusterLight) / sizeof(vec4));
+	lightsDesc.mDesc.mStructStride = sizeof(vec4);
+	lightsDesc.mDesc.mSize = sizeof(ClusterLight) * gMaxClusteredLightCount;
+	lightsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	lightsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		lightsDesc.ppBuffer = &pLightsBuffers[i];
+		addResource(&lightsDesc, NULL);
+	}
+
+	// Written by the light bin pass every frame before the scene reads them, they rest as shader resources in between
+	BufferLoadDesc clusterLightCountsDesc = {};
+	clusterLightCountsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER | DESCRIPTOR_TYPE_RW_BUFFER;
+	clusterLightCountsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	clusterLightCountsDesc.mDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+	clusterLightCountsDesc.mDesc.mFirstElement = 0;
+	clusterLightCountsDesc.mDesc.mElementCount = CLUSTER_COUNT;
+	clusterLightCountsDesc.mDesc.mStructStride = sizeof(uint32_t);
+	clusterLightCountsDesc.mDesc.mSize = sizeof(uint32_t) * CLUSTER_COUNT;
+	clusterLightCountsDesc.pData = NULL;
+	clusterLightCountsDesc.ppBuffer = &pClusterLightCountsBuffer;
+	addResource(&clusterLightCountsDesc, NULL);
+
+	BufferLoadDesc clusterLightIndicesDesc = clusterLightCountsDesc;
+	clusterLightIndicesDesc.mDesc.mElementCount = CLUSTER_COUNT * CLUSTER_MAX_LIGHTS;
+	clusterLightIndicesDesc.mDesc.mSize = sizeof(uint32_t) * CLUSTER_COUNT * CLUSTER_MAX_LIGHTS;
+	clusterLightIndicesDesc.ppBuffer = &pClusterLightIndicesBuffer;
+	addResource(&clusterLightIndicesDesc, NULL);
+
+	BufferLoadDesc clusterLightCountsReadbackDesc = {};
+	clusterLightCountsReadbackDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_TO_CPU;
+	clusterLightCountsReadbackDesc.mDesc.mStartState = RESOURCE_STATE_COPY_DEST;
+	clusterLightCountsReadbackDesc.mDesc.mSize = sizeof(uint32_t) * CLUSTER_COUNT;
+	clusterLightCountsReadbackDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	clusterLightCountsReadbackDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		clusterLightCountsReadbackDesc.ppBuffer = &pClusterLightCountsReadbackBuffers[i];
+		addResource(&clusterLightCountsReadbackDesc, NULL);
+	}
+
+	// Sized by the draw nodes and meshes of createScene
+	addSceneBuffers();
+	addOcclusionRetestBuffer();
+}
+
+// Written by the record threads every frame, the lists only exist when LODs were built
+static void addLodInstanceBuffers()
+{
+	gLodInstanceCapacity = getLodInstanceCapacity();
+	gInstanceLods = (uint8_t*)calloc(gLodInstanceCapacity, sizeof(uint8_t));
+
+	BufferLoadDesc lodInstancesDesc = {};
+	lodInstancesDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	lodInstancesDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	lodInstancesDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	lodInstancesDesc.mDesc.mFirstElement = 0;
+	lodInstancesDesc.mDesc.mElementCount = gLodInstanceCapacity;
+	lodInstancesDesc.mDesc.mStructStride = sizeof(uint32_t);
+	lodInstancesDesc.mDesc.mSize = sizeof(uint32_t) * (uint64_t)gLodInstanceCapacity;
+	lodInstancesDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		lodInstancesDesc.ppBuffer = &pLodInstancesBuffers[i];
+		addResource(&lodInstancesDesc, NULL);
+	}
+}
+
+void MeshViewer::addSceneBuffers()
+{
+	addLodInstanceBuffers();
+
+	// One argument block per GLTF mesh, so a node can issue all of its meshes with a single indirect call
+	BufferLoadDesc indirectArgsDesc = {};
+	indirectArgsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_INDIRECT_BUFFER;
+	indirectArgsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	indirectArgsDesc.mDesc.mSize = sizeof(IndirectDrawIndexArguments) * max(gMeshAsset.mMeshCount, 1u);
+	indirectArgsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	indirectArgsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		indirectArgsDesc.ppBuffer = &pIndirectDrawArgsBuffers[i];
+		addResource(&indirectArgsDesc, NULL);
+	}
+
+	// GPU culling
+	const uint32_t meshBoundsCount = max(gMeshWorldBounds.mCount, 1u);
+
+	BufferLoadDesc meshBoundsDesc = {};
+	meshBoundsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	meshBoundsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	meshBoundsDesc.mDesc.mFirstElement = 0;
+	meshBoundsDesc.mDesc.mElementCount = meshBoundsCount * 2;
+	meshBoundsDesc.mDesc.mStructStride = sizeof(vec4);
+	meshBoundsDesc.mDesc.mSize = sizeof(vec4) * meshBoundsCount * 2;
+	meshBoundsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	meshBoundsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		meshBoundsDesc.ppBuffer = &pMeshBoundsBuffers[i];
+		addResource(&meshBoundsDesc, NULL);
+	}
+
+	// Zero instance counts and draw counts, copied over the GPU arguments before every cull pass
+	const uint32_t gpuDrawArgsSize = getGpuDrawArgsSize();
+	uint8_t* pGpuDrawArgsReset = (uint8_t*)calloc(1, gpuDrawArgsSize);
+	IndirectDrawIndexArguments* pResetArgs = (IndirectDrawIndexArguments*)pGpuDrawArgsReset;
+	for (uint32_t d = 0; d < gDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const MeshAssetMesh& mesh = gMeshAsset.pMeshes[node.mMeshIndex + i];
+			pResetArgs[node.mFirstBounds + i].mIndexCount = mesh.mIndexCount;
+			pResetArgs[node.mFirstBounds + i].mStartIndex = mesh.mStartIndex;
+		}
+	}
+
+	BufferLoadDesc gpuDrawArgsResetDesc = {};
+	gpuDrawArgsResetDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+	gpuDrawArgsResetDesc.mDesc.mStartState = RESOURCE_STATE_COPY_SOURCE;
+	gpuDrawArgsResetDesc.mDesc.mSize = gpuDrawArgsSize;
+	gpuDrawArgsResetDesc.pData = pGpuDrawArgsReset;
+	gpuDrawArgsResetDesc.ppBuffer = &pGpuDrawArgsResetBuffer;
+	addResource(&gpuDrawArgsResetDesc, NULL);
+
+	addGpuCullBuffers();
+
+	// Meshlet culling, the tables stay minimal when no meshlets were built
+	const uint32_t clusterDrawNodeCount = gMeshlets.mMeshletCount ? gDrawNodeCount : 0;
+	uint32_t clusterCapacity = 0;
+	for (uint32_t d = 0; d < clusterDrawNodeCount; ++d)
+	{
+		for (uint32_t i = 0; i < gDrawNodes[d].mMeshCount; ++i)
+			clusterCapacity += gMeshlets.pMeshletCounts[gDrawNodes[d].mMeshIndex + i];
+	}
+	uint32_t* pClusters = (uint32_t*)malloc(sizeof(uint32_t) * 4 * max(clusterCapacity, 1u));
+	IndirectDrawIndexArguments* pClusterResetArgs = (IndirectDrawIndexArguments*)calloc(meshBoundsCount, sizeof(IndirectDrawIndexArguments));
+	gClusterCount = 0;
+	gClusterIndexCount = 0;
+	for (uint32_t d = 0; d < clusterDrawNodeCount; ++d)
+	{
+		const DrawNode& node = gDrawNodes[d];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const uint32_t assetMesh = node.mMeshIndex + i;
+			const uint32_t drawMesh = node.mFirstBounds + i;
+			for (uint32_t m = 0; m < gMeshlets.pMeshletCounts[assetMesh]; ++m)
+			{
+				uint32_t* pCluster = pClusters + gClusterCount++ * 4;
+				pCluster[0] = gMeshlets.pFirstMeshlet[assetMesh] + m;
+				pCluster[1] = drawMesh;
+				pCluster[2] = gClusterIndexCount;
+				pCluster[3] = 0;
+			}
+
+			// Every draw mesh owns a segment as large as the whole mesh, so appends never overflow
+			pClusterResetArgs[drawMesh].mInstanceCount = 1;
+			pClusterResetArgs[drawMesh].mStartIndex = gClusterIndexCount;
+			gClusterIndexCount += gMeshAsset.pMeshes[assetMesh].mIndexCount;
+		}
+	}
+
+	BufferLoadDesc drawTransformsDesc = {};
+	drawTransformsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	drawTransformsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	drawTransformsDesc.mDesc.mFirstElement = 0;
+	drawTransformsDesc.mDesc.mElementCount = meshBoundsCount;
+	drawTransformsDesc.mDesc.mStructStride = sizeof(mat4);
+	drawTransformsDesc.mDesc.mSize = sizeof(mat4) * meshBoundsCount;
+	drawTransformsDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	drawTransformsDesc.pData = NULL;
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		drawTransformsDesc.ppBuffer = &pDrawTransformsBuffers[i];
+		addResource(&drawTransformsDesc, NULL);
+	}
+
+	BufferLoadDesc clustersDesc = {};
+	clustersDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+	clustersDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	clustersDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	clustersDesc.mDesc.mFirstElement = 0;
+	clustersDesc.mDesc.mElementCount = max(gClusterCount, 1u);
+	clustersDesc.mDesc.mStructStride = sizeof(uint32_t) * 4;
+	clustersDesc.mDesc.mSize = sizeof(uint32_t) * 4 * max(gClusterCount, 1u);
+	clustersDesc.pData = pClusters;
+	clustersDesc.ppBuffer = &pClustersBuffer;
+	addResource(&clustersDesc, &gSceneGeometry.mUploadToken);
+
+	BufferLoadDesc meshletsDesc = clustersDesc;
+	meshletsDesc.mDesc.mElementCount = max(gMeshlets.mMeshletCount, 1u);
+	meshletsDesc.mDesc.mStructStride = sizeof(Meshlet);
+	meshletsDesc.mDesc.mSize = sizeof(Meshlet) * max(gMeshlets.mMeshletCount, 1u);
+	meshletsDesc.pData = gMeshlets.pMeshlets;
+	meshletsDesc.ppBuffer = &pMeshletsBuffer;
+	addResource(&meshletsDesc, &gSceneGeometry.mUploadToken);
+
+	BufferLoadDesc meshletBoundsDesc = clustersDesc;
+	meshletBoundsDesc.mDesc.mElementCount = max(gMeshlets.mMeshletCount, 1u) * 2;
+	meshletBoundsDesc.mDesc.mStructStride = sizeof(vec4);
+	meshletBoundsDesc.mDesc.mSize = sizeof(MeshletBounds) * max(gMeshlets.mMeshletCount, 1u);
+	meshletBoundsDesc.pData = gMeshlets.pBounds;
+	meshletBoundsDesc.ppBuffer = &pMeshletBoundsBuffer;
+	addResource(&meshletBoundsDesc, &gSceneGeometry.mUploadToken);
+
+	BufferLoadDesc meshletIndicesDesc = clustersDesc;
+	meshletIndicesDesc.mDesc.mElementCount = max(gMeshlets.mIndexCount, 1u);
+	meshletIndicesDesc.mDesc.mStructStride = sizeof(uint32_t);
+	meshletIndicesDesc.mDesc.mSize = sizeof(uint32_t) * max(gMeshlets.mIndexCount, 1u);
+	meshletIndicesDesc.pData = gMeshlets.pIndices;
+	meshletIndicesDesc.ppBuffer = &pMeshletIndicesBuffer;
+	addResource(&meshletIndicesDesc, &gSceneGeometry.mUploadToken);
+
+	BufferLoadDesc clusterDrawArgsResetDesc = {};
+	clusterDrawArgsResetDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+	clusterDrawArgsResetDesc.mDesc.mStartState = RESOURCE_STATE_COPY_SOURCE;
+	clusterDrawArgsResetDesc.mDesc.mSize = sizeof(IndirectDrawIndexArguments) * meshBoundsCount;
+	clusterDrawArgsResetDesc.pData = pClusterResetArgs;
+	clusterDrawArgsResetDesc.ppBuffer = &pClusterDrawArgsResetBuffer;
+	addResource(&clusterDrawArgsResetDesc, NULL);
+
+	BufferLoadDesc clusterDrawArgsDesc = {};
+	clusterDrawArgsDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_INDIRECT_BUFFER;
+	clusterDrawArgsDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	clusterDrawArgsDesc.mDesc.mStartState = RESOURCE_STATE_INDIRECT_ARGUMENT;
+	clusterDrawArgsDesc.mDesc.mFirstElement = 0;
+	clusterDrawArgsDesc.mDesc.mStructStride = sizeof(uint32_t);
+	clusterDrawArgsDesc.pData = NULL;
+	clusterDrawArgsDesc.mDesc.mElementCount = meshBoundsCount * sizeof(IndirectDrawIndexArguments) / sizeof(uint32_t);
+	clusterDrawArgsDesc.mDesc.mSize = sizeof(IndirectDrawIndexArguments) * meshBoundsCount;
+	clusterDrawArgsDesc.ppBuffer = &pClusterDrawArgsBuffer;
+	addResource(&clusterDrawArgsDesc, NULL);
+
+	BufferLoadDesc clusterIndexDesc = {};
+	clusterIndexDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_INDEX_BUFFER;
+	clusterIndexDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+	clusterIndexDesc.mDesc.mStartState = RESOURCE_STATE_INDEX_BUFFER;
+	clusterIndexDesc.mDesc.mFirstElement = 0;
+	clusterIndexDesc.mDesc.mElementCount = max(gClusterIndexCount, 1u);
+	clusterIndexDesc.mDesc.mStructStride = sizeof(uint32_t);
+	clusterIndexDesc.mDesc.mSize = sizeof(uint32_t) * max(gClusterIndexCount, 1u);
+	clusterIndexDesc.pData = NULL;
+	clusterIndexDesc.ppBuffer = &pClusterIndexBuffer;
+	addResource(&clusterIndexDesc, NULL);
+
+	gSceneStagingAllocations[gSceneStagingAllocationCount++] = pGpuDrawArgsReset;
+	gSceneStagingAllocations[gSceneStagingAllocationCount++] = pClusters;
+	gSceneStagingAllocations[gSceneStagingAllocationCount++] = pClusterResetArgs;
+}
+
+// Exit removes with the GPU idle, a scene swap retires to the deferred removal queue, frames in flight still read them
+static void removeSceneBuffer(Buffer** ppBuffer, bool deferred)
+{
+	if (deferred)
+		deferRemoveBuffer(&gDeferredRemovals, *ppBuffer);
+	else
+		removeResource(*ppBuffer);
+	*ppBuffer = NULL;
+}
+
+// The retest list is full size while gOcclusionBuffers is set, addGpuCullBuffers clears it past the memory budget
+static void updateOcclusionRetestBuffer()
+{
+	if (gOcclusionRetestCapacity == (gOcclusionBuffers ? gMaxOcclusionRetestCount : 1))
+		return;
+	removeSceneBuffer(&pOcclusionRetestBuffer, true);
+	addOcclusionRetestBuffer();
+}
+
+void MeshViewer::removeSceneBuffers(bool deferred)
+{
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		removeSceneBuffer(&pLodInstancesBuffers[i], deferred);
+		removeSceneBuffer(&pIndirectDrawArgsBuffers[i], deferred);
+		removeSceneBuffer(&pMeshBoundsBuffers[i], deferred);
+		removeSceneBuffer(&pDrawTransformsBuffers[i], deferred);
+	}
+	removeSceneBuffer(&pGpuDrawArgsBuffer, deferred);
+	removeSceneBuffer(&pGpuDrawArgsResetBuffer, deferred);
+	removeSceneBuffer(&pVisibleInstancesBuffer, deferred);
+	removeSceneBuffer(&pClustersBuffer, deferred);
+	removeSceneBuffer(&pMeshletsBuffer, deferred);
+	removeSceneBuffer(&pMeshletBoundsBuffer, deferred);
+	removeSceneBuffer(&pMeshletIndicesBuffer, deferred);
+	removeSceneBuffer(&pClusterDrawArgsBuffer, deferred);
+	removeSceneBuffer(&pClusterDrawArgsResetBuffer, deferred);
+	removeSceneBuffer(&pClusterIndexBuffer, deferred);
+	free(gInstanceLods);
+	gInstanceLods = NULL;
 }
 
 void MeshViewer::createDescriptorSets()
 {
-	DescriptorSetDesc setDesc = { pBasicRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_DRAW, 1 };
+	DescriptorSetDesc setDesc = { pBasicRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_DRAW, gMaxFramesInFlight };
 	addDescriptorSet(pRenderer, &setDesc, &pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
-	setDesc = { pBasicRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, 3 };
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+		updateMaterialTextures(i);
+
+	// Every set binding a scene sized buffer
+	addSceneDescriptorSets();
+
+	// One set per mip of every frame slot, each with its own pair of mips and the frame's upload arena
+	setDesc = { pHiZRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+	addDescriptorSet(pRenderer, &setDesc, &pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	setDesc = { pHiZRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_DRAW, gMaxFramesInFlight * gHiZMaxMipCount };
+	addDescriptorSet(pRenderer, &setDesc, &pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW]);
+
+	setDesc = { pLightBinRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+	addDescriptorSet(pRenderer, &setDesc, &pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	setDesc = { pLightBinRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gMaxFramesInFlight };
+	addDescriptorSet(pRenderer, &setDesc, &pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+
+	DescriptorData lightParams[2] = {};
+	lightParams[0].pName = "clusterLightCounts";
+	lightParams[0].ppBuffers = &pClusterLightCountsBuffer;
+	lightParams[1].pName = "clusterLightIndices";
+	lightParams[1].ppBuffers = &pClusterLightIndicesBuffer;
+	updateDescriptorSet(pRenderer, 0, pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 2, lightParams);
+
+	DescriptorData params[2] = {};
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		params[0] = {};
+		params[0].pName = "lightBinConstants";
+		params[0].ppBuffers = &pLightBinConstantsBuffers[i];
+		params[1] = {};
+		params[1].pName = "lights";
+		params[1].ppBuffers = &pLightsBuffers[i];
+		updateDescriptorSet(pRenderer, i, pLightBinDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], 2, params);
+	}
+}
+
+void MeshViewer::addSceneDescriptorSets()
+{
+	DescriptorSetDesc setDesc = { pBasicRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gMaxFramesInFlight };
 	addDescriptorSet(pRenderer, &setDesc, &pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+	setDesc = { pBasicRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+	addDescriptorSet(pRenderer, &setDesc, &pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
 
 	DescriptorData params[4] = {};
-	params[0].pName = "meshConstants";
-	params[0].ppBuffers = &pMeshConstantsBuffer;
-	params[1].pName = "materialConstants";
-	params[1].ppBuffers = &pMaterialConstantsBuffer;
-	params[2].pName = "baseColorMap";
-	params[2].ppTextures = &pBaseColorMap;
-	params[3].pName = "baseColorSampler";
-	params[3].ppSamplers = &pBaseColorSampler;
-	updateDescriptorSet(pRenderer, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 4, params);
-
-	for (uint32_t i = 0; i < gImageCount; ++i)
+	params[0] = {};
+	params[0].pName = "instanceTransforms";
+	params[0].ppBuffers = &pInstanceTransformsBuffer;
+	params[1] = {};
+	params[1].pName = "visibleInstances";
+	params[1].ppBuffers = &pVisibleInstancesBuffer;
+	params[2] = {};
+	params[2].pName = "materials";
+	params[2].ppBuffers = &pMaterialsBuffer;
+	updateDescriptorSet(pRenderer, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 3, params);
+
+	DescriptorData lightParams[3] = {};
+	lightParams[0].pName = "clusterLightCounts";
+	lightParams[0].ppBuffers = &pClusterLightCountsBuffer;
+	lightParams[1].pName = "clusterLightIndices";
+	lightParams[1].ppBuffers = &pClusterLightIndicesBuffer;
+	lightParams[2].pName = "shadowMap";
+	lightParams[2].ppTextures = &pShadowMap->pTexture;
+	updateDescriptorSet(pRenderer, 0, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 3, lightParams);
+
+	// The global constants are the first block of every frame's upload arena
+	DescriptorDataRange globalConstantsRange = { 0, (uint32_t)round_up_64(sizeof(GlobalConstants), gUploadArena.mAlignment) };
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
 	{
 		params[0].pName = "globalConstants";
-		params[0].ppBuffers = &pGlobalConstantsBuffer[i];
-		updateDescriptorSet(pRenderer, i, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], 1, params);
+		params[0].ppBuffers = &gUploadArena.ppBuffers[i];
+		params[0].pRanges = &globalConstantsRange;
+		params[1].pName = "lodInstances";
+		params[1].ppBuffers = &pLodInstancesBuffers[i];
+		params[2] = {};
+		params[2].pName = "lights";
+		params[2].ppBuffers = &pLightsBuffers[i];
+		params[3] = {};
+		params[3].pName = "shadowInstances";
+		params[3].ppBuffers = &pShadowInstancesBuffers[i];
+		updateDescriptorSet(pRenderer, i, pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], 4, params);
+	}
+
+	setDesc = { pCullRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+	addDescriptorSet(pRenderer, &setDesc, &pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	setDesc = { pCullRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gMaxFramesInFlight };
+	addDescriptorSet(pRenderer, &setDesc, &pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+
+	params[0] = {};
+	params[0].pName = "instanceTransforms";
+	params[0].ppBuffers = &pInstanceTransformsBuffer;
+	params[1] = {};
+	params[1].pName = "drawArgs";
+	params[1].ppBuffers = &pGpuDrawArgsBuffer;
+	params[2] = {};
+	params[2].pName = "visibleInstances";
+	params[2].ppBuffers = &pVisibleInstancesBuffer;
+	updateDescriptorSet(pRenderer, 0, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 3, params);
+
+	DescriptorData occlusionParams[3] = {};
+	occlusionParams[0].pName = "occlusionRetest";
+	occlusionParams[0].ppBuffers = &pOcclusionRetestBuffer;
+	occlusionParams[1].pName = "occlusionCounters";
+	occlusionParams[1].ppBuffers = &pOcclusionCountersBuffer;
+	occlusionParams[2].pName = "occlusionDispatchArgs";
+	occlusionParams[2].ppBuffers = &pOcclusionDispatchArgsBuffer;
+	updateDescriptorSet(pRenderer, 0, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 3, occlusionParams);
+
+	// The pyramid follows the depth buffer, addHiZPyramid binds it. Sets replaced after the first Load get it here.
+	if (pHiZTexture)
+	{
+		occlusionParams[0] = {};
+		occlusionParams[0].pName = "hiZ";
+		occlusionParams[0].ppTextures = &pHiZTexture;
+		updateDescriptorSet(pRenderer, 0, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 1, occlusionParams);
+	}
+
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		params[0] = {};
+		params[0].pName = "cullConstants";
+		params[0].ppBuffers = &pCullConstantsBuffers[i];
+		params[1] = {};
+		params[1].pName = "meshBounds";
+		params[1].ppBuffers = &pMeshBoundsBuffers[i];
+		updateDescriptorSet(pRenderer, i, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], 2, params);
+	}
+
+	setDesc = { pClusterCullRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+	addDescriptorSet(pRenderer, &setDesc, &pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE]);
+	setDesc = { pClusterCullRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gMaxFramesInFlight };
+	addDescriptorSet(pRenderer, &setDesc, &pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME]);
+
+	DescriptorData clusterParams[6] = {};
+	clusterParams[0].pName = "clusters";
+	clusterParams[0].ppBuffers = &pClustersBuffer;
+	clusterParams[1].pName = "meshlets";
+	clusterParams[1].ppBuffers = &pMeshletsBuffer;
+	clusterParams[2].pName = "meshletBounds";
+	clusterParams[2].ppBuffers = &pMeshletBoundsBuffer;
+	clusterParams[3].pName = "meshletIndices";
+	clusterParams[3].ppBuffers = &pMeshletIndicesBuffer;
+	clusterParams[4].pName = "clusterDrawArgs";
+	clusterParams[4].ppBuffers = &pClusterDrawArgsBuffer;
+	clusterParams[5].pName = "clusterIndices";
+	clusterParams[5].ppBuffers = &pClusterIndexBuffer;
+	updateDescriptorSet(pRenderer, 0, pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 6, clusterParams);
+
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		params[0] = {};
+		params[0].pName = "clusterCullConstants";
+		params[0].ppBuffers = &pClusterCullConstantsBuffers[i];
+		params[1] = {};
+		params[1].pName = "drawTransforms";
+		params[1].ppBuffers = &pDrawTransformsBuffers[i];
+		updateDescriptorSet(pRenderer, i, pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], 2, params);
 	}
 }
 
+// Same as removeSceneBuffer
+static void removeSceneDescriptorSet(DescriptorSet** ppDescriptorSet, bool deferred)
+{
+	if (deferred)
+		deferRemoveDescriptorSet(&gDeferredRemovals, *ppDescriptorSet);
+	else
+		removeDescriptorSet(pRenderer, *ppDescriptorSet);
+	*ppDescriptorSet = NULL;
+}
+
+void MeshViewer::removeSceneDescriptorSets(bool deferred)
+{
+	removeSceneDescriptorSet(&pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], deferred);
+	removeSceneDescriptorSet(&pBasicDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], deferred);
+	removeSceneDescriptorSet(&pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], deferred);
+	removeSceneDescriptorSet(&pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], deferred);
+	removeSceneDescriptorSet(&pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], deferred);
+	removeSceneDescriptorSet(&pClusterCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_FRAME], deferred);
+}
+
 void MeshViewer::createScene()
 {
 	CameraMotionParameters cmp{ 1.0f, 120.0f, 40.0f };
@@ -710,53 +4181,64 @@ void MeshViewer::createScene()
 	pCameraController = initFpsCameraController(camPos, lookAt);
 	pCameraController->setMotionParameters(cmp);
 
-	typedef void(*UpdateTransformHandler)(GLTFContainer* pData, size_t nodeIndex, mat4* nodeTransforms, bool* nodeTransformsInited);
-	static UpdateTransformHandler UpdateTransform = [](GLTFContainer* pData, size_t nodeIndex, mat4* nodeTransforms, bool* nodeTransformsInited)
-	{
-		if (nodeTransformsInited[nodeIndex]) { return; }
-
-		if (pData->pNodes[nodeIndex].mScale.getX() != pData->pNodes[nodeIndex].mScale.getY() ||
-			pData->pNodes[nodeIndex].mScale.getX() != pData->pNodes[nodeIndex].mScale.getZ())
-		{
-			LOGF(LogLevel::eWARNING, "Node %llu has a non-uniform scale and will have an incorrect normal when rendered.", (uint64_t)nodeIndex);
-		}
+	addSceneNodes();
+}
 
-		mat4 matrix = pData->pNodes[nodeIndex].mMatrix;
-		if (pData->pNodes[nodeIndex].mParentIndex != UINT_MAX)
+void MeshViewer::addSceneNodes()
+{
+	const uint32_t assetNodeCount = gMeshAsset.mNodeCount;
+	uint32_t* pParents = (uint32_t*)malloc(sizeof(uint32_t) * max(assetNodeCount, 1u));
+	mat4* pLocalMatrices = (mat4*)malloc(sizeof(mat4) * max(assetNodeCount, 1u)); //-V630
+	for (uint32_t i = 0; i < assetNodeCount; ++i)
+	{
+		const MeshAssetNode& node = gMeshAsset.pNodes[i];
+		pLocalMatrices[i] = getMeshAssetNodeMatrix(node);
+		// Column lengths of the upper 3x3 are the node's scale
+		const mat3 basis = pLocalMatrices[i].getUpper3x3();
+		const float scaleX = length(basis.getCol0());
+		if (fabsf(scaleX - length(basis.getCol1())) > 1e-4f * scaleX || fabsf(scaleX - length(basis.getCol2())) > 1e-4f * scaleX)
 		{
-			UpdateTransform(pData, (size_t)pData->pNodes[nodeIndex].mParentIndex, nodeTransforms, nodeTransformsInited);
-			matrix = nodeTransforms[pData->pNodes[nodeIndex].mParentIndex] * matrix;
+			LOGF(LogLevel::eWARNING, "Node %u has a non-uniform scale and will have an incorrect normal when rendered.", i);
 		}
-		nodeTransforms[nodeIndex] = matrix;
-		nodeTransformsInited[nodeIndex] = true;
-	};
+		pParents[i] = node.mParentIndex;
+	}
 
-	if (pGLTFContainer->mNodeCount)
+	// The frame loop always has a graph to update, a model without nodes or with a broken hierarchy gets an empty
+	// one and draws nothing
+	SceneGraphDesc sceneGraphDesc = {};
+	sceneGraphDesc.mNodeCount = assetNodeCount;
+	sceneGraphDesc.pParents = pParents;
+	sceneGraphDesc.pLocalMatrices = pLocalMatrices;
+	if (!initSceneGraph(&sceneGraphDesc, &pSceneGraph))
 	{
-		bool* nodeTransformsInited = (bool*)alloca(sizeof(bool) * pGLTFContainer->mNodeCount);
-		memset(nodeTransformsInited, 0, sizeof(bool) * pGLTFContainer->mNodeCount);
+		sceneGraphDesc = {};
+		initSceneGraph(&sceneGraphDesc, &pSceneGraph);
+	}
+	updateSceneGraph(pSceneGraph);
 
-		gNodeTransforms = (mat4*)malloc(sizeof(mat4) * pGLTFContainer->mNodeCount); //-V630
+	free(pLocalMatrices);
+	free(pParents);
 
-		for (uint32_t i = 0; i < pGLTFContainer->mNodeCount; ++i)
-		{
-			UpdateTransform(pGLTFContainer, i, gNodeTransforms, nodeTransformsInited);
-		}
+	uint32_t meshBoundsCount = 0;
+	if (pSceneGraph->mNodeCount)
+	{
+		const uint32_t nodeCount = pSceneGraph->mNodeCount;
 
 		// Scale and centre the model.
 
 		Point3 modelBounds[2] = { Point3(FLT_MAX), Point3(-FLT_MAX) };
-		size_t nodeIndex = 0;
-		for (uint32_t n = 0; n < pGLTFContainer->mNodeCount; ++n)
+		for (uint32_t n = 0; n < nodeCount; ++n)
 		{
-			GLTFNode& node = pGLTFContainer->pNodes[n];
+			const MeshAssetNode& node = gMeshAsset.pNodes[n];
 
-			if (node.mMeshIndex != UINT_MAX)
+			if (node.mMeshIndex != MESH_ASSET_INVALID_NODE)
 			{
+				const mat4& worldMatrix = pSceneGraph->pWorldMatrices[pSceneGraph->pSortedIndices[n]];
 				for (uint32_t i = 0; i < node.mMeshCount; ++i)
 				{
-					Point3 minBound = pGLTFContainer->pMeshes[node.mMeshIndex + i].mMin;
-					Point3 maxBound = pGLTFContainer->pMeshes[node.mMeshIndex + i].mMax;
+					const MeshAssetMesh& mesh = gMeshAsset.pMeshes[node.mMeshIndex + i];
+					Point3 minBound = Point3(mesh.mMin[0], mesh.mMin[1], mesh.mMin[2]);
+					Point3 maxBound = Point3(mesh.mMax[0], mesh.mMax[1], mesh.mMax[2]);
 					Point3 localPoints[] = {
 						Point3(minBound.getX(), minBound.getY(), minBound.getZ()),
 						Point3(minBound.getX(), minBound.getY(), maxBound.getZ()),
@@ -769,13 +4251,12 @@ void MeshViewer::createScene()
 					};
 					for (size_t j = 0; j < 8; j += 1)
 					{
-						vec4 worldPoint = gNodeTransforms[nodeIndex] * localPoints[j];
+						vec4 worldPoint = worldMatrix * localPoints[j];
 						modelBounds[0] = minPerElem(modelBounds[0], Point3(worldPoint.getXYZ()));
 						modelBounds[1] = maxPerElem(modelBounds[1], Point3(worldPoint.getXYZ()));
 					}
 				}
 			}
-			nodeIndex += 1;
 		}
 
 		const float targetSize = 1.0;
@@ -790,11 +4271,101 @@ void MeshViewer::createScene()
 		scaleVector.setZ(-scaleVector.getZ());
 		mat4 translateScale = mat4::scale(scaleVector) * mat4::translation(-Vector3(modelCentreBase));
 
-		for (uint32_t i = 0; i < pGLTFContainer->mNodeCount; ++i)
+		sceneGraphSetRootTransform(pSceneGraph, translateScale);
+		updateSceneGraph(pSceneGraph);
+
+		gDrawNodes = (DrawNode*)malloc(sizeof(DrawNode) * nodeCount);
+		gDrawNodeCount = 0;
+		for (uint32_t i = 0; i < nodeCount; ++i)
 		{
-			gNodeTransforms[i] = translateScale * gNodeTransforms[i];
+			const MeshAssetNode& node = gMeshAsset.pNodes[i];
+			if (node.mMeshIndex != MESH_ASSET_INVALID_NODE)
+			{
+				DrawNode& drawNode = gDrawNodes[gDrawNodeCount++];
+				drawNode.mSceneNode = pSceneGraph->pSortedIndices[i];
+				drawNode.mMeshIndex = node.mMeshIndex;
+				drawNode.mMeshCount = node.mMeshCount;
+				drawNode.mFirstBounds = meshBoundsCount;
+				meshBoundsCount += node.mMeshCount;
+
+				for (uint32_t l = 0; l < MESH_LOD_MAX_LEVELS; ++l)
+				{
+					drawNode.mLodErrors[l] = 0.0f;
+					for (uint32_t m = 0; m < node.mMeshCount && gMeshLods.pLevels; ++m)
+						drawNode.mLodErrors[l] = max(drawNode.mLodErrors[l], getMeshLodLevel(&gMeshLods, node.mMeshIndex + m, l).mError);
+				}
+			}
 		}
 	}
+
+	initBoundsArray(meshBoundsCount, &gMeshWorldBounds);
+	gMeshVisibility = (uint8_t*)calloc(gMeshWorldBounds.mPaddedCount, sizeof(uint8_t));
+	gDrawNodeLods = (uint8_t*)calloc(max(gDrawNodeCount, 1u), sizeof(uint8_t));
+	gDrawNodeLodStates = (DrawNodeLodState*)calloc(max(gDrawNodeCount, 1u), sizeof(DrawNodeLodState));
+	initDrawSortList(gDrawNodeCount, &gDrawOrder);
+	updateMeshWorldBounds(true);
+}
+
+void MeshViewer::removeSceneNodes()
+{
+	exitSceneGraph(pSceneGraph);
+	pSceneGraph = NULL;
+	free(gDrawNodes);
+	gDrawNodes = NULL;
+	gDrawNodeCount = 0;
+	exitBoundsArray(&gMeshWorldBounds);
+	free(gMeshVisibility);
+	gMeshVisibility = NULL;
+	free(gDrawNodeLods);
+	gDrawNodeLods = NULL;
+	free(gDrawNodeLodStates);
+	gDrawNodeLodStates = NULL;
+	exitDrawSortList(&gDrawOrder);
+}
+
+void MeshViewer::addImportedScene()
+{
+	// Everything sized for the empty startup scene is retired, frames in flight still use its buffers and sets. Its
+	// material table has no textures, only the buffer of the default material goes.
+	removeSceneDescriptorSets(true);
+	removeSceneBuffers(true);
+	deferRemoveBuffer(&gDeferredRemovals, pMaterialsBuffer);
+	pMaterialsBuffer = NULL;
+	exitMaterialTable(&gMaterialTable);
+	removeSceneNodes();
+
+	useSceneImport(&gSceneImport);
+	addSceneGeometry();
+	addMaterials();
+	addSceneNodes();
+	addSceneBuffers();
+	updateOcclusionRetestBuffer();
+	addSceneDescriptorSets();
+
+	LOGF(LogLevel::eINFO, "Scene imported %.2f ms after startup, %u draw nodes", getHiresTimerUSec(&gStartupTimer, false) / 1000.0f, gDrawNodeCount);
+}
+
+void MeshViewer::resizeGpuCullBuffers()
+{
+	// Frames in flight still cull into the old buffers and bind them through the old sets
+	gOcclusionBuffers = gOcclusionBuffers || gOcclusionCulling;
+	removeSceneDescriptorSets(true);
+	removeSceneBuffer(&pGpuDrawArgsBuffer, true);
+	removeSceneBuffer(&pVisibleInstancesBuffer, true);
+	addGpuCullBuffers();
+	updateOcclusionRetestBuffer();
+	addSceneDescriptorSets();
+}
+
+void MeshViewer::resizeLodInstanceBuffers()
+{
+	// Frames in flight still read the old lists through the old sets, the levels restart from 0
+	removeSceneDescriptorSets(true);
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+		removeSceneBuffer(&pLodInstancesBuffers[i], true);
+	free(gInstanceLods);
+	addLodInstanceBuffers();
+	addSceneDescriptorSets();
 }
 
 void MeshViewer::createGUI()
@@ -806,6 +4377,110 @@ void MeshViewer::createGUI()
 	SeparatorWidget separator;
 	uiCreateComponentWidget(pGuiGraphics, "", &separator, WIDGET_TYPE_SEPARATOR);
 
+	DropdownWidget drawModeDropdown;
+	drawModeDropdown.pData = &gDrawMode;
+	drawModeDropdown.pNames = gDrawModeNames;
+	drawModeDropdown.pValues = gDrawModeValues;
+	drawModeDropdown.mCount = DRAW_MODE_COUNT;
+	uiCreateComponentWidget(pGuiGraphics, "Draw Mode", &drawModeDropdown, WIDGET_TYPE_DROPDOWN);
+
+	SliderUintWidget instanceCountSlider;
+	instanceCountSlider.pData = &gInstanceCount;
+	instanceCountSlider.mMin = 1;
+	instanceCountSlider.mMax = gMaxInstanceCount;
+	instanceCountSlider.mStep = 1;
+	uiCreateComponentWidget(pGuiGraphics, "Instance Count", &instanceCountSlider, WIDGET_TYPE_SLIDER_UINT);
+
+	SliderUintWidget recordThreadsSlider;
+	recordThreadsSlider.pData = &gRecordThreadCount;
+	recordThreadsSlider.mMin = 1;
+	recordThreadsSlider.mMax = gMaxRecordThreads;
+	recordThreadsSlider.mStep = 1;
+	uiCreateComponentWidget(pGuiGraphics, "Record Threads", &recordThreadsSlider, WIDGET_TYPE_SLIDER_UINT);
+
+	SliderUintWidget framesInFlightSlider;
+	framesInFlightSlider.pData = &gFramesInFlight;
+	framesInFlightSlider.mMin = 1;
+	framesInFlightSlider.mMax = gMaxFramesInFlight;
+	framesInFlightSlider.mStep = 1;
+	uiCreateComponentWidget(pGuiGraphics, "Frames In Flight", &framesInFlightSlider, WIDGET_TYPE_SLIDER_UINT);
+
+	CheckboxWidget animateCheckbox;
+	animateCheckbox.pData = &gAnimateScene;
+	uiCreateComponentWidget(pGuiGraphics, "Animate Scene", &animateCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	CheckboxWidget frustumCullingCheckbox;
+	frustumCullingCheckbox.pData = &gFrustumCulling;
+	uiCreateComponentWidget(pGuiGraphics, "Frustum Culling", &frustumCullingCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	CheckboxWidget depthPrepassCheckbox;
+	depthPrepassCheckbox.pData = &gDepthPrepass;
+	uiCreateComponentWidget(pGuiGraphics, "Depth Prepass", &depthPrepassCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	CheckboxWidget sortDrawsCheckbox;
+	sortDrawsCheckbox.pData = &gSortDraws;
+	uiCreateComponentWidget(pGuiGraphics, "Sort Draws", &sortDrawsCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	CheckboxWidget gpuCullingCheckbox;
+	gpuCullingCheckbox.pData = &gGpuCulling;
+	uiCreateComponentWidget(pGuiGraphics, "GPU Culling", &gpuCullingCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	// Only with GPU culling, meshlet culling takes precedence over both
+	CheckboxWidget occlusionCullingCheckbox;
+	occlusionCullingCheckbox.pData = &gOcclusionCulling;
+	uiCreateComponentWidget(pGuiGraphics, "Occlusion Culling (Hi-Z)", &occlusionCullingCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	if (gBuildMeshlets)
+	{
+		CheckboxWidget meshletCullingCheckbox;
+		meshletCullingCheckbox.pData = &gMeshletCulling;
+		uiCreateComponentWidget(pGuiGraphics, "Meshlet Culling", &meshletCullingCheckbox, WIDGET_TYPE_CHECKBOX);
+
+		CheckboxWidget meshletConeCullingCheckbox;
+		meshletConeCullingCheckbox.pData = &gMeshletConeCulling;
+		uiCreateComponentWidget(pGuiGraphics, "Meshlet Cone Culling", &meshletConeCullingCheckbox, WIDGET_TYPE_CHECKBOX);
+	}
+
+	// With --stream the LODs are still being built
+	if (gBuildLods)
+	{
+		CheckboxWidget lodCheckbox;
+		lodCheckbox.pData = &gLodSelection;
+		uiCreateComponentWidget(pGuiGraphics, "LOD Selection", &lodCheckbox, WIDGET_TYPE_CHECKBOX);
+
+		SliderFloatWidget lodThresholdSlider;
+		lodThresholdSlider.pData = &gLodPixelThreshold;
+		lodThresholdSlider.mMin = 0.25f;
+		lodThresholdSlider.mMax = 16.0f;
+		lodThresholdSlider.mStep = 0.25f;
+		uiCreateComponentWidget(pGuiGraphics, "LOD Pixel Error", &lodThresholdSlider, WIDGET_TYPE_SLIDER_FLOAT);
+	}
+
+	uiCreateComponentWidget(pGuiGraphics, "", &separator, WIDGET_TYPE_SEPARATOR);
+
+	DropdownWidget streamedModelDropdown;
+	streamedModelDropdown.pData = &gStreamableModel;
+	streamedModelDropdown.pNames = gStreamableModelNames;
+	streamedModelDropdown.pValues = gStreamableModelValues;
+	streamedModelDropdown.mCount = sizeof(gStreamableModelNames) / sizeof(gStreamableModelNames[0]);
+	uiCreateComponentWidget(pGuiGraphics, "Streamed Model", &streamedModelDropdown, WIDGET_TYPE_DROPDOWN);
+
+	ButtonWidget addModelButton;
+	UIWidget* pAddModelButton = uiCreateComponentWidget(pGuiGraphics, "Add Model", &addModelButton, WIDGET_TYPE_BUTTON);
+	uiSetWidgetOnEditedCallback(pAddModelButton, NULL, addStreamedModel);
+
+	if (pTextureStreaming)
+	{
+		SliderFloatWidget textureBudgetSlider;
+		textureBudgetSlider.pData = &gTextureBudgetMB;
+		textureBudgetSlider.mMin = 0.0625f;
+		textureBudgetSlider.mMax = 512.0f;
+		textureBudgetSlider.mStep = 0.0625f;
+		uiCreateComponentWidget(pGuiGraphics, "Texture Budget (MB)", &textureBudgetSlider, WIDGET_TYPE_SLIDER_FLOAT);
+	}
+
+	uiCreateComponentWidget(pGuiGraphics, "", &separator, WIDGET_TYPE_SEPARATOR);
+
 	CollapsingHeaderWidget LightWidgets;
 	LightWidgets.mDefaultOpen = false;
 	uiSetCollapsingHeaderWidgetCollapsed(&LightWidgets, false);
@@ -826,6 +4501,31 @@ void MeshViewer::createGUI()
 
 	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "", &separator, WIDGET_TYPE_SEPARATOR);
 
+	CheckboxWidget shadowsCheckbox;
+	shadowsCheckbox.pData = &gShadows;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Sun Shadows", &shadowsCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	CheckboxWidget shadowCachingCheckbox;
+	shadowCachingCheckbox.pData = &gShadowCaching;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Cache Shadow Cascades", &shadowCachingCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	// The slices change size with the distance, which renders every cascade again
+	SliderFloatWidget shadowDistanceSlider;
+	shadowDistanceSlider.pData = &gShadowCascades.mDesc.mFar;
+	shadowDistanceSlider.mMin = 2.0f;
+	shadowDistanceSlider.mMax = 200.0f;
+	shadowDistanceSlider.mStep = 0.5f;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Shadow Distance", &shadowDistanceSlider, WIDGET_TYPE_SLIDER_FLOAT);
+
+	SliderFloatWidget shadowNormalOffsetSlider;
+	shadowNormalOffsetSlider.pData = &gShadowNormalOffset;
+	shadowNormalOffsetSlider.mMin = 0.0f;
+	shadowNormalOffsetSlider.mMax = 8.0f;
+	shadowNormalOffsetSlider.mStep = 0.1f;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Shadow Normal Offset", &shadowNormalOffsetSlider, WIDGET_TYPE_SLIDER_FLOAT);
+
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "", &separator, WIDGET_TYPE_SEPARATOR);
+
 	CollapsingHeaderWidget LightColor1Picker;
 	ColorPickerWidget light1Picker;
 	light1Picker.pData = &gLightColor[0];
@@ -894,18 +4594,48 @@ void MeshViewer::createGUI()
 
 	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "", &separator, WIDGET_TYPE_SEPARATOR);
 
+	SliderUintWidget clusteredLightCountSlider;
+	clusteredLightCountSlider.pData = &gClusteredLightCount;
+	clusteredLightCountSlider.mMin = 0;
+	clusteredLightCountSlider.mMax = gMaxClusteredLightCount;
+	clusteredLightCountSlider.mStep = 1;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Clustered Lights", &clusteredLightCountSlider, WIDGET_TYPE_SLIDER_UINT);
+
+	SliderFloatWidget clusteredLightRadiusSlider;
+	clusteredLightRadiusSlider.pData = &gClusteredLightRadius;
+	clusteredLightRadiusSlider.mMin = 0.05f;
+	clusteredLightRadiusSlider.mMax = 5.0f;
+	clusteredLightRadiusSlider.mStep = 0.01f;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Clustered Light Radius", &clusteredLightRadiusSlider, WIDGET_TYPE_SLIDER_FLOAT);
+
+	SliderFloatWidget clusteredLightIntensitySlider;
+	clusteredLightIntensitySlider.pData = &gClusteredLightIntensity;
+	clusteredLightIntensitySlider.mMin = 0.0f;
+	clusteredLightIntensitySlider.mMax = 5.0f;
+	clusteredLightIntensitySlider.mStep = 0.001f;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Clustered Light Intensity", &clusteredLightIntensitySlider, WIDGET_TYPE_SLIDER_FLOAT);
+
+	CheckboxWidget animateLightsCheckbox;
+	animateLightsCheckbox.pData = &gAnimateLights;
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "Animate Lights", &animateLightsCheckbox, WIDGET_TYPE_CHECKBOX);
+
+	uiCreateCollapsingHeaderSubWidget(&LightWidgets, "", &separator, WIDGET_TYPE_SEPARATOR);
+
 	uiCreateComponentWidget(pGuiGraphics, "Light Options", &LightWidgets, WIDGET_TYPE_COLLAPSING_HEADER);
 }
 
 bool MeshViewer::addSwapChain()
 {
+	if (gBenchmarkDesc.mHeadless)
+		return true;
+
 	SwapChainDesc swapChainDesc = {};
 	swapChainDesc.mWindowHandle = pWindow->handle;
 	swapChainDesc.mPresentQueueCount = 1;
 	swapChainDesc.ppPresentQueues = &pGraphicsQueue;
 	swapChainDesc.mWidth = mSettings.mWidth;
 	swapChainDesc.mHeight = mSettings.mHeight;
-	swapChainDesc.mImageCount = gImageCount;
+	swapChainDesc.mImageCount = gSwapchainImageCount;
 
 	// This unit test does manual tone mapping
 	swapChainDesc.mColorFormat = getRecommendedSwapchainFormat(true, false);
@@ -917,7 +4647,25 @@ bool MeshViewer::addSwapChain()
 
 bool MeshViewer::addRenderTargets()
 {
-	return true;
+	if (!gBenchmarkDesc.mHeadless)
+		return true;
+
+	// Same format as the swapchain would have, so headless runs compile the same pipelines
+	RenderTargetDesc offscreenRT = {};
+	offscreenRT.mArraySize = 1;
+	offscreenRT.mDepth = 1;
+	offscreenRT.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+	offscreenRT.mFormat = getRecommendedSwapchainFormat(true, false);
+	offscreenRT.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+	offscreenRT.mWidth = mSettings.mWidth;
+	offscreenRT.mHeight = mSettings.mHeight;
+	offscreenRT.mSampleCount = SAMPLE_COUNT_1;
+	offscreenRT.mSampleQuality = 0;
+	offscreenRT.mFlags = TEXTURE_CREATION_FLAG_NONE;
+	offscreenRT.pName = "Offscreen Output";
+	addRenderTarget(pRenderer, &offscreenRT, &pOffscreenTarget);
+
+	return pOffscreenTarget != NULL;
 }
 
 bool MeshViewer::addDepthBuffer()
@@ -940,6 +4688,75 @@ bool MeshViewer::addDepthBuffer()
 	return pDepthBuffer != NULL;
 }
 
+bool MeshViewer::addHiZPyramid()
+{
+	gHiZWidth = 1;
+	while (gHiZWidth * 2 <= mSettings.mWidth)
+		gHiZWidth *= 2;
+	gHiZHeight = 1;
+	while (gHiZHeight * 2 <= mSettings.mHeight)
+		gHiZHeight *= 2;
+	gHiZMipCount = 1;
+	while ((max(gHiZWidth, gHiZHeight) >> gHiZMipCount) && gHiZMipCount < gHiZMaxMipCount)
+		++gHiZMipCount;
+
+	TextureDesc hiZDesc = {};
+	hiZDesc.mWidth = gHiZWidth;
+	hiZDesc.mHeight = gHiZHeight;
+	hiZDesc.mDepth = 1;
+	hiZDesc.mArraySize = 1;
+	hiZDesc.mMipLevels = gHiZMipCount;
+	hiZDesc.mSampleCount = SAMPLE_COUNT_1;
+	hiZDesc.mFormat = TinyImageFormat_R32G32_SFLOAT;
+	hiZDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+	hiZDesc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE | DESCRIPTOR_TYPE_RW_TEXTURE;
+	hiZDesc.pName = "Hi-Z Pyramid";
+
+	TextureLoadDesc hiZLoadDesc = {};
+	hiZLoadDesc.pDesc = &hiZDesc;
+	hiZLoadDesc.ppTexture = &pHiZTexture;
+	addResource(&hiZLoadDesc, NULL);
+	if (!pHiZTexture)
+		return false;
+
+	// Nothing in it yet
+	gHiZValid = false;
+
+	// Load runs with the GPU idle, so the sets can be rewritten in place
+	DescriptorData params[3] = {};
+	params[0].pName = "hiZ";
+	params[0].ppTextures = &pHiZTexture;
+	updateDescriptorSet(pRenderer, 0, pCullDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 1, params);
+
+	params[0].pName = "depthBuffer";
+	params[0].ppTextures = &pDepthBuffer->pTexture;
+	updateDescriptorSet(pRenderer, 0, pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_NONE], 1, params);
+
+	// Mip 0 reads the depth buffer, its source is never read
+	DescriptorDataRange hiZConstantsRange = { 0, sizeof(HiZConstants) };
+	for (uint32_t i = 0; i < gMaxFramesInFlight; ++i)
+	{
+		for (uint32_t mip = 0; mip < gHiZMipCount; ++mip)
+		{
+			params[0] = {};
+			params[0].pName = "hiZConstants_rootcbv";
+			params[0].ppBuffers = &gUploadArena.ppBuffers[i];
+			params[0].pRanges = &hiZConstantsRange;
+			params[1] = {};
+			params[1].pName = "hiZSource";
+			params[1].ppTextures = &pHiZTexture;
+			params[1].mUAVMipSlice = mip ? mip - 1 : 0;
+			params[2] = {};
+			params[2].pName = "hiZDestination";
+			params[2].ppTextures = &pHiZTexture;
+			params[2].mUAVMipSlice = mip;
+			updateDescriptorSet(pRenderer, i * gHiZMaxMipCount + mip, pHiZDescriptorSets[DESCRIPTOR_UPDATE_FREQ_PER_DRAW], 3, params);
+		}
+	}
+
+	return true;
+}
+
 void MeshViewer::addPipelines()
 {
 	RasterizerStateDesc rasterizerStateDesc = {};
@@ -952,10 +4769,11 @@ void MeshViewer::addPipelines()
 
 	PipelineDesc desc = {};
 	desc.mType = PIPELINE_TYPE_GRAPHICS;
+	desc.pCache = pPipelineCache;
 	GraphicsPipelineDesc& basicPipelineSettings = desc.mGraphicsDesc;
 	basicPipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
 	basicPipelineSettings.mRenderTargetCount = 1;
-	basicPipelineSettings.pColorFormats = &pSwapChain->ppRenderTargets[0]->mFormat;
+	basicPipelineSettings.pColorFormats = &getOutputRenderTarget(0)->mFormat;
 	basicPipelineSettings.pDepthState = &depthStateDesc;
 	basicPipelineSettings.mDepthStencilFormat = pDepthBuffer->mFormat;
 	basicPipelineSettings.mSampleCount = pDepthBuffer->mSampleCount;
@@ -965,22 +4783,92 @@ void MeshViewer::addPipelines()
 	basicPipelineSettings.pShaderProgram = pBasicShader;
 	basicPipelineSettings.pVertexLayout = &gVertexLayout;
 	addPipeline(pRenderer, &desc, &pBasicPipeline);
+
+	// After the depth prepass only the fragments that wrote the depth pass the test
+	DepthStateDesc equalDepthStateDesc = depthStateDesc;
+	equalDepthStateDesc.mDepthWrite = false;
+	equalDepthStateDesc.mDepthFunc = CMP_EQUAL;
+	basicPipelineSettings.pDepthState = &equalDepthStateDesc;
+	addPipeline(pRenderer, &desc, &pBasicEqualPipeline);
+
+	// Keeps the full vertex layout, the position is all depth.vert reads but the vertex stride has to match the buffer
+	basicPipelineSettings.mRenderTargetCount = 0;
+	basicPipelineSettings.pColorFormats = NULL;
+	basicPipelineSettings.pDepthState = &depthStateDesc;
+	basicPipelineSettings.pShaderProgram = pDepthPrepassShader;
+	addPipeline(pRenderer, &desc, &pDepthPrepassPipeline);
+
+	// Slope scaled bias for the texels a sloped caster spans, the shader adds the constant part
+	RasterizerStateDesc shadowRasterizerStateDesc = rasterizerStateDesc;
+	shadowRasterizerStateDesc.mSlopeScaledDepthBias = 2.0f;
+	basicPipelineSettings.pRasterizerState = &shadowRasterizerStateDesc;
+	basicPipelineSettings.mDepthStencilFormat = pShadowMap->mFormat;
+	basicPipelineSettings.mSampleCount = pShadowMap->mSampleCount;
+	basicPipelineSettings.mSampleQuality = pShadowMap->mSampleQuality;
+	basicPipelineSettings.pShaderProgram = pShadowShader;
+	addPipeline(pRenderer, &desc, &pShadowPipeline);
+
+	desc = {};
+	desc.mType = PIPELINE_TYPE_COMPUTE;
+	desc.pCache = pPipelineCache;
+	ComputePipelineDesc& cullPipelineSettings = desc.mComputeDesc;
+	cullPipelineSettings.pRootSignature = pCullRootSignature;
+	cullPipelineSettings.pShaderProgram = pCullShader;
+	addPipeline(pRenderer, &desc, &pCullPipeline);
+
+	cullPipelineSettings.pShaderProgram = pCullLateShader;
+	addPipeline(pRenderer, &desc, &pCullLatePipeline);
+
+	cullPipelineSettings.pRootSignature = pHiZRootSignature;
+	cullPipelineSettings.pShaderProgram = pHiZDepthShader;
+	addPipeline(pRenderer, &desc, &pHiZDepthPipeline);
+
+	cullPipelineSettings.pShaderProgram = pHiZReduceShader;
+	addPipeline(pRenderer, &desc, &pHiZReducePipeline);
+
+	cullPipelineSettings.pRootSignature = pClusterCullRootSignature;
+	cullPipelineSettings.pShaderProgram = pClusterCullShader;
+	addPipeline(pRenderer, &desc, &pClusterCullPipeline);
+
+	cullPipelineSettings.pRootSignature = pLightBinRootSignature;
+	cullPipelineSettings.pShaderProgram = pLightBinShader;
+	addPipeline(pRenderer, &desc, &pLightBinPipeline);
 }
 
-void MeshViewer::updateUniformBuffers()
+void MeshViewer::removePipelines()
 {
-	BufferUpdateDesc globalConstantsBufferCbv = { pGlobalConstantsBuffer[gFrameIndex] };
-	beginUpdateResource(&globalConstantsBufferCbv);
-	*(GlobalConstants*)globalConstantsBufferCbv.pMappedData = gGlobalConstantsData;
-	endUpdateResource(&globalConstantsBufferCbv, NULL);
+	if (gPipelineColorFormat == TinyImageFormat_UNDEFINED)
+		return;
+
+	// The UI and font systems remove theirs right away, which is only reached with the GPU idle: the Load after a
+	// swapchain change or Exit
+	removeUserInterfacePipelines();
+	removeFontSystemPipelines();
 
-	BufferUpdateDesc meshConstantsBufferCbv = { pMeshConstantsBuffer };
-	beginUpdateResource(&meshConstantsBufferCbv);
-	*(MeshConstants*)meshConstantsBufferCbv.pMappedData = gMeshConstants;
-	endUpdateResource(&meshConstantsBufferCbv, NULL);
+	deferRemovePipeline(&gDeferredRemovals, pBasicPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pBasicEqualPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pDepthPrepassPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pShadowPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pCullPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pClusterCullPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pLightBinPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pCullLatePipeline);
+	deferRemovePipeline(&gDeferredRemovals, pHiZDepthPipeline);
+	deferRemovePipeline(&gDeferredRemovals, pHiZReducePipeline);
+	pBasicPipeline = NULL;
+	pBasicEqualPipeline = NULL;
+	pDepthPrepassPipeline = NULL;
+	pShadowPipeline = NULL;
+	pCullPipeline = NULL;
+	pClusterCullPipeline = NULL;
+	pLightBinPipeline = NULL;
+	pCullLatePipeline = NULL;
+	pHiZDepthPipeline = NULL;
+	pHiZReducePipeline = NULL;
+	gPipelineColorFormat = TinyImageFormat_UNDEFINED;
+}
 
-	BufferUpdateDesc materialConstantsBufferCbv = { pMaterialConstantsBuffer };
-	beginUpdateResource(&materialConstantsBufferCbv);
-	*(MaterialConstants*)materialConstantsBufferCbv.pMappedData = gMaterialConstants;
-	endUpdateResource(&materialConstantsBufferCbv, NULL);
+void MeshViewer::updateUniformBuffers()
+{
+	memcpy(gGlobalConstantsUpload.get(0), &gGlobalConstantsData, sizeof(gGlobalConstantsData));
 }
@@ -0,0 +1,320 @@
+#include "BasisTexture.h"
+
+#include <new>
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+#include "../../../Common_3/ThirdParty/OpenSource/basis_universal/transcoder/basisu_transcoder.h"
+
+using basist::transcoder_texture_format;
+
+typedef struct BasisFormat
+{
+	transcoder_texture_format	mTranscoderFormat;
+	TinyImageFormat				mUnormFormat;
+	TinyImageFormat				mSrgbFormat;
+	bool						mAlpha;
+} BasisFormat;
+
+// In order of preference, the first one the GPU can sample wins
+static const BasisFormat gBasisFormats[] = {
+	{ transcoder_texture_format::cTFBC7_RGBA, TinyImageFormat_DXBC7_UNORM, TinyImageFormat_DXBC7_SRGB, true },
+	{ transcoder_texture_format::cTFASTC_4x4_RGBA, TinyImageFormat_ASTC_4x4_UNORM, TinyImageFormat_ASTC_4x4_SRGB, true },
+	{ transcoder_texture_format::cTFBC3_RGBA, TinyImageFormat_DXBC3_UNORM, TinyImageFormat_DXBC3_SRGB, true },
+	{ transcoder_texture_format::cTFBC1_RGB, TinyImageFormat_DXBC1_RGB_UNORM, TinyImageFormat_DXBC1_RGB_SRGB, false },
+	{ transcoder_texture_format::cTFETC2_RGBA, TinyImageFormat_ETC2_R8G8B8A8_UNORM, TinyImageFormat_ETC2_R8G8B8A8_SRGB, true },
+	{ transcoder_texture_format::cTFRGBA32, TinyImageFormat_R8G8B8A8_UNORM, TinyImageFormat_R8G8B8A8_SRGB, true },
+};
+
+static basist::etc1_global_selector_codebook* getSelectorCodebook()
+{
+	// Built once on the first texture, the transcoders only read it
+	static bool initialized = false;
+	if (!initialized)
+	{
+		basist::basisu_transcoder_init();
+		initialized = true;
+	}
+	static basist::etc1_global_selector_codebook codebook(basist::g_global_selector_cb_size, basist::g_global_selector_cb);
+	return &codebook;
+}
+
+static bool selectBasisFormat(Renderer* pRenderer, bool uastc, bool hasAlpha, bool srgb, BasisTexture* pTexture)
+{
+	// ETC1S blocks convert to BC1 almost losslessly, BC7 would only double the memory of an opaque ETC1S texture
+	const bool preferBc1 = !uastc && !hasAlpha;
+	for (uint32_t pass = preferBc1 ? 0 : 1; pass < 2; ++pass)
+	{
+		for (uint32_t i = 0; i < sizeof(gBasisFormats) / sizeof(gBasisFormats[0]); ++i)
+		{
+			const BasisFormat& format = gBasisFormats[i];
+			if ((pass == 0 && format.mTranscoderFormat != transcoder_texture_format::cTFBC1_RGB) || (hasAlpha && !format.mAlpha))
+				continue;
+
+			const TinyImageFormat imageFormat = srgb ? format.mSrgbFormat : format.mUnormFormat;
+			if (pRenderer->pCapBits->canShaderReadFrom[imageFormat])
+			{
+				pTexture->mFormat = imageFormat;
+				pTexture->mTranscoderFormat = (uint32_t)format.mTranscoderFormat;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Frees everything but the texture, the transcode tasks have to be done
+static void releaseBasisFile(BasisTexture* pTexture)
+{
+	if (pTexture->pTranscoder)
+	{
+#if BASISD_SUPPORT_KTX2
+		if (pTexture->mKtx2)
+			((basist::ktx2_transcoder*)pTexture->pTranscoder)->~ktx2_transcoder();
+		else
+#endif
+			((basist::basisu_transcoder*)pTexture->pTranscoder)->~basisu_transcoder();
+		free(pTexture->pTranscoder);
+		pTexture->pTranscoder = NULL;
+	}
+	free(pTexture->pFileData);
+	pTexture->pFileData = NULL;
+
+	if (pTexture->pImages)
+	{
+		for (uint32_t i = 0; i < pTexture->mImageCount; ++i)
+			free(pTexture->pImages[i].pData);
+		free(pTexture->pImages);
+	}
+	pTexture->pImages = NULL;
+}
+
+static void transcodeBasisImageTask(void* pUserData, uintptr_t index)
+{
+	BasisTexture* pTexture = (BasisTexture*)pUserData;
+	BasisImage* pImage = &pTexture->pImages[index];
+
+	const uint32_t blockCount = pImage->mBlocksX * pImage->mBlocksY;
+	pImage->pData = (uint8_t*)malloc((size_t)blockCount * (TinyImageFormat_BitSizeOfBlock(pTexture->mFormat) / 8));
+	const transcoder_texture_format format = (transcoder_texture_format)pTexture->mTranscoderFormat;
+
+	// Every task brings its own transcoder state, the transcoder itself is shared by all images of the file
+	bool transcoded = false;
+#if BASISD_SUPPORT_KTX2
+	if (pTexture->mKtx2)
+	{
+		basist::ktx2_transcoder_state state;
+		transcoded = ((basist::ktx2_transcoder*)pTexture->pTranscoder)
+						 ->transcode_image_level(pImage->mLevel, pImage->mLayer, pImage->mFace, pImage->pData, blockCount, format, 0, 0, 0, -1, -1, &state);
+	}
+	else
+#endif
+	{
+		basist::basisu_transcoder_state state;
+		const uint32_t imageIndex = pImage->mLayer * pTexture->mFaceCount + pImage->mFace;
+		transcoded = ((const basist::basisu_transcoder*)pTexture->pTranscoder)
+						 ->transcode_image_level(pTexture->pFileData, pTexture->mFileSize, imageIndex, pImage->mLevel, pImage->pData, blockCount, format, 0, 0, &state);
+	}
+
+	tfrg_atomic32_store_release(&pImage->mState, transcoded ? BASIS_IMAGE_STATE_TRANSCODED : BASIS_IMAGE_STATE_FAILED);
+}
+
+bool addBasisTexture(Renderer* pRenderer, ThreadSystem* pThreadSystem, const BasisTextureDesc* pDesc, BasisTexture* pTexture)
+{
+	*pTexture = {};
+	snprintf(pTexture->mFileName, sizeof(pTexture->mFileName), "%s", pDesc->pFileName);
+	const char* pExtension = strrchr(pDesc->pFileName, '.');
+	pTexture->mKtx2 = pExtension && strcmp(pExtension, ".ktx2") == 0;
+	initHiresTimer(&pTexture->mLoadTimer);
+
+	FileStream stream = {};
+	if (!fsOpenStreamFromPath(RD_TEXTURES, pDesc->pFileName, FM_READ_BINARY, NULL, &stream))
+	{
+		LOGF(LogLevel::eERROR, "Basis: could not open '%s'", pDesc->pFileName);
+		return false;
+	}
+	pTexture->mFileSize = (uint32_t)fsGetStreamFileSize(&stream);
+	pTexture->pFileData = malloc(max(pTexture->mFileSize, 1u));
+	const bool read = fsReadFromStream(&stream, pTexture->pFileData, pTexture->mFileSize) == pTexture->mFileSize;
+	fsCloseStream(&stream);
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t levelCount = 0;
+	uint32_t layerCount = 0;
+	bool uastc = false;
+	bool hasAlpha = false;
+	bool valid = read;
+	pTexture->mFaceCount = 1;
+	if (pTexture->mKtx2)
+	{
+#if BASISD_SUPPORT_KTX2
+		basist::ktx2_transcoder* pTranscoder = new (malloc(sizeof(basist::ktx2_transcoder))) basist::ktx2_transcoder(getSelectorCodebook());
+		pTexture->pTranscoder = pTranscoder;
+		valid = valid && pTranscoder->init(pTexture->pFileData, pTexture->mFileSize) && pTranscoder->start_transcoding();
+		if (valid)
+		{
+			width = pTranscoder->get_width();
+			height = pTranscoder->get_height();
+			levelCount = pTranscoder->get_levels();
+			layerCount = max(pTranscoder->get_layers(), 1u);
+			pTexture->mFaceCount = pTranscoder->get_faces();
+			uastc = pTranscoder->get_format() == basist::basis_tex_format::cUASTC4x4;
+			hasAlpha = pTranscoder->get_has_alpha();
+		}
+#else
+		valid = false;
+#endif
+	}
+	else
+	{
+		basist::basisu_transcoder* pTranscoder = new (malloc(sizeof(basist::basisu_transcoder))) basist::basisu_transcoder(getSelectorCodebook());
+		pTexture->pTranscoder = pTranscoder;
+
+		basist::basisu_file_info fileInfo;
+		basist::basisu_image_info imageInfo;
+		valid = valid && pTranscoder->get_file_info(pTexture->pFileData, pTexture->mFileSize, fileInfo) &&
+			pTranscoder->get_image_info(pTexture->pFileData, pTexture->mFileSize, imageInfo, 0) &&
+			pTranscoder->start_transcoding(pTexture->pFileData, pTexture->mFileSize);
+		// Video frames and volumes have no layout a single texture can hold, the images of a 2D file may differ in
+		// size so only the first one is used
+		valid = valid && (fileInfo.m_tex_type == basist::cBASISTexType2D || fileInfo.m_tex_type == basist::cBASISTexType2DArray ||
+			fileInfo.m_tex_type == basist::cBASISTexTypeCubemapArray);
+		if (valid)
+		{
+			width = imageInfo.m_width;
+			height = imageInfo.m_height;
+			levelCount = imageInfo.m_total_levels;
+			pTexture->mFaceCount = fileInfo.m_tex_type == basist::cBASISTexTypeCubemapArray ? 6 : 1;
+			layerCount = fileInfo.m_tex_type == basist::cBASISTexType2D ? 1 : fileInfo.m_total_images / pTexture->mFaceCount;
+			uastc = fileInfo.m_tex_format == basist::basis_tex_format::cUASTC4x4;
+			hasAlpha = fileInfo.m_has_alpha_slices;
+		}
+	}
+
+	valid = valid && width && height && levelCount && layerCount;
+	if (!valid || !selectBasisFormat(pRenderer, uastc, hasAlpha, pDesc->mSrgb, pTexture))
+	{
+		LOGF(LogLevel::eERROR, "Basis: '%s' cannot be transcoded to a format this GPU samples", pDesc->pFileName);
+		releaseBasisFile(pTexture);
+		return false;
+	}
+
+	TextureDesc textureDesc = {};
+	textureDesc.mWidth = width;
+	textureDesc.mHeight = height;
+	textureDesc.mDepth = 1;
+	textureDesc.mArraySize = layerCount * pTexture->mFaceCount;
+	textureDesc.mMipLevels = levelCount;
+	textureDesc.mSampleCount = SAMPLE_COUNT_1;
+	textureDesc.mFormat = pTexture->mFormat;
+	textureDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+	textureDesc.mDescriptors = pTexture->mFaceCount == 6 ? DESCRIPTOR_TYPE_TEXTURE_CUBE : DESCRIPTOR_TYPE_TEXTURE;
+	textureDesc.pName = pTexture->mFileName;
+
+	TextureLoadDesc loadDesc = {};
+	loadDesc.pDesc = &textureDesc;
+	loadDesc.ppTexture = &pTexture->pTexture;
+	addResource(&loadDesc, NULL);
+
+	const uint32_t blockWidth = TinyImageFormat_WidthOfBlock(pTexture->mFormat);
+	const uint32_t blockHeight = TinyImageFormat_HeightOfBlock(pTexture->mFormat);
+	pTexture->mImageCount = levelCount * layerCount * pTexture->mFaceCount;
+	pTexture->pImages = (BasisImage*)calloc(pTexture->mImageCount, sizeof(BasisImage));
+	for (uint32_t level = 0, i = 0; level < levelCount; ++level)
+	{
+		for (uint32_t layer = 0; layer < layerCount; ++layer)
+		{
+			for (uint32_t face = 0; face < pTexture->mFaceCount; ++face, ++i)
+			{
+				BasisImage& image = pTexture->pImages[i];
+				image.mLevel = level;
+				image.mLayer = layer;
+				image.mFace = face;
+				image.mBlocksX = (max(width >> level, 1u) + blockWidth - 1) / blockWidth;
+				image.mBlocksY = (max(height >> level, 1u) + blockHeight - 1) / blockHeight;
+				tfrg_atomic32_store_relaxed(&image.mState, BASIS_IMAGE_STATE_TRANSCODING);
+			}
+		}
+	}
+
+	addThreadSystemRangeTask(pThreadSystem, transcodeBasisImageTask, pTexture, pTexture->mImageCount);
+
+	LOGF(LogLevel::eINFO, "Basis: '%s' %ux%u, %u mips, %u layers, %u faces, %s, %.1f KB file, transcoding %u images", pDesc->pFileName, width,
+		height, levelCount, layerCount, pTexture->mFaceCount, uastc ? "UASTC" : "ETC1S", pTexture->mFileSize / 1024.0f, pTexture->mImageCount);
+	return true;
+}
+
+bool updateBasisTexture(BasisTexture* pTexture)
+{
+	if (pTexture->mState != BASIS_TEXTURE_STATE_LOADING)
+		return false;
+
+	if (pTexture->pImages)
+	{
+		bool transcoding = false;
+		bool failed = false;
+		for (uint32_t i = 0; i < pTexture->mImageCount; ++i)
+		{
+			BasisImage* pImage = &pTexture->pImages[i];
+			if (pImage->mUploaded)
+				continue;
+
+			const uint32_t state = tfrg_atomic32_load_acquire(&pImage->mState);
+			transcoding |= state == BASIS_IMAGE_STATE_TRANSCODING;
+			failed |= state == BASIS_IMAGE_STATE_FAILED;
+			if (state != BASIS_IMAGE_STATE_TRANSCODED)
+				continue;
+
+			TextureUpdateDesc updateDesc = {};
+			updateDesc.pTexture = pTexture->pTexture;
+			updateDesc.mMipLevel = pImage->mLevel;
+			updateDesc.mArrayLayer = pImage->mLayer * pTexture->mFaceCount + pImage->mFace;
+			beginUpdateResource(&updateDesc);
+			for (uint32_t row = 0; row < updateDesc.mRowCount; ++row)
+				memcpy((uint8_t*)updateDesc.pMappedData + (size_t)row * updateDesc.mDstRowStride, pImage->pData + (size_t)row * updateDesc.mSrcRowStride,
+					updateDesc.mSrcRowStride);
+			endUpdateResource(&updateDesc, &pTexture->mUploadToken);
+
+			free(pImage->pData);
+			pImage->pData = NULL;
+			pImage->mUploaded = true;
+			++pTexture->mUploadedCount;
+		}
+
+		// The file stays alive while any task may still read it
+		if (transcoding)
+			return false;
+
+		releaseBasisFile(pTexture);
+		if (failed)
+		{
+			LOGF(LogLevel::eERROR, "Basis: transcoding '%s' failed", pTexture->mFileName);
+			pTexture->mFailed = true;
+		}
+	}
+
+	if (!isTokenCompleted(&pTexture->mUploadToken))
+		return false;
+
+	// Removed once the images queued before the failure have landed
+	if (pTexture->mFailed)
+	{
+		removeResource(pTexture->pTexture);
+		pTexture->pTexture = NULL;
+		pTexture->mState = BASIS_TEXTURE_STATE_FAILED;
+		return false;
+	}
+
+	pTexture->mLoadMs = (float)getHiresTimerUSec(&pTexture->mLoadTimer, false) / 1000.0f;
+	pTexture->mState = BASIS_TEXTURE_STATE_READY;
+	LOGF(LogLevel::eINFO, "Basis: '%s' resident after %.2f ms, %u images", pTexture->mFileName, pTexture->mLoadMs, pTexture->mUploadedCount);
+	return true;
+}
+
+void exitBasisTexture(BasisTexture* pTexture)
+{
+	releaseBasisFile(pTexture);
+	if (pTexture->pTexture)
+		removeResource(pTexture->pTexture);
+	*pTexture = {};
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../../../Common_3/OS/Core/ThreadSystem.h"
+#include "../../../Common_3/OS/Core/Atomics.h"
+#include "../../../Common_3/OS/Interfaces/ITime.h"
+#include "../../../Common_3/Renderer/IRenderer.h"
+#include "../../../Common_3/Renderer/IResourceLoader.h"
+
+// Basis Universal textures, .basis and .ktx2 files from RD_TEXTURES. The file is read and its header parsed on the
+// calling thread, then every mip of every layer and face is transcoded by its own task into the best block format the
+// GPU samples: BC7, ASTC 4x4, BC1/BC3, ETC2 and RGBA8 as the last resort. The main thread uploads each image as soon
+// as its task is done, so transcoding overlaps the upload of the images finished before it.
+
+typedef enum BasisTextureState
+{
+	// Tasks are transcoding, or uploads are in flight
+	BASIS_TEXTURE_STATE_LOADING = 0,
+	BASIS_TEXTURE_STATE_READY,
+	BASIS_TEXTURE_STATE_FAILED,
+} BasisTextureState;
+
+typedef enum BasisImageState
+{
+	BASIS_IMAGE_STATE_TRANSCODING = 0,
+	BASIS_IMAGE_STATE_TRANSCODED,
+	BASIS_IMAGE_STATE_FAILED,
+} BasisImageState;
+
+typedef struct BasisImage
+{
+	uint32_t		mLevel;
+	uint32_t		mLayer;
+	uint32_t		mFace;
+	// Output size in blocks, or in pixels for RGBA8
+	uint32_t		mBlocksX;
+	uint32_t		mBlocksY;
+	// Written by the task, owned by the main thread once mState is no longer BASIS_IMAGE_STATE_TRANSCODING
+	uint8_t*		pData;
+	tfrg_atomic32_t	mState;
+	bool			mUploaded;
+} BasisImage;
+
+typedef struct BasisTextureDesc
+{
+	const char*	pFileName;
+	// Color data samples as SRGB
+	bool		mSrgb;
+} BasisTextureDesc;
+
+typedef struct BasisTexture
+{
+	char				mFileName[64];
+	BasisTextureState	mState;
+	Texture*			pTexture;
+	TinyImageFormat		mFormat;
+	// basist::transcoder_texture_format
+	uint32_t			mTranscoderFormat;
+
+	// File contents and the basist transcoder for it, released once every image is uploaded
+	void*				pFileData;
+	uint32_t			mFileSize;
+	void*				pTranscoder;
+	bool				mKtx2;
+	// Layers of a cube map texture hold their six faces next to each other
+	uint32_t			mFaceCount;
+
+	BasisImage*			pImages;
+	uint32_t			mImageCount;
+	uint32_t			mUploadedCount;
+	SyncToken			mUploadToken;
+	// An image failed to transcode, the texture goes once mUploadToken completes
+	bool				mFailed;
+
+	float				mLoadMs;
+	HiresTimer			mLoadTimer;
+} BasisTexture;
+
+// Reads the file and queues one transcode task per image on pThreadSystem. Returns false for files that cannot be
+// read or transcoded, pTexture is then left empty.
+bool addBasisTexture(Renderer* pRenderer, ThreadSystem* pThreadSystem, const BasisTextureDesc* pDesc, BasisTexture* pTexture);
+
+// Main thread, once per frame: uploads the images whose tasks are done and frees the file once the last one is queued.
+// Returns true when the texture became ready during this call.
+bool updateBasisTexture(BasisTexture* pTexture);
+
+// The thread system has to be idle, or done with this texture
+void exitBasisTexture(BasisTexture* pTexture);
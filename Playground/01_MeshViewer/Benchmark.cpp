@@ -0,0 +1,172 @@
+#include "Benchmark.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+#include "../../../Common_3/OS/Interfaces/IFileSystem.h"
+
+static const uint32_t	gDefaultWarmupFrameCount = 60;
+static const uint32_t	gDefaultMeasuredFrameCount = 600;
+
+// Camera orbit around the fitted model, one full turn over the measured frames
+static const float		gOrbitRadius = 3.0f;
+static const float		gOrbitHeight = 1.5f;
+static const float		gOrbitHeightVariation = 0.75f;
+
+bool parseBenchmarkArgs(int argc, const char** argv, BenchmarkDesc* pDesc)
+{
+	ASSERT(pDesc);
+
+	*pDesc = {};
+	pDesc->mWarmupFrameCount = gDefaultWarmupFrameCount;
+	pDesc->mMeasuredFrameCount = gDefaultMeasuredFrameCount;
+	pDesc->pOutputFileName = "benchmark.json";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* pArg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (strcmp(pArg, "--benchmark") == 0)
+			pDesc->mEnabled = true;
+		else if (strcmp(pArg, "--headless") == 0)
+			pDesc->mHeadless = true;
+		else if (strcmp(pArg, "--warmup") == 0 && hasValue)
+			pDesc->mWarmupFrameCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(pArg, "--frames") == 0 && hasValue)
+			pDesc->mMeasuredFrameCount = max((uint32_t)strtoul(argv[++i], NULL, 10), 1u);
+		else if (strcmp(pArg, "--output") == 0 && hasValue)
+			pDesc->pOutputFileName = argv[++i];
+	}
+
+	// Headless runs have nobody to look at them, they only make sense as a benchmark
+	if (pDesc->mHeadless)
+		pDesc->mEnabled = true;
+
+	return pDesc->mEnabled;
+}
+
+void initBenchmark(const BenchmarkDesc* pDesc, Benchmark** ppBenchmark)
+{
+	ASSERT(pDesc);
+	ASSERT(ppBenchmark);
+
+	Benchmark* pBenchmark = (Benchmark*)calloc(1, sizeof(Benchmark));
+	pBenchmark->mDesc = *pDesc;
+	pBenchmark->pFrames = (BenchmarkFrame*)calloc(pDesc->mMeasuredFrameCount, sizeof(BenchmarkFrame));
+
+	LOGF(LogLevel::eINFO, "Benchmark: %u warm-up frames, %u measured frames%s", pDesc->mWarmupFrameCount, pDesc->mMeasuredFrameCount,
+		pDesc->mHeadless ? ", headless" : "");
+
+	*ppBenchmark = pBenchmark;
+}
+
+void exitBenchmark(Benchmark* pBenchmark)
+{
+	if (!pBenchmark)
+		return;
+
+	free(pBenchmark->pFrames);
+	free(pBenchmark);
+}
+
+void getBenchmarkCameraPose(const Benchmark* pBenchmark, vec3* pPosition, vec3* pLookAt)
+{
+	// Warm-up frames run the start of the path as well so caches see the same views as the measured frames
+	const uint32_t measuredCount = pBenchmark->mDesc.mMeasuredFrameCount;
+	const uint32_t warmupCount = pBenchmark->mDesc.mWarmupFrameCount;
+	const uint32_t pathFrame = pBenchmark->mFrameIndex < warmupCount ? pBenchmark->mFrameIndex % measuredCount : pBenchmark->mFrameIndex - warmupCount;
+
+	const float t = (float)pathFrame / (float)measuredCount;
+	const float angle = 2.0f * PI * t;
+
+	*pPosition = vec3(cosf(angle) * gOrbitRadius, gOrbitHeight + sinf(2.0f * angle) * gOrbitHeightVariation, sinf(angle) * gOrbitRadius);
+	*pLookAt = vec3(0.0f, 0.4f, 0.0f);
+}
+
+void benchmarkRecordFrame(Benchmark* pBenchmark, const BenchmarkFrame* pFrame)
+{
+	if (benchmarkIsDone(pBenchmark))
+		return;
+
+	if (pBenchmark->mFrameIndex >= pBenchmark->mDesc.mWarmupFrameCount)
+		pBenchmark->pFrames[pBenchmark->mFrameIndex - pBenchmark->mDesc.mWarmupFrameCount] = *pFrame;
+
+	++pBenchmark->mFrameIndex;
+}
+
+bool benchmarkIsDone(const Benchmark* pBenchmark)
+{
+	return pBenchmark->mFrameIndex >= pBenchmark->mDesc.mWarmupFrameCount + pBenchmark->mDesc.mMeasuredFrameCount;
+}
+
+static int compareFloat(const void* pLhs, const void* pRhs)
+{
+	const float lhs = *(const float*)pLhs;
+	const float rhs = *(const float*)pRhs;
+	return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+// Nearest-rank percentile of an ascending array
+static float getPercentile(const float* pSorted, uint32_t count, float percentile)
+{
+	uint32_t rank = (uint32_t)ceilf(percentile / 100.0f * (float)count);
+	rank = clamp(rank, 1u, count);
+	return pSorted[rank - 1];
+}
+
+static void writeTimingSummary(FileStream* pStream, const char* pName, float* pValues, uint32_t count, bool last)
+{
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < count; ++i)
+		sum += pValues[i];
+
+	qsort(pValues, count, sizeof(float), compareFloat);
+
+	fsPrintToStream(pStream, "\t\t\"%s\": { \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n", pName,
+		sum / (float)count, pValues[0], getPercentile(pValues, count, 50.0f), getPercentile(pValues, count, 95.0f),
+		getPercentile(pValues, count, 99.0f), pValues[count - 1], last ? "" : ",");
+}
+
+bool writeBenchmarkReport(const Benchmark* pBenchmark, const char* pAppName)
+{
+	const uint32_t frameCount = pBenchmark->mDesc.mMeasuredFrameCount;
+
+	FileStream stream = {};
+	if (!fsOpenStreamFromPath(RD_OTHER_FILES, pBenchmark->mDesc.pOutputFileName, FM_WRITE, NULL, &stream))
+	{
+		LOGF(LogLevel::eERROR, "Benchmark: could not open '%s' for writing", pBenchmark->mDesc.pOutputFileName);
+		return false;
+	}
+
+	float* pTimings = (float*)malloc(sizeof(float) * frameCount);
+
+	fsPrintToStream(&stream, "{\n");
+	fsPrintToStream(&stream, "\t\"app\": \"%s\",\n", pAppName);
+	fsPrintToStream(&stream, "\t\"headless\": %s,\n", pBenchmark->mDesc.mHeadless ? "true" : "false");
+	fsPrintToStream(&stream, "\t\"warmupFrames\": %u,\n", pBenchmark->mDesc.mWarmupFrameCount);
+	fsPrintToStream(&stream, "\t\"measuredFrames\": %u,\n", frameCount);
+
+	fsPrintToStream(&stream, "\t\"summary\": {\n");
+	for (uint32_t i = 0; i < frameCount; ++i)
+		pTimings[i] = pBenchmark->pFrames[i].mCpuMs;
+	writeTimingSummary(&stream, "cpuMs", pTimings, frameCount, false);
+	for (uint32_t i = 0; i < frameCount; ++i)
+		pTimings[i] = pBenchmark->pFrames[i].mGpuMs;
+	writeTimingSummary(&stream, "gpuMs", pTimings, frameCount, true);
+	fsPrintToStream(&stream, "\t},\n");
+
+	fsPrintToStream(&stream, "\t\"frames\": [\n");
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		const BenchmarkFrame& frame = pBenchmark->pFrames[i];
+		fsPrintToStream(&stream, "\t\t{ \"cpuMs\": %.4f, \"gpuMs\": %.4f, \"draws\": %u, \"triangles\": %llu }%s\n", frame.mCpuMs, frame.mGpuMs,
+			frame.mDrawCount, (unsigned long long)frame.mTriangleCount, i + 1 < frameCount ? "," : "");
+	}
+	fsPrintToStream(&stream, "\t]\n");
+	fsPrintToStream(&stream, "}\n");
+
+	free(pTimings);
+	fsCloseStream(&stream);
+
+	LOGF(LogLevel::eINFO, "Benchmark: report written to '%s'", pBenchmark->mDesc.pOutputFileName);
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// Fixed length benchmark run: a number of warm-up frames followed by measured frames along a deterministic
+// camera path, written out as a JSON report once the last frame is recorded.
+//
+// Command line:
+//   --benchmark              enable the benchmark run
+//   --headless               render to an offscreen target, no swapchain and no presentation
+//   --warmup <frames>        frames rendered before measuring (default 60)
+//   --frames <frames>        measured frames (default 600)
+//   --output <file>          report file name in RD_OTHER_FILES (default benchmark.json)
+
+typedef struct BenchmarkDesc
+{
+	bool			mEnabled;
+	bool			mHeadless;
+	uint32_t		mWarmupFrameCount;
+	uint32_t		mMeasuredFrameCount;
+	const char*		pOutputFileName;
+} BenchmarkDesc;
+
+typedef struct BenchmarkFrame
+{
+	float		mCpuMs;
+	float		mGpuMs;
+	uint32_t	mDrawCount;
+	uint64_t	mTriangleCount;
+} BenchmarkFrame;
+
+typedef struct Benchmark
+{
+	BenchmarkDesc	mDesc;
+	// Frames rendered so far, warm-up included
+	uint32_t		mFrameIndex;
+	BenchmarkFrame*	pFrames;
+} Benchmark;
+
+// Fills pDesc from the command line, returns pDesc->mEnabled
+bool parseBenchmarkArgs(int argc, const char** argv, BenchmarkDesc* pDesc);
+
+void initBenchmark(const BenchmarkDesc* pDesc, Benchmark** ppBenchmark);
+void exitBenchmark(Benchmark* pBenchmark);
+
+// Camera pose of the current frame. The path only depends on the frame index, so every run sees the same views.
+void getBenchmarkCameraPose(const Benchmark* pBenchmark, vec3* pPosition, vec3* pLookAt);
+
+// Stores the stats of the current frame if it is measured and advances to the next frame
+void benchmarkRecordFrame(Benchmark* pBenchmark, const BenchmarkFrame* pFrame);
+bool benchmarkIsDone(const Benchmark* pBenchmark);
+
+bool writeBenchmarkReport(const Benchmark* pBenchmark, const char* pAppName);
@@ -0,0 +1,103 @@
+#include "ClusteredLights.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+// Cosine of the outer cone angle written for point lights, below any angle a spot can have
+static const float gPointLightCosine = -2.0f;
+
+// Same field for the same seed on every platform, rand() is not
+static float nextRandom(uint32_t* pState)
+{
+	*pState = *pState * 1664525u + 1013904223u;
+	return (float)(*pState >> 8) / (float)(1u << 24);
+}
+
+void initLightField(uint32_t capacity, uint32_t seed, LightField* pField)
+{
+	ASSERT(pField);
+
+	pField->mCapacity = capacity;
+	pField->pEntries = (LightFieldEntry*)calloc(max(capacity, 1u), sizeof(LightFieldEntry));
+
+	uint32_t state = seed;
+	for (uint32_t i = 0; i < capacity; ++i)
+	{
+		LightFieldEntry& entry = pField->pEntries[i];
+		for (uint32_t c = 0; c < 3; ++c)
+			entry.mUnitPosition[c] = nextRandom(&state);
+		entry.mOrbitRadius = 0.1f + nextRandom(&state) * 0.5f;
+		entry.mOrbitPhase = nextRandom(&state) * 2.0f * PI;
+		entry.mOrbitSpeed = (nextRandom(&state) - 0.5f) * 2.0f;
+
+		// Saturated colors, the brightest channel is always 1
+		float brightest = 0.0f;
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			entry.mColor[c] = 0.1f + nextRandom(&state);
+			brightest = max(brightest, entry.mColor[c]);
+		}
+		for (uint32_t c = 0; c < 3; ++c)
+			entry.mColor[c] /= brightest;
+
+		entry.mSpotCosine = gPointLightCosine;
+		if (i % 4 == 3)
+		{
+			const vec3 direction = normalize(vec3((nextRandom(&state) - 0.5f), -1.0f, (nextRandom(&state) - 0.5f)));
+			entry.mSpotDirection[0] = direction.getX();
+			entry.mSpotDirection[1] = direction.getY();
+			entry.mSpotDirection[2] = direction.getZ();
+			entry.mSpotCosine = cosf((25.0f + nextRandom(&state) * 20.0f) * PI / 180.0f);
+		}
+	}
+}
+
+void exitLightField(LightField* pField)
+{
+	free(pField->pEntries);
+	*pField = {};
+}
+
+void writeLightField(const LightField* pField, uint32_t lightCount, float time, float radius, float intensity, const vec3& boundsMin,
+	const vec3& boundsMax, ClusterLight* pLights)
+{
+	ASSERT(lightCount <= pField->mCapacity);
+
+	const vec3 size = boundsMax - boundsMin;
+	for (uint32_t i = 0; i < lightCount; ++i)
+	{
+		const LightFieldEntry& entry = pField->pEntries[i];
+		const float angle = entry.mOrbitPhase + entry.mOrbitSpeed * time;
+		const vec3 position = boundsMin +
+			vec3(entry.mUnitPosition[0] * size.getX() + cosf(angle) * entry.mOrbitRadius, entry.mUnitPosition[1] * size.getY(),
+				entry.mUnitPosition[2] * size.getZ() + sinf(angle) * entry.mOrbitRadius);
+
+		ClusterLight& light = pLights[i];
+		light.mPositionRadius = vec4(position, radius);
+		light.mColorIntensity = vec4(entry.mColor[0], entry.mColor[1], entry.mColor[2], intensity);
+		light.mSpotDirection = vec4(entry.mSpotDirection[0], entry.mSpotDirection[1], entry.mSpotDirection[2], entry.mSpotCosine);
+	}
+}
+
+vec4 getClusterScale(uint32_t width, uint32_t height, float zNear, float zFar)
+{
+	// slice = CLUSTER_GRID_Z * log2(depth / zNear) / log2(zFar / zNear)
+	const float sliceScale = (float)CLUSTER_GRID_Z / log2f(zFar / zNear);
+	return vec4((float)CLUSTER_GRID_X / (float)max(width, 1u), (float)CLUSTER_GRID_Y / (float)max(height, 1u), sliceScale,
+		-log2f(zNear) * sliceScale);
+}
+
+void computeClusterLightStats(const uint32_t* pCounts, ClusterLightStats* pStats)
+{
+	uint64_t total = 0;
+	*pStats = {};
+	for (uint32_t i = 0; i < CLUSTER_COUNT; ++i)
+	{
+		const uint32_t count = pCounts[i];
+		total += count;
+		pStats->mMaxLights = max(pStats->mMaxLights, count);
+		pStats->mOccupiedCount += count ? 1 : 0;
+		pStats->mOverflowCount += count > CLUSTER_MAX_LIGHTS ? 1 : 0;
+	}
+	pStats->mAverageLights = (float)total / (float)CLUSTER_COUNT;
+	pStats->mAverageOccupiedLights = pStats->mOccupiedCount ? (float)total / (float)pStats->mOccupiedCount : 0.0f;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// Clustered forward lighting. The view frustum is cut into a froxel grid of CLUSTER_GRID_X x CLUSTER_GRID_Y screen tiles
+// and CLUSTER_GRID_Z depth slices spaced exponentially between the near and far plane of the grid. light_bin.comp writes
+// the lights touching every cluster, basic.frag only shades with the lights of the cluster its pixel falls in.
+// The grid constants must match Shaders/cluster.h.fsl.
+
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+// Lights beyond this many are counted but not stored, the cluster shades with the first CLUSTER_MAX_LIGHTS
+#define CLUSTER_MAX_LIGHTS 128
+
+// One light of the lights buffer, three float4 each
+typedef struct ClusterLight
+{
+	// xyz = world position, w = radius the light fades out at
+	vec4		mPositionRadius;
+	// rgb = color, a = intensity
+	vec4		mColorIntensity;
+	// xyz = spot direction, w = cosine of the outer cone angle, -2 for point lights
+	vec4		mSpotDirection;
+} ClusterLight;
+
+typedef struct LightFieldEntry
+{
+	// Centre of the orbit in [0, 1] of the box the field is spread over
+	float		mUnitPosition[3];
+	float		mOrbitRadius;
+	float		mOrbitPhase;
+	// Radians per second, negative orbits the other way
+	float		mOrbitSpeed;
+	float		mColor[3];
+	float		mSpotDirection[3];
+	float		mSpotCosine;
+} LightFieldEntry;
+
+// Deterministic field of point and spot lights orbiting in a box, every fourth light is a spot pointing down
+typedef struct LightField
+{
+	LightFieldEntry*	pEntries;
+	uint32_t			mCapacity;
+} LightField;
+
+typedef struct ClusterLightStats
+{
+	float		mAverageLights;
+	// Average over the clusters holding at least one light
+	float		mAverageOccupiedLights;
+	uint32_t	mMaxLights;
+	uint32_t	mOccupiedCount;
+	// Clusters holding more than CLUSTER_MAX_LIGHTS lights
+	uint32_t	mOverflowCount;
+} ClusterLightStats;
+
+void initLightField(uint32_t capacity, uint32_t seed, LightField* pField);
+void exitLightField(LightField* pField);
+
+// Writes the first lightCount lights of the field at time seconds, spread over [boundsMin, boundsMax]
+void writeLightField(const LightField* pField, uint32_t lightCount, float time, float radius, float intensity, const vec3& boundsMin,
+	const vec3& boundsMax, ClusterLight* pLights);
+
+// x, y = clusters per pixel, z, w = scale and bias turning log2 of the view depth into a depth slice
+vec4 getClusterScale(uint32_t width, uint32_t height, float zNear, float zFar);
+
+// pCounts holds the light count of every cluster as written by light_bin.comp
+void computeClusterLightStats(const uint32_t* pCounts, ClusterLightStats* pStats);
@@ -0,0 +1,87 @@
+#include "DeferredRemoval.h"
+
+static void removeNow(Renderer* pRenderer, const DeferredRemoval& entry)
+{
+	switch (entry.mType)
+	{
+	case DEFERRED_REMOVAL_RENDER_TARGET: removeRenderTarget(pRenderer, (RenderTarget*)entry.pResource); break;
+	case DEFERRED_REMOVAL_PIPELINE: removePipeline(pRenderer, (Pipeline*)entry.pResource); break;
+	case DEFERRED_REMOVAL_TEXTURE: removeResource((Texture*)entry.pResource); break;
+	case DEFERRED_REMOVAL_BUFFER: removeResource((Buffer*)entry.pResource); break;
+	case DEFERRED_REMOVAL_DESCRIPTOR_SET: removeDescriptorSet(pRenderer, (DescriptorSet*)entry.pResource); break;
+	}
+}
+
+static void deferRemoval(DeferredRemovalQueue* pQueue, DeferredRemovalType type, void* pResource)
+{
+	if (!pResource)
+		return;
+
+	if (pQueue->mCount == pQueue->mCapacity)
+	{
+		pQueue->mCapacity = max(pQueue->mCapacity * 2, 16u);
+		pQueue->pEntries = (DeferredRemoval*)realloc(pQueue->pEntries, sizeof(DeferredRemoval) * pQueue->mCapacity);
+	}
+	pQueue->pEntries[pQueue->mCount++] = { type, pResource, pQueue->mFrame };
+}
+
+void initDeferredRemovalQueue(Renderer* pRenderer, uint32_t framesInFlight, DeferredRemovalQueue* pQueue)
+{
+	*pQueue = {};
+	pQueue->pRenderer = pRenderer;
+	pQueue->mFramesInFlight = framesInFlight;
+}
+
+void exitDeferredRemovalQueue(DeferredRemovalQueue* pQueue)
+{
+	for (uint32_t i = 0; i < pQueue->mCount; ++i)
+		removeNow(pQueue->pRenderer, pQueue->pEntries[i]);
+	free(pQueue->pEntries);
+	*pQueue = {};
+}
+
+void deferRemoveRenderTarget(DeferredRemovalQueue* pQueue, RenderTarget* pRenderTarget)
+{
+	deferRemoval(pQueue, DEFERRED_REMOVAL_RENDER_TARGET, pRenderTarget);
+}
+
+void deferRemovePipeline(DeferredRemovalQueue* pQueue, Pipeline* pPipeline)
+{
+	deferRemoval(pQueue, DEFERRED_REMOVAL_PIPELINE, pPipeline);
+}
+
+void deferRemoveTexture(DeferredRemovalQueue* pQueue, Texture* pTexture)
+{
+	deferRemoval(pQueue, DEFERRED_REMOVAL_TEXTURE, pTexture);
+}
+
+void deferRemoveBuffer(DeferredRemovalQueue* pQueue, Buffer* pBuffer)
+{
+	deferRemoval(pQueue, DEFERRED_REMOVAL_BUFFER, pBuffer);
+}
+
+void deferRemoveDescriptorSet(DeferredRemovalQueue* pQueue, DescriptorSet* pDescriptorSet)
+{
+	deferRemoval(pQueue, DEFERRED_REMOVAL_DESCRIPTOR_SET, pDescriptorSet);
+}
+
+void updateDeferredRemovalQueue(DeferredRemovalQueue* pQueue)
+{
+	// Entries stamped with frame F were reachable by frame F at the latest, and the fence waited on before frame
+	// F + mFramesInFlight is the one frame F signalled
+	++pQueue->mFrame;
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < pQueue->mCount; ++i)
+	{
+		if (pQueue->mFrame >= pQueue->pEntries[i].mFrame + pQueue->mFramesInFlight)
+		{
+			removeNow(pQueue->pRenderer, pQueue->pEntries[i]);
+			++pQueue->mRemovedCount;
+		}
+		else
+		{
+			pQueue->pEntries[count++] = pQueue->pEntries[i];
+		}
+	}
+	pQueue->mCount = count;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../../../Common_3/Renderer/IRenderer.h"
+#include "../../../Common_3/Renderer/IResourceLoader.h"
+
+// Resources a frame in flight may still use are handed to this queue instead of being removed. Every entry is stamped
+// with the frame it was retired in and removed once the render complete fence of that frame has been waited on, which
+// happens mFramesInFlight frames later when its fence slot comes around again. Retiring never waits on the GPU.
+
+typedef enum DeferredRemovalType
+{
+	DEFERRED_REMOVAL_RENDER_TARGET = 0,
+	DEFERRED_REMOVAL_PIPELINE,
+	DEFERRED_REMOVAL_TEXTURE,
+	DEFERRED_REMOVAL_BUFFER,
+	DEFERRED_REMOVAL_DESCRIPTOR_SET,
+} DeferredRemovalType;
+
+typedef struct DeferredRemoval
+{
+	DeferredRemovalType	mType;
+	void*				pResource;
+	uint64_t			mFrame;
+} DeferredRemoval;
+
+typedef struct DeferredRemovalQueue
+{
+	Renderer*			pRenderer;
+	uint32_t			mFramesInFlight;
+	// Frames begun so far, the stamp of everything retired before the next one begins
+	uint64_t			mFrame;
+	DeferredRemoval*	pEntries;
+	uint32_t			mCount;
+	uint32_t			mCapacity;
+	uint32_t			mRemovedCount;
+} DeferredRemovalQueue;
+
+void initDeferredRemovalQueue(Renderer* pRenderer, uint32_t framesInFlight, DeferredRemovalQueue* pQueue);
+
+// Removes everything still queued, the GPU has to be idle
+void exitDeferredRemovalQueue(DeferredRemovalQueue* pQueue);
+
+void deferRemoveRenderTarget(DeferredRemovalQueue* pQueue, RenderTarget* pRenderTarget);
+void deferRemovePipeline(DeferredRemovalQueue* pQueue, Pipeline* pPipeline);
+void deferRemoveTexture(DeferredRemovalQueue* pQueue, Texture* pTexture);
+void deferRemoveBuffer(DeferredRemovalQueue* pQueue, Buffer* pBuffer);
+void deferRemoveDescriptorSet(DeferredRemovalQueue* pQueue, DescriptorSet* pDescriptorSet);
+
+// Once per frame, after waiting on the render complete fence of the frame about to be recorded: removes the resources
+// no frame in flight can reach anymore
+void updateDeferredRemovalQueue(DeferredRemovalQueue* pQueue);
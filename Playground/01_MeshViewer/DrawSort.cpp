@@ -0,0 +1,100 @@
+#include "DrawSort.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+void initDrawSortList(uint32_t capacity, DrawSortList* pList)
+{
+	ASSERT(pList);
+
+	const uint32_t allocCount = max(capacity, 1u);
+	pList->pKeys = (uint64_t*)malloc(sizeof(uint64_t) * allocCount);
+	pList->pValues = (uint32_t*)malloc(sizeof(uint32_t) * allocCount);
+	pList->pScratchKeys = (uint64_t*)malloc(sizeof(uint64_t) * allocCount);
+	pList->pScratchValues = (uint32_t*)malloc(sizeof(uint32_t) * allocCount);
+	pList->mCount = 0;
+	pList->mCapacity = capacity;
+	pList->mPassCount = 0;
+}
+
+void exitDrawSortList(DrawSortList* pList)
+{
+	free(pList->pKeys);
+	free(pList->pValues);
+	free(pList->pScratchKeys);
+	free(pList->pScratchValues);
+	*pList = {};
+}
+
+uint64_t makeDrawSortKey(uint32_t pipeline, uint32_t material, float distance)
+{
+	union
+	{
+		float		mFloat;
+		uint32_t	mBits;
+	} depth;
+	depth.mFloat = max(distance, 0.0f);
+
+	return ((uint64_t)(pipeline & 0xFF) << DRAW_SORT_KEY_PIPELINE_SHIFT) | ((uint64_t)(material & 0xFFFF) << DRAW_SORT_KEY_MATERIAL_SHIFT) |
+		((uint64_t)depth.mBits << DRAW_SORT_KEY_DEPTH_SHIFT);
+}
+
+void sortDrawList(DrawSortList* pList)
+{
+	const uint32_t count = pList->mCount;
+	pList->mPassCount = 0;
+	if (count < 2)
+		return;
+
+	// All eight histograms in one read of the keys
+	uint32_t histograms[8][256] = {};
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint64_t key = pList->pKeys[i];
+		for (uint32_t pass = 0; pass < 8; ++pass)
+			++histograms[pass][(key >> (pass * 8)) & 0xFF];
+	}
+
+	uint64_t* pKeys = pList->pKeys;
+	uint32_t* pValues = pList->pValues;
+	uint64_t* pOutKeys = pList->pScratchKeys;
+	uint32_t* pOutValues = pList->pScratchValues;
+	for (uint32_t pass = 0; pass < 8; ++pass)
+	{
+		uint32_t* pHistogram = histograms[pass];
+		const uint32_t shift = pass * 8;
+		if (pHistogram[(pKeys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; ++digit)
+		{
+			const uint32_t digitCount = pHistogram[digit];
+			pHistogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const uint32_t dst = pHistogram[(pKeys[i] >> shift) & 0xFF]++;
+			pOutKeys[dst] = pKeys[i];
+			pOutValues[dst] = pValues[i];
+		}
+
+		uint64_t* pTempKeys = pKeys;
+		pKeys = pOutKeys;
+		pOutKeys = pTempKeys;
+		uint32_t* pTempValues = pValues;
+		pValues = pOutValues;
+		pOutValues = pTempValues;
+		++pList->mPassCount;
+	}
+
+	// An odd number of passes leaves the result in the scratch buffers, swap them so pKeys holds it
+	if (pKeys != pList->pKeys)
+	{
+		pList->pScratchKeys = pList->pKeys;
+		pList->pScratchValues = pList->pValues;
+		pList->pKeys = pKeys;
+		pList->pValues = pValues;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// 64 bit draw sort keys, sorted ascending so draws group by pipeline, then by material, then go front to back.
+// Bits 63..56 hold the pipeline, 55..40 the material and 39..8 the view distance as float bits, which order like the
+// distances themselves as long as they are not negative. The low byte is free.
+
+#define DRAW_SORT_KEY_PIPELINE_SHIFT	56
+#define DRAW_SORT_KEY_MATERIAL_SHIFT	40
+#define DRAW_SORT_KEY_DEPTH_SHIFT		8
+
+typedef struct DrawSortList
+{
+	// Keys and the draw each key belongs to, sorted in place by sortDrawList
+	uint64_t*	pKeys;
+	uint32_t*	pValues;
+	uint32_t	mCount;
+	uint32_t	mCapacity;
+	// Ping-pong buffers of the radix passes
+	uint64_t*	pScratchKeys;
+	uint32_t*	pScratchValues;
+	// Radix passes the last sort ran, passes where every key has the same digit are skipped
+	uint32_t	mPassCount;
+} DrawSortList;
+
+void initDrawSortList(uint32_t capacity, DrawSortList* pList);
+void exitDrawSortList(DrawSortList* pList);
+
+uint64_t makeDrawSortKey(uint32_t pipeline, uint32_t material, float distance);
+
+static inline void addDrawSortEntry(DrawSortList* pList, uint64_t key, uint32_t value)
+{
+	pList->pKeys[pList->mCount] = key;
+	pList->pValues[pList->mCount] = value;
+	++pList->mCount;
+}
+
+// Stable LSD radix sort of the keys, 8 bits per pass, the values move with their keys
+void sortDrawList(DrawSortList* pList);
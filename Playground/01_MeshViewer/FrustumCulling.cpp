@@ -0,0 +1,161 @@
+#include "FrustumCulling.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLING_SSE
+
+static const uint8_t gMaskBitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+
+void initBoundsArray(uint32_t count, BoundsArray* pBounds)
+{
+	ASSERT(pBounds);
+
+	const uint32_t paddedCount = round_up(max(count, 1u), 4u);
+	// One allocation for all six arrays, each array starts at a multiple of 4 floats
+	float* pData = (float*)calloc(paddedCount * 6, sizeof(float));
+
+	pBounds->mCount = count;
+	pBounds->mPaddedCount = paddedCount;
+	pBounds->pMinX = pData;
+	pBounds->pMinY = pData + paddedCount;
+	pBounds->pMinZ = pData + paddedCount * 2;
+	pBounds->pMaxX = pData + paddedCount * 3;
+	pBounds->pMaxY = pData + paddedCount * 4;
+	pBounds->pMaxZ = pData + paddedCount * 5;
+}
+
+void exitBoundsArray(BoundsArray* pBounds)
+{
+	free(pBounds->pMinX);
+	*pBounds = {};
+}
+
+void setTransformedBounds(BoundsArray* pBounds, uint32_t index, const vec3& localMin, const vec3& localMax, const mat4& worldMatrix)
+{
+	ASSERT(index < pBounds->mCount);
+
+	// Transform centre and half extent instead of the 8 corners
+	const vec3 localCentre = (localMin + localMax) * 0.5f;
+	const vec3 localExtent = (localMax - localMin) * 0.5f;
+
+	const vec3 centre = (worldMatrix * Point3(localCentre)).getXYZ();
+	const vec3 extent =
+		absPerElem(worldMatrix.getCol0().getXYZ()) * localExtent.getX() +
+		absPerElem(worldMatrix.getCol1().getXYZ()) * localExtent.getY() +
+		absPerElem(worldMatrix.getCol2().getXYZ()) * localExtent.getZ();
+
+	pBounds->pMinX[index] = centre.getX() - extent.getX();
+	pBounds->pMinY[index] = centre.getY() - extent.getY();
+	pBounds->pMinZ[index] = centre.getZ() - extent.getZ();
+	pBounds->pMaxX[index] = centre.getX() + extent.getX();
+	pBounds->pMaxY[index] = centre.getY() + extent.getY();
+	pBounds->pMaxZ[index] = centre.getZ() + extent.getZ();
+}
+
+void extractFrustumPlanes(const mat4& viewProjection, Frustum* pFrustum)
+{
+	// Gribb/Hartmann: clip space bounds -w <= x,y <= w and 0 <= z <= w expressed on the matrix rows.
+	// The z planes are valid for both regular and reversed depth, only their near/far names swap.
+	const mat4 rows = transpose(viewProjection);
+	const vec4 row0 = rows.getCol0();
+	const vec4 row1 = rows.getCol1();
+	const vec4 row2 = rows.getCol2();
+	const vec4 row3 = rows.getCol3();
+
+	pFrustum->mPlanes[0] = row3 + row0;
+	pFrustum->mPlanes[1] = row3 - row0;
+	pFrustum->mPlanes[2] = row3 + row1;
+	pFrustum->mPlanes[3] = row3 - row1;
+	pFrustum->mPlanes[4] = row2;
+	pFrustum->mPlanes[5] = row3 - row2;
+
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		const float normalLength = length(pFrustum->mPlanes[i].getXYZ());
+		if (normalLength > 0.0f)
+			pFrustum->mPlanes[i] /= normalLength;
+	}
+}
+
+void inflateFrustum(Frustum* pFrustum, const vec3& extent)
+{
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		vec4& plane = pFrustum->mPlanes[i];
+		plane.setW(plane.getW() + dot(absPerElem(plane.getXYZ()), extent));
+	}
+}
+
+uint32_t cullBounds(const Frustum* pFrustum, const BoundsArray* pBounds, uint8_t* pVisibility)
+{
+	// A box is outside when its corner furthest along the plane normal (the positive vertex) is behind the plane.
+	// The positive vertex only depends on the signs of the normal, so the min or max array is picked per plane
+	// up front and the inner loop is a plain multiply-add over 4 boxes.
+	const float* pPlaneX[6];
+	const float* pPlaneY[6];
+	const float* pPlaneZ[6];
+	float        planes[6][4];
+	for (uint32_t p = 0; p < 6; ++p)
+	{
+		const vec4& plane = pFrustum->mPlanes[p];
+		planes[p][0] = plane.getX();
+		planes[p][1] = plane.getY();
+		planes[p][2] = plane.getZ();
+		planes[p][3] = plane.getW();
+		pPlaneX[p] = planes[p][0] >= 0.0f ? pBounds->pMaxX : pBounds->pMinX;
+		pPlaneY[p] = planes[p][1] >= 0.0f ? pBounds->pMaxY : pBounds->pMinY;
+		pPlaneZ[p] = planes[p][2] >= 0.0f ? pBounds->pMaxZ : pBounds->pMinZ;
+	}
+
+	uint32_t visibleCount = 0;
+	const uint32_t count = pBounds->mCount;
+
+#if defined(FRUSTUM_CULLING_SSE)
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t p = 0; p < 6; ++p)
+	{
+		planeX[p] = _mm_set1_ps(planes[p][0]);
+		planeY[p] = _mm_set1_ps(planes[p][1]);
+		planeZ[p] = _mm_set1_ps(planes[p][2]);
+		planeW[p] = _mm_set1_ps(planes[p][3]);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], _mm_loadu_ps(pPlaneX[p] + i)), planeW[p]);
+			distance = _mm_add_ps(_mm_mul_ps(planeY[p], _mm_loadu_ps(pPlaneY[p] + i)), distance);
+			distance = _mm_add_ps(_mm_mul_ps(planeZ[p], _mm_loadu_ps(pPlaneZ[p] + i)), distance);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		pVisibility[i + 0] = (uint8_t)(mask & 1);
+		pVisibility[i + 1] = (uint8_t)((mask >> 1) & 1);
+		pVisibility[i + 2] = (uint8_t)((mask >> 2) & 1);
+		pVisibility[i + 3] = (uint8_t)((mask >> 3) & 1);
+
+		// Padding entries are written as well, only count the real boxes
+		const int validMask = count - i >= 4 ? 0xf : (1 << (count - i)) - 1;
+		visibleCount += gMaskBitCount[mask & validMask];
+	}
+#else
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		bool inside = true;
+		for (uint32_t p = 0; p < 6 && inside; ++p)
+			inside = planes[p][0] * pPlaneX[p][i] + planes[p][1] * pPlaneY[p][i] + planes[p][2] * pPlaneZ[p][i] + planes[p][3] >= 0.0f;
+
+		pVisibility[i] = inside ? 1 : 0;
+		visibleCount += pVisibility[i];
+	}
+#endif
+
+	return visibleCount;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// View frustum culling of world space AABBs.
+// Boxes are stored as SoA float arrays so the kernel tests 4 boxes per plane with one SIMD multiply-add chain.
+
+typedef struct Frustum
+{
+	// Inward facing planes (xyz = normal, w = distance), a point p is inside when dot(plane, (p, 1)) >= 0
+	vec4		mPlanes[6];
+} Frustum;
+
+typedef struct BoundsArray
+{
+	uint32_t	mCount;
+	// Arrays are padded to a multiple of 4 entries, the padding holds empty boxes at the origin
+	uint32_t	mPaddedCount;
+	float*		pMinX;
+	float*		pMinY;
+	float*		pMinZ;
+	float*		pMaxX;
+	float*		pMaxY;
+	float*		pMaxZ;
+} BoundsArray;
+
+void initBoundsArray(uint32_t count, BoundsArray* pBounds);
+void exitBoundsArray(BoundsArray* pBounds);
+
+// Stores the world space AABB of the local box [localMin, localMax] transformed by worldMatrix
+void setTransformedBounds(BoundsArray* pBounds, uint32_t index, const vec3& localMin, const vec3& localMax, const mat4& worldMatrix);
+
+void extractFrustumPlanes(const mat4& viewProjection, Frustum* pFrustum);
+// Pushes every plane out so boxes grown by extent on each axis are tested, without touching the boxes
+void inflateFrustum(Frustum* pFrustum, const vec3& extent);
+
+// Writes 1 for every box intersecting the frustum and 0 otherwise. pVisibility must hold mPaddedCount entries.
+// Returns the number of visible boxes.
+uint32_t cullBounds(const Frustum* pFrustum, const BoundsArray* pBounds, uint8_t* pVisibility);
@@ -0,0 +1,61 @@
+#include "Materials.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+COMPILE_ASSERT(sizeof(GpuMaterial) == MATERIAL_STRIDE * sizeof(vec4));
+
+void initMaterialTable(const MeshAsset* pAsset, const char* sceneTextureName, MaterialTable* pTable)
+{
+	ASSERT(pTable);
+
+	*pTable = {};
+	pTable->mMaterialCount = pAsset->mMaterialCount + 1;
+	pTable->pMaterials = (GpuMaterial*)calloc(pTable->mMaterialCount, sizeof(GpuMaterial));
+	pTable->pAssetTextures = (uint32_t*)calloc(max(pAsset->mTextureCount, 1u), sizeof(uint32_t));
+
+	// Slot of every asset texture
+	uint32_t* pTextureSlots = (uint32_t*)calloc(max(pAsset->mTextureCount, 1u), sizeof(uint32_t));
+	for (uint32_t i = 0; i < pAsset->mTextureCount; ++i)
+	{
+		if (strcmp(pAsset->pTextures[i].mName, sceneTextureName) == 0)
+		{
+			pTextureSlots[i] = MATERIAL_TEXTURE_SCENE;
+		}
+		else if (MATERIAL_TEXTURE_FIRST_ASSET + pTable->mTextureCount < MATERIAL_MAX_TEXTURES)
+		{
+			pTextureSlots[i] = MATERIAL_TEXTURE_FIRST_ASSET + pTable->mTextureCount;
+			pTable->pAssetTextures[pTable->mTextureCount++] = i;
+		}
+		else
+		{
+			LOGF(LogLevel::eWARNING, "Materials: more than %u textures, '%s' samples white", MATERIAL_MAX_TEXTURES, pAsset->pTextures[i].mName);
+			pTextureSlots[i] = MATERIAL_TEXTURE_WHITE;
+		}
+	}
+
+	// Metallic 0 and roughness 1 are the constants the scene was lit with before materials
+	GpuMaterial& defaultMaterial = pTable->pMaterials[MATERIAL_DEFAULT];
+	defaultMaterial.mBaseColorFactor = vec4(1.0f);
+	defaultMaterial.mMetallic = 0.0f;
+	defaultMaterial.mRoughness = 1.0f;
+	defaultMaterial.mBaseColorTexture = MATERIAL_TEXTURE_SCENE;
+
+	for (uint32_t i = 0; i < pAsset->mMaterialCount; ++i)
+	{
+		const MeshAssetMaterial& src = pAsset->pMaterials[i];
+		GpuMaterial& dst = pTable->pMaterials[i + 1];
+		dst.mBaseColorFactor = vec4(src.mBaseColorFactor[0], src.mBaseColorFactor[1], src.mBaseColorFactor[2], src.mBaseColorFactor[3]);
+		dst.mMetallic = src.mMetallicFactor;
+		dst.mRoughness = src.mRoughnessFactor;
+		dst.mBaseColorTexture = src.mBaseColorTexture < pAsset->mTextureCount ? pTextureSlots[src.mBaseColorTexture] : MATERIAL_TEXTURE_WHITE;
+	}
+
+	free(pTextureSlots);
+}
+
+void exitMaterialTable(MaterialTable* pTable)
+{
+	free(pTable->pMaterials);
+	free(pTable->pAssetTextures);
+	*pTable = {};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "MeshAsset.h"
+
+// Scene materials for bindless drawing. Every material is MATERIAL_STRIDE float4s of the materials buffer, indexed by
+// the material index in the draw constants, and its base color texture is an index into the materialTextures array of
+// the per draw descriptor set. Switching materials between draws never touches a descriptor set, so it works the same
+// for direct, instanced and indirect draws. The constants must match Shaders/material.h.fsl.
+
+#define MATERIAL_MAX_TEXTURES		256
+#define MATERIAL_STRIDE				2
+// Material of everything without a GLTF material: placeholders, streamed models and meshes that reference none.
+// It samples the scene base color map unscaled, as every draw did before materials were loaded.
+#define MATERIAL_DEFAULT			0
+// Texture slots: the scene base color map, which may be streamed or transcoded, a white texture for untextured
+// materials, then the asset textures
+#define MATERIAL_TEXTURE_SCENE		0
+#define MATERIAL_TEXTURE_WHITE		1
+#define MATERIAL_TEXTURE_FIRST_ASSET	2
+
+// Layout of one material in the materials buffer
+typedef struct GpuMaterial
+{
+	vec4		mBaseColorFactor;
+	float		mMetallic;
+	float		mRoughness;
+	uint32_t	mBaseColorTexture;
+	uint32_t	mPadding;
+} GpuMaterial;
+
+typedef struct MaterialTable
+{
+	// MATERIAL_DEFAULT followed by the asset materials in order
+	GpuMaterial*	pMaterials;
+	uint32_t		mMaterialCount;
+	// Asset texture loaded into slot MATERIAL_TEXTURE_FIRST_ASSET + i
+	uint32_t*		pAssetTextures;
+	uint32_t		mTextureCount;
+} MaterialTable;
+
+// Asset textures named sceneTextureName use the scene base color map slot instead of loading a second copy. Textures
+// beyond MATERIAL_MAX_TEXTURES are dropped with a warning, their materials sample white.
+void initMaterialTable(const MeshAsset* pAsset, const char* sceneTextureName, MaterialTable* pTable);
+void exitMaterialTable(MaterialTable* pTable);
+
+// Material index of an asset mesh
+inline uint32_t getMeshMaterial(const MaterialTable* pTable, const MeshAssetMesh& mesh)
+{
+	return mesh.mMaterialIndex < pTable->mMaterialCount - 1 ? mesh.mMaterialIndex + 1 : MATERIAL_DEFAULT;
+}
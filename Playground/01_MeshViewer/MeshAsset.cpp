@@ -0,0 +1,732 @@
+#include "MeshAsset.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+#include "../../../Common_3/ThirdParty/OpenSource/cgltf/GLTFLoader.h"
+#include "../../../Common_3/ThirdParty/OpenSource/meshoptimizer/src/meshoptimizer.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// float3 position, float3 normal, float2 uv, matches the vertex layout of the GLTF path
+static const uint32_t gBakedVertexStride = 8 * sizeof(float);
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return round_up_64(offset, MESH_ASSET_ALIGNMENT);
+}
+
+static void copyNodesAndMeshes(const GLTFContainer* pContainer, MeshAssetNode* pNodes, MeshAssetMesh* pMeshes)
+{
+	for (uint32_t i = 0; i < pContainer->mNodeCount; ++i)
+	{
+		const GLTFNode& src = pContainer->pNodes[i];
+		MeshAssetNode& dst = pNodes[i];
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			const vec4 column = src.mMatrix.getCol(c);
+			dst.mLocalMatrix[c * 4 + 0] = column.getX();
+			dst.mLocalMatrix[c * 4 + 1] = column.getY();
+			dst.mLocalMatrix[c * 4 + 2] = column.getZ();
+			dst.mLocalMatrix[c * 4 + 3] = column.getW();
+		}
+		dst.mParentIndex = src.mParentIndex;
+		dst.mMeshIndex = src.mMeshIndex;
+		dst.mMeshCount = src.mMeshCount;
+	}
+
+	for (uint32_t i = 0; i < pContainer->mMeshCount; ++i)
+	{
+		const GLTFMesh& src = pContainer->pMeshes[i];
+		MeshAssetMesh& dst = pMeshes[i];
+		Point3 minBound = src.mMin;
+		Point3 maxBound = src.mMax;
+		dst.mMin[0] = minBound.getX();
+		dst.mMin[1] = minBound.getY();
+		dst.mMin[2] = minBound.getZ();
+		dst.mMax[0] = maxBound.getX();
+		dst.mMax[1] = maxBound.getY();
+		dst.mMax[2] = maxBound.getZ();
+		dst.mStartIndex = src.mStartIndex;
+		dst.mIndexCount = src.mIndexCount;
+	}
+}
+
+// File name of the image without directory and extension, "textures/DuckCM.png" becomes "DuckCM"
+static void getTextureName(const cgltf_image& image, uint32_t index, MeshAssetTexture* pTexture)
+{
+	const char* pPath = image.uri && strncmp(image.uri, "data:", 5) != 0 ? image.uri : image.name;
+	if (!pPath)
+	{
+		snprintf(pTexture->mName, sizeof(pTexture->mName), "image%u", index);
+		return;
+	}
+
+	const char* pFileName = pPath;
+	for (const char* c = pPath; *c; ++c)
+	{
+		if (*c == '/' || *c == '\\')
+			pFileName = c + 1;
+	}
+	const char* pExtension = strrchr(pFileName, '.');
+	const size_t length = min((size_t)(pExtension ? pExtension - pFileName : strlen(pFileName)), sizeof(pTexture->mName) - 1);
+	memcpy(pTexture->mName, pFileName, length);
+	pTexture->mName[length] = '\0';
+}
+
+static void copyMaterials(const cgltf_data* pData, MeshAssetMaterial* pMaterials, MeshAssetTexture* pTextures)
+{
+	for (cgltf_size i = 0; i < pData->materials_count; ++i)
+	{
+		const cgltf_material& src = pData->materials[i];
+		MeshAssetMaterial& dst = pMaterials[i];
+		// GLTF defaults, also what materials without the metallic roughness model get
+		for (uint32_t c = 0; c < 4; ++c)
+			dst.mBaseColorFactor[c] = 1.0f;
+		dst.mMetallicFactor = 1.0f;
+		dst.mRoughnessFactor = 1.0f;
+		dst.mBaseColorTexture = MESH_ASSET_INVALID_TEXTURE;
+		dst.mDoubleSided = src.double_sided ? 1 : 0;
+		if (!src.has_pbr_metallic_roughness)
+			continue;
+
+		const cgltf_pbr_metallic_roughness& pbr = src.pbr_metallic_roughness;
+		for (uint32_t c = 0; c < 4; ++c)
+			dst.mBaseColorFactor[c] = pbr.base_color_factor[c];
+		dst.mMetallicFactor = pbr.metallic_factor;
+		dst.mRoughnessFactor = pbr.roughness_factor;
+		if (pbr.base_color_texture.texture && pbr.base_color_texture.texture->image)
+			dst.mBaseColorTexture = (uint32_t)(pbr.base_color_texture.texture->image - pData->images);
+	}
+
+	for (cgltf_size i = 0; i < pData->images_count; ++i)
+		getTextureName(pData->images[i], (uint32_t)i, &pTextures[i]);
+}
+
+// Decodes the container into a complete file image, NULL if the container does not match its GLTF data
+static uint8_t* buildFileImage(const GLTFContainer* pContainer, const char* fileName, uint64_t* pImageSize)
+{
+	ASSERT(pContainer->pHandle);
+
+	const cgltf_data* pData = pContainer->pHandle;
+
+	// Container meshes are the GLTF primitives in declaration order, count them the same way
+	uint32_t primitiveCount = 0;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	for (cgltf_size m = 0; m < pData->meshes_count; ++m)
+	{
+		for (cgltf_size p = 0; p < pData->meshes[m].primitives_count; ++p)
+		{
+			const cgltf_primitive& primitive = pData->meshes[m].primitives[p];
+			uint32_t primitiveVertexCount = 0;
+			for (cgltf_size a = 0; a < primitive.attributes_count; ++a)
+			{
+				if (primitive.attributes[a].type == cgltf_attribute_type_position)
+					primitiveVertexCount = (uint32_t)primitive.attributes[a].data->count;
+			}
+			vertexCount += primitiveVertexCount;
+			indexCount += primitive.indices ? (uint32_t)primitive.indices->count : primitiveVertexCount;
+			++primitiveCount;
+		}
+	}
+
+	if (primitiveCount != pContainer->mMeshCount)
+	{
+		LOGF(LogLevel::eERROR, "Mesh import: '%s' has %u primitives but the container has %u meshes", fileName, primitiveCount, pContainer->mMeshCount);
+		return NULL;
+	}
+
+	const uint32_t indexSize = vertexCount <= 0xFFFF ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	MeshAssetHeader header = {};
+	header.mMagic = MESH_ASSET_MAGIC;
+	header.mVersion = MESH_ASSET_VERSION;
+	header.mNodeCount = pContainer->mNodeCount;
+	header.mMeshCount = pContainer->mMeshCount;
+	header.mVertexCount = vertexCount;
+	header.mVertexStride = gBakedVertexStride;
+	header.mIndexCount = indexCount;
+	header.mIndexSize = indexSize;
+	header.mMaterialCount = (uint32_t)pData->materials_count;
+	header.mTextureCount = (uint32_t)pData->images_count;
+	header.mNodesOffset = alignOffset(sizeof(MeshAssetHeader));
+	header.mMeshesOffset = alignOffset(header.mNodesOffset + sizeof(MeshAssetNode) * header.mNodeCount);
+	header.mMaterialsOffset = alignOffset(header.mMeshesOffset + sizeof(MeshAssetMesh) * header.mMeshCount);
+	header.mTexturesOffset = alignOffset(header.mMaterialsOffset + sizeof(MeshAssetMaterial) * header.mMaterialCount);
+	header.mVerticesOffset = alignOffset(header.mTexturesOffset + sizeof(MeshAssetTexture) * header.mTextureCount);
+	header.mIndicesOffset = alignOffset(header.mVerticesOffset + (uint64_t)gBakedVertexStride * vertexCount);
+	header.mFileSize = alignOffset(header.mIndicesOffset + (uint64_t)indexSize * indexCount);
+
+	// Padding stays zero so saved images are deterministic
+	uint8_t* pFile = (uint8_t*)calloc(1, (size_t)header.mFileSize);
+	memcpy(pFile, &header, sizeof(header));
+
+	MeshAssetMesh* pMeshes = (MeshAssetMesh*)(pFile + header.mMeshesOffset);
+	copyNodesAndMeshes(pContainer, (MeshAssetNode*)(pFile + header.mNodesOffset), pMeshes);
+	copyMaterials(pData, (MeshAssetMaterial*)(pFile + header.mMaterialsOffset), (MeshAssetTexture*)(pFile + header.mTexturesOffset));
+
+	float* pVertices = (float*)(pFile + header.mVerticesOffset);
+	uint8_t* pIndices = pFile + header.mIndicesOffset;
+
+	uint32_t meshIndex = 0;
+	uint32_t baseVertex = 0;
+	uint32_t baseIndex = 0;
+	for (cgltf_size m = 0; m < pData->meshes_count; ++m)
+	{
+		for (cgltf_size p = 0; p < pData->meshes[m].primitives_count; ++p)
+		{
+			const cgltf_primitive& primitive = pData->meshes[m].primitives[p];
+			const cgltf_accessor* pPositions = NULL;
+			const cgltf_accessor* pNormals = NULL;
+			const cgltf_accessor* pUVs = NULL;
+			for (cgltf_size a = 0; a < primitive.attributes_count; ++a)
+			{
+				const cgltf_attribute& attribute = primitive.attributes[a];
+				if (attribute.type == cgltf_attribute_type_position)
+					pPositions = attribute.data;
+				else if (attribute.type == cgltf_attribute_type_normal)
+					pNormals = attribute.data;
+				else if (attribute.type == cgltf_attribute_type_texcoord && attribute.index == 0)
+					pUVs = attribute.data;
+			}
+
+			const uint32_t primitiveVertexCount = pPositions ? (uint32_t)pPositions->count : 0;
+			for (uint32_t v = 0; v < primitiveVertexCount; ++v)
+			{
+				float* pVertex = pVertices + (size_t)(baseVertex + v) * 8;
+				cgltf_accessor_read_float(pPositions, v, pVertex, 3);
+				if (pNormals)
+					cgltf_accessor_read_float(pNormals, v, pVertex + 3, 3);
+				if (pUVs)
+					cgltf_accessor_read_float(pUVs, v, pVertex + 6, 2);
+			}
+
+			// Indices are rebased onto the shared vertex blob so every draw uses a vertex offset of 0
+			const uint32_t primitiveIndexCount = primitive.indices ? (uint32_t)primitive.indices->count : primitiveVertexCount;
+			for (uint32_t i = 0; i < primitiveIndexCount; ++i)
+			{
+				const uint32_t index = baseVertex + (primitive.indices ? (uint32_t)cgltf_accessor_read_index(primitive.indices, i) : i);
+				if (indexSize == sizeof(uint16_t))
+					((uint16_t*)pIndices)[baseIndex + i] = (uint16_t)index;
+				else
+					((uint32_t*)pIndices)[baseIndex + i] = index;
+			}
+
+			pMeshes[meshIndex].mStartIndex = baseIndex;
+			pMeshes[meshIndex].mIndexCount = primitiveIndexCount;
+			pMeshes[meshIndex].mMaterialIndex =
+				primitive.material ? (uint32_t)(primitive.material - pData->materials) : MESH_ASSET_INVALID_MATERIAL;
+
+			baseVertex += primitiveVertexCount;
+			baseIndex += primitiveIndexCount;
+			++meshIndex;
+		}
+	}
+
+	*pImageSize = header.mFileSize;
+	return pFile;
+}
+
+static bool mapFile(const char* pPath, MeshAsset* pAsset)
+{
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(pPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* pMapping = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!pMapping)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	pAsset->pFileHandle = file;
+	pAsset->pMappingHandle = mapping;
+	pAsset->pImage = (const uint8_t*)pMapping;
+	pAsset->mImageSize = (uint64_t)fileSize.QuadPart;
+	pAsset->mMapped = true;
+	return true;
+#else
+	int file = open(pPath, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat fileStat = {};
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void* pMapping = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps the file referenced
+	close(file);
+	if (pMapping == MAP_FAILED)
+		return false;
+
+	// The blobs are read front to back exactly once by the upload
+	madvise(pMapping, (size_t)fileStat.st_size, MADV_WILLNEED);
+
+	pAsset->pImage = (const uint8_t*)pMapping;
+	pAsset->mImageSize = (uint64_t)fileStat.st_size;
+	pAsset->mMapped = true;
+	return true;
+#endif
+}
+
+static void releaseImage(MeshAsset* pAsset)
+{
+	if (!pAsset->pImage)
+		return;
+
+	if (!pAsset->mMapped)
+	{
+		free((void*)pAsset->pImage);
+	}
+	else
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(pAsset->pImage);
+		CloseHandle((HANDLE)pAsset->pMappingHandle);
+		CloseHandle((HANDLE)pAsset->pFileHandle);
+		pAsset->pMappingHandle = NULL;
+		pAsset->pFileHandle = NULL;
+#else
+		munmap((void*)pAsset->pImage, (size_t)pAsset->mImageSize);
+#endif
+	}
+	pAsset->pImage = NULL;
+	pAsset->mImageSize = 0;
+	pAsset->mMapped = false;
+}
+
+static bool validateHeader(const MeshAssetHeader* pHeader, uint64_t fileSize)
+{
+	if (pHeader->mMagic != MESH_ASSET_MAGIC || pHeader->mVersion != MESH_ASSET_VERSION || pHeader->mFileSize != fileSize)
+		return false;
+	if (pHeader->mVertexStride != gBakedVertexStride || (pHeader->mIndexSize != sizeof(uint16_t) && pHeader->mIndexSize != sizeof(uint32_t)))
+		return false;
+
+	return pHeader->mNodesOffset + sizeof(MeshAssetNode) * pHeader->mNodeCount <= fileSize &&
+		pHeader->mMeshesOffset + sizeof(MeshAssetMesh) * pHeader->mMeshCount <= fileSize &&
+		pHeader->mMaterialsOffset + sizeof(MeshAssetMaterial) * pHeader->mMaterialCount <= fileSize &&
+		pHeader->mTexturesOffset + sizeof(MeshAssetTexture) * pHeader->mTextureCount <= fileSize &&
+		pHeader->mVerticesOffset + (uint64_t)pHeader->mVertexStride * pHeader->mVertexCount <= fileSize &&
+		pHeader->mIndicesOffset + (uint64_t)pHeader->mIndexSize * pHeader->mIndexCount <= fileSize;
+}
+
+// Every table entry and index has to stay inside the sections it refers to, the scene graph, the draws and the GPU
+// index fetches trust them without checks. Needs a header that passed validateHeader.
+static bool validateSections(const MeshAssetHeader* pHeader, const uint8_t* pFile)
+{
+	const MeshAssetNode* pNodes = (const MeshAssetNode*)(pFile + pHeader->mNodesOffset);
+	for (uint32_t i = 0; i < pHeader->mNodeCount; ++i)
+	{
+		const MeshAssetNode& node = pNodes[i];
+		if (node.mParentIndex != MESH_ASSET_INVALID_NODE && node.mParentIndex >= pHeader->mNodeCount)
+			return false;
+		if (node.mMeshIndex != MESH_ASSET_INVALID_NODE && (uint64_t)node.mMeshIndex + node.mMeshCount > pHeader->mMeshCount)
+			return false;
+	}
+
+	const MeshAssetMesh* pMeshes = (const MeshAssetMesh*)(pFile + pHeader->mMeshesOffset);
+	for (uint32_t i = 0; i < pHeader->mMeshCount; ++i)
+	{
+		const MeshAssetMesh& mesh = pMeshes[i];
+		if ((uint64_t)mesh.mStartIndex + mesh.mIndexCount > pHeader->mIndexCount)
+			return false;
+		if (mesh.mMaterialIndex != MESH_ASSET_INVALID_MATERIAL && mesh.mMaterialIndex >= pHeader->mMaterialCount)
+			return false;
+	}
+
+	const MeshAssetMaterial* pMaterials = (const MeshAssetMaterial*)(pFile + pHeader->mMaterialsOffset);
+	for (uint32_t i = 0; i < pHeader->mMaterialCount; ++i)
+	{
+		if (pMaterials[i].mBaseColorTexture != MESH_ASSET_INVALID_TEXTURE && pMaterials[i].mBaseColorTexture >= pHeader->mTextureCount)
+			return false;
+	}
+
+#if defined(_DEBUG)
+	// Walks the whole index blob, which the zero-copy load otherwise leaves untouched until the upload, so only debug
+	// builds pay for it. Release builds check the tables only.
+	const uint8_t* pIndices = pFile + pHeader->mIndicesOffset;
+	for (uint32_t i = 0; i < pHeader->mIndexCount; ++i)
+	{
+		const uint32_t index = pHeader->mIndexSize == sizeof(uint16_t) ? ((const uint16_t*)pIndices)[i] : ((const uint32_t*)pIndices)[i];
+		if (index >= pHeader->mVertexCount)
+			return false;
+	}
+#endif
+	return true;
+}
+
+// Validates pAsset->pImage and points the asset at its sections
+static bool attachImage(MeshAsset* pAsset, const char* fileName)
+{
+	const uint8_t* pFile = pAsset->pImage;
+	const MeshAssetHeader* pHeader = (const MeshAssetHeader*)pFile;
+	if (pAsset->mImageSize < sizeof(MeshAssetHeader) || !validateHeader(pHeader, pAsset->mImageSize) || !validateSections(pHeader, pFile))
+	{
+		LOGF(LogLevel::eWARNING, "Mesh asset '%s' is not a valid version %u file or is corrupt, ignoring it", fileName, MESH_ASSET_VERSION);
+		releaseImage(pAsset);
+		return false;
+	}
+
+	// Nodes, meshes and materials are tiny and outlive the mapping, the blobs are only referenced
+	pAsset->mNodeCount = pHeader->mNodeCount;
+	pAsset->mMeshCount = pHeader->mMeshCount;
+	pAsset->mMaterialCount = pHeader->mMaterialCount;
+	pAsset->mTextureCount = pHeader->mTextureCount;
+	pAsset->pNodes = (MeshAssetNode*)malloc(sizeof(MeshAssetNode) * max(pHeader->mNodeCount, 1u));
+	pAsset->pMeshes = (MeshAssetMesh*)malloc(sizeof(MeshAssetMesh) * max(pHeader->mMeshCount, 1u));
+	pAsset->pMaterials = (MeshAssetMaterial*)malloc(sizeof(MeshAssetMaterial) * max(pHeader->mMaterialCount, 1u));
+	pAsset->pTextures = (MeshAssetTexture*)malloc(sizeof(MeshAssetTexture) * max(pHeader->mTextureCount, 1u));
+	memcpy(pAsset->pNodes, pFile + pHeader->mNodesOffset, sizeof(MeshAssetNode) * pHeader->mNodeCount);
+	memcpy(pAsset->pMeshes, pFile + pHeader->mMeshesOffset, sizeof(MeshAssetMesh) * pHeader->mMeshCount);
+	memcpy(pAsset->pMaterials, pFile + pHeader->mMaterialsOffset, sizeof(MeshAssetMaterial) * pHeader->mMaterialCount);
+	memcpy(pAsset->pTextures, pFile + pHeader->mTexturesOffset, sizeof(MeshAssetTexture) * pHeader->mTextureCount);
+
+	pAsset->mVertexCount = pHeader->mVertexCount;
+	pAsset->mVertexStride = pHeader->mVertexStride;
+	pAsset->mIndexCount = pHeader->mIndexCount;
+	pAsset->mIndexSize = pHeader->mIndexSize;
+	pAsset->pVertices = pFile + pHeader->mVerticesOffset;
+	pAsset->pIndices = pFile + pHeader->mIndicesOffset;
+	return true;
+}
+
+bool importMeshAsset(const char* gltfFileName, MeshAsset* pAsset)
+{
+	ASSERT(pAsset);
+
+	*pAsset = {};
+
+	GLTFContainer* pContainer = NULL;
+	if (gltfLoadContainer(gltfFileName, NULL, GLTF_FLAG_CALCULATE_BOUNDS, &pContainer) != 0)
+	{
+		LOGF(LogLevel::eERROR, "Mesh import: could not load '%s'", gltfFileName);
+		return false;
+	}
+
+	uint64_t imageSize = 0;
+	pAsset->pImage = buildFileImage(pContainer, gltfFileName, &imageSize);
+	pAsset->mImageSize = imageSize;
+	gltfUnloadContainer(pContainer);
+
+	return pAsset->pImage && attachImage(pAsset, gltfFileName);
+}
+
+bool saveMeshAsset(const MeshAsset* pAsset, ResourceDirectory resourceDir, const char* fileName)
+{
+	ASSERT(pAsset->pImage);
+
+	FileStream stream = {};
+	bool written = false;
+	if (fsOpenStreamFromPath(resourceDir, fileName, FM_WRITE_BINARY, NULL, &stream))
+	{
+		written = fsWriteToStream(&stream, pAsset->pImage, (size_t)pAsset->mImageSize) == (size_t)pAsset->mImageSize;
+		fsCloseStream(&stream);
+	}
+
+	if (!written)
+	{
+		LOGF(LogLevel::eERROR, "Mesh bake: could not write '%s'", fileName);
+		return false;
+	}
+
+	LOGF(LogLevel::eINFO, "Mesh bake: '%s', %u nodes, %u meshes, %u vertices, %u indices", fileName, pAsset->mNodeCount, pAsset->mMeshCount,
+		pAsset->mVertexCount, pAsset->mIndexCount);
+	return true;
+}
+
+bool loadMeshAsset(ResourceDirectory resourceDir, const char* fileName, MeshAsset* pAsset)
+{
+	ASSERT(pAsset);
+
+	*pAsset = {};
+
+	char path[512] = {};
+	fsAppendPathComponent(fsGetResourceDirectory(resourceDir), fileName, path);
+	return mapFile(path, pAsset) && attachImage(pAsset, fileName);
+}
+
+void releaseMeshAssetBlobs(MeshAsset* pAsset)
+{
+	pAsset->pVertices = NULL;
+	pAsset->pIndices = NULL;
+	releaseImage(pAsset);
+}
+
+void exitMeshAsset(MeshAsset* pAsset)
+{
+	releaseMeshAssetBlobs(pAsset);
+	free(pAsset->pNodes);
+	free(pAsset->pMeshes);
+	free(pAsset->pMaterials);
+	free(pAsset->pTextures);
+	*pAsset = {};
+}
+
+static uint16_t quantizeUnorm16(float value)
+{
+	return (uint16_t)(clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static int16_t quantizeSnorm16(float value)
+{
+	const float scaled = clamp(value, -1.0f, 1.0f) * 32767.0f;
+	return (int16_t)(scaled >= 0.0f ? scaled + 0.5f : scaled - 0.5f);
+}
+
+// Round to nearest, values beyond the half range saturate to infinity and denormals flush to zero
+static uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	const uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0)
+		return (uint16_t)sign;
+	if (exponent >= 31)
+		return (uint16_t)(sign | 0x7C00);
+
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	// The carry of the rounding correctly moves into the exponent
+	if (mantissa & 0x1000)
+		++half;
+	return (uint16_t)half;
+}
+
+// Octahedral mapping of a unit vector onto [-1, 1]^2
+static void encodeOctahedral(const float* pNormal, int16_t* pEncoded)
+{
+	const float l1 = fabsf(pNormal[0]) + fabsf(pNormal[1]) + fabsf(pNormal[2]);
+	float x = l1 > 0.0f ? pNormal[0] / l1 : 0.0f;
+	float y = l1 > 0.0f ? pNormal[1] / l1 : 0.0f;
+	if (pNormal[2] < 0.0f)
+	{
+		const float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	pEncoded[0] = quantizeSnorm16(x);
+	pEncoded[1] = quantizeSnorm16(y);
+}
+
+void* packMeshAssetVertices(const MeshAsset* pAsset, vec3* pDequantScale, vec3* pDequantOffset)
+{
+	ASSERT(pAsset->pVertices);
+	ASSERT(pAsset->mVertexStride == gBakedVertexStride);
+
+	const float* pSrc = (const float*)pAsset->pVertices;
+	const uint32_t vertexCount = pAsset->mVertexCount;
+
+	// One quantization range for the whole blob, draws of several meshes share the vertex shader constants
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			boundsMin[c] = min(boundsMin[c], pSrc[v * 8 + c]);
+			boundsMax[c] = max(boundsMax[c], pSrc[v * 8 + c]);
+		}
+	}
+
+	float scale[3];
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		if (vertexCount == 0)
+			boundsMin[c] = boundsMax[c] = 0.0f;
+		scale[c] = boundsMax[c] > boundsMin[c] ? boundsMax[c] - boundsMin[c] : 1.0f;
+	}
+
+	uint8_t* pPacked = (uint8_t*)malloc((size_t)vertexCount * MESH_ASSET_PACKED_VERTEX_STRIDE);
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		const float* pVertex = pSrc + (size_t)v * 8;
+		uint8_t* pDst = pPacked + (size_t)v * MESH_ASSET_PACKED_VERTEX_STRIDE;
+
+		uint16_t* pPosition = (uint16_t*)pDst;
+		for (uint32_t c = 0; c < 3; ++c)
+			pPosition[c] = quantizeUnorm16((pVertex[c] - boundsMin[c]) / scale[c]);
+		pPosition[3] = 0;
+
+		encodeOctahedral(pVertex + 3, (int16_t*)(pDst + 8));
+
+		uint16_t* pUV = (uint16_t*)(pDst + 12);
+		pUV[0] = floatToHalf(pVertex[6]);
+		pUV[1] = floatToHalf(pVertex[7]);
+	}
+
+	*pDequantScale = vec3(scale[0], scale[1], scale[2]);
+	*pDequantOffset = vec3(boundsMin[0], boundsMin[1], boundsMin[2]);
+	return pPacked;
+}
+
+// Post-transform cache size the orders are tuned for and measured against, matches most desktop GPUs
+static const uint32_t	gVertexCacheSize = 16;
+// Overdraw optimization may make the vertex cache efficiency this much worse to reduce overdraw
+static const float		gOverdrawThreshold = 1.05f;
+
+static void readIndices(const MeshAsset* pAsset, uint32_t first, uint32_t count, uint32_t rebase, uint32_t* pDst)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (pAsset->mIndexSize == sizeof(uint16_t))
+			pDst[i] = ((const uint16_t*)pAsset->pIndices)[first + i] - rebase;
+		else
+			pDst[i] = ((const uint32_t*)pAsset->pIndices)[first + i] - rebase;
+	}
+}
+
+static void writeIndices(MeshAsset* pAsset, uint32_t first, uint32_t count, uint32_t rebase, const uint32_t* pSrc)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (pAsset->mIndexSize == sizeof(uint16_t))
+			((uint16_t*)pAsset->pIndices)[first + i] = (uint16_t)(pSrc[i] + rebase);
+		else
+			((uint32_t*)pAsset->pIndices)[first + i] = pSrc[i] + rebase;
+	}
+}
+
+bool optimizeMeshAsset(MeshAsset* pAsset)
+{
+	ASSERT(pAsset->pVertices && pAsset->pIndices);
+	ASSERT(pAsset->mVertexStride == gBakedVertexStride);
+
+	if (pAsset->mMapped)
+	{
+		LOGF(LogLevel::eWARNING, "Mesh optimize: baked files keep the order they were baked with, rebake with --bake to optimize them");
+		return false;
+	}
+
+	uint32_t maxMeshIndexCount = 0;
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+		maxMeshIndexCount = max(maxMeshIndexCount, pAsset->pMeshes[m].mIndexCount);
+
+	uint32_t* pSource = (uint32_t*)malloc(sizeof(uint32_t) * max(maxMeshIndexCount, 1u));
+	uint32_t* pCacheOrder = (uint32_t*)malloc(sizeof(uint32_t) * max(maxMeshIndexCount, 1u));
+	uint32_t* pOverdrawOrder = (uint32_t*)malloc(sizeof(uint32_t) * max(maxMeshIndexCount, 1u));
+
+	// Meshes reference their own contiguous vertex range, triangles are reordered within each mesh so the index
+	// ranges of the mesh table stay valid
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+	{
+		const MeshAssetMesh& mesh = pAsset->pMeshes[m];
+		if (mesh.mIndexCount < 3)
+			continue;
+
+		uint32_t firstVertex = UINT_MAX;
+		uint32_t lastVertex = 0;
+		readIndices(pAsset, mesh.mStartIndex, mesh.mIndexCount, 0, pSource);
+		for (uint32_t i = 0; i < mesh.mIndexCount; ++i)
+		{
+			firstVertex = min(firstVertex, pSource[i]);
+			lastVertex = max(lastVertex, pSource[i]);
+		}
+		for (uint32_t i = 0; i < mesh.mIndexCount; ++i)
+			pSource[i] -= firstVertex;
+
+		const uint32_t vertexCount = lastVertex - firstVertex + 1;
+		const float* pPositions = (const float*)((const uint8_t*)pAsset->pVertices + (size_t)firstVertex * pAsset->mVertexStride);
+
+		const meshopt_VertexCacheStatistics cacheBefore = meshopt_analyzeVertexCache(pSource, mesh.mIndexCount, vertexCount, gVertexCacheSize, 0, 0);
+		const meshopt_OverdrawStatistics overdrawBefore = meshopt_analyzeOverdraw(pSource, mesh.mIndexCount, pPositions, vertexCount, pAsset->mVertexStride);
+
+		meshopt_optimizeVertexCache(pCacheOrder, pSource, mesh.mIndexCount, vertexCount);
+		meshopt_optimizeOverdraw(pOverdrawOrder, pCacheOrder, mesh.mIndexCount, pPositions, vertexCount, pAsset->mVertexStride, gOverdrawThreshold);
+
+		const meshopt_VertexCacheStatistics cacheAfter = meshopt_analyzeVertexCache(pOverdrawOrder, mesh.mIndexCount, vertexCount, gVertexCacheSize, 0, 0);
+		const meshopt_OverdrawStatistics overdrawAfter = meshopt_analyzeOverdraw(pOverdrawOrder, mesh.mIndexCount, pPositions, vertexCount, pAsset->mVertexStride);
+
+		writeIndices(pAsset, mesh.mStartIndex, mesh.mIndexCount, firstVertex, pOverdrawOrder);
+
+		LOGF(LogLevel::eINFO, "Mesh optimize: mesh %u, %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f", m, mesh.mIndexCount / 3,
+			cacheBefore.acmr, cacheAfter.acmr, cacheBefore.atvr, cacheAfter.atvr, overdrawBefore.overdraw, overdrawAfter.overdraw);
+	}
+
+	free(pSource);
+	free(pCacheOrder);
+	free(pOverdrawOrder);
+
+	// Vertices are then laid out in the order the optimized index stream first touches them. Unreferenced vertices
+	// are dropped, the vertex section keeps its offset and only its count shrinks.
+	uint32_t* pIndices = (uint32_t*)malloc(sizeof(uint32_t) * max(pAsset->mIndexCount, 1u));
+	readIndices(pAsset, 0, pAsset->mIndexCount, 0, pIndices);
+	const meshopt_VertexFetchStatistics fetchBefore = meshopt_analyzeVertexFetch(pIndices, pAsset->mIndexCount, pAsset->mVertexCount, pAsset->mVertexStride);
+
+	void* pVertices = malloc((size_t)pAsset->mVertexCount * pAsset->mVertexStride);
+	const uint32_t vertexCount = (uint32_t)meshopt_optimizeVertexFetch(pVertices, pIndices, pAsset->mIndexCount, pAsset->pVertices, pAsset->mVertexCount,
+		pAsset->mVertexStride);
+	const meshopt_VertexFetchStatistics fetchAfter = meshopt_analyzeVertexFetch(pIndices, pAsset->mIndexCount, vertexCount, pAsset->mVertexStride);
+
+	uint8_t* pImage = (uint8_t*)pAsset->pImage;
+	MeshAssetHeader* pHeader = (MeshAssetHeader*)pImage;
+	memset(pImage + pHeader->mVerticesOffset, 0, (size_t)pAsset->mVertexCount * pAsset->mVertexStride);
+	memcpy(pImage + pHeader->mVerticesOffset, pVertices, (size_t)vertexCount * pAsset->mVertexStride);
+	writeIndices(pAsset, 0, pAsset->mIndexCount, 0, pIndices);
+	free(pVertices);
+	free(pIndices);
+
+	LOGF(LogLevel::eINFO, "Mesh optimize: %u -> %u vertices, vertex fetch overfetch %.3f -> %.3f", pAsset->mVertexCount, vertexCount,
+		fetchBefore.overfetch, fetchAfter.overfetch);
+
+	pHeader->mVertexCount = vertexCount;
+	pAsset->mVertexCount = vertexCount;
+	return true;
+}
+
+void computeMeshUvDensities(const MeshAsset* pAsset, float* pDensities)
+{
+	ASSERT(pAsset->pVertices && pAsset->pIndices);
+	ASSERT(pAsset->mVertexStride == gBakedVertexStride);
+
+	const float* pVertices = (const float*)pAsset->pVertices;
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+	{
+		const MeshAssetMesh& mesh = pAsset->pMeshes[m];
+		double meshArea = 0.0;
+		double uvArea = 0.0;
+		for (uint32_t t = 0; t + 2 < mesh.mIndexCount; t += 3)
+		{
+			uint32_t triangle[3];
+			readIndices(pAsset, mesh.mStartIndex + t, 3, 0, triangle);
+			const float* a = pVertices + (size_t)triangle[0] * 8;
+			const float* b = pVertices + (size_t)triangle[1] * 8;
+			const float* c = pVertices + (size_t)triangle[2] * 8;
+
+			meshArea += 0.5f * length(cross(vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]), vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2])));
+			uvArea += 0.5f * fabsf((b[6] - a[6]) * (c[7] - a[7]) - (c[6] - a[6]) * (b[7] - a[7]));
+		}
+		pDensities[m] = meshArea > 0.0 ? (float)sqrt(uvArea / meshArea) : 0.0f;
+	}
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <limits.h>
+
+#include "../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// Flat scene description the viewer draws from: nodes, mesh index ranges and bounds, plus the vertex and index
+// blobs in their final GPU layout. It is either imported from a GLTF file, which is read and parsed once into the
+// same in-memory image a baked file has, or loaded from a baked .fpbm file by mapping it and uploading straight
+// from the mapped pages.
+//
+// File layout, every section starts at a multiple of MESH_ASSET_ALIGNMENT:
+//   MeshAssetHeader
+//   MeshAssetNode[mNodeCount]
+//   MeshAssetMesh[mMeshCount]
+//   MeshAssetMaterial[mMaterialCount]
+//   MeshAssetTexture[mTextureCount]
+//   vertices, mVertexCount * mVertexStride bytes (float3 position, float3 normal, float2 uv)
+//   indices, mIndexCount * mIndexSize bytes, already offset into the shared vertex blob
+
+#define MESH_ASSET_MAGIC		0x4d425046 // "FPBM"
+#define MESH_ASSET_VERSION		3
+#define MESH_ASSET_ALIGNMENT	256
+#define MESH_ASSET_EXTENSION	"fpbm"
+#define MESH_ASSET_INVALID_NODE	UINT_MAX
+// Meshes without a material and materials without a base color texture
+#define MESH_ASSET_INVALID_MATERIAL	UINT_MAX
+#define MESH_ASSET_INVALID_TEXTURE	UINT_MAX
+#define MESH_ASSET_TEXTURE_NAME_LENGTH	64
+
+// Packed vertex: R16G16B16A16_UNORM position relative to the asset bounds, R16G16_SNORM octahedral normal,
+// R16G16_SFLOAT uv, half the size of the baked float layout
+#define MESH_ASSET_PACKED_VERTEX_STRIDE	16
+
+typedef struct MeshAssetHeader
+{
+	uint32_t	mMagic;
+	uint32_t	mVersion;
+	uint32_t	mNodeCount;
+	uint32_t	mMeshCount;
+	uint32_t	mVertexCount;
+	uint32_t	mVertexStride;
+	uint32_t	mIndexCount;
+	uint32_t	mIndexSize;
+	uint32_t	mMaterialCount;
+	uint32_t	mTextureCount;
+	uint64_t	mNodesOffset;
+	uint64_t	mMeshesOffset;
+	uint64_t	mMaterialsOffset;
+	uint64_t	mTexturesOffset;
+	uint64_t	mVerticesOffset;
+	uint64_t	mIndicesOffset;
+	uint64_t	mFileSize;
+} MeshAssetHeader;
+
+typedef struct MeshAssetNode
+{
+	// Column major local transform
+	float		mLocalMatrix[16];
+	uint32_t	mParentIndex;
+	// First mesh and mesh count, mMeshIndex is MESH_ASSET_INVALID_NODE for nodes without meshes
+	uint32_t	mMeshIndex;
+	uint32_t	mMeshCount;
+	uint32_t	mPadding;
+} MeshAssetNode;
+
+typedef struct MeshAssetMesh
+{
+	float		mMin[3];
+	uint32_t	mStartIndex;
+	float		mMax[3];
+	uint32_t	mIndexCount;
+	// GLTF material of the primitive, MESH_ASSET_INVALID_MATERIAL when it has none
+	uint32_t	mMaterialIndex;
+} MeshAssetMesh;
+
+// The metallic roughness parameters of a GLTF material
+typedef struct MeshAssetMaterial
+{
+	float		mBaseColorFactor[4];
+	float		mMetallicFactor;
+	float		mRoughnessFactor;
+	// Entry of the asset textures, MESH_ASSET_INVALID_TEXTURE for untextured materials
+	uint32_t	mBaseColorTexture;
+	// GLTF doubleSided, meshlets of these meshes are never cone culled
+	uint32_t	mDoubleSided;
+} MeshAssetMaterial;
+
+// A GLTF image, by its file name without directory and extension, the way RD_TEXTURES files are loaded
+typedef struct MeshAssetTexture
+{
+	char		mName[MESH_ASSET_TEXTURE_NAME_LENGTH];
+} MeshAssetTexture;
+
+typedef struct MeshAsset
+{
+	uint32_t		mNodeCount;
+	uint32_t		mMeshCount;
+	uint32_t		mMaterialCount;
+	uint32_t		mTextureCount;
+	MeshAssetNode*	pNodes;
+	MeshAssetMesh*	pMeshes;
+	MeshAssetMaterial*	pMaterials;
+	MeshAssetTexture*	pTextures;
+
+	// Only set until releaseMeshAssetBlobs, they point into the file image
+	uint32_t		mVertexCount;
+	uint32_t		mVertexStride;
+	uint32_t		mIndexCount;
+	uint32_t		mIndexSize;
+	const void*		pVertices;
+	const void*		pIndices;
+
+	// File image, either the mapped baked file or the heap copy built by the import
+	const uint8_t*	pImage;
+	uint64_t		mImageSize;
+	bool			mMapped;
+#if defined(_WIN32)
+	void*			pFileHandle;
+	void*			pMappingHandle;
+#endif
+} MeshAsset;
+
+// Reads and parses a GLTF file from RD_MESHES once and decodes nodes, meshes, bounds, materials and vertex data from
+// that parse
+bool importMeshAsset(const char* gltfFileName, MeshAsset* pAsset);
+
+// Writes the file image of an asset whose blobs are not released yet, this is the bake step
+bool saveMeshAsset(const MeshAsset* pAsset, ResourceDirectory resourceDir, const char* fileName);
+
+// Maps a baked file. Returns false if it does not exist or does not match the current format.
+bool loadMeshAsset(ResourceDirectory resourceDir, const char* fileName, MeshAsset* pAsset);
+
+// Unmaps or frees the file image once the blobs are uploaded, nodes, meshes, materials and textures stay valid
+void releaseMeshAssetBlobs(MeshAsset* pAsset);
+
+void exitMeshAsset(MeshAsset* pAsset);
+
+// Reorders the triangles of every mesh for the post-transform vertex cache and then for overdraw, and the vertices
+// for fetch locality, logging ACMR, ATVR, overdraw and overfetch before and after. Works in place on an imported
+// image, so a bake that follows writes the optimized order. Returns false for mapped baked files.
+bool optimizeMeshAsset(MeshAsset* pAsset);
+
+// Converts the float vertex blob to the packed layout, the caller frees the returned memory.
+// The shader gets the position back as unorm * pDequantScale + pDequantOffset.
+void* packMeshAssetVertices(const MeshAsset* pAsset, vec3* pDequantScale, vec3* pDequantOffset);
+
+// Average UV units per mesh unit of every mesh, the square root of its UV area over its surface area. Texture
+// streaming turns it into the screen density of a texture. Needs the blobs in the float layout.
+void computeMeshUvDensities(const MeshAsset* pAsset, float* pDensities);
+
+inline mat4 getMeshAssetNodeMatrix(const MeshAssetNode& node)
+{
+	const float* m = node.mLocalMatrix;
+	return mat4(vec4(m[0], m[1], m[2], m[3]), vec4(m[4], m[5], m[6], m[7]), vec4(m[8], m[9], m[10], m[11]), vec4(m[12], m[13], m[14], m[15]));
+}
@@ -0,0 +1,135 @@
+#include "MeshLod.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+#include "../../../Common_3/ThirdParty/OpenSource/meshoptimizer/src/meshoptimizer.h"
+
+// Share of the level 0 triangles each level aims for, and the error relative to the mesh extent the simplifier may
+// introduce on top of the previous level to get there
+static const float	gLodTargetRatios[MESH_LOD_MAX_LEVELS] = { 1.0f, 0.5f, 0.25f, 0.125f };
+static const float	gLodTargetErrors[MESH_LOD_MAX_LEVELS] = { 0.0f, 0.01f, 0.02f, 0.05f };
+// A level that keeps more than this share of the previous level's indices is not worth its memory and ends the chain
+static const float	gLodMinReduction = 0.9f;
+// Coarser levels are only taken below this share of the pixel threshold
+static const float	gLodHysteresis = 0.75f;
+
+static uint32_t readIndex(const MeshAsset* pAsset, uint32_t i)
+{
+	return pAsset->mIndexSize == sizeof(uint16_t) ? ((const uint16_t*)pAsset->pIndices)[i] : ((const uint32_t*)pAsset->pIndices)[i];
+}
+
+void buildMeshLods(const MeshAsset* pAsset, MeshLodSet* pSet)
+{
+	ASSERT(pAsset->pVertices && pAsset->pIndices);
+
+	*pSet = {};
+	pSet->mMeshCount = pAsset->mMeshCount;
+	pSet->mIndexSize = pAsset->mIndexSize;
+	pSet->pLevels = (MeshLodLevel*)calloc(max(pAsset->mMeshCount, 1u) * MESH_LOD_MAX_LEVELS, sizeof(MeshLodLevel));
+
+	uint32_t maxMeshIndexCount = 0;
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+		maxMeshIndexCount = max(maxMeshIndexCount, pAsset->pMeshes[m].mIndexCount);
+
+	// Every accepted level is smaller than the one it was simplified from, so the chain of a mesh never needs more
+	// than MESH_LOD_MAX_LEVELS - 1 times its own index count
+	uint32_t* pLodIndices = (uint32_t*)malloc(sizeof(uint32_t) * max(pAsset->mIndexCount * (MESH_LOD_MAX_LEVELS - 1), 1u));
+	uint32_t* pSource = (uint32_t*)malloc(sizeof(uint32_t) * max(maxMeshIndexCount, 1u));
+	uint32_t* pDestination = (uint32_t*)malloc(sizeof(uint32_t) * max(maxMeshIndexCount, 1u));
+	uint32_t lodIndexCount = 0;
+	uint64_t levelTriangles[MESH_LOD_MAX_LEVELS] = {};
+
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+	{
+		const MeshAssetMesh& mesh = pAsset->pMeshes[m];
+		MeshLodLevel* pLevels = pSet->pLevels + m * MESH_LOD_MAX_LEVELS;
+		pLevels[0] = { mesh.mStartIndex, mesh.mIndexCount, 0.0f };
+
+		// The simplifier keeps state per vertex, so it only gets the vertex range this mesh references
+		uint32_t firstVertex = UINT_MAX;
+		uint32_t lastVertex = 0;
+		for (uint32_t i = 0; i < mesh.mIndexCount; ++i)
+		{
+			pSource[i] = readIndex(pAsset, mesh.mStartIndex + i);
+			firstVertex = min(firstVertex, pSource[i]);
+			lastVertex = max(lastVertex, pSource[i]);
+		}
+		for (uint32_t i = 0; i < mesh.mIndexCount; ++i)
+			pSource[i] -= firstVertex;
+
+		const float* pPositions = (const float*)((const uint8_t*)pAsset->pVertices + (size_t)firstVertex * pAsset->mVertexStride);
+		const uint32_t vertexCount = mesh.mIndexCount ? lastVertex - firstVertex + 1 : 0;
+		const float extent = max(mesh.mMax[0] - mesh.mMin[0], max(mesh.mMax[1] - mesh.mMin[1], mesh.mMax[2] - mesh.mMin[2]));
+
+		// Each level is simplified from the previous one, its error bound adds up the steps taken
+		uint32_t levelCount = 1;
+		uint32_t sourceCount = mesh.mIndexCount;
+		for (; levelCount < MESH_LOD_MAX_LEVELS && sourceCount >= 3; ++levelCount)
+		{
+			const size_t targetCount = (size_t)((float)mesh.mIndexCount * gLodTargetRatios[levelCount]) / 3 * 3;
+			const uint32_t count = (uint32_t)meshopt_simplify(pDestination, pSource, sourceCount, pPositions, vertexCount,
+				pAsset->mVertexStride, targetCount, gLodTargetErrors[levelCount]);
+			if (count == 0 || (float)count > (float)sourceCount * gLodMinReduction)
+				break;
+
+			for (uint32_t i = 0; i < count; ++i)
+				pLodIndices[lodIndexCount + i] = pDestination[i] + firstVertex;
+
+			pLevels[levelCount] = { pAsset->mIndexCount + lodIndexCount, count, pLevels[levelCount - 1].mError + gLodTargetErrors[levelCount] * extent };
+			lodIndexCount += count;
+
+			memcpy(pSource, pDestination, sizeof(uint32_t) * count);
+			sourceCount = count;
+		}
+
+		for (uint32_t l = levelCount; l < MESH_LOD_MAX_LEVELS; ++l)
+			pLevels[l] = pLevels[levelCount - 1];
+		for (uint32_t l = 0; l < MESH_LOD_MAX_LEVELS; ++l)
+			levelTriangles[l] += pLevels[l].mIndexCount / 3;
+	}
+
+	// Simplification never adds vertices, so the levels fit the asset index size
+	pSet->mIndexCount = pAsset->mIndexCount + lodIndexCount;
+	pSet->pIndices = malloc((size_t)pSet->mIndexCount * pSet->mIndexSize);
+	memcpy(pSet->pIndices, pAsset->pIndices, (size_t)pAsset->mIndexCount * pAsset->mIndexSize);
+	if (pSet->mIndexSize == sizeof(uint16_t))
+	{
+		uint16_t* pDst = (uint16_t*)pSet->pIndices + pAsset->mIndexCount;
+		for (uint32_t i = 0; i < lodIndexCount; ++i)
+			pDst[i] = (uint16_t)pLodIndices[i];
+	}
+	else
+	{
+		memcpy((uint32_t*)pSet->pIndices + pAsset->mIndexCount, pLodIndices, sizeof(uint32_t) * lodIndexCount);
+	}
+
+	free(pLodIndices);
+	free(pSource);
+	free(pDestination);
+
+	LOGF(LogLevel::eINFO, "LODs: %u meshes, triangles per level %llu / %llu / %llu / %llu, %.1f KB of extra indices", pAsset->mMeshCount,
+		(unsigned long long)levelTriangles[0], (unsigned long long)levelTriangles[1], (unsigned long long)levelTriangles[2],
+		(unsigned long long)levelTriangles[3], (float)lodIndexCount * pSet->mIndexSize / 1024.0f);
+}
+
+void releaseMeshLodIndices(MeshLodSet* pSet)
+{
+	free(pSet->pIndices);
+	pSet->pIndices = NULL;
+}
+
+void exitMeshLods(MeshLodSet* pSet)
+{
+	free(pSet->pLevels);
+	free(pSet->pIndices);
+	*pSet = {};
+}
+
+uint32_t selectMeshLod(const float* pErrors, uint32_t currentLevel, float pixelsPerUnit, float threshold)
+{
+	uint32_t level = min(currentLevel, (uint32_t)MESH_LOD_MAX_LEVELS - 1);
+	while (level > 0 && pErrors[level] * pixelsPerUnit > threshold)
+		--level;
+	while (level + 1 < MESH_LOD_MAX_LEVELS && pErrors[level + 1] * pixelsPerUnit < threshold * gLodHysteresis)
+		++level;
+	return level;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "MeshAsset.h"
+
+// Simplified index ranges for every mesh of an asset. Level 0 is the mesh as imported, every further level targets
+// half the triangles of the previous one and records a conservative bound of its error in mesh units, so a level
+// can be picked from how large that error would be on screen.
+//
+// Levels are appended after the asset's own indices in one blob of the asset index size. The scene index buffer is
+// uploaded from it, so drawing another level only changes the start index and index count of a draw.
+
+#define MESH_LOD_MAX_LEVELS	4
+
+typedef struct MeshLodLevel
+{
+	uint32_t	mStartIndex;
+	uint32_t	mIndexCount;
+	// Upper bound of the distance between this level and the original surface, in mesh units
+	float		mError;
+} MeshLodLevel;
+
+typedef struct MeshLodSet
+{
+	// MESH_LOD_MAX_LEVELS entries per asset mesh, meshes that stop simplifying repeat their last level
+	uint32_t		mMeshCount;
+	MeshLodLevel*	pLevels;
+
+	// Asset indices followed by every simplified level, only set until releaseMeshLodIndices
+	uint32_t		mIndexCount;
+	uint32_t		mIndexSize;
+	void*			pIndices;
+} MeshLodSet;
+
+// pAsset needs its vertex and index blobs in the baked float layout
+void buildMeshLods(const MeshAsset* pAsset, MeshLodSet* pSet);
+
+// Frees the index blob once it is uploaded, the level table stays valid
+void releaseMeshLodIndices(MeshLodSet* pSet);
+
+void exitMeshLods(MeshLodSet* pSet);
+
+// Returns the coarsest level whose error stays under threshold pixels, moving from currentLevel. pErrors holds the
+// MESH_LOD_MAX_LEVELS errors of the object and pixelsPerUnit how many pixels one error unit covers at its distance.
+// A coarser level is only taken once its error is well under the threshold so objects at a transition do not pop.
+uint32_t selectMeshLod(const float* pErrors, uint32_t currentLevel, float pixelsPerUnit, float threshold);
+
+inline const MeshLodLevel& getMeshLodLevel(const MeshLodSet* pSet, uint32_t mesh, uint32_t level)
+{
+	return pSet->pLevels[mesh * MESH_LOD_MAX_LEVELS + level];
+}
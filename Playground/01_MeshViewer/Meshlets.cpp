@@ -0,0 +1,193 @@
+#include "Meshlets.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+// Below this the cone is too wide to ever be culled and only costs a test
+static const float gMinConeDot = 0.1f;
+
+static uint32_t readIndex(const MeshAsset* pAsset, uint32_t i)
+{
+	return pAsset->mIndexSize == sizeof(uint16_t) ? ((const uint16_t*)pAsset->pIndices)[i] : ((const uint32_t*)pAsset->pIndices)[i];
+}
+
+static const float* getPosition(const MeshAsset* pAsset, uint32_t vertex)
+{
+	return (const float*)((const uint8_t*)pAsset->pVertices + (size_t)vertex * pAsset->mVertexStride);
+}
+
+static void computeBounds(const MeshAsset* pAsset, const uint32_t* pIndices, uint32_t indexCount, const uint32_t* pVertices,
+	uint32_t vertexCount, MeshletBounds* pBounds)
+{
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		const float* p = getPosition(pAsset, pVertices[v]);
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			boundsMin[c] = min(boundsMin[c], p[c]);
+			boundsMax[c] = max(boundsMax[c], p[c]);
+		}
+	}
+
+	float radiusSq = 0.0f;
+	for (uint32_t c = 0; c < 3; ++c)
+		pBounds->mCenter[c] = (boundsMin[c] + boundsMax[c]) * 0.5f;
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		const float* p = getPosition(pAsset, pVertices[v]);
+		const float dx = p[0] - pBounds->mCenter[0];
+		const float dy = p[1] - pBounds->mCenter[1];
+		const float dz = p[2] - pBounds->mCenter[2];
+		radiusSq = max(radiusSq, dx * dx + dy * dy + dz * dz);
+	}
+	pBounds->mRadius = sqrtf(radiusSq);
+
+	// Cone around the average face normal, its half angle is the largest deviation of any face normal
+	vec3 normals[MESHLET_MAX_TRIANGLES];
+	uint32_t normalCount = 0;
+	vec3 axis = vec3(0.0f);
+	for (uint32_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		const float* a = getPosition(pAsset, pIndices[t]);
+		const float* b = getPosition(pAsset, pIndices[t + 1]);
+		const float* c = getPosition(pAsset, pIndices[t + 2]);
+		const vec3 normal = cross(vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]), vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+		const float area = length(normal);
+		if (area <= 0.0f)
+			continue;
+
+		normals[normalCount] = normal / area;
+		axis += normals[normalCount];
+		++normalCount;
+	}
+
+	pBounds->mConeCutoff = 1.0f;
+	pBounds->mConeAxis[0] = 0.0f;
+	pBounds->mConeAxis[1] = 0.0f;
+	pBounds->mConeAxis[2] = 1.0f;
+
+	const float axisLength = length(axis);
+	if (normalCount == 0 || axisLength <= 0.0f)
+		return;
+
+	axis = axis / axisLength;
+	float minDot = 1.0f;
+	for (uint32_t n = 0; n < normalCount; ++n)
+		minDot = min(minDot, dot(normals[n], axis));
+
+	pBounds->mConeAxis[0] = axis.getX();
+	pBounds->mConeAxis[1] = axis.getY();
+	pBounds->mConeAxis[2] = axis.getZ();
+	if (minDot >= gMinConeDot)
+		pBounds->mConeCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+void buildMeshlets(const MeshAsset* pAsset, MeshletSet* pSet)
+{
+	ASSERT(pAsset->pVertices && pAsset->pIndices);
+
+	*pSet = {};
+	pSet->mMeshCount = pAsset->mMeshCount;
+	pSet->pFirstMeshlet = (uint32_t*)calloc(max(pAsset->mMeshCount, 1u), sizeof(uint32_t));
+	pSet->pMeshletCounts = (uint32_t*)calloc(max(pAsset->mMeshCount, 1u), sizeof(uint32_t));
+
+	uint32_t indexCapacity = 0;
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+		indexCapacity += pAsset->pMeshes[m].mIndexCount;
+	pSet->pIndices = (uint32_t*)malloc(sizeof(uint32_t) * max(indexCapacity, 1u));
+
+	// Every meshlet holds at least MESHLET_MAX_VERTICES / 3 triangles unless it ends its mesh
+	uint32_t meshletCapacity = pAsset->mMeshCount + indexCapacity / (3 * (MESHLET_MAX_VERTICES / 3)) + 1;
+	pSet->pMeshlets = (Meshlet*)malloc(sizeof(Meshlet) * meshletCapacity);
+
+	uint32_t localVertices[MESHLET_MAX_VERTICES];
+	for (uint32_t m = 0; m < pAsset->mMeshCount; ++m)
+	{
+		const MeshAssetMesh& mesh = pAsset->pMeshes[m];
+		pSet->pFirstMeshlet[m] = pSet->mMeshletCount;
+
+		uint32_t vertexCount = 0;
+		uint32_t triangleCount = 0;
+		uint32_t meshletStart = pSet->mIndexCount;
+		for (uint32_t t = 0; t + 2 < mesh.mIndexCount; t += 3)
+		{
+			uint32_t triangle[3];
+			uint32_t newVertexCount = 0;
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				triangle[k] = readIndex(pAsset, mesh.mStartIndex + t + k);
+				bool found = false;
+				for (uint32_t v = 0; v < vertexCount && !found; ++v)
+					found = localVertices[v] == triangle[k];
+				for (uint32_t p = 0; p < k && !found; ++p)
+					found = triangle[p] == triangle[k];
+				newVertexCount += found ? 0 : 1;
+			}
+
+			if (vertexCount + newVertexCount > MESHLET_MAX_VERTICES || triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+			{
+				Meshlet& meshlet = pSet->pMeshlets[pSet->mMeshletCount++];
+				meshlet = { meshletStart, pSet->mIndexCount - meshletStart, m, vertexCount };
+				meshletStart = pSet->mIndexCount;
+				vertexCount = 0;
+				triangleCount = 0;
+			}
+
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				bool found = false;
+				for (uint32_t v = 0; v < vertexCount && !found; ++v)
+					found = localVertices[v] == triangle[k];
+				if (!found)
+					localVertices[vertexCount++] = triangle[k];
+				pSet->pIndices[pSet->mIndexCount++] = triangle[k];
+			}
+			++triangleCount;
+		}
+
+		if (triangleCount)
+		{
+			Meshlet& meshlet = pSet->pMeshlets[pSet->mMeshletCount++];
+			meshlet = { meshletStart, pSet->mIndexCount - meshletStart, m, vertexCount };
+		}
+		pSet->pMeshletCounts[m] = pSet->mMeshletCount - pSet->pFirstMeshlet[m];
+	}
+	ASSERT(pSet->mMeshletCount <= meshletCapacity);
+
+	// The local vertex lists are rebuilt here rather than kept, bounds are a cold path
+	pSet->pBounds = (MeshletBounds*)malloc(sizeof(MeshletBounds) * max(pSet->mMeshletCount, 1u));
+	for (uint32_t i = 0; i < pSet->mMeshletCount; ++i)
+	{
+		const Meshlet& meshlet = pSet->pMeshlets[i];
+		const uint32_t* pIndices = pSet->pIndices + meshlet.mIndexOffset;
+		uint32_t vertexCount = 0;
+		for (uint32_t j = 0; j < meshlet.mIndexCount; ++j)
+		{
+			bool found = false;
+			for (uint32_t v = 0; v < vertexCount && !found; ++v)
+				found = localVertices[v] == pIndices[j];
+			if (!found)
+				localVertices[vertexCount++] = pIndices[j];
+		}
+		computeBounds(pAsset, pIndices, meshlet.mIndexCount, localVertices, vertexCount, &pSet->pBounds[i]);
+
+		// Both sides of a double-sided material are seen, no direction of the cone faces away
+		const uint32_t materialIndex = pAsset->pMeshes[meshlet.mMeshIndex].mMaterialIndex;
+		if (materialIndex != MESH_ASSET_INVALID_MATERIAL && pAsset->pMaterials[materialIndex].mDoubleSided)
+			pSet->pBounds[i].mConeCutoff = 1.0f;
+	}
+
+	LOGF(LogLevel::eINFO, "Meshlets: %u clusters from %u triangles, %.1f triangles per cluster", pSet->mMeshletCount, pSet->mIndexCount / 3,
+		pSet->mMeshletCount ? (float)pSet->mIndexCount / 3.0f / (float)pSet->mMeshletCount : 0.0f);
+}
+
+void exitMeshlets(MeshletSet* pSet)
+{
+	free(pSet->pMeshlets);
+	free(pSet->pBounds);
+	free(pSet->pIndices);
+	free(pSet->pFirstMeshlet);
+	free(pSet->pMeshletCounts);
+	*pSet = {};
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+#include "MeshAsset.h"
+
+// Splits every mesh of an asset into small clusters of triangles with a bounding sphere and a normal cone,
+// so a compute pass can drop clusters outside the frustum or facing away from the camera.
+//
+// Clusters are built greedily in index order and never span two meshes. Their indices are copied into one
+// uint32 stream that still references the shared vertex buffer, so culled output can be drawn with it directly.
+
+#define MESHLET_MAX_VERTICES	64
+#define MESHLET_MAX_TRIANGLES	124
+
+// Matches uint4 meshlets[] in cluster_cull.comp
+typedef struct Meshlet
+{
+	uint32_t	mIndexOffset;
+	uint32_t	mIndexCount;
+	uint32_t	mMeshIndex;
+	uint32_t	mVertexCount;
+} Meshlet;
+
+// Matches two float4 of meshletBounds[] in cluster_cull.comp
+typedef struct MeshletBounds
+{
+	float	mCenter[3];
+	float	mRadius;
+	float	mConeAxis[3];
+	// Sine of the cone half angle widened by 90 degrees, 1 disables the backface test for the cluster
+	float	mConeCutoff;
+} MeshletBounds;
+
+typedef struct MeshletSet
+{
+	uint32_t		mMeshletCount;
+	uint32_t		mIndexCount;
+	Meshlet*		pMeshlets;
+	MeshletBounds*	pBounds;
+	uint32_t*		pIndices;
+
+	// Per asset mesh
+	uint32_t		mMeshCount;
+	uint32_t*		pFirstMeshlet;
+	uint32_t*		pMeshletCounts;
+} MeshletSet;
+
+// pAsset needs its vertex and index blobs in the baked float layout
+void buildMeshlets(const MeshAsset* pAsset, MeshletSet* pSet);
+void exitMeshlets(MeshletSet* pSet);
@@ -0,0 +1,187 @@
+#include "ModelStreaming.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+// Fits the model like the main scene: largest axis scaled to mSize, centre of its base at mPosition
+static void placeModel(StreamedModel* pModel)
+{
+	const MeshAsset& asset = pModel->mAsset;
+	SceneGraph* pSceneGraph = pModel->pSceneGraph;
+
+	vec3 boundsMin = vec3(FLT_MAX);
+	vec3 boundsMax = vec3(-FLT_MAX);
+	for (uint32_t n = 0; n < asset.mNodeCount; ++n)
+	{
+		const MeshAssetNode& node = asset.pNodes[n];
+		if (node.mMeshIndex == MESH_ASSET_INVALID_NODE)
+			continue;
+
+		const mat4& worldMatrix = pSceneGraph->pWorldMatrices[pSceneGraph->pSortedIndices[n]];
+		for (uint32_t i = 0; i < node.mMeshCount; ++i)
+		{
+			const MeshAssetMesh& mesh = asset.pMeshes[node.mMeshIndex + i];
+			for (uint32_t c = 0; c < 8; ++c)
+			{
+				const Point3 corner((c & 1) ? mesh.mMax[0] : mesh.mMin[0], (c & 2) ? mesh.mMax[1] : mesh.mMin[1], (c & 4) ? mesh.mMax[2] : mesh.mMin[2]);
+				const vec3 worldPoint = (worldMatrix * corner).getXYZ();
+				boundsMin = minPerElem(boundsMin, worldPoint);
+				boundsMax = maxPerElem(boundsMax, worldPoint);
+			}
+		}
+	}
+
+	const vec3 size = boundsMax - boundsMin;
+	const float largestDim = max(size.getX(), max(size.getY(), size.getZ()));
+	const float scale = largestDim > 0.0f ? pModel->mSize / largestDim : 1.0f;
+	const vec3 centreBase = vec3(0.5f * (boundsMin.getX() + boundsMax.getX()), boundsMin.getY(), 0.5f * (boundsMin.getZ() + boundsMax.getZ()));
+	Vector3 scaleVector = Vector3(scale);
+	scaleVector.setZ(-scaleVector.getZ());
+	sceneGraphSetRootTransform(pSceneGraph, mat4::translation(pModel->mPosition) * mat4::scale(scaleVector) * mat4::translation(-centreBase));
+	updateSceneGraph(pSceneGraph);
+
+	// The mirrored z swaps min and max of that axis
+	const vec3 halfSize = size * (0.5f * scale);
+	pModel->mBoundsMin = pModel->mPosition + vec3(-halfSize.getX(), 0.0f, -halfSize.getZ());
+	pModel->mBoundsMax = pModel->mPosition + vec3(halfSize.getX(), size.getY() * scale, halfSize.getZ());
+}
+
+static void loadStreamedModelTask(void* pUserData, uintptr_t index)
+{
+	UNREF_PARAM(index);
+	StreamedModel* pModel = (StreamedModel*)pUserData;
+
+	char gltfFileName[128] = {};
+	char bakedFileName[128] = {};
+	snprintf(gltfFileName, sizeof(gltfFileName), "%s.gltf", pModel->mName);
+	snprintf(bakedFileName, sizeof(bakedFileName), "%s.%s", pModel->mName, MESH_ASSET_EXTENSION);
+
+	const bool loaded = loadMeshAsset(RD_MESHES, bakedFileName, &pModel->mAsset) || importMeshAsset(gltfFileName, &pModel->mAsset);
+	if (!loaded || !pModel->mAsset.mNodeCount)
+	{
+		LOGF(LogLevel::eERROR, "Streaming: could not load model '%s'", pModel->mName);
+		tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_FAILED);
+		return;
+	}
+
+	const MeshAsset& asset = pModel->mAsset;
+	if (!asset.mVertexCount || !asset.mIndexCount)
+	{
+		LOGF(LogLevel::eINFO, "Streaming: model '%s' has no geometry, nothing to draw", pModel->mName);
+		tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_EMPTY);
+		return;
+	}
+
+	if (pModel->mOptimize && !asset.mMapped)
+		optimizeMeshAsset(&pModel->mAsset);
+
+	uint32_t* pParents = (uint32_t*)malloc(sizeof(uint32_t) * asset.mNodeCount);
+	mat4* pLocalMatrices = (mat4*)malloc(sizeof(mat4) * asset.mNodeCount); //-V630
+	for (uint32_t i = 0; i < asset.mNodeCount; ++i)
+	{
+		pParents[i] = asset.pNodes[i].mParentIndex;
+		pLocalMatrices[i] = getMeshAssetNodeMatrix(asset.pNodes[i]);
+	}
+
+	SceneGraphDesc sceneGraphDesc = {};
+	sceneGraphDesc.mNodeCount = asset.mNodeCount;
+	sceneGraphDesc.pParents = pParents;
+	sceneGraphDesc.pLocalMatrices = pLocalMatrices;
+	const bool sceneGraphCreated = initSceneGraph(&sceneGraphDesc, &pModel->pSceneGraph);
+	free(pLocalMatrices);
+	free(pParents);
+	if (!sceneGraphCreated)
+	{
+		LOGF(LogLevel::eERROR, "Streaming: model '%s' has an invalid node hierarchy", pModel->mName);
+		tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_FAILED);
+		return;
+	}
+	updateSceneGraph(pModel->pSceneGraph);
+
+	placeModel(pModel);
+
+	pModel->mVertexStride = asset.mVertexStride;
+	pModel->mPositionDequantScale = vec4(1.0f);
+	pModel->mPositionDequantOffset = vec4(0.0f);
+	if (pModel->mPackVertices)
+	{
+		vec3 dequantScale;
+		vec3 dequantOffset;
+		pModel->pPackedVertices = packMeshAssetVertices(&asset, &dequantScale, &dequantOffset);
+		pModel->mVertexStride = MESH_ASSET_PACKED_VERTEX_STRIDE;
+		pModel->mPositionDequantScale = vec4(dequantScale, 0.0f);
+		pModel->mPositionDequantOffset = vec4(dequantOffset, 0.0f);
+	}
+	pModel->mIndexType = asset.mIndexSize == sizeof(uint16_t) ? INDEX_TYPE_UINT16 : INDEX_TYPE_UINT32;
+
+	tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_LOADED);
+}
+
+void requestStreamedModel(ThreadSystem* pThreadSystem, const StreamedModelDesc* pDesc, StreamedModel* pModel)
+{
+	*pModel = {};
+	snprintf(pModel->mName, sizeof(pModel->mName), "%s", pDesc->pName);
+	pModel->mPosition = pDesc->mPosition;
+	pModel->mSize = pDesc->mSize;
+	pModel->mOptimize = pDesc->mOptimize;
+	pModel->mPackVertices = pDesc->mPackVertices;
+	tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_LOADING);
+	initHiresTimer(&pModel->mLoadTimer);
+
+	addThreadSystemTask(pThreadSystem, loadStreamedModelTask, pModel);
+}
+
+bool updateStreamedModel(StreamedModel* pModel)
+{
+	const StreamedModelState state = getStreamedModelState(pModel);
+	if (state == STREAMED_MODEL_STATE_LOADED)
+	{
+		const MeshAsset& asset = pModel->mAsset;
+
+		BufferLoadDesc vertexBufferDesc = {};
+		vertexBufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER;
+		vertexBufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		vertexBufferDesc.mDesc.mSize = (uint64_t)asset.mVertexCount * pModel->mVertexStride;
+		vertexBufferDesc.pData = pModel->pPackedVertices ? pModel->pPackedVertices : asset.pVertices;
+		vertexBufferDesc.ppBuffer = &pModel->pVertexBuffer;
+		addResource(&vertexBufferDesc, &pModel->mUploadToken);
+
+		BufferLoadDesc indexBufferDesc = {};
+		indexBufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_INDEX_BUFFER;
+		indexBufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		indexBufferDesc.mDesc.mSize = (uint64_t)asset.mIndexCount * asset.mIndexSize;
+		indexBufferDesc.pData = asset.pIndices;
+		indexBufferDesc.ppBuffer = &pModel->pIndexBuffer;
+		addResource(&indexBufferDesc, &pModel->mUploadToken);
+
+		tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_UPLOADING);
+		return false;
+	}
+
+	if (state == STREAMED_MODEL_STATE_UPLOADING && isTokenCompleted(&pModel->mUploadToken))
+	{
+		releaseMeshAssetBlobs(&pModel->mAsset);
+		free(pModel->pPackedVertices);
+		pModel->pPackedVertices = NULL;
+		pModel->mLoadMs = (float)getHiresTimerUSec(&pModel->mLoadTimer, false) / 1000.0f;
+		tfrg_atomic32_store_release(&pModel->mState, STREAMED_MODEL_STATE_READY);
+
+		LOGF(LogLevel::eINFO, "Streaming: '%s' resident after %.2f ms, %u meshes, %u triangles", pModel->mName, pModel->mLoadMs,
+			pModel->mAsset.mMeshCount, pModel->mAsset.mIndexCount / 3);
+		return true;
+	}
+
+	return false;
+}
+
+void exitStreamedModel(StreamedModel* pModel)
+{
+	if (pModel->pVertexBuffer)
+		removeResource(pModel->pVertexBuffer);
+	if (pModel->pIndexBuffer)
+		removeResource(pModel->pIndexBuffer);
+	free(pModel->pPackedVertices);
+	exitMeshAsset(&pModel->mAsset);
+	if (pModel->pSceneGraph)
+		exitSceneGraph(pModel->pSceneGraph);
+	*pModel = {};
+}
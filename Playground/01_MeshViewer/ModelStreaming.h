@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../../../Common_3/OS/Core/ThreadSystem.h"
+#include "../../../Common_3/OS/Core/Atomics.h"
+#include "../../../Common_3/OS/Interfaces/ITime.h"
+#include "../../../Common_3/Renderer/IRenderer.h"
+#include "../../../Common_3/Renderer/IResourceLoader.h"
+
+#include "MeshAsset.h"
+#include "SceneGraph.h"
+
+// Models added while the viewer runs. The file is mapped or imported, optimized and packed by a task on a load
+// thread, the main thread then queues the uploads and polls their token, so neither the frame nor the graphics
+// queue ever waits for a model. Until a model is resident the viewer draws a placeholder in its place.
+
+typedef enum StreamedModelState
+{
+	// Read and decoded by the load task, only mName and mPosition are valid
+	STREAMED_MODEL_STATE_LOADING = 0,
+	// CPU data is ready, the main thread has to queue the uploads
+	STREAMED_MODEL_STATE_LOADED,
+	// Uploads are queued, mUploadToken tells when they land. Bounds and scene graph are valid from here on.
+	STREAMED_MODEL_STATE_UPLOADING,
+	STREAMED_MODEL_STATE_READY,
+	// Loaded without vertices or indices, there is nothing to upload or draw
+	STREAMED_MODEL_STATE_EMPTY,
+	STREAMED_MODEL_STATE_FAILED,
+} StreamedModelState;
+
+typedef struct StreamedModelDesc
+{
+	const char*	pName;
+	// Where the centre of the model's base lands, the model is scaled to mSize on its largest axis
+	vec3		mPosition;
+	float		mSize;
+	bool		mOptimize;
+	bool		mPackVertices;
+} StreamedModelDesc;
+
+typedef struct StreamedModel
+{
+	char			mName[64];
+	vec3			mPosition;
+	float			mSize;
+	bool			mOptimize;
+	bool			mPackVertices;
+	tfrg_atomic32_t	mState;
+
+	MeshAsset		mAsset;
+	SceneGraph*		pSceneGraph;
+	// World space bounds of all meshes
+	vec3			mBoundsMin;
+	vec3			mBoundsMax;
+
+	Buffer*			pVertexBuffer;
+	Buffer*			pIndexBuffer;
+	uint32_t		mVertexStride;
+	IndexType		mIndexType;
+	vec4			mPositionDequantScale;
+	vec4			mPositionDequantOffset;
+	void*			pPackedVertices;
+	SyncToken		mUploadToken;
+
+	float			mLoadMs;
+	HiresTimer		mLoadTimer;
+} StreamedModel;
+
+// Starts loading <pName>.fpbm, or <pName>.gltf when there is no baked file, from RD_MESHES on pThreadSystem
+void requestStreamedModel(ThreadSystem* pThreadSystem, const StreamedModelDesc* pDesc, StreamedModel* pModel);
+
+// Main thread, once per frame: queues the uploads of loaded models and releases the CPU copies of uploaded ones.
+// Returns true when the model became ready during this call.
+bool updateStreamedModel(StreamedModel* pModel);
+
+inline StreamedModelState getStreamedModelState(StreamedModel* pModel)
+{
+	return (StreamedModelState)tfrg_atomic32_load_acquire(&pModel->mState);
+}
+
+// The load thread has to be idle, or done with this model
+void exitStreamedModel(StreamedModel* pModel);
@@ -0,0 +1,223 @@
+#include "SceneGraph.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+static void decomposeMatrix(const mat4& matrix, vec3* pTranslation, Quat* pRotation, vec3* pScale)
+{
+	vec3 axisX = matrix.getCol0().getXYZ();
+	vec3 axisY = matrix.getCol1().getXYZ();
+	vec3 axisZ = matrix.getCol2().getXYZ();
+
+	vec3 scale = vec3(length(axisX), length(axisY), length(axisZ));
+	// Mirrored transforms keep a proper rotation by flipping one axis
+	if (dot(cross(axisX, axisY), axisZ) < 0.0f)
+		scale.setX(-scale.getX());
+
+	*pTranslation = matrix.getTranslation();
+	*pScale = scale;
+	*pRotation = Quat::identity();
+	if (scale.getX() != 0.0f && scale.getY() != 0.0f && scale.getZ() != 0.0f)
+	{
+		mat3 rotation(axisX / scale.getX(), axisY / scale.getY(), axisZ / scale.getZ());
+		*pRotation = normalize(Quat(rotation));
+	}
+}
+
+bool initSceneGraph(const SceneGraphDesc* pDesc, SceneGraph** ppSceneGraph)
+{
+	ASSERT(pDesc);
+	ASSERT(ppSceneGraph);
+
+	*ppSceneGraph = NULL;
+	const uint32_t nodeCount = pDesc->mNodeCount;
+
+	SceneGraph* pSceneGraph = (SceneGraph*)calloc(1, sizeof(SceneGraph));
+	pSceneGraph->mNodeCount = nodeCount;
+	pSceneGraph->mRootTransform = mat4::identity();
+	pSceneGraph->mRootDirty = true;
+
+	pSceneGraph->pParents = (uint32_t*)malloc(sizeof(uint32_t) * nodeCount);
+	pSceneGraph->pSourceIndices = (uint32_t*)malloc(sizeof(uint32_t) * nodeCount);
+	pSceneGraph->pSortedIndices = (uint32_t*)malloc(sizeof(uint32_t) * nodeCount);
+	pSceneGraph->pUpdateList = (uint32_t*)malloc(sizeof(uint32_t) * nodeCount);
+	pSceneGraph->pTranslations = (vec3*)malloc(sizeof(vec3) * nodeCount); //-V630
+	pSceneGraph->pRotations = (Quat*)malloc(sizeof(Quat) * nodeCount); //-V630
+	pSceneGraph->pScales = (vec3*)malloc(sizeof(vec3) * nodeCount); //-V630
+	pSceneGraph->pLocalMatrices = (mat4*)malloc(sizeof(mat4) * nodeCount); //-V630
+	pSceneGraph->pWorldMatrices = (mat4*)malloc(sizeof(mat4) * nodeCount); //-V630
+	pSceneGraph->pFlags = (uint8_t*)malloc(sizeof(uint8_t) * nodeCount);
+
+	// Resolve the depth of every node without recursion, walking up until a node of known depth
+	uint32_t* pDepths = (uint32_t*)malloc(sizeof(uint32_t) * nodeCount);
+	uint32_t* pStack = (uint32_t*)malloc(sizeof(uint32_t) * nodeCount);
+	memset(pDepths, 0xff, sizeof(uint32_t) * nodeCount);
+
+	uint32_t levelCount = 0;
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		uint32_t stackSize = 0;
+		uint32_t node = i;
+		while (node != SCENE_GRAPH_INVALID_NODE && pDepths[node] == UINT_MAX)
+		{
+			// A walk longer than the node count has come back to a node it already visited
+			if (stackSize == nodeCount)
+			{
+				LOGF(LogLevel::eERROR, "Scene graph: cycle in the node hierarchy through node %u", node);
+				free(pStack);
+				free(pDepths);
+				exitSceneGraph(pSceneGraph);
+				return false;
+			}
+			pStack[stackSize++] = node;
+			node = pDesc->pParents[node];
+			if (node != SCENE_GRAPH_INVALID_NODE && node >= nodeCount)
+			{
+				LOGF(LogLevel::eERROR, "Scene graph: node %u has parent %u, there are only %u nodes", pStack[stackSize - 1], node, nodeCount);
+				free(pStack);
+				free(pDepths);
+				exitSceneGraph(pSceneGraph);
+				return false;
+			}
+		}
+
+		uint32_t depth = node == SCENE_GRAPH_INVALID_NODE ? 0 : pDepths[node] + 1;
+		while (stackSize)
+			pDepths[pStack[--stackSize]] = depth++;
+
+		levelCount = max(levelCount, pDepths[i] + 1);
+	}
+
+	// Counting sort by depth, stable so siblings keep their source order
+	pSceneGraph->mLevelCount = levelCount;
+	pSceneGraph->pLevelOffsets = (uint32_t*)calloc(levelCount + 1, sizeof(uint32_t));
+	for (uint32_t i = 0; i < nodeCount; ++i)
+		++pSceneGraph->pLevelOffsets[pDepths[i] + 1];
+	for (uint32_t level = 0; level < levelCount; ++level)
+		pSceneGraph->pLevelOffsets[level + 1] += pSceneGraph->pLevelOffsets[level];
+
+	memcpy(pStack, pSceneGraph->pLevelOffsets, sizeof(uint32_t) * levelCount);
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		const uint32_t sorted = pStack[pDepths[i]]++;
+		pSceneGraph->pSourceIndices[sorted] = i;
+		pSceneGraph->pSortedIndices[i] = sorted;
+	}
+
+	for (uint32_t sorted = 0; sorted < nodeCount; ++sorted)
+	{
+		const uint32_t source = pSceneGraph->pSourceIndices[sorted];
+		const uint32_t parent = pDesc->pParents[source];
+		pSceneGraph->pParents[sorted] = parent == SCENE_GRAPH_INVALID_NODE ? SCENE_GRAPH_INVALID_NODE : pSceneGraph->pSortedIndices[parent];
+
+		// Keep the source matrix as is, TRS is only used to rebuild it once the node is modified
+		pSceneGraph->pLocalMatrices[sorted] = pDesc->pLocalMatrices[source];
+		decomposeMatrix(pDesc->pLocalMatrices[source], &pSceneGraph->pTranslations[sorted], &pSceneGraph->pRotations[sorted],
+			&pSceneGraph->pScales[sorted]);
+		pSceneGraph->pFlags[sorted] = SCENE_NODE_FLAG_NONE;
+	}
+
+	free(pStack);
+	free(pDepths);
+
+	*ppSceneGraph = pSceneGraph;
+	return true;
+}
+
+void exitSceneGraph(SceneGraph* pSceneGraph)
+{
+	if (!pSceneGraph)
+		return;
+
+	free(pSceneGraph->pLevelOffsets);
+	free(pSceneGraph->pParents);
+	free(pSceneGraph->pSourceIndices);
+	free(pSceneGraph->pSortedIndices);
+	free(pSceneGraph->pUpdateList);
+	free(pSceneGraph->pTranslations);
+	free(pSceneGraph->pRotations);
+	free(pSceneGraph->pScales);
+	free(pSceneGraph->pLocalMatrices);
+	free(pSceneGraph->pWorldMatrices);
+	free(pSceneGraph->pFlags);
+	free(pSceneGraph);
+}
+
+void sceneGraphSetLocalTRS(SceneGraph* pSceneGraph, uint32_t node, const vec3& translation, const Quat& rotation, const vec3& scale)
+{
+	ASSERT(node < pSceneGraph->mNodeCount);
+	pSceneGraph->pTranslations[node] = translation;
+	pSceneGraph->pRotations[node] = rotation;
+	pSceneGraph->pScales[node] = scale;
+	pSceneGraph->pFlags[node] |= SCENE_NODE_FLAG_LOCAL_DIRTY;
+}
+
+void sceneGraphSetRootTransform(SceneGraph* pSceneGraph, const mat4& rootTransform)
+{
+	pSceneGraph->mRootTransform = rootTransform;
+	pSceneGraph->mRootDirty = true;
+}
+
+uint32_t updateSceneGraph(SceneGraph* pSceneGraph)
+{
+	const uint32_t* pParents = pSceneGraph->pParents;
+	uint8_t*        pFlags = pSceneGraph->pFlags;
+	uint32_t*       pUpdateList = pSceneGraph->pUpdateList;
+	mat4*           pLocalMatrices = pSceneGraph->pLocalMatrices;
+	mat4*           pWorldMatrices = pSceneGraph->pWorldMatrices;
+
+	uint32_t updatedCount = 0;
+	for (uint32_t level = 0; level < pSceneGraph->mLevelCount; ++level)
+	{
+		const uint32_t levelBegin = pSceneGraph->pLevelOffsets[level];
+		const uint32_t levelEnd = pSceneGraph->pLevelOffsets[level + 1];
+		const uint32_t levelUpdateBegin = updatedCount;
+
+		// Gather the nodes of this level whose world matrix changes. Parents live in earlier levels,
+		// so their SCENE_NODE_FLAG_WORLD_CHANGED bit already reflects this update.
+		for (uint32_t i = levelBegin; i < levelEnd; ++i)
+		{
+			uint8_t flags = pFlags[i];
+			const uint32_t parent = pParents[i];
+
+			bool changed = (flags & SCENE_NODE_FLAG_LOCAL_DIRTY) != 0;
+			if (parent == SCENE_GRAPH_INVALID_NODE)
+				changed = changed || pSceneGraph->mRootDirty;
+			else
+				changed = changed || (pFlags[parent] & SCENE_NODE_FLAG_WORLD_CHANGED) != 0;
+
+			if (flags & SCENE_NODE_FLAG_LOCAL_DIRTY)
+				pLocalMatrices[i] = mat4(pSceneGraph->pRotations[i], pSceneGraph->pTranslations[i]) * mat4::scale(pSceneGraph->pScales[i]);
+
+			flags &= (uint8_t)~(SCENE_NODE_FLAG_LOCAL_DIRTY | SCENE_NODE_FLAG_WORLD_CHANGED);
+			if (changed)
+			{
+				flags |= SCENE_NODE_FLAG_WORLD_CHANGED;
+				pUpdateList[updatedCount++] = i;
+			}
+			pFlags[i] = flags;
+		}
+
+		// Batched multiply over the compacted list, the SIMD matrix product runs back to back without branching on flags
+		if (level == 0)
+		{
+			const mat4 rootTransform = pSceneGraph->mRootTransform;
+			for (uint32_t u = levelUpdateBegin; u < updatedCount; ++u)
+			{
+				const uint32_t i = pUpdateList[u];
+				pWorldMatrices[i] = rootTransform * pLocalMatrices[i];
+			}
+		}
+		else
+		{
+			for (uint32_t u = levelUpdateBegin; u < updatedCount; ++u)
+			{
+				const uint32_t i = pUpdateList[u];
+				pWorldMatrices[i] = pWorldMatrices[pParents[i]] * pLocalMatrices[i];
+			}
+		}
+	}
+
+	pSceneGraph->mRootDirty = false;
+	pSceneGraph->mUpdatedCount = updatedCount;
+	return updatedCount;
+}
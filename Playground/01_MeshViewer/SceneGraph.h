@@ -0,0 +1,70 @@
+#pragma once
+
+#include <limits.h>
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// Flat transform hierarchy.
+// Nodes are stored sorted by depth, so every parent comes before its children and the world matrices
+// can be resolved in one forward pass. Local transforms are kept as TRS in SoA arrays, and only nodes
+// whose local transform changed (and their subtrees) are recomputed by updateSceneGraph.
+
+#define SCENE_GRAPH_INVALID_NODE UINT_MAX
+
+typedef enum SceneNodeFlags
+{
+	SCENE_NODE_FLAG_NONE = 0x0,
+	// Local TRS was modified, local matrix has to be rebuilt
+	SCENE_NODE_FLAG_LOCAL_DIRTY = 0x1,
+	// World matrix was recomputed by the last updateSceneGraph call
+	SCENE_NODE_FLAG_WORLD_CHANGED = 0x2,
+} SceneNodeFlags;
+
+typedef struct SceneGraphDesc
+{
+	uint32_t		mNodeCount;
+	// Parent of each source node, SCENE_GRAPH_INVALID_NODE for roots
+	const uint32_t*	pParents;
+	const mat4*		pLocalMatrices;
+} SceneGraphDesc;
+
+typedef struct SceneGraph
+{
+	uint32_t	mNodeCount;
+	uint32_t	mLevelCount;
+	// Nodes of depth d are [pLevelOffsets[d], pLevelOffsets[d + 1])
+	uint32_t*	pLevelOffsets;
+
+	// All per node arrays below are in sorted order, pParents holds sorted indices
+	uint32_t*	pParents;
+	uint32_t*	pSourceIndices;
+	vec3*		pTranslations;
+	Quat*		pRotations;
+	vec3*		pScales;
+	mat4*		pLocalMatrices;
+	mat4*		pWorldMatrices;
+	uint8_t*	pFlags;
+
+	// Source node index -> sorted index
+	uint32_t*	pSortedIndices;
+
+	// Scratch list of the nodes recomputed by the current update
+	uint32_t*	pUpdateList;
+	uint32_t	mUpdatedCount;
+
+	// Applied on top of every root, e.g. to fit a model into the view
+	mat4		mRootTransform;
+	bool		mRootDirty;
+} SceneGraph;
+
+// A desc without nodes gives an empty graph. Fails, logging why, if a parent index is out of range or the parents form
+// a cycle.
+bool initSceneGraph(const SceneGraphDesc* pDesc, SceneGraph** ppSceneGraph);
+void exitSceneGraph(SceneGraph* pSceneGraph);
+
+// Node indices are sorted indices, use pSortedIndices to translate from source indices
+void sceneGraphSetLocalTRS(SceneGraph* pSceneGraph, uint32_t node, const vec3& translation, const Quat& rotation, const vec3& scale);
+void sceneGraphSetRootTransform(SceneGraph* pSceneGraph, const mat4& rootTransform);
+
+// Recomputes the world matrices of all dirty subtrees. Returns the number of nodes recomputed.
+uint32_t updateSceneGraph(SceneGraph* pSceneGraph);
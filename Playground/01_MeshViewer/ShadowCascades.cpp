@@ -0,0 +1,178 @@
+#include "ShadowCascades.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+// Light directions closer than this are the same light, the sliders move in steps far larger
+static const float gSameLightCosine = 0.999999f;
+// Relative change of the slice radius that needs a new render, anything smaller is float noise
+static const float gSliceRadiusTolerance = 1e-4f;
+
+void initShadowCascades(const ShadowCascadesDesc* pDesc, ShadowCascades* pCascades)
+{
+	ASSERT(pDesc->mResolution > 2 && pDesc->mNear > 0.0f && pDesc->mFar > pDesc->mNear);
+
+	*pCascades = {};
+	pCascades->mDesc = *pDesc;
+	pCascades->mLightDirection = vec3(0.0f);
+	invalidateShadowCascades(pCascades, SHADOW_REFRESH_INVALID);
+}
+
+void invalidateShadowCascades(ShadowCascades* pCascades, ShadowRefresh refresh)
+{
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+	{
+		if (pCascades->mCascades[i].mPendingRefresh == SHADOW_REFRESH_NONE)
+			pCascades->mCascades[i].mPendingRefresh = refresh;
+	}
+}
+
+static float getSplitDistance(const ShadowCascadesDesc& desc, uint32_t split)
+{
+	const float t = (float)split / (float)SHADOW_CASCADE_COUNT;
+	const float logarithmic = desc.mNear * powf(desc.mFar / desc.mNear, t);
+	const float uniform = desc.mNear + (desc.mFar - desc.mNear) * t;
+	return desc.mSplitLambda * logarithmic + (1.0f - desc.mSplitLambda) * uniform;
+}
+
+// Bounding sphere of the view frustum between splitNear and splitFar, its radius does not depend on where the camera
+// looks
+static void getSliceSphere(const mat4& cameraMatrix, float tanHalfFovX, float tanHalfFovY, float splitNear, float splitFar, vec3* pCenter,
+	float* pRadius)
+{
+	vec3 corners[8];
+	vec3 center = vec3(0.0f);
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		const float depth = i & 4 ? splitFar : splitNear;
+		const float x = (i & 1 ? 1.0f : -1.0f) * tanHalfFovX * depth;
+		const float y = (i & 2 ? 1.0f : -1.0f) * tanHalfFovY * depth;
+		corners[i] = (cameraMatrix * vec4(x, y, depth, 1.0f)).getXYZ();
+		center += corners[i];
+	}
+	center = center / 8.0f;
+
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < 8; ++i)
+		radius = max(radius, length(corners[i] - center));
+
+	*pCenter = center;
+	*pRadius = radius;
+}
+
+// Places the cascade around the slice and writes its shadow matrix
+static void placeCascade(ShadowCascades* pCascades, ShadowCascade* pCascade, uint32_t index, float sliceX, float sliceY, float sliceRadius,
+	float splitFar, const vec3& sceneMin, const vec3& sceneMax, bool caching)
+{
+	const ShadowCascadesDesc& desc = pCascades->mDesc;
+	// Cascades rendered every frame gain nothing from a margin
+	const float margin = caching && desc.mRefreshIntervals[index] != 1 ? desc.mCacheMargin : 0.0f;
+	const float coveredRadius = sliceRadius * (1.0f + margin);
+	// Snapping moves the centre by up to a texel, the region grows by two so the slice still fits
+	const float radius = coveredRadius + 4.0f * coveredRadius / (float)desc.mResolution;
+	const float texelSize = 2.0f * radius / (float)desc.mResolution;
+	const float centerX = floorf(sliceX / texelSize) * texelSize;
+	const float centerY = floorf(sliceY / texelSize) * texelSize;
+
+	// The depth range spans every caster, whatever the camera sees
+	const vec3& forward = pCascades->mLightForward;
+	float depthMin = FLT_MAX;
+	float depthMax = -FLT_MAX;
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		const vec3 corner = vec3(i & 1 ? sceneMax.getX() : sceneMin.getX(), i & 2 ? sceneMax.getY() : sceneMin.getY(),
+			i & 4 ? sceneMax.getZ() : sceneMin.getZ());
+		const float depth = dot(corner, forward);
+		depthMin = min(depthMin, depth);
+		depthMax = max(depthMax, depth);
+	}
+	const float depthPadding = max((depthMax - depthMin) * 0.01f, 0.01f);
+	depthMin -= depthPadding;
+	depthMax += depthPadding;
+	const float depthRange = depthMax - depthMin;
+
+	const vec3& right = pCascades->mLightRight;
+	const vec3& up = pCascades->mLightUp;
+	pCascade->mShadowMatrix = mat4(vec4(right.getX() / radius, up.getX() / radius, forward.getX() / depthRange, 0.0f),
+		vec4(right.getY() / radius, up.getY() / radius, forward.getY() / depthRange, 0.0f),
+		vec4(right.getZ() / radius, up.getZ() / radius, forward.getZ() / depthRange, 0.0f),
+		vec4(-centerX / radius, -centerY / radius, -depthMin / depthRange, 1.0f));
+	pCascade->mCenterX = centerX;
+	pCascade->mCenterY = centerY;
+	pCascade->mRadius = radius;
+	pCascade->mSliceRadius = sliceRadius;
+	pCascade->mSplitFar = splitFar;
+}
+
+void updateShadowCascades(ShadowCascades* pCascades, const mat4& viewMatrix, float tanHalfFovX, float tanHalfFovY, const vec3& lightDirection,
+	const vec3& sceneMin, const vec3& sceneMax, bool caching)
+{
+	if (dot(lightDirection, pCascades->mLightDirection) < gSameLightCosine)
+	{
+		invalidateShadowCascades(pCascades, SHADOW_REFRESH_LIGHT);
+
+		// Any basis around the light works as long as it only depends on the light
+		pCascades->mLightDirection = lightDirection;
+		pCascades->mLightForward = -lightDirection;
+		const vec3 reference = fabsf(lightDirection.getY()) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+		pCascades->mLightRight = normalize(cross(reference, pCascades->mLightForward));
+		pCascades->mLightUp = cross(pCascades->mLightForward, pCascades->mLightRight);
+	}
+
+	const bool windowDone = ++pCascades->mWindowFrameCount == SHADOW_STATS_WINDOW;
+	const mat4 cameraMatrix = orthoInverse(viewMatrix);
+	for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+	{
+		ShadowCascade& cascade = pCascades->mCascades[i];
+		const float splitNear = getSplitDistance(pCascades->mDesc, i);
+		const float splitFar = getSplitDistance(pCascades->mDesc, i + 1);
+		vec3 sliceCenter;
+		float sliceRadius;
+		getSliceSphere(cameraMatrix, tanHalfFovX, tanHalfFovY, splitNear, splitFar, &sliceCenter, &sliceRadius);
+		const float sliceX = dot(sliceCenter, pCascades->mLightRight);
+		const float sliceY = dot(sliceCenter, pCascades->mLightUp);
+
+		const uint32_t interval = pCascades->mDesc.mRefreshIntervals[i];
+		const float reach = max(fabsf(sliceX - cascade.mCenterX), fabsf(sliceY - cascade.mCenterY)) + sliceRadius;
+		ShadowRefresh refresh = cascade.mPendingRefresh;
+		if (refresh == SHADOW_REFRESH_NONE && fabsf(sliceRadius - cascade.mSliceRadius) > gSliceRadiusTolerance * sliceRadius)
+			refresh = SHADOW_REFRESH_INVALID;
+		if (refresh == SHADOW_REFRESH_NONE && !caching)
+			refresh = SHADOW_REFRESH_UNCACHED;
+		if (refresh == SHADOW_REFRESH_NONE && interval && cascade.mFramesSinceRender + 1 >= interval)
+			refresh = SHADOW_REFRESH_INTERVAL;
+		if (refresh == SHADOW_REFRESH_NONE && reach > cascade.mRadius)
+			refresh = SHADOW_REFRESH_COVERAGE;
+
+		cascade.mRefresh = refresh;
+		cascade.mPendingRefresh = SHADOW_REFRESH_NONE;
+		if (refresh != SHADOW_REFRESH_NONE)
+		{
+			placeCascade(pCascades, &cascade, i, sliceX, sliceY, sliceRadius, splitFar, sceneMin, sceneMax, caching);
+			cascade.mFramesSinceRender = 0;
+			++cascade.mWindowRenderCount;
+		}
+		else
+		{
+			++cascade.mFramesSinceRender;
+		}
+
+		if (windowDone)
+		{
+			cascade.mHitRate = 1.0f - (float)cascade.mWindowRenderCount / (float)SHADOW_STATS_WINDOW;
+			cascade.mWindowRenderCount = 0;
+		}
+	}
+	if (windowDone)
+		pCascades->mWindowFrameCount = 0;
+}
+
+bool shadowCascadeOverlaps(const ShadowCascades* pCascades, uint32_t cascade, const vec3& boundsMin, const vec3& boundsMax)
+{
+	const ShadowCascade& c = pCascades->mCascades[cascade];
+	const vec3 center = (boundsMin + boundsMax) * 0.5f;
+	const vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	const float extentX = dot(extent, absPerElem(pCascades->mLightRight));
+	const float extentY = dot(extent, absPerElem(pCascades->mLightUp));
+	return fabsf(dot(center, pCascades->mLightRight) - c.mCenterX) <= c.mRadius + extentX &&
+		fabsf(dot(center, pCascades->mLightUp) - c.mCenterY) <= c.mRadius + extentY;
+}
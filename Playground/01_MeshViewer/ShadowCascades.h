@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../../../Common_3/OS/Math/MathTypes.h"
+
+// Cascaded shadow maps of the sun with cached cascades. Every cascade covers the bounding sphere of its slice of the
+// view frustum, so its size does not change when the camera turns, and its centre is snapped to its texels, so the
+// map does not shimmer when the camera moves. A cascade keeps the map it rendered last until the light turns, a caster
+// moves, its refresh interval runs out or the camera leaves the margin the cascade was rendered with.
+// The cascade count must match Shaders/shadow.h.fsl.
+
+#define SHADOW_CASCADE_COUNT 4
+// Frames the hit rate of the stats is measured over
+#define SHADOW_STATS_WINDOW 120
+
+typedef enum ShadowRefresh
+{
+	// The cascade is drawn from its cache
+	SHADOW_REFRESH_NONE = 0,
+	// Nothing cached yet, or the shadow settings or the view changed the slice
+	SHADOW_REFRESH_INVALID,
+	SHADOW_REFRESH_LIGHT,
+	SHADOW_REFRESH_CASTERS,
+	// The slice left the region the cascade was rendered for
+	SHADOW_REFRESH_COVERAGE,
+	SHADOW_REFRESH_INTERVAL,
+	// Caching is off
+	SHADOW_REFRESH_UNCACHED,
+	SHADOW_REFRESH_COUNT
+} ShadowRefresh;
+
+typedef struct ShadowCascadesDesc
+{
+	// View distances the cascades split, the first cascade starts at mNear and the last ends at mFar
+	float		mNear;
+	float		mFar;
+	// 0 splits the distance evenly, 1 logarithmically
+	float		mSplitLambda;
+	// Extra radius a cached cascade is rendered with, as a fraction of its slice radius, the camera moves that far
+	// before the cascade has to be rendered again
+	float		mCacheMargin;
+	uint32_t	mResolution;
+	// Frames between renders of each cascade, 0 only renders it when the cache is out of date
+	uint32_t	mRefreshIntervals[SHADOW_CASCADE_COUNT];
+} ShadowCascadesDesc;
+
+typedef struct ShadowCascade
+{
+	// World to shadow map of the last render: x, y in [-1, 1], z in [0, 1]
+	mat4			mShadowMatrix;
+	// Light space centre and half extent of the region of the last render
+	float			mCenterX;
+	float			mCenterY;
+	float			mRadius;
+	// Radius of the bounding sphere of the slice the cascade was rendered for
+	float			mSliceRadius;
+	// View distance the slice of the cascade ends at
+	float			mSplitFar;
+	uint32_t		mFramesSinceRender;
+	// Why the cascade renders this frame, SHADOW_REFRESH_NONE when it is drawn from the cache
+	ShadowRefresh	mRefresh;
+	// Set by invalidateShadowCascades, taken by the next update
+	ShadowRefresh	mPendingRefresh;
+	// Stats: renders of the window so far and the hit rate of the last complete window
+	uint32_t		mWindowRenderCount;
+	float			mHitRate;
+	float			mRecordMs;
+	// Instances of the field the last render drew
+	uint32_t		mInstanceCount;
+} ShadowCascade;
+
+typedef struct ShadowCascades
+{
+	ShadowCascadesDesc	mDesc;
+	ShadowCascade		mCascades[SHADOW_CASCADE_COUNT];
+	// Unit vector towards the light the cascades were rendered for and the light space axes derived from it
+	vec3				mLightDirection;
+	vec3				mLightRight;
+	vec3				mLightUp;
+	vec3				mLightForward;
+	uint32_t			mWindowFrameCount;
+} ShadowCascades;
+
+void initShadowCascades(const ShadowCascadesDesc* pDesc, ShadowCascades* pCascades);
+
+// Every cascade renders again on the next update
+void invalidateShadowCascades(ShadowCascades* pCascades, ShadowRefresh refresh);
+
+// Picks the cascades that render this frame and places them. viewMatrix is the camera's world to view matrix with +z
+// forward, tanHalfFovX and tanHalfFovY the tangents of its half field of view. lightDirection points towards the light
+// and [sceneMin, sceneMax] bounds every caster. Without caching every cascade renders.
+void updateShadowCascades(ShadowCascades* pCascades, const mat4& viewMatrix, float tanHalfFovX, float tanHalfFovY, const vec3& lightDirection,
+	const vec3& sceneMin, const vec3& sceneMax, bool caching);
+
+// Whether the box can cast into the region the cascade renders
+bool shadowCascadeOverlaps(const ShadowCascades* pCascades, uint32_t cascade, const vec3& boundsMin, const vec3& boundsMax);
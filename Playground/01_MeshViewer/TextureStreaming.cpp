@@ -0,0 +1,522 @@
+#include "TextureStreaming.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+#define DDS_MAKE_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static const uint32_t gDdsMagic = DDS_MAKE_FOURCC('D', 'D', 'S', ' ');
+static const uint32_t gDdsPixelFormatFourCC = 0x4;
+static const uint32_t gDdsPixelFormatRgb = 0x40;
+static const uint32_t gDdsCaps2CubeMap = 0x200;
+static const uint32_t gDdsCaps2Volume = 0x200000;
+static const uint32_t gDdsDimensionTexture2D = 3;
+static const uint32_t gDdsMiscTextureCube = 0x4;
+
+typedef struct DdsPixelFormat
+{
+	uint32_t	mSize;
+	uint32_t	mFlags;
+	uint32_t	mFourCC;
+	uint32_t	mRgbBitCount;
+	uint32_t	mRBitMask;
+	uint32_t	mGBitMask;
+	uint32_t	mBBitMask;
+	uint32_t	mABitMask;
+} DdsPixelFormat;
+
+typedef struct DdsHeader
+{
+	uint32_t		mSize;
+	uint32_t		mFlags;
+	uint32_t		mHeight;
+	uint32_t		mWidth;
+	uint32_t		mPitchOrLinearSize;
+	uint32_t		mDepth;
+	uint32_t		mMipMapCount;
+	uint32_t		mReserved1[11];
+	DdsPixelFormat	mPixelFormat;
+	uint32_t		mCaps;
+	uint32_t		mCaps2;
+	uint32_t		mCaps3;
+	uint32_t		mCaps4;
+	uint32_t		mReserved2;
+} DdsHeader;
+
+typedef struct DdsHeaderDx10
+{
+	uint32_t	mDxgiFormat;
+	uint32_t	mResourceDimension;
+	uint32_t	mMiscFlag;
+	uint32_t	mArraySize;
+	uint32_t	mMiscFlags2;
+} DdsHeaderDx10;
+
+// Block width in pixels and bytes per block, uncompressed formats are 1x1 blocks
+static bool getDxgiFormat(uint32_t dxgiFormat, TinyImageFormat* pFormat, uint32_t* pBlockSize, uint32_t* pBlockBytes)
+{
+	switch (dxgiFormat)
+	{
+	case 28: *pFormat = TinyImageFormat_R8G8B8A8_UNORM; *pBlockSize = 1; *pBlockBytes = 4; return true;
+	case 29: *pFormat = TinyImageFormat_R8G8B8A8_SRGB; *pBlockSize = 1; *pBlockBytes = 4; return true;
+	case 87: *pFormat = TinyImageFormat_B8G8R8A8_UNORM; *pBlockSize = 1; *pBlockBytes = 4; return true;
+	case 91: *pFormat = TinyImageFormat_B8G8R8A8_SRGB; *pBlockSize = 1; *pBlockBytes = 4; return true;
+	case 71: *pFormat = TinyImageFormat_DXBC1_RGBA_UNORM; *pBlockSize = 4; *pBlockBytes = 8; return true;
+	case 72: *pFormat = TinyImageFormat_DXBC1_RGBA_SRGB; *pBlockSize = 4; *pBlockBytes = 8; return true;
+	case 77: *pFormat = TinyImageFormat_DXBC3_UNORM; *pBlockSize = 4; *pBlockBytes = 16; return true;
+	case 78: *pFormat = TinyImageFormat_DXBC3_SRGB; *pBlockSize = 4; *pBlockBytes = 16; return true;
+	case 98: *pFormat = TinyImageFormat_DXBC7_UNORM; *pBlockSize = 4; *pBlockBytes = 16; return true;
+	case 99: *pFormat = TinyImageFormat_DXBC7_SRGB; *pBlockSize = 4; *pBlockBytes = 16; return true;
+	default: return false;
+	}
+}
+
+// Legacy headers without the DX10 extension, only the formats the DX10 path knows
+static bool getLegacyFormat(const DdsPixelFormat& pixelFormat, uint32_t* pDxgiFormat)
+{
+	if (pixelFormat.mFlags & gDdsPixelFormatFourCC)
+	{
+		if (pixelFormat.mFourCC == DDS_MAKE_FOURCC('D', 'X', 'T', '1'))
+			*pDxgiFormat = 71;
+		else if (pixelFormat.mFourCC == DDS_MAKE_FOURCC('D', 'X', 'T', '5'))
+			*pDxgiFormat = 77;
+		else
+			return false;
+		return true;
+	}
+
+	if ((pixelFormat.mFlags & gDdsPixelFormatRgb) && pixelFormat.mRgbBitCount == 32)
+	{
+		if (pixelFormat.mRBitMask == 0x000000ff && pixelFormat.mBBitMask == 0x00ff0000)
+			*pDxgiFormat = 28;
+		else if (pixelFormat.mRBitMask == 0x00ff0000 && pixelFormat.mBBitMask == 0x000000ff)
+			*pDxgiFormat = 87;
+		else
+			return false;
+		return true;
+	}
+
+	return false;
+}
+
+static bool readDdsLayout(const char* pFileName, StreamedTexture* pTexture)
+{
+	FileStream stream = {};
+	if (!fsOpenStreamFromPath(RD_TEXTURES, pFileName, FM_READ_BINARY, NULL, &stream))
+	{
+		LOGF(LogLevel::eERROR, "Texture streaming: could not open '%s'", pFileName);
+		return false;
+	}
+
+	uint32_t magic = 0;
+	DdsHeader header = {};
+	DdsHeaderDx10 headerDx10 = {};
+	bool valid = fsReadFromStream(&stream, &magic, sizeof(magic)) == sizeof(magic) && magic == gDdsMagic &&
+		fsReadFromStream(&stream, &header, sizeof(header)) == sizeof(header) && header.mSize == sizeof(header);
+
+	uint64_t dataOffset = sizeof(magic) + sizeof(header);
+	uint32_t dxgiFormat = 0;
+	if (valid && (header.mPixelFormat.mFlags & gDdsPixelFormatFourCC) && header.mPixelFormat.mFourCC == DDS_MAKE_FOURCC('D', 'X', '1', '0'))
+	{
+		valid = fsReadFromStream(&stream, &headerDx10, sizeof(headerDx10)) == sizeof(headerDx10) &&
+			headerDx10.mResourceDimension == gDdsDimensionTexture2D && headerDx10.mArraySize <= 1 && !(headerDx10.mMiscFlag & gDdsMiscTextureCube);
+		dxgiFormat = headerDx10.mDxgiFormat;
+		dataOffset += sizeof(headerDx10);
+	}
+	else if (valid)
+	{
+		valid = !(header.mCaps2 & (gDdsCaps2CubeMap | gDdsCaps2Volume)) && getLegacyFormat(header.mPixelFormat, &dxgiFormat);
+	}
+	fsCloseStream(&stream);
+
+	uint32_t blockSize = 1;
+	uint32_t blockBytes = 4;
+	if (!valid || !getDxgiFormat(dxgiFormat, &pTexture->mFormat, &blockSize, &blockBytes) || !header.mWidth || !header.mHeight)
+	{
+		LOGF(LogLevel::eWARNING, "Texture streaming: '%s' is not a 2D DDS texture in a streamable format", pFileName);
+		return false;
+	}
+
+	pTexture->mWidth = header.mWidth;
+	pTexture->mHeight = header.mHeight;
+	pTexture->mMipCount = min(max(header.mMipMapCount, 1u), (uint32_t)TEXTURE_STREAMING_MAX_MIPS);
+	for (uint32_t mip = 0; mip < pTexture->mMipCount; ++mip)
+	{
+		const uint32_t blocksX = (max(header.mWidth >> mip, 1u) + blockSize - 1) / blockSize;
+		const uint32_t blocksY = (max(header.mHeight >> mip, 1u) + blockSize - 1) / blockSize;
+		pTexture->mMipOffsets[mip] = dataOffset;
+		pTexture->mMipSizes[mip] = blocksX * blocksY * blockBytes;
+		dataOffset += pTexture->mMipSizes[mip];
+	}
+
+	pTexture->mTailMip = pTexture->mMipCount - 1;
+	for (uint32_t mip = 0; mip < pTexture->mMipCount; ++mip)
+	{
+		if (max(header.mWidth >> mip, header.mHeight >> mip) <= TEXTURE_STREAMING_TAIL_SIZE)
+		{
+			pTexture->mTailMip = mip;
+			break;
+		}
+	}
+	return true;
+}
+
+static uint64_t getMipRangeBytes(const StreamedTexture* pTexture, uint32_t firstMip)
+{
+	uint64_t bytes = 0;
+	for (uint32_t mip = firstMip; mip < pTexture->mMipCount; ++mip)
+		bytes += pTexture->mMipSizes[mip];
+	return bytes;
+}
+
+// Only the read task changes the state besides the main thread, and never from or to idle
+static bool isReplacing(StreamedTexture* pTexture)
+{
+	return tfrg_atomic32_load_relaxed(&pTexture->mPendingState) != STREAMED_TEXTURE_STATE_IDLE;
+}
+
+static uint32_t getCommittedMip(StreamedTexture* pTexture)
+{
+	return isReplacing(pTexture) ? pTexture->mPendingMip : pTexture->mResidentMip;
+}
+
+// Mips [firstMip, mMipCount) as stored in the file, NULL if the read fails
+static uint8_t* readMips(const StreamedTexture* pTexture, uint32_t firstMip)
+{
+	const uint64_t offset = pTexture->mMipOffsets[firstMip];
+	const uint64_t size = getMipRangeBytes(pTexture, firstMip);
+	uint8_t* pData = (uint8_t*)malloc((size_t)size);
+
+	// Mips are stored finest first, one read covers the whole range
+	FileStream stream = {};
+	bool read = fsOpenStreamFromPath(RD_TEXTURES, pTexture->mFileName, FM_READ_BINARY, NULL, &stream);
+	if (read)
+	{
+		read = fsSeekStream(&stream, SBO_START_OF_FILE, (ssize_t)offset) && fsReadFromStream(&stream, pData, (size_t)size) == (size_t)size;
+		fsCloseStream(&stream);
+	}
+	if (!read)
+	{
+		LOGF(LogLevel::eERROR, "Texture streaming: could not read mips %u-%u of '%s'", firstMip, pTexture->mMipCount - 1, pTexture->mFileName);
+		free(pData);
+		return NULL;
+	}
+	return pData;
+}
+
+static void readMipsTask(void* pUserData, uintptr_t index)
+{
+	UNREF_PARAM(index);
+	StreamedTexture* pTexture = (StreamedTexture*)pUserData;
+	pTexture->pPendingData = readMips(pTexture, pTexture->mPendingMip);
+	tfrg_atomic32_store_release(&pTexture->mPendingState, pTexture->pPendingData ? STREAMED_TEXTURE_STATE_READ : STREAMED_TEXTURE_STATE_READ_FAILED);
+}
+
+// Creates a texture holding mips [mPendingMip, mMipCount) and queues their upload from pData, which it frees
+static void queueReplacementUpload(TextureStreaming* pStreaming, StreamedTexture* pTexture, uint8_t* pData)
+{
+	const uint32_t firstMip = pTexture->mPendingMip;
+
+	TextureDesc textureDesc = {};
+	textureDesc.mWidth = max(pTexture->mWidth >> firstMip, 1u);
+	textureDesc.mHeight = max(pTexture->mHeight >> firstMip, 1u);
+	textureDesc.mDepth = 1;
+	textureDesc.mArraySize = 1;
+	textureDesc.mMipLevels = pTexture->mMipCount - firstMip;
+	textureDesc.mSampleCount = SAMPLE_COUNT_1;
+	textureDesc.mFormat = pTexture->mFormat;
+	textureDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+	textureDesc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+	textureDesc.pName = pTexture->mFileName;
+
+	TextureLoadDesc loadDesc = {};
+	loadDesc.pDesc = &textureDesc;
+	loadDesc.ppTexture = &pTexture->pPendingTexture;
+	addResource(&loadDesc, NULL);
+
+	const uint8_t* pSrc = pData;
+	for (uint32_t mip = firstMip; mip < pTexture->mMipCount; ++mip)
+	{
+		TextureUpdateDesc updateDesc = {};
+		updateDesc.pTexture = pTexture->pPendingTexture;
+		updateDesc.mMipLevel = mip - firstMip;
+		updateDesc.mArrayLayer = 0;
+		beginUpdateResource(&updateDesc);
+		for (uint32_t row = 0; row < updateDesc.mRowCount; ++row)
+			memcpy((uint8_t*)updateDesc.pMappedData + (size_t)row * updateDesc.mDstRowStride, pSrc + (size_t)row * updateDesc.mSrcRowStride,
+				updateDesc.mSrcRowStride);
+		endUpdateResource(&updateDesc, &pTexture->mPendingToken);
+		pSrc += pTexture->mMipSizes[mip];
+	}
+	free(pData);
+
+	tfrg_atomic32_store_relaxed(&pTexture->mPendingState, STREAMED_TEXTURE_STATE_UPLOADING);
+	pStreaming->mStats.mUploadedBytes += getMipRangeBytes(pTexture, firstMip);
+}
+
+// Commits the texture to mips [firstMip, mMipCount) and hands the read to the thread system, a later update queues the
+// upload
+static void startReplacement(TextureStreaming* pStreaming, StreamedTexture* pTexture, uint32_t firstMip)
+{
+	ASSERT(!isReplacing(pTexture));
+	pTexture->mPendingMip = firstMip;
+	tfrg_atomic32_store_relaxed(&pTexture->mPendingState, STREAMED_TEXTURE_STATE_READING);
+	addThreadSystemTask(pStreaming->mDesc.pThreadSystem, readMipsTask, pTexture);
+}
+
+// Drops the finest mip of a texture, returns the bytes the budget gets back
+static uint64_t evictMip(TextureStreaming* pStreaming, StreamedTexture* pTexture)
+{
+	const uint32_t mip = pTexture->mResidentMip;
+	startReplacement(pStreaming, pTexture, mip + 1);
+	++pStreaming->mStats.mEvictionCount;
+	return pTexture->mMipSizes[mip];
+}
+
+static bool isRequested(const TextureStreaming* pStreaming, const StreamedTexture* pTexture)
+{
+	return pTexture->mLastRequestFrame == pStreaming->mFrame;
+}
+
+// True when a should give up a mip before b, see the order in the header
+static bool evictsBefore(const TextureStreaming* pStreaming, const StreamedTexture* a, const StreamedTexture* b)
+{
+	const bool aRequested = isRequested(pStreaming, a);
+	const bool bRequested = isRequested(pStreaming, b);
+	if (aRequested != bRequested)
+		return !aRequested;
+	if (!aRequested)
+		return a->mLastRequestFrame < b->mLastRequestFrame;
+
+	const int32_t aExcess = (int32_t)a->mWantedMip - (int32_t)a->mResidentMip;
+	const int32_t bExcess = (int32_t)b->mWantedMip - (int32_t)b->mResidentMip;
+	if (aExcess != bExcess)
+		return aExcess > bExcess;
+	return a->mRequestedPixelsPerUv < b->mRequestedPixelsPerUv;
+}
+
+// With onlyUnneeded set, textures a draw asked for at their resident mip or finer are not candidates
+static StreamedTexture* findEvictionVictim(TextureStreaming* pStreaming, const StreamedTexture* pExclude, bool onlyUnneeded)
+{
+	StreamedTexture* pVictim = NULL;
+	for (uint32_t i = 0; i < pStreaming->mTextureCount; ++i)
+	{
+		StreamedTexture* pTexture = &pStreaming->pTextures[i];
+		if (pTexture == pExclude || !pTexture->pTexture || isReplacing(pTexture) || pTexture->mResidentMip >= pTexture->mTailMip)
+			continue;
+		if (onlyUnneeded && isRequested(pStreaming, pTexture) && pTexture->mWantedMip <= pTexture->mResidentMip)
+			continue;
+		if (!pVictim || evictsBefore(pStreaming, pTexture, pVictim))
+			pVictim = pTexture;
+	}
+	return pVictim;
+}
+
+static int compareUpgrades(const void* pA, const void* pB)
+{
+	const StreamedTexture* a = *(const StreamedTexture* const*)pA;
+	const StreamedTexture* b = *(const StreamedTexture* const*)pB;
+	// Furthest from the wanted mip first, then the largest on screen
+	const int32_t aDeficit = (int32_t)a->mResidentMip - (int32_t)a->mWantedMip;
+	const int32_t bDeficit = (int32_t)b->mResidentMip - (int32_t)b->mWantedMip;
+	if (aDeficit != bDeficit)
+		return bDeficit - aDeficit;
+	return a->mRequestedPixelsPerUv > b->mRequestedPixelsPerUv ? -1 : (a->mRequestedPixelsPerUv < b->mRequestedPixelsPerUv ? 1 : 0);
+}
+
+static void retireTexture(TextureStreaming* pStreaming, Texture* pTexture)
+{
+	if (pStreaming->mRetiredCount == pStreaming->mRetiredCapacity)
+	{
+		pStreaming->mRetiredCapacity = max(pStreaming->mRetiredCapacity * 2, 16u);
+		pStreaming->pRetired = (RetiredTexture*)realloc(pStreaming->pRetired, sizeof(RetiredTexture) * pStreaming->mRetiredCapacity);
+	}
+	pStreaming->pRetired[pStreaming->mRetiredCount++] = { pTexture, pStreaming->mFrame };
+}
+
+void initTextureStreaming(const TextureStreamingDesc* pDesc, TextureStreaming** ppStreaming)
+{
+	TextureStreaming* pStreaming = (TextureStreaming*)calloc(1, sizeof(TextureStreaming));
+	pStreaming->mDesc = *pDesc;
+	pStreaming->pTextures = (StreamedTexture*)calloc(max(pDesc->mMaxTextures, 1u), sizeof(StreamedTexture));
+	pStreaming->ppUpgrades = (StreamedTexture**)calloc(max(pDesc->mMaxTextures, 1u), sizeof(StreamedTexture*));
+	// Frame 0 would match textures that were never requested
+	pStreaming->mFrame = 1;
+	*ppStreaming = pStreaming;
+}
+
+void exitTextureStreaming(TextureStreaming* pStreaming)
+{
+	if (!pStreaming)
+		return;
+
+	for (uint32_t i = 0; i < pStreaming->mTextureCount; ++i)
+	{
+		if (pStreaming->pTextures[i].pTexture)
+			removeResource(pStreaming->pTextures[i].pTexture);
+		if (pStreaming->pTextures[i].pPendingTexture)
+			removeResource(pStreaming->pTextures[i].pPendingTexture);
+		free(pStreaming->pTextures[i].pPendingData);
+	}
+	for (uint32_t i = 0; i < pStreaming->mRetiredCount; ++i)
+		removeResource(pStreaming->pRetired[i].pTexture);
+
+	free(pStreaming->pTextures);
+	free(pStreaming->ppUpgrades);
+	free(pStreaming->pRetired);
+	free(pStreaming);
+}
+
+uint32_t addStreamedTexture(TextureStreaming* pStreaming, const char* pFileName)
+{
+	if (pStreaming->mTextureCount == pStreaming->mDesc.mMaxTextures)
+	{
+		LOGF(LogLevel::eWARNING, "Texture streaming: at most %u textures", pStreaming->mDesc.mMaxTextures);
+		return UINT32_MAX;
+	}
+
+	StreamedTexture* pTexture = &pStreaming->pTextures[pStreaming->mTextureCount];
+	*pTexture = {};
+	snprintf(pTexture->mFileName, sizeof(pTexture->mFileName), "%s", pFileName);
+	if (!readDdsLayout(pFileName, pTexture))
+		return UINT32_MAX;
+
+	// The tail is small and read right away, so the first frames already have it
+	pTexture->mResidentMip = pTexture->mMipCount;
+	pTexture->mWantedMip = pTexture->mTailMip;
+	uint8_t* pTailData = readMips(pTexture, pTexture->mTailMip);
+	if (!pTailData)
+		return UINT32_MAX;
+	pTexture->mPendingMip = pTexture->mTailMip;
+	queueReplacementUpload(pStreaming, pTexture, pTailData);
+
+	LOGF(LogLevel::eINFO, "Texture streaming: '%s' %ux%u, %u mips, tail of %.1f KB out of %.1f KB", pFileName, pTexture->mWidth,
+		pTexture->mHeight, pTexture->mMipCount, getMipRangeBytes(pTexture, pTexture->mTailMip) / 1024.0f, getMipRangeBytes(pTexture, 0) / 1024.0f);
+	return pStreaming->mTextureCount++;
+}
+
+void requestStreamedTexture(TextureStreaming* pStreaming, uint32_t index, float pixelsPerUv)
+{
+	StreamedTexture* pTexture = &pStreaming->pTextures[index];
+	if (!isRequested(pStreaming, pTexture))
+		pTexture->mRequestedPixelsPerUv = 0.0f;
+	pTexture->mRequestedPixelsPerUv = max(pTexture->mRequestedPixelsPerUv, pixelsPerUv);
+	pTexture->mLastRequestFrame = pStreaming->mFrame;
+}
+
+void updateTextureStreaming(TextureStreaming* pStreaming)
+{
+	// Textures retired this many updates ago can no longer be sampled by a frame in flight
+	uint32_t retiredCount = 0;
+	for (uint32_t i = 0; i < pStreaming->mRetiredCount; ++i)
+	{
+		if (pStreaming->mFrame >= pStreaming->pRetired[i].mFrame + pStreaming->mDesc.mFramesInFlight)
+			removeResource(pStreaming->pRetired[i].pTexture);
+		else
+			pStreaming->pRetired[retiredCount++] = pStreaming->pRetired[i];
+	}
+	pStreaming->mRetiredCount = retiredCount;
+
+	uint64_t committedBytes = 0;
+	for (uint32_t i = 0; i < pStreaming->mTextureCount; ++i)
+	{
+		StreamedTexture* pTexture = &pStreaming->pTextures[i];
+		const uint32_t pendingState = tfrg_atomic32_load_acquire(&pTexture->mPendingState);
+		if (pendingState == STREAMED_TEXTURE_STATE_READ)
+		{
+			uint8_t* pData = pTexture->pPendingData;
+			pTexture->pPendingData = NULL;
+			queueReplacementUpload(pStreaming, pTexture, pData);
+		}
+		else if (pendingState == STREAMED_TEXTURE_STATE_READ_FAILED)
+		{
+			// The texture keeps its resident mips, the budget gets the committed bytes back below
+			tfrg_atomic32_store_relaxed(&pTexture->mPendingState, STREAMED_TEXTURE_STATE_IDLE);
+		}
+		else if (pendingState == STREAMED_TEXTURE_STATE_UPLOADING && isTokenCompleted(&pTexture->mPendingToken))
+		{
+			if (pTexture->pTexture)
+				retireTexture(pStreaming, pTexture->pTexture);
+			pTexture->pTexture = pTexture->pPendingTexture;
+			pTexture->mResidentMip = pTexture->mPendingMip;
+			pTexture->pPendingTexture = NULL;
+			tfrg_atomic32_store_relaxed(&pTexture->mPendingState, STREAMED_TEXTURE_STATE_IDLE);
+		}
+
+		// Texels of the finest mip per pixel, every halving of that is one mip coarser
+		pTexture->mWantedMip = pTexture->mTailMip;
+		if (isRequested(pStreaming, pTexture) && pTexture->mRequestedPixelsPerUv > 0.0f)
+		{
+			const float texelsPerPixel = (float)max(pTexture->mWidth, pTexture->mHeight) / pTexture->mRequestedPixelsPerUv;
+			const float mip = texelsPerPixel > 1.0f ? floorf(log2f(texelsPerPixel)) : 0.0f;
+			pTexture->mWantedMip = min((uint32_t)mip, pTexture->mTailMip);
+		}
+
+		committedBytes += getMipRangeBytes(pTexture, getCommittedMip(pTexture));
+	}
+
+	// A lowered budget takes mips from every kind of texture until it is met again
+	while (committedBytes > pStreaming->mDesc.mBudgetBytes)
+	{
+		StreamedTexture* pVictim = findEvictionVictim(pStreaming, NULL, false);
+		const uint64_t freedBytes = pVictim ? evictMip(pStreaming, pVictim) : 0;
+		if (!freedBytes)
+			break;
+		committedBytes -= freedBytes;
+	}
+
+	uint32_t upgradeCount = 0;
+	for (uint32_t i = 0; i < pStreaming->mTextureCount; ++i)
+	{
+		StreamedTexture* pTexture = &pStreaming->pTextures[i];
+		if (pTexture->pTexture && !isReplacing(pTexture) && pTexture->mWantedMip < pTexture->mResidentMip)
+			pStreaming->ppUpgrades[upgradeCount++] = pTexture;
+	}
+	qsort(pStreaming->ppUpgrades, upgradeCount, sizeof(StreamedTexture*), compareUpgrades);
+
+	// One mip finer per texture and update, room comes from textures that do not need their mips
+	uint64_t uploadBytes = 0;
+	pStreaming->mStats.mDeniedCount = 0;
+	for (uint32_t i = 0; i < upgradeCount; ++i)
+	{
+		StreamedTexture* pTexture = pStreaming->ppUpgrades[i];
+		const uint32_t mip = pTexture->mResidentMip - 1;
+		const uint64_t growthBytes = pTexture->mMipSizes[mip];
+		while (committedBytes + growthBytes > pStreaming->mDesc.mBudgetBytes)
+		{
+			StreamedTexture* pVictim = findEvictionVictim(pStreaming, pTexture, true);
+			const uint64_t freedBytes = pVictim ? evictMip(pStreaming, pVictim) : 0;
+			if (!freedBytes)
+				break;
+			committedBytes -= freedBytes;
+		}
+		if (committedBytes + growthBytes > pStreaming->mDesc.mBudgetBytes)
+		{
+			++pStreaming->mStats.mDeniedCount;
+			continue;
+		}
+
+		const uint64_t rangeBytes = getMipRangeBytes(pTexture, mip);
+		if (uploadBytes && uploadBytes + rangeBytes > pStreaming->mDesc.mMaxUploadBytesPerFrame)
+			break;
+		startReplacement(pStreaming, pTexture, mip);
+		committedBytes += growthBytes;
+		uploadBytes += rangeBytes;
+	}
+
+	TextureStreamingStats& stats = pStreaming->mStats;
+	stats.mTextureCount = pStreaming->mTextureCount;
+	stats.mSatisfiedCount = 0;
+	stats.mResidentBytes = 0;
+	stats.mWantedBytes = 0;
+	stats.mCommittedBytes = committedBytes;
+	for (uint32_t i = 0; i < pStreaming->mTextureCount; ++i)
+	{
+		const StreamedTexture* pTexture = &pStreaming->pTextures[i];
+		if (pTexture->pTexture)
+			stats.mResidentBytes += getMipRangeBytes(pTexture, pTexture->mResidentMip);
+		stats.mWantedBytes += getMipRangeBytes(pTexture, pTexture->mWantedMip);
+		stats.mSatisfiedCount += pTexture->pTexture && pTexture->mResidentMip <= pTexture->mWantedMip ? 1 : 0;
+	}
+
+	++pStreaming->mFrame;
+}
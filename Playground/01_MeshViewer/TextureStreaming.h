@@ -0,0 +1,135 @@
+#pragma once
+
+#include "../../../Common_3/OS/Core/ThreadSystem.h"
+#include "../../../Common_3/OS/Core/Atomics.h"
+#include "../../../Common_3/OS/Interfaces/IFileSystem.h"
+#include "../../../Common_3/Renderer/IRenderer.h"
+#include "../../../Common_3/Renderer/IResourceLoader.h"
+
+// Mip streaming for DDS textures from RD_TEXTURES. Adding a texture uploads only its mip tail, the mips no larger than
+// TEXTURE_STREAMING_TAIL_SIZE. Draws report how many screen pixels one UV unit of the texture covers, and every update
+// moves each texture one mip towards the level that density asks for.
+//
+// A streamed texture is a regular Texture that holds its resident mips only, so the hardware clamps sampling to the
+// finest resident mip and shaders need no change. Changing the residency reads the mips of a replacement texture from
+// the file on a thread of mDesc.pThreadSystem, the next update after the read creates the replacement and queues its
+// upload. The replacement is swapped in once its upload token completes, and the old texture is removed after
+// mFramesInFlight more updates.
+//
+// The budget caps the bytes of all textures, counting each one at its resident or, while a replacement is in flight,
+// its replacement size. To stay under it, textures give up their finest mip in this order:
+// - textures no draw asked for this frame, least recently requested first;
+// - textures with more detail than they were asked for;
+// - the textures covering the fewest pixels per UV unit.
+// Mip tails are never evicted.
+
+#define TEXTURE_STREAMING_MAX_MIPS	16
+#define TEXTURE_STREAMING_TAIL_SIZE	64
+
+typedef enum StreamedTextureState
+{
+	// No replacement in flight
+	STREAMED_TEXTURE_STATE_IDLE = 0,
+	// A task reads mips [mPendingMip, mMipCount) into pPendingData
+	STREAMED_TEXTURE_STATE_READING,
+	STREAMED_TEXTURE_STATE_READ,
+	STREAMED_TEXTURE_STATE_READ_FAILED,
+	// pPendingTexture is created and waits for mPendingToken
+	STREAMED_TEXTURE_STATE_UPLOADING,
+} StreamedTextureState;
+
+typedef struct StreamedTexture
+{
+	char			mFileName[64];
+	TinyImageFormat	mFormat;
+	uint32_t		mWidth;
+	uint32_t		mHeight;
+	uint32_t		mMipCount;
+	// Finest mip that is always resident
+	uint32_t		mTailMip;
+	// File offset and bytes of every mip of the full chain
+	uint64_t		mMipOffsets[TEXTURE_STREAMING_MAX_MIPS];
+	uint32_t		mMipSizes[TEXTURE_STREAMING_MAX_MIPS];
+
+	// NULL until the tail is uploaded, its mip 0 is mip mResidentMip of the full chain
+	Texture*		pTexture;
+	uint32_t		mResidentMip;
+	tfrg_atomic32_t	mPendingState;
+	uint8_t*		pPendingData;
+	Texture*		pPendingTexture;
+	uint32_t		mPendingMip;
+	SyncToken		mPendingToken;
+
+	// Largest density draws reported since the last update, and the update it was last reported for
+	float			mRequestedPixelsPerUv;
+	uint64_t		mLastRequestFrame;
+	uint32_t		mWantedMip;
+} StreamedTexture;
+
+typedef struct TextureStreamingDesc
+{
+	uint64_t	mBudgetBytes;
+	// Upper bound of the mip bytes requested per update
+	uint64_t	mMaxUploadBytesPerFrame;
+	uint32_t	mMaxTextures;
+	uint32_t	mFramesInFlight;
+	// Runs the file reads of replacements
+	ThreadSystem*	pThreadSystem;
+} TextureStreamingDesc;
+
+typedef struct TextureStreamingStats
+{
+	uint32_t	mTextureCount;
+	// Textures whose resident mip is the one their draws asked for, or finer
+	uint32_t	mSatisfiedCount;
+	uint64_t	mResidentBytes;
+	// Bytes the budget is checked against, resident plus in flight replacements
+	uint64_t	mCommittedBytes;
+	// Bytes if every texture had the mip its draws asked for
+	uint64_t	mWantedBytes;
+	uint64_t	mUploadedBytes;
+	uint32_t	mEvictionCount;
+	// Upgrades the budget held back in the last update
+	uint32_t	mDeniedCount;
+} TextureStreamingStats;
+
+typedef struct RetiredTexture
+{
+	Texture*	pTexture;
+	uint64_t	mFrame;
+} RetiredTexture;
+
+typedef struct TextureStreaming
+{
+	TextureStreamingDesc	mDesc;
+	StreamedTexture*		pTextures;
+	uint32_t				mTextureCount;
+	// Scratch for ordering the upgrades of an update, mDesc.mMaxTextures entries
+	StreamedTexture**		ppUpgrades;
+	RetiredTexture*			pRetired;
+	uint32_t				mRetiredCount;
+	uint32_t				mRetiredCapacity;
+	uint64_t				mFrame;
+	TextureStreamingStats	mStats;
+} TextureStreaming;
+
+void initTextureStreaming(const TextureStreamingDesc* pDesc, TextureStreaming** ppStreaming);
+
+// Waits for nothing, the caller makes sure no read or upload is in flight and no frame samples the textures
+void exitTextureStreaming(TextureStreaming* pStreaming);
+
+// Reads the DDS header and the mip tail and queues its upload. Returns UINT32_MAX for files that cannot be streamed:
+// arrays, cube maps, volumes and formats other than RGBA8, BGRA8, BC1, BC3 and BC7.
+uint32_t addStreamedTexture(TextureStreaming* pStreaming, const char* pFileName);
+
+// pixelsPerUv is how many screen pixels one UV unit of the texture covers for a draw, the largest one of a frame wins
+void requestStreamedTexture(TextureStreaming* pStreaming, uint32_t index, float pixelsPerUv);
+
+// Once per frame on the main thread, after the fence of the frame: queues the uploads of completed reads, swaps in
+// completed uploads, removes retired textures, then evicts and upgrades within the budget. Never touches the file.
+void updateTextureStreaming(TextureStreaming* pStreaming);
+
+inline Texture* getStreamedTexture(const TextureStreaming* pStreaming, uint32_t index)
+{
+	return pStreaming->pTextures[index].pTexture;
+}
@@ -0,0 +1,73 @@
+#include "UploadArena.h"
+
+#include "../../../Common_3/OS/Interfaces/ILog.h"
+
+void initUploadArena(const UploadArenaDesc* pDesc, UploadArena* pArena)
+{
+	ASSERT(pDesc->mFrameCount && pDesc->mAlignment);
+
+	*pArena = {};
+	pArena->mFrameCount = pDesc->mFrameCount;
+	pArena->mAlignment = pDesc->mAlignment;
+	pArena->mSize = round_up_64(pDesc->mSize, pDesc->mAlignment);
+	pArena->ppBuffers = (Buffer**)calloc(pDesc->mFrameCount, sizeof(Buffer*));
+
+	BufferLoadDesc bufferDesc = {};
+	bufferDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bufferDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+	bufferDesc.mDesc.mSize = pArena->mSize;
+	bufferDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+	bufferDesc.mDesc.pName = pDesc->pName;
+	bufferDesc.pData = NULL;
+	for (uint32_t i = 0; i < pDesc->mFrameCount; ++i)
+	{
+		bufferDesc.ppBuffer = &pArena->ppBuffers[i];
+		addResource(&bufferDesc, NULL);
+	}
+
+	resetUploadArena(pArena, 0);
+}
+
+void exitUploadArena(UploadArena* pArena)
+{
+	for (uint32_t i = 0; i < pArena->mFrameCount; ++i)
+		removeResource(pArena->ppBuffers[i]);
+	free(pArena->ppBuffers);
+	*pArena = {};
+}
+
+void resetUploadArena(UploadArena* pArena, uint32_t frameIndex)
+{
+	ASSERT(frameIndex < pArena->mFrameCount);
+
+	pArena->mPeakUsed = max(pArena->mPeakUsed, pArena->mUsed);
+	pArena->mFrameIndex = frameIndex;
+	pArena->pCpuAddress = (uint8_t*)pArena->ppBuffers[frameIndex]->pCpuMappedAddress;
+	pArena->mUsed = 0;
+	pArena->mAllocationCount = 0;
+}
+
+uint32_t allocateUploadBlock(UploadArena* pArena, uint32_t elementSize, uint32_t count, UploadBlock* pBlock)
+{
+	const uint32_t stride = (uint32_t)round_up_64(elementSize, pArena->mAlignment);
+	const uint32_t available = (uint32_t)((pArena->mSize - pArena->mUsed) / stride);
+	if (count > available)
+	{
+		if (!pArena->mOverflowReported)
+		{
+			LOGF(LogLevel::eWARNING, "Upload arena is full (%llu bytes per frame), skipping what does not fit.", (unsigned long long)pArena->mSize);
+			pArena->mOverflowReported = true;
+		}
+		count = available;
+	}
+
+	pBlock->pCpuAddress = pArena->pCpuAddress + pArena->mUsed;
+	pBlock->pBuffer = pArena->ppBuffers[pArena->mFrameIndex];
+	pBlock->mOffset = pArena->mUsed;
+	pBlock->mStride = stride;
+	pBlock->mCount = count;
+
+	pArena->mUsed += (uint64_t)stride * count;
+	++pArena->mAllocationCount;
+	return count;
+}
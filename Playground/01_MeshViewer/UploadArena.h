@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../../../Common_3/Renderer/IRenderer.h"
+#include "../../../Common_3/Renderer/IResourceLoader.h"
+
+// Per-frame linear upload arena. Every frame slot owns a persistently mapped uniform buffer, allocations bump a cursor
+// through the buffer of the current slot and return the CPU pointer to write through together with the offset the GPU
+// binds. resetUploadArena rewinds the cursor once the fence of the slot has been waited on, nothing is ever freed one
+// by one and nothing is copied, the CPU writes straight into memory the GPU reads.
+
+typedef struct UploadArenaDesc
+{
+	// Bytes per frame slot
+	uint64_t	mSize;
+	uint32_t	mFrameCount;
+	// Every element starts at a multiple of it, the uniform buffer alignment so each one can be bound as a CBV
+	uint32_t	mAlignment;
+	const char*	pName;
+} UploadArenaDesc;
+
+typedef struct UploadArena
+{
+	Buffer**	ppBuffers;
+	uint32_t	mFrameCount;
+	uint32_t	mAlignment;
+	uint64_t	mSize;
+	// State of the current frame slot
+	uint32_t	mFrameIndex;
+	uint8_t*	pCpuAddress;
+	uint64_t	mUsed;
+	uint32_t	mAllocationCount;
+	// Largest mUsed of any frame since init
+	uint64_t	mPeakUsed;
+	bool		mOverflowReported;
+} UploadArena;
+
+// count elements of elementSize bytes, each one at a multiple of the arena alignment
+typedef struct UploadBlock
+{
+	uint8_t*	pCpuAddress;
+	Buffer*		pBuffer;
+	uint64_t	mOffset;
+	uint32_t	mStride;
+	uint32_t	mCount;
+} UploadBlock;
+
+void initUploadArena(const UploadArenaDesc* pDesc, UploadArena* pArena);
+// The GPU has to be done with every frame slot
+void exitUploadArena(UploadArena* pArena);
+
+// Starts writing into the buffer of frameIndex, whose fence has been waited on
+void resetUploadArena(UploadArena* pArena, uint32_t frameIndex);
+
+// Allocates up to count elements, fewer once the frame's buffer is full, which is reported once. Returns the number
+// of elements allocated.
+uint32_t allocateUploadBlock(UploadArena* pArena, uint32_t elementSize, uint32_t count, UploadBlock* pBlock);
+
+// Typed view of an UploadBlock
+template <typename T> struct UploadAllocation
+{
+	UploadBlock	mBlock;
+
+	T* get(uint32_t index) const { return (T*)(mBlock.pCpuAddress + (uint64_t)index * mBlock.mStride); }
+	uint64_t getOffset(uint32_t index) const { return mBlock.mOffset + (uint64_t)index * mBlock.mStride; }
+	uint32_t getCount() const { return mBlock.mCount; }
+	Buffer* getBuffer() const { return mBlock.pBuffer; }
+};
+
+template <typename T> inline UploadAllocation<T> allocateUpload(UploadArena* pArena, uint32_t count = 1)
+{
+	UploadAllocation<T> allocation = {};
+	allocateUploadBlock(pArena, (uint32_t)sizeof(T), count, &allocation.mBlock);
+	return allocation;
+}